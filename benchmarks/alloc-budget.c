@@ -0,0 +1,379 @@
+/* alloc-budget.c
+ *
+ * Copyright 2022 Patrick Winters
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE X CONSORTIUM BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written
+ * authorization.
+ */
+
+#include <glib.h>
+#include <json-glib/json-glib.h>
+#include <replit.h>
+#include <stdlib.h>
+
+#include "bench-alloc.h"
+#include "bench-report.h"
+#include "mock-server.h"
+
+#define QUERY "query Items { items { id title description } }"
+#define SUBSCRIPTION "subscription Events { event { sequence timestamp } }"
+#define ITEMS_PATH "data.items"
+
+#define PAYLOAD_SIZE 1024
+#define WARMUP 16
+#define ITERATIONS 200
+#define TIMEOUT_SECONDS 30
+
+/* Budgets written by --update leave this much room above the measured usage,
+ * so that small differences between libsoup and GLib versions don't fail the
+ * check. */
+#define HEADROOM 1.1
+
+/* Exit status for a skipped benchmark. */
+#define EXIT_SKIP 77
+
+static gboolean update = FALSE;
+
+static GOptionEntry entries[] = {
+	{ "update", 'u', 0, G_OPTION_ARG_NONE, &update, "Rewrite the budgets from this run", NULL },
+	{ NULL },
+};
+
+/* Allocations made by the calling thread over a number of operations. */
+typedef struct {
+	guint64 allocs;
+	guint64 bytes;
+} BudgetUsage;
+
+static void budget_usage_begin(BudgetUsage* usage) {
+	usage->allocs = bench_alloc_count();
+	usage->bytes = bench_alloc_bytes();
+}
+
+/* Turns the totals since budget_usage_begin() into a per-operation average,
+ * rounded up. */
+static void budget_usage_end(BudgetUsage* usage, guint operations) {
+	usage->allocs = bench_alloc_count() - usage->allocs;
+	usage->bytes = bench_alloc_bytes() - usage->bytes;
+
+	usage->allocs = (usage->allocs + operations - 1) / operations;
+	usage->bytes = (usage->bytes + operations - 1) / operations;
+}
+
+static ReplitClient* budget_client_new(MockServer* server) {
+	ReplitClient* client = replit_client_new("budget");
+	replit_client_set_base_uri(client, mock_server_get_uri(server));
+
+	return client;
+}
+
+static gboolean budget_query(MockServer* server, BudgetUsage* usage) {
+	ReplitClient* client = budget_client_new(server);
+	gboolean success = TRUE;
+
+	for (guint i = 0; i < WARMUP + ITERATIONS && success; i++) {
+		if (i == WARMUP) budget_usage_begin(usage);
+
+		JsonNode* data = replit_client_query(client, QUERY, NULL, NULL);
+
+		if (data != NULL) {
+			json_node_unref(data);
+		} else {
+			success = FALSE;
+		}
+	}
+
+	budget_usage_end(usage, ITERATIONS);
+	g_object_unref(client);
+
+	return success;
+}
+
+typedef struct {
+	GMainLoop* loop;
+	JsonNode* data;
+} BudgetAsyncState;
+
+static void budget_query_ready(GObject* source, GAsyncResult* res, gpointer user_data) {
+	BudgetAsyncState* state = user_data;
+
+	state->data = replit_client_query_finish(REPLIT_CLIENT (source), res, NULL);
+
+	g_main_loop_quit(state->loop);
+}
+
+static gboolean budget_query_async(MockServer* server, BudgetUsage* usage) {
+	ReplitClient* client = budget_client_new(server);
+	BudgetAsyncState state = { .loop = g_main_loop_new(NULL, FALSE) };
+	gboolean success = TRUE;
+
+	for (guint i = 0; i < WARMUP + ITERATIONS && success; i++) {
+		if (i == WARMUP) budget_usage_begin(usage);
+
+		replit_client_query_async(client, QUERY, NULL, NULL, budget_query_ready, &state);
+		g_main_loop_run(state.loop);
+
+		if (state.data != NULL) {
+			json_node_unref(state.data);
+			state.data = NULL;
+		} else {
+			success = FALSE;
+		}
+	}
+
+	budget_usage_end(usage, ITERATIONS);
+	g_main_loop_unref(state.loop);
+	g_object_unref(client);
+
+	return success;
+}
+
+static gboolean budget_query_element(
+	ReplitClient* client __attribute__((unused)),
+	JsonNode* element,
+	gpointer user_data __attribute__((unused))
+) {
+	json_node_unref(element);
+
+	return TRUE;
+}
+
+static gboolean budget_query_foreach(MockServer* server, BudgetUsage* usage) {
+	ReplitClient* client = budget_client_new(server);
+	gboolean success = TRUE;
+
+	for (guint i = 0; i < WARMUP + ITERATIONS && success; i++) {
+		if (i == WARMUP) budget_usage_begin(usage);
+
+		success = replit_client_query_foreach(
+			client,
+			QUERY,
+			NULL,
+			ITEMS_PATH,
+			budget_query_element,
+			NULL,
+			NULL
+		);
+	}
+
+	budget_usage_end(usage, ITERATIONS);
+	g_object_unref(client);
+
+	return success;
+}
+
+typedef struct {
+	GMainLoop* loop;
+	BudgetUsage* usage;
+	guint received;
+	gboolean timed_out;
+} BudgetFrameState;
+
+static void budget_subscription_event(
+	ReplitSubscriber* subscriber __attribute__((unused)),
+	guint id __attribute__((unused)),
+	JsonNode* data,
+	gpointer user_data
+) {
+	BudgetFrameState* state = user_data;
+
+	json_node_unref(data);
+
+	if (++state->received == WARMUP) budget_usage_begin(state->usage);
+	if (state->received == WARMUP + ITERATIONS) g_main_loop_quit(state->loop);
+}
+
+static gboolean budget_timeout(gpointer user_data) {
+	BudgetFrameState* state = user_data;
+
+	state->timed_out = TRUE;
+	g_main_loop_quit(state->loop);
+
+	return G_SOURCE_REMOVE;
+}
+
+static gboolean budget_subscription_frame(MockServer* server, BudgetUsage* usage) {
+	ReplitClient* client = budget_client_new(server);
+	ReplitSubscriber* subscriber = replit_client_get_subscriber(client);
+
+	BudgetFrameState state = {
+		.loop = g_main_loop_new(NULL, FALSE),
+		.usage = usage,
+	};
+
+	replit_subscriber_subscribe(subscriber, SUBSCRIPTION, NULL, budget_subscription_event, &state);
+
+	guint timeout = g_timeout_add_seconds(TIMEOUT_SECONDS, budget_timeout, &state);
+	g_main_loop_run(state.loop);
+
+	if (!state.timed_out) {
+		g_source_remove(timeout);
+		budget_usage_end(usage, ITERATIONS);
+	}
+
+	g_main_loop_unref(state.loop);
+	g_object_unref(client);
+
+	return !state.timed_out;
+}
+
+static const struct {
+	const gchar* name;
+	gboolean (* measure)(MockServer* server, BudgetUsage* usage);
+} paths[] = {
+	{ "query", budget_query },
+	{ "query-async", budget_query_async },
+	{ "query-foreach", budget_query_foreach },
+	{ "subscription-frame", budget_subscription_frame },
+};
+
+/* Measures a path and compares it against its budget, or replaces the budget
+ * when updating. Returns whether the path is within its budget. */
+static gboolean budget_check(
+	MockServer* server,
+	GKeyFile* budgets,
+	const gchar* name,
+	gboolean (* measure)(MockServer* server, BudgetUsage* usage)
+) {
+	BudgetUsage usage = { 0 };
+
+	if (!measure(server, &usage)) {
+		g_printerr("%s: requests to the mock server failed\n", name);
+
+		return FALSE;
+	}
+
+	if (update) {
+		g_key_file_set_uint64(budgets, name, "allocs", (guint64) (usage.allocs * HEADROOM + 1));
+		g_key_file_set_uint64(budgets, name, "bytes", (guint64) (usage.bytes * HEADROOM + 1));
+	}
+
+	GError* error = NULL;
+	guint64 allocs_budget = g_key_file_get_uint64(budgets, name, "allocs", &error);
+	guint64 bytes_budget = error == NULL
+		? g_key_file_get_uint64(budgets, name, "bytes", &error)
+		: 0;
+
+	if (error != NULL) {
+		g_printerr("%s: %s\n", name, error->message);
+		g_error_free(error);
+
+		return FALSE;
+	}
+
+	gboolean within = usage.allocs <= allocs_budget && usage.bytes <= bytes_budget;
+
+	JsonBuilder* builder = bench_report_begin("alloc-budget");
+	bench_report_string(builder, "path", name);
+	bench_report_int(builder, "allocs", usage.allocs);
+	bench_report_int(builder, "allocs_budget", allocs_budget);
+	bench_report_int(builder, "bytes", usage.bytes);
+	bench_report_int(builder, "bytes_budget", bytes_budget);
+	bench_report_boolean(builder, "within_budget", within);
+	bench_report_end(builder);
+
+	return within;
+}
+
+gint main(gint argc, gchar** argv) {
+	GError* error = NULL;
+	GOptionContext* context = g_option_context_new("BUDGETS");
+
+	g_option_context_set_summary(
+		context,
+		"Counts the heap allocations made per operation on the client's hot\n"
+		"paths, against a local mock server, and fails if any exceeds its\n"
+		"budget in the BUDGETS key file."
+	);
+	g_option_context_add_main_entries(context, entries, NULL);
+
+	if (!g_option_context_parse(context, &argc, &argv, &error) || argc != 2) {
+		gchar* help = g_option_context_get_help(context, TRUE, NULL);
+		g_printerr("%s", error != NULL ? error->message : help);
+
+		g_free(help);
+		g_clear_error(&error);
+		g_option_context_free(context);
+
+		return EXIT_FAILURE;
+	}
+
+	g_option_context_free(context);
+
+	if (!bench_alloc_supported()) {
+		g_printerr("%s\n", "Allocation counting is not supported on this platform");
+
+		return EXIT_SKIP;
+	}
+
+	const gchar* budgets_path = argv[1];
+	GKeyFile* budgets = g_key_file_new();
+	GKeyFileFlags flags = G_KEY_FILE_KEEP_COMMENTS;
+
+	if (!g_key_file_load_from_file(budgets, budgets_path, flags, &error)) {
+		if (!update || !g_error_matches(error, G_FILE_ERROR, G_FILE_ERROR_NOENT)) {
+			g_printerr("%s: %s\n", budgets_path, error->message);
+			g_error_free(error);
+			g_key_file_unref(budgets);
+
+			return EXIT_FAILURE;
+		}
+
+		g_clear_error(&error);
+	}
+
+	MockServerOptions options = {
+		.payload_size = PAYLOAD_SIZE,
+		.event_count = WARMUP + ITERATIONS,
+	};
+
+	MockServer* server = mock_server_new(&options, 0, &error);
+
+	if (server == NULL) {
+		g_printerr("%s\n", error->message);
+		g_error_free(error);
+		g_key_file_unref(budgets);
+
+		return EXIT_FAILURE;
+	}
+
+	gboolean success = TRUE;
+
+	for (guint i = 0; i < G_N_ELEMENTS (paths); i++) {
+		success &= budget_check(server, budgets, paths[i].name, paths[i].measure);
+	}
+
+	mock_server_free(server);
+
+	if (update && !g_key_file_save_to_file(budgets, budgets_path, &error)) {
+		g_printerr("%s: %s\n", budgets_path, error->message);
+		g_error_free(error);
+
+		success = FALSE;
+	}
+
+	g_key_file_unref(budgets);
+
+	return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,128 @@
+/* bench-alloc.c
+ *
+ * Copyright 2022 Patrick Winters
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE X CONSORTIUM BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written
+ * authorization.
+ */
+
+#include <errno.h>
+#include <stddef.h>
+
+#include "bench-alloc.h"
+
+#if defined(__GLIBC__) && !defined(__SANITIZE_ADDRESS__)
+#define BENCH_ALLOC_INTERPOSE 1
+#endif
+
+#ifdef BENCH_ALLOC_INTERPOSE
+
+extern void* __libc_malloc(size_t size);
+extern void* __libc_calloc(size_t count, size_t size);
+extern void* __libc_realloc(void* ptr, size_t size);
+extern void* __libc_memalign(size_t alignment, size_t size);
+
+/* Thread-local, so that allocations made by the mock server's thread are not
+ * counted against the client. */
+static __thread guint64 alloc_count;
+static __thread guint64 alloc_bytes;
+
+void* malloc(size_t size) {
+	alloc_count++;
+	alloc_bytes += size;
+
+	return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size) {
+	alloc_count++;
+	alloc_bytes += count * size;
+
+	return __libc_calloc(count, size);
+}
+
+void* realloc(void* ptr, size_t size) {
+	alloc_count++;
+	alloc_bytes += size;
+
+	return __libc_realloc(ptr, size);
+}
+
+/* GLib's g_aligned_alloc() and some of libsoup's dependencies use the aligned
+ * allocators, which glibc does not route through malloc. */
+void* memalign(size_t alignment, size_t size) {
+	alloc_count++;
+	alloc_bytes += size;
+
+	return __libc_memalign(alignment, size);
+}
+
+void* aligned_alloc(size_t alignment, size_t size) {
+	alloc_count++;
+	alloc_bytes += size;
+
+	return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void** ptr, size_t alignment, size_t size) {
+	if (alignment % sizeof(void*) != 0 || (alignment & (alignment - 1)) != 0) return EINVAL;
+
+	alloc_count++;
+	alloc_bytes += size;
+
+	void* result = __libc_memalign(alignment, size);
+	if (result == NULL) return ENOMEM;
+
+	*ptr = result;
+
+	return 0;
+}
+
+gboolean bench_alloc_supported(void) {
+	return TRUE;
+}
+
+guint64 bench_alloc_count(void) {
+	return alloc_count;
+}
+
+guint64 bench_alloc_bytes(void) {
+	return alloc_bytes;
+}
+
+#else
+
+gboolean bench_alloc_supported(void) {
+	return FALSE;
+}
+
+guint64 bench_alloc_count(void) {
+	return 0;
+}
+
+guint64 bench_alloc_bytes(void) {
+	return 0;
+}
+
+#endif
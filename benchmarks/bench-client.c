@@ -0,0 +1,654 @@
+/* bench-client.c
+ *
+ * Copyright 2022 Patrick Winters
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE X CONSORTIUM BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written
+ * authorization.
+ */
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <json-glib/json-glib.h>
+#include <replit.h>
+#include <stdlib.h>
+
+#include "bench-alloc.h"
+#include "bench-report.h"
+#include "mock-server.h"
+
+#define QUERY "query Items { items { id title description } }"
+#define QUERY_NAME "Items"
+#define SUBSCRIPTION "subscription Events { event { sequence timestamp } }"
+
+#define WARMUP_REQUESTS 16
+#define RECONNECT_EVENT_RATE 1000
+#define RECONNECT_SETTLE_MS 20
+#define TIMEOUT_SECONDS 120
+
+static gint requests = 2000;
+static gint concurrency = 1;
+static gint latency = 0;
+static gint payload_size = 1024;
+static gint events = 20000;
+static gint event_rate = 0;
+static gint reconnects = 20;
+static gboolean use_cookie_file = FALSE;
+
+static GOptionEntry entries[] = {
+	{ "requests", 'n', 0, G_OPTION_ARG_INT, &requests, "Queries to send", "N" },
+	{ "concurrency", 'c', 0, G_OPTION_ARG_INT, &concurrency, "Queries in flight at once", "N" },
+	{ "latency", 'l', 0, G_OPTION_ARG_INT, &latency, "Server delay per query", "MS" },
+	{ "payload-size", 's', 0, G_OPTION_ARG_INT, &payload_size, "Query response size", "BYTES" },
+	{ "events", 'e', 0, G_OPTION_ARG_INT, &events, "Subscription events to receive", "N" },
+	{ "event-rate", 'r', 0, G_OPTION_ARG_INT, &event_rate, "Events per second, 0 for unlimited", "HZ" },
+	{ "reconnects", 'k', 0, G_OPTION_ARG_INT, &reconnects, "Connection drops to time", "N" },
+	{ "cookie-file", 'j', 0, G_OPTION_ARG_NONE, &use_cookie_file, "Keep cookies in a file when timing startup" },
+	{ NULL },
+};
+
+static void bench_report_allocs(
+	JsonBuilder* builder,
+	const gchar* unit,
+	guint64 count,
+	guint64 bytes,
+	guint n
+) {
+	if (!bench_alloc_supported() || n == 0) return;
+
+	gchar* count_name = g_strdup_printf("allocs_per_%s", unit);
+	gchar* bytes_name = g_strdup_printf("alloc_bytes_per_%s", unit);
+
+	bench_report_double(builder, count_name, (gdouble) count / n);
+	bench_report_double(builder, bytes_name, (gdouble) bytes / n);
+
+	g_free(count_name);
+	g_free(bytes_name);
+}
+
+static gint bench_compare_int64(gconstpointer a, gconstpointer b) {
+	gint64 x = *(const gint64*) a;
+	gint64 y = *(const gint64*) b;
+
+	return (x > y) - (x < y);
+}
+
+static gint64 bench_percentile(GArray* sorted, gdouble fraction) {
+	if (sorted->len == 0) return 0;
+
+	guint index = (guint) (fraction * (sorted->len - 1) + 0.5);
+
+	return g_array_index(sorted, gint64, index);
+}
+
+static void bench_report_samples(JsonBuilder* builder, const gchar* prefix, GArray* samples) {
+	g_array_sort(samples, bench_compare_int64);
+
+	const gdouble fractions[] = { 0.5, 0.9, 0.99, 1.0 };
+	const gchar* suffixes[] = { "p50_us", "p90_us", "p99_us", "max_us" };
+
+	for (guint i = 0; i < G_N_ELEMENTS (fractions); i++) {
+		gchar* name = g_strdup_printf("%s_%s", prefix, suffixes[i]);
+		bench_report_int(builder, name, bench_percentile(samples, fractions[i]));
+		g_free(name);
+	}
+}
+
+static ReplitClient* bench_client_new(MockServer* server) {
+	ReplitClient* client = replit_client_new("bench");
+	replit_client_set_base_uri(client, mock_server_get_uri(server));
+
+	return client;
+}
+
+typedef struct {
+	ReplitClient* client;
+	GMainLoop* loop;
+	guint issued;
+	guint completed;
+	guint failed;
+} QueryState;
+
+static void bench_query_issue(QueryState* state);
+
+static void bench_query_ready(GObject* source, GAsyncResult* res, gpointer user_data) {
+	QueryState* state = user_data;
+	JsonNode* data = replit_client_query_finish(REPLIT_CLIENT (source), res, NULL);
+
+	if (data != NULL) {
+		json_node_unref(data);
+	} else {
+		state->failed++;
+	}
+
+	state->completed++;
+
+	if (state->issued < (guint) requests) {
+		bench_query_issue(state);
+	} else if (state->completed == state->issued) {
+		g_main_loop_quit(state->loop);
+	}
+}
+
+static void bench_query_issue(QueryState* state) {
+	state->issued++;
+	replit_client_query_async(state->client, QUERY, NULL, NULL, bench_query_ready, state);
+}
+
+/* Measures query throughput, latency and allocations, sending queries one at a
+ * time through the synchronous API or several at a time through the
+ * asynchronous one. */
+static gboolean bench_query(MockServer* server) {
+	GError* error = NULL;
+	ReplitClient* client = bench_client_new(server);
+
+	for (guint i = 0; i < WARMUP_REQUESTS; i++) {
+		JsonNode* data = replit_client_query(client, QUERY, NULL, &error);
+
+		if (data == NULL) {
+			g_printerr("%s\n", error->message);
+			g_error_free(error);
+			g_object_unref(client);
+
+			return FALSE;
+		}
+
+		json_node_unref(data);
+	}
+
+	replit_client_reset_stats(client);
+	g_ptr_array_unref(replit_client_reset_latencies(client));
+
+	QueryState state = { .client = client };
+
+	guint64 allocs = bench_alloc_count();
+	guint64 alloc_bytes = bench_alloc_bytes();
+	gint64 start = g_get_monotonic_time();
+
+	if (concurrency <= 1) {
+		for (; state.completed < (guint) requests; state.completed++) {
+			JsonNode* data = replit_client_query(client, QUERY, NULL, NULL);
+
+			if (data != NULL) {
+				json_node_unref(data);
+			} else {
+				state.failed++;
+			}
+		}
+	} else {
+		state.loop = g_main_loop_new(NULL, FALSE);
+
+		for (gint i = 0; i < concurrency && state.issued < (guint) requests; i++) {
+			bench_query_issue(&state);
+		}
+
+		g_main_loop_run(state.loop);
+		g_main_loop_unref(state.loop);
+	}
+
+	gdouble seconds = (gdouble) (g_get_monotonic_time() - start) / G_USEC_PER_SEC;
+	allocs = bench_alloc_count() - allocs;
+	alloc_bytes = bench_alloc_bytes() - alloc_bytes;
+
+	ReplitClientStats stats;
+	replit_client_get_stats(client, &stats);
+
+	JsonBuilder* builder = bench_report_begin("query");
+	bench_report_int(builder, "requests", requests);
+	bench_report_int(builder, "concurrency", MAX(concurrency, 1));
+	bench_report_int(builder, "latency_ms", latency);
+	bench_report_int(builder, "response_bytes", stats.bytes_in / MAX(stats.requests, 1));
+	bench_report_int(builder, "errors", state.failed);
+	bench_report_double(builder, "requests_per_sec", requests / seconds);
+	bench_report_double(builder, "mb_per_sec", stats.bytes_in / seconds / 1e6);
+
+	GPtrArray* latencies = replit_client_get_latencies(client);
+
+	for (guint i = 0; i < latencies->len; i++) {
+		ReplitOperationLatency* entry = g_ptr_array_index(latencies, i);
+		if (g_strcmp0(entry->operation_name, QUERY_NAME) != 0) continue;
+
+		bench_report_int(builder, "latency_p50_us", entry->p50);
+		bench_report_int(builder, "latency_p90_us", entry->p90);
+		bench_report_int(builder, "latency_p99_us", entry->p99);
+		bench_report_int(builder, "latency_max_us", entry->max);
+	}
+
+	bench_report_allocs(builder, "request", allocs, alloc_bytes, requests);
+	bench_report_end(builder);
+
+	g_ptr_array_unref(latencies);
+	g_object_unref(client);
+
+	return state.failed == 0;
+}
+
+typedef struct {
+	ReplitClient* client;
+	guint requests;
+	guint failed;
+	GArray* latencies;
+} ThreadState;
+
+static gpointer bench_threads_worker(gpointer user_data) {
+	ThreadState* state = user_data;
+
+	for (guint i = 0; i < state->requests; i++) {
+		gint64 start = g_get_monotonic_time();
+		JsonNode* data = replit_client_query(state->client, QUERY, NULL, NULL);
+		gint64 elapsed = g_get_monotonic_time() - start;
+
+		if (data != NULL) {
+			json_node_unref(data);
+			g_array_append_val(state->latencies, elapsed);
+		} else {
+			state->failed++;
+		}
+	}
+
+	return NULL;
+}
+
+/* Measures how query throughput scales when one client is shared by several
+ * threads making synchronous queries, as the workers of a thread pool would,
+ * with --concurrency setting the number of threads. */
+static gboolean bench_threads(MockServer* server) {
+	GError* error = NULL;
+	ReplitClient* client = bench_client_new(server);
+	guint threads = MAX(concurrency, 1);
+
+	for (guint i = 0; i < WARMUP_REQUESTS; i++) {
+		JsonNode* data = replit_client_query(client, QUERY, NULL, &error);
+
+		if (data == NULL) {
+			g_printerr("%s\n", error->message);
+			g_error_free(error);
+			g_object_unref(client);
+
+			return FALSE;
+		}
+
+		json_node_unref(data);
+	}
+
+	ThreadState* states = g_new0(ThreadState, threads);
+	GThread** workers = g_new(GThread*, threads);
+	gint64 start = g_get_monotonic_time();
+
+	for (guint i = 0; i < threads; i++) {
+		states[i].client = client;
+		states[i].requests = requests / threads + (i < requests % threads);
+		states[i].latencies = g_array_sized_new(FALSE, FALSE, sizeof(gint64), states[i].requests);
+
+		workers[i] = g_thread_new("bench-worker", bench_threads_worker, &states[i]);
+	}
+
+	GArray* latencies = g_array_sized_new(FALSE, FALSE, sizeof(gint64), requests);
+	guint failed = 0;
+
+	for (guint i = 0; i < threads; i++) {
+		g_thread_join(workers[i]);
+
+		g_array_append_vals(latencies, states[i].latencies->data, states[i].latencies->len);
+		failed += states[i].failed;
+
+		g_array_unref(states[i].latencies);
+	}
+
+	gdouble seconds = (gdouble) (g_get_monotonic_time() - start) / G_USEC_PER_SEC;
+
+	JsonBuilder* builder = bench_report_begin("threads");
+	bench_report_int(builder, "requests", requests);
+	bench_report_int(builder, "threads", threads);
+	bench_report_int(builder, "latency_ms", latency);
+	bench_report_int(builder, "errors", failed);
+	bench_report_double(builder, "requests_per_sec", requests / seconds);
+	bench_report_samples(builder, "latency", latencies);
+	bench_report_end(builder);
+
+	g_array_unref(latencies);
+	g_free(workers);
+	g_free(states);
+	g_object_unref(client);
+
+	return failed == 0;
+}
+
+typedef struct {
+	MockServer* server;
+	GMainLoop* loop;
+	gboolean timed_out;
+
+	guint received;
+	gint64 first_time;
+	gint64 last_time;
+	guint64 allocs;
+	guint64 alloc_bytes;
+	GArray* delays;
+
+	gboolean dropped;
+	gint64 drop_time;
+	GArray* reconnect_times;
+} SubscriptionState;
+
+static gboolean bench_timeout(gpointer user_data) {
+	SubscriptionState* state = user_data;
+
+	state->timed_out = TRUE;
+	g_main_loop_quit(state->loop);
+
+	return G_SOURCE_REMOVE;
+}
+
+/* Reads the sequence number and server send time out of an event. */
+static void bench_event_read(JsonNode* data, guint* sequence, gint64* timestamp) {
+	JsonObject* object = json_node_get_object(data);
+	JsonObject* event = json_object_get_object_member(object, "event");
+
+	*sequence = (guint) json_object_get_int_member(event, "sequence");
+	*timestamp = json_object_get_int_member(event, "timestamp");
+}
+
+static void bench_subscription_event(
+	ReplitSubscriber* subscriber __attribute__((unused)),
+	guint id __attribute__((unused)),
+	JsonNode* data,
+	gpointer user_data
+) {
+	SubscriptionState* state = user_data;
+	gint64 now = g_get_monotonic_time();
+
+	guint sequence;
+	gint64 timestamp;
+	bench_event_read(data, &sequence, &timestamp);
+	json_node_unref(data);
+
+	if (state->received++ == 0) {
+		state->first_time = now;
+		state->allocs = bench_alloc_count();
+		state->alloc_bytes = bench_alloc_bytes();
+	}
+
+	gint64 delay = now - timestamp;
+	g_array_append_val(state->delays, delay);
+
+	if (state->received < (guint) events) return;
+
+	state->last_time = now;
+	state->allocs = bench_alloc_count() - state->allocs;
+	state->alloc_bytes = bench_alloc_bytes() - state->alloc_bytes;
+
+	g_main_loop_quit(state->loop);
+}
+
+/* Measures how quickly events from a subscription are received and
+ * dispatched. */
+static gboolean bench_subscription(MockServer* server) {
+	ReplitClient* client = bench_client_new(server);
+	ReplitSubscriber* subscriber = replit_client_get_subscriber(client);
+
+	SubscriptionState state = {
+		.loop = g_main_loop_new(NULL, FALSE),
+		.delays = g_array_sized_new(FALSE, FALSE, sizeof(gint64), events),
+	};
+
+	replit_subscriber_subscribe(subscriber, SUBSCRIPTION, NULL, bench_subscription_event, &state);
+
+	guint timeout = g_timeout_add_seconds(TIMEOUT_SECONDS, bench_timeout, &state);
+	g_main_loop_run(state.loop);
+
+	if (!state.timed_out) g_source_remove(timeout);
+
+	gdouble seconds = (gdouble) (state.last_time - state.first_time) / G_USEC_PER_SEC;
+
+	JsonBuilder* builder = bench_report_begin("subscription");
+	bench_report_int(builder, "events", state.received);
+	bench_report_int(builder, "event_rate", event_rate);
+	bench_report_boolean(builder, "timed_out", state.timed_out);
+
+	if (!state.timed_out && seconds > 0) {
+		bench_report_double(builder, "events_per_sec", (state.received - 1) / seconds);
+		bench_report_samples(builder, "delivery", state.delays);
+		bench_report_allocs(builder, "event", state.allocs, state.alloc_bytes, state.received - 1);
+	}
+
+	bench_report_end(builder);
+
+	g_array_unref(state.delays);
+	g_main_loop_unref(state.loop);
+	g_object_unref(client);
+
+	return !state.timed_out;
+}
+
+static gboolean bench_reconnect_drop(gpointer user_data) {
+	SubscriptionState* state = user_data;
+
+	state->dropped = TRUE;
+	state->drop_time = g_get_monotonic_time();
+
+	mock_server_drop_connections(state->server);
+
+	return G_SOURCE_REMOVE;
+}
+
+static void bench_reconnect_event(
+	ReplitSubscriber* subscriber __attribute__((unused)),
+	guint id __attribute__((unused)),
+	JsonNode* data,
+	gpointer user_data
+) {
+	SubscriptionState* state = user_data;
+	gint64 now = g_get_monotonic_time();
+
+	guint sequence;
+	gint64 timestamp;
+	bench_event_read(data, &sequence, &timestamp);
+	json_node_unref(data);
+
+	/* The first event of a subscription is the first sent on its connection,
+	 * so it marks both the initial connection and every reconnection. */
+	if (sequence != 0) return;
+
+	if (state->dropped) {
+		gint64 reconnect_time = now - state->drop_time;
+		g_array_append_val(state->reconnect_times, reconnect_time);
+		state->dropped = FALSE;
+	}
+
+	if (state->reconnect_times->len == (guint) reconnects) {
+		g_main_loop_quit(state->loop);
+
+		return;
+	}
+
+	g_timeout_add(RECONNECT_SETTLE_MS, bench_reconnect_drop, state);
+}
+
+/* Measures the time from the server dropping the subscription connection to
+ * the first event arriving over the new one. */
+static gboolean bench_reconnect(MockServer* server) {
+	ReplitClient* client = bench_client_new(server);
+	ReplitSubscriber* subscriber = replit_client_get_subscriber(client);
+
+	SubscriptionState state = {
+		.server = server,
+		.loop = g_main_loop_new(NULL, FALSE),
+		.reconnect_times = g_array_sized_new(FALSE, FALSE, sizeof(gint64), reconnects),
+	};
+
+	replit_subscriber_subscribe(subscriber, SUBSCRIPTION, NULL, bench_reconnect_event, &state);
+
+	guint timeout = g_timeout_add_seconds(TIMEOUT_SECONDS, bench_timeout, &state);
+	g_main_loop_run(state.loop);
+
+	if (!state.timed_out) g_source_remove(timeout);
+
+	JsonBuilder* builder = bench_report_begin("reconnect");
+	bench_report_int(builder, "reconnects", state.reconnect_times->len);
+	bench_report_boolean(builder, "timed_out", state.timed_out);
+	bench_report_samples(builder, "reconnect", state.reconnect_times);
+	bench_report_end(builder);
+
+	g_array_unref(state.reconnect_times);
+	g_main_loop_unref(state.loop);
+	g_object_unref(client);
+
+	return !state.timed_out;
+}
+
+/* Measures how long a new client takes to answer its first query, including
+ * setting up its session and connecting, as a short-lived process would. */
+static gboolean bench_startup(MockServer* server) {
+	GError* error = NULL;
+	gchar* dir = NULL;
+	gchar* cookie_file = NULL;
+
+	if (use_cookie_file) {
+		dir = g_dir_make_tmp("bench-client-XXXXXX", &error);
+
+		if (dir == NULL) {
+			g_printerr("%s\n", error->message);
+			g_error_free(error);
+
+			return FALSE;
+		}
+
+		cookie_file = g_build_filename(dir, "cookies.txt", NULL);
+	}
+
+	GArray* samples = g_array_sized_new(FALSE, FALSE, sizeof(gint64), requests);
+	guint failed = 0;
+
+	guint64 allocs = bench_alloc_count();
+	guint64 alloc_bytes = bench_alloc_bytes();
+
+	for (gint i = 0; i < requests; i++) {
+		gint64 start = g_get_monotonic_time();
+
+		ReplitClient* client = bench_client_new(server);
+		replit_client_set_cookie_file(client, cookie_file);
+
+		JsonNode* data = replit_client_query(client, QUERY, NULL, NULL);
+		gint64 elapsed = g_get_monotonic_time() - start;
+
+		if (data != NULL) {
+			json_node_unref(data);
+			g_array_append_val(samples, elapsed);
+		} else {
+			failed++;
+		}
+
+		g_object_unref(client);
+	}
+
+	allocs = bench_alloc_count() - allocs;
+	alloc_bytes = bench_alloc_bytes() - alloc_bytes;
+
+	JsonBuilder* builder = bench_report_begin("startup");
+	bench_report_int(builder, "clients", requests);
+	bench_report_boolean(builder, "cookie_file", use_cookie_file);
+	bench_report_int(builder, "errors", failed);
+	bench_report_samples(builder, "startup", samples);
+	bench_report_allocs(builder, "client", allocs, alloc_bytes, requests);
+	bench_report_end(builder);
+
+	g_array_unref(samples);
+
+	if (cookie_file != NULL) {
+		g_unlink(cookie_file);
+		g_rmdir(dir);
+	}
+
+	g_free(cookie_file);
+	g_free(dir);
+
+	return failed == 0;
+}
+
+gint main(gint argc, gchar** argv) {
+	GError* error = NULL;
+	GOptionContext* context = g_option_context_new("query|threads|subscription|reconnect|startup");
+
+	g_option_context_set_summary(
+		context,
+		"Benchmarks the client against a local mock of Replit's GraphQL API,\n"
+		"printing the results of each run as a line of JSON."
+	);
+	g_option_context_add_main_entries(context, entries, NULL);
+
+	if (!g_option_context_parse(context, &argc, &argv, &error) || argc != 2) {
+		gchar* help = g_option_context_get_help(context, TRUE, NULL);
+		g_printerr("%s", error != NULL ? error->message : help);
+
+		g_free(help);
+		g_clear_error(&error);
+		g_option_context_free(context);
+
+		return EXIT_FAILURE;
+	}
+
+	g_option_context_free(context);
+
+	const gchar* mode = argv[1];
+	MockServerOptions options = {
+		.latency_ms = MAX(latency, 0),
+		.payload_size = MAX(payload_size, 0),
+		.event_rate = MAX(event_rate, 0),
+	};
+
+	gboolean (* run)(MockServer* server);
+
+	if (g_str_equal(mode, "query")) {
+		run = bench_query;
+	} else if (g_str_equal(mode, "threads")) {
+		run = bench_threads;
+	} else if (g_str_equal(mode, "subscription")) {
+		run = bench_subscription;
+		options.event_count = MAX(events, 1);
+	} else if (g_str_equal(mode, "reconnect")) {
+		run = bench_reconnect;
+		if (options.event_rate == 0) options.event_rate = RECONNECT_EVENT_RATE;
+	} else if (g_str_equal(mode, "startup")) {
+		run = bench_startup;
+	} else {
+		g_printerr("Unknown benchmark: %s\n", mode);
+
+		return EXIT_FAILURE;
+	}
+
+	MockServer* server = mock_server_new(&options, 0, &error);
+
+	if (server == NULL) {
+		g_printerr("%s\n", error->message);
+		g_error_free(error);
+
+		return EXIT_FAILURE;
+	}
+
+	gboolean success = run(server);
+
+	mock_server_free(server);
+
+	return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
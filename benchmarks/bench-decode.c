@@ -0,0 +1,370 @@
+/* bench-decode.c
+ *
+ * Copyright 2022 Patrick Winters
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE X CONSORTIUM BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written
+ * authorization.
+ */
+
+#include <glib-object.h>
+#include <json-glib/json-glib.h>
+#include <replit.h>
+#include <stdlib.h>
+
+#define RUN_TIME (G_USEC_PER_SEC / 2)
+#define ITEM_COUNT 2000
+
+/* Object types shaped like the repl listings returned by Replit's API. */
+
+#define BENCH_TYPE_USER bench_user_get_type()
+G_DECLARE_FINAL_TYPE (BenchUser, bench_user, BENCH, USER, GObject)
+
+struct _BenchUser {
+	GObject parent_instance;
+
+	gchar* id;
+	gchar* username;
+};
+
+G_DEFINE_TYPE (BenchUser, bench_user, G_TYPE_OBJECT)
+
+enum {
+	USER_PROP_0,
+	USER_PROP_ID,
+	USER_PROP_USERNAME,
+};
+
+static void bench_user_set_property(
+	GObject* gobject,
+	guint property_id,
+	const GValue* value,
+	GParamSpec* pspec
+) {
+	BenchUser* self = BENCH_USER (gobject);
+
+	switch (property_id) {
+		case USER_PROP_ID:
+			g_free(self->id);
+			self->id = g_value_dup_string(value);
+			break;
+
+		case USER_PROP_USERNAME:
+			g_free(self->username);
+			self->username = g_value_dup_string(value);
+			break;
+
+		default:
+			G_OBJECT_WARN_INVALID_PROPERTY_ID(gobject, property_id, pspec);
+			break;
+	}
+}
+
+static void bench_user_get_property(
+	GObject* gobject,
+	guint property_id,
+	GValue* value __attribute__((unused)),
+	GParamSpec* pspec
+) {
+	G_OBJECT_WARN_INVALID_PROPERTY_ID(gobject, property_id, pspec);
+}
+
+static void bench_user_finalize(GObject* gobject) {
+	BenchUser* self = BENCH_USER (gobject);
+
+	g_free(self->id);
+	g_free(self->username);
+
+	G_OBJECT_CLASS (bench_user_parent_class)->finalize(gobject);
+}
+
+static void bench_user_class_init(BenchUserClass* klass) {
+	GObjectClass* object_class = G_OBJECT_CLASS (klass);
+
+	object_class->set_property = bench_user_set_property;
+	object_class->get_property = bench_user_get_property;
+	object_class->finalize = bench_user_finalize;
+
+	g_object_class_install_property(object_class, USER_PROP_ID,
+		g_param_spec_string("id", NULL, NULL, NULL, G_PARAM_WRITABLE));
+	g_object_class_install_property(object_class, USER_PROP_USERNAME,
+		g_param_spec_string("username", NULL, NULL, NULL, G_PARAM_WRITABLE));
+}
+
+static void bench_user_init(BenchUser* self __attribute__((unused))) {}
+
+#define BENCH_TYPE_REPL bench_repl_get_type()
+G_DECLARE_FINAL_TYPE (BenchRepl, bench_repl, BENCH, REPL, GObject)
+
+struct _BenchRepl {
+	GObject parent_instance;
+
+	gchar* id;
+	gchar* title;
+	gchar* url;
+	gchar* description;
+	gchar* language;
+	gboolean is_private;
+	gint64 run_count;
+	gdouble score;
+	BenchUser* owner;
+};
+
+G_DEFINE_TYPE (BenchRepl, bench_repl, G_TYPE_OBJECT)
+
+enum {
+	REPL_PROP_0,
+	REPL_PROP_ID,
+	REPL_PROP_TITLE,
+	REPL_PROP_URL,
+	REPL_PROP_DESCRIPTION,
+	REPL_PROP_LANGUAGE,
+	REPL_PROP_IS_PRIVATE,
+	REPL_PROP_RUN_COUNT,
+	REPL_PROP_SCORE,
+	REPL_PROP_OWNER,
+};
+
+static void bench_repl_set_property(
+	GObject* gobject,
+	guint property_id,
+	const GValue* value,
+	GParamSpec* pspec
+) {
+	BenchRepl* self = BENCH_REPL (gobject);
+
+	switch (property_id) {
+		case REPL_PROP_ID:
+			g_free(self->id);
+			self->id = g_value_dup_string(value);
+			break;
+
+		case REPL_PROP_TITLE:
+			g_free(self->title);
+			self->title = g_value_dup_string(value);
+			break;
+
+		case REPL_PROP_URL:
+			g_free(self->url);
+			self->url = g_value_dup_string(value);
+			break;
+
+		case REPL_PROP_DESCRIPTION:
+			g_free(self->description);
+			self->description = g_value_dup_string(value);
+			break;
+
+		case REPL_PROP_LANGUAGE:
+			g_free(self->language);
+			self->language = g_value_dup_string(value);
+			break;
+
+		case REPL_PROP_IS_PRIVATE:
+			self->is_private = g_value_get_boolean(value);
+			break;
+
+		case REPL_PROP_RUN_COUNT:
+			self->run_count = g_value_get_int64(value);
+			break;
+
+		case REPL_PROP_SCORE:
+			self->score = g_value_get_double(value);
+			break;
+
+		case REPL_PROP_OWNER:
+			g_clear_object(&self->owner);
+			self->owner = g_value_dup_object(value);
+			break;
+
+		default:
+			G_OBJECT_WARN_INVALID_PROPERTY_ID(gobject, property_id, pspec);
+			break;
+	}
+}
+
+static void bench_repl_get_property(
+	GObject* gobject,
+	guint property_id,
+	GValue* value __attribute__((unused)),
+	GParamSpec* pspec
+) {
+	G_OBJECT_WARN_INVALID_PROPERTY_ID(gobject, property_id, pspec);
+}
+
+static void bench_repl_finalize(GObject* gobject) {
+	BenchRepl* self = BENCH_REPL (gobject);
+
+	g_free(self->id);
+	g_free(self->title);
+	g_free(self->url);
+	g_free(self->description);
+	g_free(self->language);
+	g_clear_object(&self->owner);
+
+	G_OBJECT_CLASS (bench_repl_parent_class)->finalize(gobject);
+}
+
+static void bench_repl_class_init(BenchReplClass* klass) {
+	GObjectClass* object_class = G_OBJECT_CLASS (klass);
+
+	object_class->set_property = bench_repl_set_property;
+	object_class->get_property = bench_repl_get_property;
+	object_class->finalize = bench_repl_finalize;
+
+	g_object_class_install_property(object_class, REPL_PROP_ID,
+		g_param_spec_string("id", NULL, NULL, NULL, G_PARAM_WRITABLE));
+	g_object_class_install_property(object_class, REPL_PROP_TITLE,
+		g_param_spec_string("title", NULL, NULL, NULL, G_PARAM_WRITABLE));
+	g_object_class_install_property(object_class, REPL_PROP_URL,
+		g_param_spec_string("url", NULL, NULL, NULL, G_PARAM_WRITABLE));
+	g_object_class_install_property(object_class, REPL_PROP_DESCRIPTION,
+		g_param_spec_string("description", NULL, NULL, NULL, G_PARAM_WRITABLE));
+	g_object_class_install_property(object_class, REPL_PROP_LANGUAGE,
+		g_param_spec_string("language", NULL, NULL, NULL, G_PARAM_WRITABLE));
+	g_object_class_install_property(object_class, REPL_PROP_IS_PRIVATE,
+		g_param_spec_boolean("isPrivate", NULL, NULL, FALSE, G_PARAM_WRITABLE));
+	g_object_class_install_property(object_class, REPL_PROP_RUN_COUNT,
+		g_param_spec_int64("runCount", NULL, NULL, 0, G_MAXINT64, 0, G_PARAM_WRITABLE));
+	g_object_class_install_property(object_class, REPL_PROP_SCORE,
+		g_param_spec_double("score", NULL, NULL, 0, G_MAXDOUBLE, 0, G_PARAM_WRITABLE));
+	g_object_class_install_property(object_class, REPL_PROP_OWNER,
+		g_param_spec_object("owner", NULL, NULL, BENCH_TYPE_USER, G_PARAM_WRITABLE));
+}
+
+static void bench_repl_init(BenchRepl* self __attribute__((unused))) {}
+
+static JsonNode* build_payload(void) {
+	GString* json = g_string_new("{\"items\":[");
+
+	for (guint i = 0; i < ITEM_COUNT; i++) {
+		if (i > 0) g_string_append_c(json, ',');
+
+		g_string_append_printf(
+			json,
+			"{\"id\":\"%08x-0000-4000-8000-%012x\",\"title\":\"Repl number %u\","
+			"\"url\":\"/@user%u/repl-%u\",\"description\":\"A description of "
+			"moderate length for repl %u, as users tend to write.\","
+			"\"language\":\"python3\",\"isPrivate\":%s,\"runCount\":%u,"
+			"\"score\":%u.5,\"unknownField\":[1,2,3],"
+			"\"owner\":{\"id\":\"%u\",\"username\":\"user%u\"}}",
+			i, i, i, i % 97, i, i,
+			i % 3 == 0 ? "true" : "false",
+			i * 7, i % 100,
+			i % 97, i % 97
+		);
+	}
+
+	g_string_append(json, "]}");
+
+	JsonParser* parser = json_parser_new_immutable();
+	g_autoptr(GError) error = NULL;
+
+	if (!json_parser_load_from_data(parser, json->str, json->len, &error)) {
+		g_printerr("%s\n", error->message);
+		exit(EXIT_FAILURE);
+	}
+
+	JsonNode* items = json_object_dup_member(
+		json_node_get_object(json_parser_get_root(parser)),
+		"items"
+	);
+
+	g_object_unref(parser);
+	g_string_free(json, TRUE);
+
+	return items;
+}
+
+static gdouble run_json_glib(JsonArray* items) {
+	guint64 objects = 0;
+	gint64 start = g_get_monotonic_time();
+	gint64 elapsed;
+
+	do {
+		for (guint i = 0; i < json_array_get_length(items); i++) {
+			GObject* object = json_gobject_deserialize(BENCH_TYPE_REPL, json_array_get_element(items, i));
+			g_object_unref(object);
+		}
+
+		objects += json_array_get_length(items);
+		elapsed = g_get_monotonic_time() - start;
+	} while (elapsed < RUN_TIME);
+
+	return objects / ((gdouble) elapsed / G_USEC_PER_SEC);
+}
+
+static gdouble run_replit(JsonNode* items) {
+	guint64 objects = 0;
+	gint64 start = g_get_monotonic_time();
+	gint64 elapsed;
+
+	do {
+		GPtrArray* array = replit_json_deserialize_array(BENCH_TYPE_REPL, items);
+		objects += array->len;
+		g_ptr_array_unref(array);
+		elapsed = g_get_monotonic_time() - start;
+	} while (elapsed < RUN_TIME);
+
+	return objects / ((gdouble) elapsed / G_USEC_PER_SEC);
+}
+
+gint main(void) {
+	JsonNode* items = build_payload();
+
+	/* Check that both decoders agree before timing them. */
+	BenchRepl* expected = BENCH_REPL (json_gobject_deserialize(
+		BENCH_TYPE_REPL,
+		json_array_get_element(json_node_get_array(items), 42)
+	));
+	BenchRepl* actual = BENCH_REPL (replit_json_deserialize(
+		BENCH_TYPE_REPL,
+		json_array_get_element(json_node_get_array(items), 42)
+	));
+
+	if (
+		g_strcmp0(expected->title, actual->title) != 0 ||
+		expected->run_count != actual->run_count ||
+		expected->is_private != actual->is_private ||
+		expected->score != actual->score ||
+		actual->owner == NULL ||
+		g_strcmp0(expected->owner->username, actual->owner->username) != 0
+	) {
+		g_printerr("%s\n", "Decoded objects differ");
+		return EXIT_FAILURE;
+	}
+
+	g_object_unref(expected);
+	g_object_unref(actual);
+
+	gdouble json_glib_rate = run_json_glib(json_node_get_array(items));
+	gdouble replit_rate = run_replit(items);
+
+	g_print("items: %u\n", ITEM_COUNT);
+	g_print("json-gobject-deserialize-objects-per-sec: %.0f\n", json_glib_rate);
+	g_print("replit-json-deserialize-objects-per-sec: %.0f\n", replit_rate);
+	g_print("speedup: %.2f\n", replit_rate / json_glib_rate);
+
+	json_node_unref(items);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,135 @@
+/* bench-graphql.c
+ *
+ * Copyright 2022 Patrick Winters
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE X CONSORTIUM BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written
+ * authorization.
+ */
+
+#include <glib.h>
+#include <replit.h>
+#include <stdlib.h>
+
+#include "replit-client-private.h"
+
+#define RUN_TIME (G_USEC_PER_SEC / 2)
+#define DOCUMENT_COPIES 64
+
+/* A representative query as kept in a .graphql file, with indentation,
+ * comments, commas and string literals that must survive minification. */
+static const gchar* document_unit =
+	"# Fetches a page of the current user's repls.\n"
+	"query CurrentUserRepls($count: Int!, $after: String) {\n"
+	"  currentUser {\n"
+	"    id,\n"
+	"    username\n"
+	"    # Connection fields\n"
+	"    repls(count: $count, after: $after, search: \"a # not a comment\") {\n"
+	"      items {\n"
+	"        ...ReplFields\n"
+	"        description(plainText: true)\n"
+	"      }\n"
+	"      pageInfo { nextCursor }\n"
+	"    }\n"
+	"  }\n"
+	"}\n"
+	"\n"
+	"fragment ReplFields on Repl {\n"
+	"  id\n"
+	"  title\n"
+	"  \"\"\"\n"
+	"  Block strings are preserved exactly.\n"
+	"  \"\"\"\n"
+	"  url\n"
+	"  timeCreated\n"
+	"}\n";
+
+gint main(void) {
+	GString* buffer = g_string_new("");
+
+	for (guint i = 0; i < DOCUMENT_COPIES; i++) {
+		g_string_append(buffer, document_unit);
+	}
+
+	g_autoptr(GError) error = NULL;
+	gchar* minified = replit_graphql_minify(buffer->str, &error);
+
+	if (minified == NULL) {
+		g_printerr("%s\n", error->message);
+		return EXIT_FAILURE;
+	}
+
+	gsize input_length = buffer->len;
+	gsize output_length = strlen(minified);
+
+	guint64 iterations = 0;
+	gint64 start = g_get_monotonic_time();
+	gint64 elapsed;
+
+	do {
+		g_free(replit_graphql_minify(buffer->str, NULL));
+		iterations++;
+		elapsed = g_get_monotonic_time() - start;
+	} while (elapsed < RUN_TIME);
+
+	gdouble seconds = (gdouble) elapsed / G_USEC_PER_SEC;
+	gdouble bytes = (gdouble) input_length * iterations;
+	gdouble saved = (gdouble) (input_length - output_length) * iterations;
+
+	/* Once the client's document cache is warm, building a request looks the
+	 * minified document up by its source text instead of minifying it again,
+	 * which is the cost paid for every repeated query. */
+	ReplitClient* client = replit_client_new("bench");
+	ReplitRequestRecord* record;
+	guint64 builds = 0;
+
+	g_bytes_unref(replit_client_build_request(client, buffer->str, NULL, NULL, &record, NULL));
+	replit_request_record_free(record);
+
+	start = g_get_monotonic_time();
+
+	do {
+		g_bytes_unref(replit_client_build_request(client, buffer->str, NULL, NULL, &record, NULL));
+		replit_request_record_free(record);
+		builds++;
+		elapsed = g_get_monotonic_time() - start;
+	} while (elapsed < RUN_TIME);
+
+	gdouble build_seconds = (gdouble) elapsed / G_USEC_PER_SEC;
+
+	g_object_unref(client);
+
+	g_print("input-bytes: %" G_GSIZE_FORMAT "\n", input_length);
+	g_print("output-bytes: %" G_GSIZE_FORMAT "\n", output_length);
+	g_print("ratio: %.3f\n", (gdouble) output_length / input_length);
+	g_print("minify-mb-per-sec: %.1f\n", bytes / seconds / 1e6);
+	g_print("minify-ns-per-saved-byte: %.2f\n", seconds * 1e9 / saved);
+	g_print("cached-build-request-per-sec: %.0f\n", builds / build_seconds);
+	g_print("cached-build-request-us: %.2f\n", build_seconds * 1e6 / builds);
+
+	g_free(minified);
+	g_string_free(buffer, TRUE);
+
+	return EXIT_SUCCESS;
+}
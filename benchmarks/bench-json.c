@@ -0,0 +1,254 @@
+/* bench-json.c
+ *
+ * Copyright 2022 Patrick Winters
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE X CONSORTIUM BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written
+ * authorization.
+ */
+
+#include <json-glib/json-glib.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "replit-json-tape-private.h"
+
+#define RUN_TIME (G_USEC_PER_SEC / 2)
+#define ITEM_COUNT 2000
+#define FRAME_COUNT 1000
+
+/* Compares the tape decoder against json-glib on the shapes of document that
+ * libreplit decodes most: a large query response listing repls, a small one for
+ * a single user, and a run of subscription frames, of which only the `data`
+ * member of the payload is needed. Set `REPLIT_JSON_KERNEL` to compare the
+ * scanning kernels. */
+
+typedef JsonNode* (* DecodeFunc)(const gchar* text, gsize length, gpointer state);
+
+static GString* build_repls(void) {
+	GString* json = g_string_new("{\"data\":{\"currentUser\":{\"repls\":{\"items\":[");
+
+	for (guint i = 0; i < ITEM_COUNT; i++) {
+		if (i > 0) g_string_append_c(json, ',');
+
+		g_string_append_printf(
+			json,
+			"{\"id\":\"%08x-0000-4000-8000-%012x\",\"title\":\"Repl number %u\","
+			"\"url\":\"/@user%u/repl-%u\",\"description\":\"A description of "
+			"moderate length for repl %u, as users tend to write.\\n\","
+			"\"language\":\"python3\",\"isPrivate\":%s,\"runCount\":%u,"
+			"\"score\":%u.5,\"tags\":[\"game\",\"2d\",\"caf\\u00e9\"],"
+			"\"owner\":{\"id\":%u,\"username\":\"user%u\"}}",
+			i, i, i, i % 97, i, i,
+			i % 3 == 0 ? "true" : "false",
+			i * 7, i % 100,
+			i % 97, i % 97
+		);
+	}
+
+	g_string_append(json, "],\"pageInfo\":{\"hasNextPage\":false,\"nextCursor\":null}}}}}");
+
+	return json;
+}
+
+static GString* build_user(void) {
+	return g_string_new(
+		"{\"data\":{\"userByUsername\":{\"id\":1234567,\"username\":\"user42\","
+		"\"firstName\":\"Ada\",\"lastName\":\"Lovelace\",\"bio\":\"Writes \\\"code\\\"\","
+		"\"isVerified\":true,\"followerCount\":1024,\"roles\":[{\"name\":\"explorer\"}]}}}"
+	);
+}
+
+/* Frames are decoded one at a time, so they are kept as separate strings. */
+static GPtrArray* build_frames(void) {
+	GPtrArray* frames = g_ptr_array_new_with_free_func(g_free);
+
+	for (guint i = 0; i < FRAME_COUNT; i++) {
+		g_ptr_array_add(frames, g_strdup_printf(
+			"{\"type\":\"data\",\"id\":%u,\"payload\":{\"data\":{\"replEvent\":{"
+			"\"__typename\":\"ReplChanged\",\"replId\":\"%08x\",\"timestamp\":%u,"
+			"\"files\":[\"main.py\",\"README.md\"],\"cursor\":{\"line\":%u,\"column\":%u}}}}}",
+			i % 8, i, 1650000000 + i, i % 300, i % 80
+		));
+	}
+
+	return frames;
+}
+
+static JsonNode* decode_json_glib(
+	const gchar* text,
+	gsize length,
+	gpointer state __attribute__((unused))
+) {
+	JsonParser* parser = json_parser_new_immutable();
+	JsonNode* root = NULL;
+
+	if (json_parser_load_from_data(parser, text, length, NULL)) {
+		root = json_parser_steal_root(parser);
+	}
+
+	g_object_unref(parser);
+
+	return root;
+}
+
+static JsonNode* decode_tape(const gchar* text, gsize length, gpointer state) {
+	ReplitJsonTape* tape = state;
+
+	if (!replit_json_tape_parse(tape, text, length, NULL)) return NULL;
+
+	return replit_json_tape_to_node(tape, REPLIT_JSON_TAPE_ROOT);
+}
+
+/* Only checks the document and finds its `data` member, which is the cost of
+ * the tape when the caller converts little or nothing to #JsonNode. */
+static JsonNode* decode_tape_only(const gchar* text, gsize length, gpointer state) {
+	ReplitJsonTape* tape = state;
+
+	if (!replit_json_tape_parse(tape, text, length, NULL)) return NULL;
+
+	if (replit_json_tape_get_member(tape, REPLIT_JSON_TAPE_ROOT, "data") == REPLIT_JSON_TAPE_NONE) {
+		return NULL;
+	}
+
+	return json_node_init_null(json_node_alloc());
+}
+
+static JsonNode* decode_frame_json_glib(const gchar* text, gsize length, gpointer state) {
+	JsonNode* root = decode_json_glib(text, length, state);
+
+	if (root == NULL) return NULL;
+
+	JsonObject* payload = json_object_get_object_member(json_node_get_object(root), "payload");
+	JsonNode* data = json_object_dup_member(payload, "data");
+
+	json_node_unref(root);
+
+	return data;
+}
+
+static JsonNode* decode_frame_tape(const gchar* text, gsize length, gpointer state) {
+	ReplitJsonTape* tape = state;
+
+	if (!replit_json_tape_parse(tape, text, length, NULL)) return NULL;
+
+	gsize payload = replit_json_tape_get_member(tape, REPLIT_JSON_TAPE_ROOT, "payload");
+
+	return replit_json_tape_to_node(tape, replit_json_tape_get_member(tape, payload, "data"));
+}
+
+/* Returns the throughput of @decode over @documents, in megabytes per
+ * second. */
+static gdouble run(DecodeFunc decode, GPtrArray* documents, gpointer state) {
+	guint64 bytes = 0;
+	gint64 start = g_get_monotonic_time();
+	gint64 elapsed;
+
+	do {
+		for (guint i = 0; i < documents->len; i++) {
+			const gchar* text = g_ptr_array_index(documents, i);
+			gsize length = strlen(text);
+			JsonNode* node = decode(text, length, state);
+
+			if (node == NULL) {
+				g_printerr("%s\n", "Failed to decode document");
+				exit(EXIT_FAILURE);
+			}
+
+			json_node_unref(node);
+			bytes += length;
+		}
+
+		elapsed = g_get_monotonic_time() - start;
+	} while (elapsed < RUN_TIME);
+
+	return bytes / 1e6 / ((gdouble) elapsed / G_USEC_PER_SEC);
+}
+
+/* Checks that both decoders produce the same tree before timing them. */
+static void check(
+	DecodeFunc expected_func,
+	DecodeFunc actual_func,
+	const gchar* text,
+	gpointer state
+) {
+	JsonNode* expected = expected_func(text, strlen(text), NULL);
+	JsonNode* actual = actual_func(text, strlen(text), state);
+
+	if (expected == NULL || actual == NULL || !json_node_equal(expected, actual)) {
+		g_printerr("%s\n", "Decoded documents differ");
+		exit(EXIT_FAILURE);
+	}
+
+	json_node_unref(expected);
+	json_node_unref(actual);
+}
+
+static void report(
+	const gchar* shape,
+	GPtrArray* documents,
+	DecodeFunc json_glib_func,
+	DecodeFunc tape_func,
+	ReplitJsonTape* tape
+) {
+	gdouble json_glib_rate = run(json_glib_func, documents, NULL);
+	gdouble tape_rate = run(tape_func, documents, tape);
+
+	g_print("%s-json-glib-mb-per-sec: %.1f\n", shape, json_glib_rate);
+	g_print("%s-tape-mb-per-sec: %.1f\n", shape, tape_rate);
+	g_print("%s-speedup: %.2f\n", shape, tape_rate / json_glib_rate);
+}
+
+gint main(void) {
+	ReplitJsonTape* tape = replit_json_tape_new();
+	GPtrArray* repls = g_ptr_array_new_with_free_func(g_free);
+	GPtrArray* users = g_ptr_array_new_with_free_func(g_free);
+	GPtrArray* frames = build_frames();
+
+	g_ptr_array_add(repls, g_string_free(build_repls(), FALSE));
+
+	for (guint i = 0; i < FRAME_COUNT; i++) g_ptr_array_add(users, g_string_free(build_user(), FALSE));
+
+	check(decode_json_glib, decode_tape, g_ptr_array_index(repls, 0), tape);
+	check(decode_json_glib, decode_tape, g_ptr_array_index(users, 0), tape);
+	check(decode_frame_json_glib, decode_frame_tape, g_ptr_array_index(frames, 0), tape);
+
+	g_print("kernel: %s\n", replit_json_tape_get_kernel());
+	g_print("repls-bytes: %" G_GSIZE_FORMAT "\n", strlen(g_ptr_array_index(repls, 0)));
+
+	report("repls", repls, decode_json_glib, decode_tape, tape);
+
+	gdouble scan_rate = run(decode_tape_only, repls, tape);
+
+	g_print("repls-tape-only-mb-per-sec: %.1f\n", scan_rate);
+
+	report("user", users, decode_json_glib, decode_tape, tape);
+	report("frames", frames, decode_frame_json_glib, decode_frame_tape, tape);
+
+	g_ptr_array_unref(repls);
+	g_ptr_array_unref(users);
+	g_ptr_array_unref(frames);
+	replit_json_tape_free(tape);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,76 @@
+/* bench-report.c
+ *
+ * Copyright 2022 Patrick Winters
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE X CONSORTIUM BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written
+ * authorization.
+ */
+
+#include "bench-report.h"
+
+JsonBuilder* bench_report_begin(const gchar* benchmark) {
+	JsonBuilder* builder = json_builder_new();
+
+	json_builder_begin_object(builder);
+	json_builder_set_member_name(builder, "benchmark");
+	json_builder_add_string_value(builder, benchmark);
+
+	return builder;
+}
+
+void bench_report_int(JsonBuilder* builder, const gchar* name, gint64 value) {
+	json_builder_set_member_name(builder, name);
+	json_builder_add_int_value(builder, value);
+}
+
+void bench_report_double(JsonBuilder* builder, const gchar* name, gdouble value) {
+	json_builder_set_member_name(builder, name);
+	json_builder_add_double_value(builder, value);
+}
+
+void bench_report_string(JsonBuilder* builder, const gchar* name, const gchar* value) {
+	json_builder_set_member_name(builder, name);
+	json_builder_add_string_value(builder, value);
+}
+
+void bench_report_boolean(JsonBuilder* builder, const gchar* name, gboolean value) {
+	json_builder_set_member_name(builder, name);
+	json_builder_add_boolean_value(builder, value);
+}
+
+void bench_report_end(JsonBuilder* builder) {
+	json_builder_end_object(builder);
+
+	JsonNode* root = json_builder_get_root(builder);
+	JsonGenerator* generator = json_generator_new();
+	json_generator_set_root(generator, root);
+
+	gchar* line = json_generator_to_data(generator, NULL);
+	g_print("%s\n", line);
+
+	g_free(line);
+	json_node_unref(root);
+	g_object_unref(generator);
+	g_object_unref(builder);
+}
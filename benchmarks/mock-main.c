@@ -0,0 +1,93 @@
+/* mock-main.c
+ *
+ * Copyright 2022 Patrick Winters
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE X CONSORTIUM BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written
+ * authorization.
+ */
+
+#include <glib.h>
+#include <stdlib.h>
+
+#include "mock-server.h"
+
+static gint port = 0;
+static gint latency = 0;
+static gint payload_size = 1024;
+static gint event_rate = 10;
+static gint event_count = 0;
+
+static GOptionEntry entries[] = {
+	{ "port", 'p', 0, G_OPTION_ARG_INT, &port, "Port to listen on, 0 for any", "PORT" },
+	{ "latency", 'l', 0, G_OPTION_ARG_INT, &latency, "Delay per query", "MS" },
+	{ "payload-size", 's', 0, G_OPTION_ARG_INT, &payload_size, "Query response size", "BYTES" },
+	{ "event-rate", 'r', 0, G_OPTION_ARG_INT, &event_rate, "Events per second, 0 for unlimited", "HZ" },
+	{ "event-count", 'e', 0, G_OPTION_ARG_INT, &event_count, "Events per subscription, 0 for unlimited", "N" },
+	{ NULL },
+};
+
+gint main(gint argc, gchar** argv) {
+	GError* error = NULL;
+	GOptionContext* context = g_option_context_new(NULL);
+
+	g_option_context_set_summary(
+		context,
+		"Serves a local mock of Replit's GraphQL API, for use with the base URI\n"
+		"setting of ReplitClient."
+	);
+	g_option_context_add_main_entries(context, entries, NULL);
+
+	if (!g_option_context_parse(context, &argc, &argv, &error)) {
+		g_printerr("%s\n", error->message);
+		g_error_free(error);
+		g_option_context_free(context);
+
+		return EXIT_FAILURE;
+	}
+
+	g_option_context_free(context);
+
+	MockServerOptions options = {
+		.latency_ms = MAX(latency, 0),
+		.payload_size = MAX(payload_size, 0),
+		.event_rate = MAX(event_rate, 0),
+		.event_count = MAX(event_count, 0),
+	};
+
+	MockServer* server = mock_server_new(&options, MAX(port, 0), &error);
+
+	if (server == NULL) {
+		g_printerr("%s\n", error->message);
+		g_error_free(error);
+
+		return EXIT_FAILURE;
+	}
+
+	g_print("%s\n", mock_server_get_uri(server));
+
+	GMainLoop* loop = g_main_loop_new(NULL, FALSE);
+	g_main_loop_run(loop);
+
+	return EXIT_SUCCESS;
+}
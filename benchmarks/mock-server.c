@@ -0,0 +1,461 @@
+/* mock-server.c
+ *
+ * Copyright 2022 Patrick Winters
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE X CONSORTIUM BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written
+ * authorization.
+ */
+
+#include <json-glib/json-glib.h>
+#include <libsoup/soup.h>
+#include <string.h>
+
+#include "mock-server.h"
+
+#define EVENT_BURST 64
+#define EVENT_TICK_MS 1
+
+#define MESSAGE_ACK      "{\"type\":\"connection_ack\"}"
+#define MESSAGE_COMPLETE "{\"type\":\"complete\",\"id\":%u}"
+#define MESSAGE_EVENT \
+	"{\"type\":\"data\",\"id\":%u,\"payload\":{\"data\":{\"event\":" \
+	"{\"sequence\":%u,\"timestamp\":%" G_GINT64_FORMAT "}}}}"
+
+struct _MockServer {
+	MockServerOptions options;
+	guint port;
+
+	GMainContext* context;
+	GMainLoop* loop;
+	GThread* thread;
+
+	GMutex mutex;
+	GCond cond;
+	gboolean ready;
+	GError* error;
+	gchar* uri;
+
+	/* Only used on the server thread. */
+	SoupServer* server;
+	gchar* payload;
+	gsize payload_length;
+	GList* connections;
+};
+
+typedef struct {
+	MockServer* server;
+	SoupWebsocketConnection* ws;
+	GPtrArray* streams;
+} MockConnection;
+
+typedef struct {
+	MockConnection* connection;
+	guint id;
+	guint sent;
+	gint64 start_time;
+	GSource* source;
+} MockStream;
+
+typedef struct {
+	SoupServer* server;
+	SoupServerMessage* msg;
+} MockReply;
+
+/* Builds a response shaped like a page of repls, padded to roughly the
+ * requested size. */
+static void mock_server_build_payload(MockServer* self) {
+	GString* payload = g_string_new("{\"data\":{\"items\":[");
+
+	for (guint i = 0; i == 0 || payload->len < self->options.payload_size; i++) {
+		if (i > 0) g_string_append_c(payload, ',');
+
+		g_string_append_printf(
+			payload,
+			"{\"id\":\"%08x\",\"title\":\"Repl %u\",\"description\":\"%s\"}",
+			i,
+			i,
+			"A repl returned by the mock server for benchmarking"
+		);
+	}
+
+	g_string_append(payload, "]}}");
+
+	self->payload_length = payload->len;
+	self->payload = g_string_free(payload, FALSE);
+}
+
+static gboolean mock_server_reply(gpointer user_data) {
+	MockReply* reply = user_data;
+
+#if SOUP_CHECK_VERSION(3, 2, 0)
+	soup_server_message_unpause(reply->msg);
+#else
+	soup_server_unpause_message(reply->server, reply->msg);
+#endif
+
+	g_object_unref(reply->msg);
+	g_free(reply);
+
+	return G_SOURCE_REMOVE;
+}
+
+static void mock_server_graphql(
+	SoupServer* server,
+	SoupServerMessage* msg,
+	const char* path __attribute__((unused)),
+	GHashTable* query __attribute__((unused)),
+	gpointer user_data
+) {
+	MockServer* self = user_data;
+	guint latency_ms = g_atomic_int_get(&self->options.latency_ms);
+
+	if (!g_str_equal(soup_server_message_get_method(msg), SOUP_METHOD_POST)) {
+		soup_server_message_set_status(msg, SOUP_STATUS_METHOD_NOT_ALLOWED, NULL);
+
+		return;
+	}
+
+	soup_server_message_set_status(msg, SOUP_STATUS_OK, NULL);
+	soup_server_message_set_response(
+		msg,
+		"application/json",
+		SOUP_MEMORY_STATIC,
+		self->payload,
+		self->payload_length
+	);
+
+	if (latency_ms == 0) return;
+
+	MockReply* reply = g_new(MockReply, 1);
+	reply->server = server;
+	reply->msg = g_object_ref(msg);
+
+#if SOUP_CHECK_VERSION(3, 2, 0)
+	soup_server_message_pause(msg);
+#else
+	soup_server_pause_message(server, msg);
+#endif
+
+	GSource* source = g_timeout_source_new(latency_ms);
+	g_source_set_callback(source, mock_server_reply, reply, NULL);
+	g_source_attach(source, self->context);
+	g_source_unref(source);
+}
+
+static void mock_stream_free(MockStream* stream) {
+	g_source_destroy(stream->source);
+	g_source_unref(stream->source);
+	g_free(stream);
+}
+
+/* Sends the events that are due on a stream, completing it once the configured
+ * number of events has been sent. */
+static gboolean mock_stream_tick(gpointer user_data) {
+	MockStream* stream = user_data;
+	MockServer* self = stream->connection->server;
+	SoupWebsocketConnection* ws = stream->connection->ws;
+
+	gint64 now = g_get_monotonic_time();
+	guint64 due = EVENT_BURST;
+
+	if (self->options.event_rate > 0) {
+		guint64 target = (now - stream->start_time) * self->options.event_rate / G_USEC_PER_SEC;
+		due = target > stream->sent ? target - stream->sent : 0;
+	}
+
+	if (self->options.event_count > 0) {
+		due = MIN(due, self->options.event_count - stream->sent);
+	}
+
+	for (guint64 i = 0; i < due; i++) {
+		gchar* message = g_strdup_printf(MESSAGE_EVENT, stream->id, stream->sent++, now);
+		soup_websocket_connection_send_text(ws, message);
+		g_free(message);
+	}
+
+	if (self->options.event_count == 0 || stream->sent < self->options.event_count) {
+		return G_SOURCE_CONTINUE;
+	}
+
+	gchar* message = g_strdup_printf(MESSAGE_COMPLETE, stream->id);
+	soup_websocket_connection_send_text(ws, message);
+	g_free(message);
+
+	g_ptr_array_remove(stream->connection->streams, stream);
+
+	return G_SOURCE_REMOVE;
+}
+
+static void mock_connection_start(MockConnection* connection, guint id) {
+	MockServer* self = connection->server;
+	MockStream* stream = g_new0(MockStream, 1);
+
+	stream->connection = connection;
+	stream->id = id;
+	stream->start_time = g_get_monotonic_time();
+
+	if (self->options.event_rate == 0) {
+		stream->source = g_idle_source_new();
+	} else {
+		stream->source = g_timeout_source_new(EVENT_TICK_MS);
+	}
+
+	g_source_set_callback(stream->source, mock_stream_tick, stream, NULL);
+	g_source_attach(stream->source, self->context);
+
+	g_ptr_array_add(connection->streams, stream);
+}
+
+static void mock_connection_stop(MockConnection* connection, guint id) {
+	for (guint i = 0; i < connection->streams->len; i++) {
+		MockStream* stream = g_ptr_array_index(connection->streams, i);
+		if (stream->id != id) continue;
+
+		g_ptr_array_remove_index_fast(connection->streams, i);
+
+		return;
+	}
+}
+
+static void mock_connection_on_message(
+	SoupWebsocketConnection* ws,
+	gint type,
+	GBytes* message,
+	gpointer user_data
+) {
+	MockConnection* connection = user_data;
+
+	if (type != SOUP_WEBSOCKET_DATA_TEXT) return;
+
+	gsize length;
+	const gchar* data = g_bytes_get_data(message, &length);
+	JsonParser* parser = json_parser_new_immutable();
+
+	if (!json_parser_load_from_data(parser, data, length, NULL)) {
+		g_object_unref(parser);
+
+		return;
+	}
+
+	JsonNode* root = json_parser_get_root(parser);
+
+	if (root == NULL || !JSON_NODE_HOLDS_OBJECT (root)) {
+		g_object_unref(parser);
+
+		return;
+	}
+
+	JsonObject* object = json_node_get_object(root);
+	const gchar* msg_type = json_object_get_string_member_with_default(object, "type", "");
+	guint id = (guint) json_object_get_int_member_with_default(object, "id", 0);
+
+	if (g_str_equal(msg_type, "connection_init")) {
+		soup_websocket_connection_send_text(ws, MESSAGE_ACK);
+	} else if (g_str_equal(msg_type, "start")) {
+		mock_connection_start(connection, id);
+	} else if (g_str_equal(msg_type, "stop")) {
+		mock_connection_stop(connection, id);
+	}
+
+	g_object_unref(parser);
+}
+
+static void mock_connection_on_closed(SoupWebsocketConnection* ws, gpointer user_data) {
+	MockConnection* connection = user_data;
+	MockServer* self = connection->server;
+
+	self->connections = g_list_remove(self->connections, connection);
+
+	g_signal_handlers_disconnect_by_data(ws, connection);
+	g_ptr_array_unref(connection->streams);
+	g_object_unref(connection->ws);
+	g_free(connection);
+}
+
+static void mock_server_websocket(
+	SoupServer* server __attribute__((unused)),
+	SoupServerMessage* msg __attribute__((unused)),
+	const char* path __attribute__((unused)),
+	SoupWebsocketConnection* ws,
+	gpointer user_data
+) {
+	MockServer* self = user_data;
+	MockConnection* connection = g_new0(MockConnection, 1);
+
+	connection->server = self;
+	connection->ws = g_object_ref(ws);
+	connection->streams = g_ptr_array_new_with_free_func((GDestroyNotify) mock_stream_free);
+
+	g_signal_connect(ws, "message", (GCallback) mock_connection_on_message, connection);
+	g_signal_connect(ws, "closed", (GCallback) mock_connection_on_closed, connection);
+
+	self->connections = g_list_prepend(self->connections, connection);
+}
+
+static gpointer mock_server_run(gpointer user_data) {
+	MockServer* self = user_data;
+	GError* error = NULL;
+
+	g_main_context_push_thread_default(self->context);
+
+	mock_server_build_payload(self);
+
+	self->server = soup_server_new(NULL, NULL);
+	soup_server_add_handler(self->server, "/graphql", mock_server_graphql, self, NULL);
+	soup_server_add_websocket_handler(
+		self->server,
+		"/graphql_subscriptions",
+		NULL,
+		NULL,
+		mock_server_websocket,
+		self,
+		NULL
+	);
+
+	gboolean listening = soup_server_listen_local(
+		self->server,
+		self->port,
+		SOUP_SERVER_LISTEN_IPV4_ONLY,
+		&error
+	);
+
+	g_mutex_lock(&self->mutex);
+
+	if (listening) {
+		GSList* uris = soup_server_get_uris(self->server);
+		gchar* uri = g_uri_to_string(uris->data);
+
+		/* Drops the trailing slash, as the client expects a bare origin. */
+		if (g_str_has_suffix(uri, "/")) uri[strlen(uri) - 1] = '\0';
+
+		self->uri = uri;
+
+		g_slist_free_full(uris, (GDestroyNotify) g_uri_unref);
+	} else {
+		self->error = error;
+	}
+
+	self->ready = TRUE;
+	g_cond_signal(&self->cond);
+	g_mutex_unlock(&self->mutex);
+
+	if (listening) g_main_loop_run(self->loop);
+
+	while (self->connections != NULL) {
+		MockConnection* connection = self->connections->data;
+		mock_connection_on_closed(connection->ws, connection);
+	}
+
+	soup_server_disconnect(self->server);
+	g_clear_object(&self->server);
+	g_free(self->payload);
+
+	g_main_context_pop_thread_default(self->context);
+
+	return NULL;
+}
+
+/* Starts a mock server listening on the loopback interface, on @port or on an
+ * ephemeral port if @port is 0. */
+MockServer* mock_server_new(const MockServerOptions* options, guint port, GError** error) {
+	MockServer* self = g_new0(MockServer, 1);
+
+	self->options = *options;
+	self->port = port;
+	self->context = g_main_context_new();
+	self->loop = g_main_loop_new(self->context, FALSE);
+
+	g_mutex_init(&self->mutex);
+	g_cond_init(&self->cond);
+
+	self->thread = g_thread_new("mock-server", mock_server_run, self);
+
+	g_mutex_lock(&self->mutex);
+	while (!self->ready) g_cond_wait(&self->cond, &self->mutex);
+	g_mutex_unlock(&self->mutex);
+
+	if (self->error != NULL) {
+		g_propagate_error(error, self->error);
+		self->error = NULL;
+
+		mock_server_free(self);
+
+		return NULL;
+	}
+
+	return self;
+}
+
+/* Returns the origin of the server, such as `http://127.0.0.1:41235`. */
+const gchar* mock_server_get_uri(MockServer* self) {
+	return self->uri;
+}
+
+/* Changes how long the server waits before answering each query, from the
+ * next query it receives. */
+void mock_server_set_latency(MockServer* self, guint latency_ms) {
+	g_atomic_int_set(&self->options.latency_ms, latency_ms);
+}
+
+static gboolean mock_server_drop_in_thread(gpointer user_data) {
+	MockServer* self = user_data;
+
+	for (GList* this = self->connections; this; this = this->next) {
+		MockConnection* connection = this->data;
+		SoupWebsocketState state = soup_websocket_connection_get_state(connection->ws);
+
+		if (state != SOUP_WEBSOCKET_STATE_OPEN) continue;
+
+		/* No more events are sent once the close handshake begins. */
+		g_ptr_array_set_size(connection->streams, 0);
+		soup_websocket_connection_close(connection->ws, SOUP_WEBSOCKET_CLOSE_GOING_AWAY, NULL);
+	}
+
+	return G_SOURCE_REMOVE;
+}
+
+/* Closes every open WebSocket connection, as a server restart would. */
+void mock_server_drop_connections(MockServer* self) {
+	g_main_context_invoke(self->context, mock_server_drop_in_thread, self);
+}
+
+static gboolean mock_server_quit(gpointer user_data) {
+	MockServer* self = user_data;
+
+	g_main_loop_quit(self->loop);
+
+	return G_SOURCE_REMOVE;
+}
+
+void mock_server_free(MockServer* self) {
+	g_main_context_invoke(self->context, mock_server_quit, self);
+	g_thread_join(self->thread);
+
+	g_main_loop_unref(self->loop);
+	g_main_context_unref(self->context);
+	g_mutex_clear(&self->mutex);
+	g_cond_clear(&self->cond);
+	g_free(self->uri);
+	g_free(self);
+}
@@ -0,0 +1,66 @@
+/* mock-server.h
+ *
+ * Copyright 2022 Patrick Winters
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE X CONSORTIUM BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written
+ * authorization.
+ */
+
+#pragma once
+
+#include <glib.h>
+
+/* A local stand-in for Replit's GraphQL endpoints, for benchmarking the client
+ * without a network. It serves every POST to /graphql with the same canned
+ * response, and every subscription started over /graphql_subscriptions with a
+ * stream of generated events. The server runs on its own thread, so that it
+ * can be driven by the synchronous client API. */
+
+typedef struct {
+	/* Milliseconds to wait before answering each query. */
+	guint latency_ms;
+
+	/* Approximate size of each query response in bytes. */
+	gsize payload_size;
+
+	/* Events per second sent on each subscription, or 0 for as fast as the
+	 * connection allows. */
+	guint event_rate;
+
+	/* Events sent on each subscription before it completes, or 0 for no
+	 * limit. */
+	guint event_count;
+} MockServerOptions;
+
+typedef struct _MockServer MockServer;
+
+MockServer* mock_server_new(const MockServerOptions* options, guint port, GError** error);
+
+const gchar* mock_server_get_uri(MockServer* server);
+
+void mock_server_set_latency(MockServer* server, guint latency_ms);
+
+void mock_server_drop_connections(MockServer* server);
+
+void mock_server_free(MockServer* server);
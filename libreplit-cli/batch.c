@@ -0,0 +1,263 @@
+/* batch.c
+ *
+ * Copyright 2022 Patrick Winters
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE X CONSORTIUM BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written
+ * authorization.
+ */
+
+#include "replit-config.h"
+
+#include <gio/gio.h>
+#include <gio-unix-2.0/gio/gunixinputstream.h>
+#include <gio-unix-2.0/gio/gunixoutputstream.h>
+#include <glib.h>
+#include <json-glib/json-glib.h>
+#include <replit.h>
+#include <unistd.h>
+
+#include "rquery.h"
+
+/* Batch mode reads one request per line from standard input, as objects of
+ * the form {"query": ..., "variables": ..., "id": ...}, and writes one line
+ * per result to standard output as soon as it arrives: {"id": ..., "data": ...}
+ * on success, or {"id": ..., "error": ...} on failure. Every request goes
+ * through the same client, so connection and TLS setup is paid once for the
+ * whole batch, and up to `concurrency` requests are in flight at a time. */
+
+typedef struct {
+	ReplitClient* client;
+	GDataInputStream* input;
+	GOutputStream* output;
+	GMainLoop* loop;
+	guint concurrency;
+	guint in_flight;
+	guint64 line;
+	gboolean reading;
+	gboolean done;
+	gboolean ok;
+} Batch;
+
+typedef struct {
+	Batch* batch;
+	JsonNode* id;
+} BatchRequest;
+
+static void batch_read_next(Batch* batch);
+
+static void batch_maybe_quit(Batch* batch) {
+	if (batch->done && !batch->reading && batch->in_flight == 0) {
+		g_main_loop_quit(batch->loop);
+	}
+}
+
+/* Writes the result of a request, taking ownership of @data. Exactly one of
+ * @data and @message is set. */
+static void batch_write_result(
+	Batch* batch,
+	JsonNode* id,
+	JsonNode* data,
+	const gchar* message
+) {
+	JsonObject* object = json_object_new();
+
+	if (id != NULL) {
+		json_object_set_member(object, "id", json_node_copy(id));
+	} else {
+		json_object_set_null_member(object, "id");
+	}
+
+	if (data != NULL) {
+		json_object_set_member(object, "data", data);
+	} else {
+		json_object_set_string_member(object, "error", message);
+		batch->ok = FALSE;
+	}
+
+	JsonNode* root = json_node_init_object(json_node_alloc(), object);
+	json_object_unref(object);
+
+	JsonGenerator* generator = json_generator_new();
+	json_generator_set_root(generator, root);
+
+	GString* line = json_generator_to_gstring(generator, g_string_new(NULL));
+	g_string_append_c(line, '\n');
+
+	g_autoptr(GError) error = NULL;
+
+	if (!g_output_stream_write_all(batch->output, line->str, line->len, NULL, NULL, &error)) {
+		g_printerr("%s\n", error->message);
+
+		batch->ok = FALSE;
+		batch->done = TRUE;
+	}
+
+	g_string_free(line, TRUE);
+	g_object_unref(generator);
+	json_node_unref(root);
+}
+
+static void batch_write_line_error(Batch* batch, JsonNode* id, const gchar* message) {
+	gchar* text = g_strdup_printf("Line %" G_GUINT64_FORMAT ": %s", batch->line, message);
+	batch_write_result(batch, id, NULL, text);
+	g_free(text);
+}
+
+static void batch_query_ready(GObject* source, GAsyncResult* res, gpointer user_data) {
+	BatchRequest* request = user_data;
+	Batch* batch = request->batch;
+
+	g_autoptr(GError) error = NULL;
+	JsonNode* data = replit_client_query_finish(REPLIT_CLIENT (source), res, &error);
+
+	batch_write_result(batch, request->id, data, data == NULL ? error->message : NULL);
+
+	if (request->id != NULL) json_node_unref(request->id);
+	g_free(request);
+
+	batch->in_flight--;
+
+	batch_read_next(batch);
+	batch_maybe_quit(batch);
+}
+
+/* Parses a line of input and sends the request it describes. */
+static void batch_start(Batch* batch, const gchar* line) {
+	g_autoptr(JsonParser) parser = json_parser_new();
+	g_autoptr(GError) error = NULL;
+
+	if (!json_parser_load_from_data(parser, line, -1, &error)) {
+		batch_write_line_error(batch, NULL, error->message);
+		return;
+	}
+
+	JsonNode* root = json_parser_get_root(parser);
+
+	if (!JSON_NODE_HOLDS_OBJECT (root)) {
+		batch_write_line_error(batch, NULL, "Expected an object");
+		return;
+	}
+
+	JsonObject* object = json_node_get_object(root);
+	JsonNode* id = json_object_get_member(object, "id");
+	JsonNode* query = json_object_get_member(object, "query");
+	JsonNode* variables = json_object_get_member(object, "variables");
+
+	if (
+		query == NULL ||
+		!JSON_NODE_HOLDS_VALUE (query) ||
+		json_node_get_value_type(query) != G_TYPE_STRING
+	) {
+		batch_write_line_error(batch, id, "Expected a string \"query\" member");
+		return;
+	}
+
+	if (variables != NULL && JSON_NODE_HOLDS_NULL (variables)) variables = NULL;
+
+	BatchRequest* request = g_new0(BatchRequest, 1);
+	request->batch = batch;
+	request->id = id != NULL ? json_node_copy(id) : NULL;
+
+	batch->in_flight++;
+
+	replit_client_query_async(
+		batch->client,
+		json_node_get_string(query),
+		variables != NULL ? json_node_copy(variables) : NULL,
+		NULL,
+		batch_query_ready,
+		request
+	);
+}
+
+static void batch_read_ready(GObject* source, GAsyncResult* res, gpointer user_data) {
+	Batch* batch = user_data;
+
+	g_autoptr(GError) error = NULL;
+	gchar* line = g_data_input_stream_read_line_finish_utf8(
+		G_DATA_INPUT_STREAM (source),
+		res,
+		NULL,
+		&error
+	);
+
+	batch->reading = FALSE;
+
+	if (line == NULL) {
+		if (error != NULL) {
+			g_printerr("%s\n", error->message);
+			batch->ok = FALSE;
+		}
+
+		batch->done = TRUE;
+	} else if (!batch->done) {
+		batch->line++;
+
+		if (*g_strstrip(line) != '\0') batch_start(batch, line);
+	}
+
+	g_free(line);
+
+	batch_read_next(batch);
+	batch_maybe_quit(batch);
+}
+
+/* Reads the next line, unless enough requests are already in flight. */
+static void batch_read_next(Batch* batch) {
+	if (batch->reading || batch->done || batch->in_flight >= batch->concurrency) return;
+
+	batch->reading = TRUE;
+
+	g_data_input_stream_read_line_async(
+		batch->input,
+		G_PRIORITY_DEFAULT,
+		NULL,
+		batch_read_ready,
+		batch
+	);
+}
+
+gboolean run_batch(ReplitClient* client, guint concurrency) {
+	GInputStream* stdin_stream = g_unix_input_stream_new(STDIN_FILENO, FALSE);
+
+	Batch batch = {
+		.client = client,
+		.input = g_data_input_stream_new(stdin_stream),
+		.output = g_unix_output_stream_new(STDOUT_FILENO, FALSE),
+		.loop = g_main_loop_new(NULL, FALSE),
+		.concurrency = MAX(concurrency, 1),
+		.ok = TRUE,
+	};
+
+	g_object_unref(stdin_stream);
+
+	batch_read_next(&batch);
+	g_main_loop_run(batch.loop);
+
+	g_main_loop_unref(batch.loop);
+	g_object_unref(batch.output);
+	g_object_unref(batch.input);
+
+	return batch.ok;
+}
@@ -0,0 +1,336 @@
+/* bench.c
+ *
+ * Copyright 2022 Patrick Winters
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE X CONSORTIUM BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written
+ * authorization.
+ */
+
+#include "replit-config.h"
+
+#include <glib.h>
+#include <glib-unix.h>
+#include <json-glib/json-glib.h>
+#include <replit.h>
+#include <signal.h>
+
+#include "rquery.h"
+
+/* Bench mode sends the same query repeatedly and reports throughput and the
+ * latency distribution of the requests that succeeded.
+ * 
+ * Without a rate, the load is closed-loop: `concurrency` requests are kept in
+ * flight, and each completion sends the next. With a rate, it is open-loop:
+ * request n is due at start + n / rate, whether or not earlier requests have
+ * completed, and up to `concurrency` are in flight at once. Latency is counted
+ * from when a request was due rather than when it was sent, so a server that
+ * falls behind shows up in the results instead of slowing the load down.
+ * 
+ * Requests due during the warmup are sent but not counted. */
+
+#define BENCH_TICK_MS 1
+
+typedef struct {
+	ReplitClient* client;
+	const gchar* query;
+	JsonNode* variables;
+	GMainLoop* loop;
+	guint concurrency;
+	gdouble rate;
+	guint64 count;
+	gint64 start;
+	gint64 warmup_end;
+	gint64 end;
+	guint64 launched;
+	guint64 measured;
+	guint in_flight;
+	gboolean stopping;
+	gint64 last_completion;
+	GArray* latencies;
+	guint64 failures;
+	GHashTable* errors;
+} Bench;
+
+typedef struct {
+	Bench* bench;
+	gint64 due;
+	gboolean measured;
+} BenchRequest;
+
+static void bench_fill(Bench* bench);
+
+/* Groups errors for the report. GraphQL errors are grouped together, since
+ * their messages come from the server and vary with the query. */
+static const gchar* bench_error_key(const GError* error) {
+	if (g_error_matches(error, REPLIT_CLIENT_ERROR, REPLIT_CLIENT_ERROR_GRAPHQL_ERROR)) {
+		return "GraphQL error";
+	}
+
+	return error->message;
+}
+
+static void bench_query_ready(GObject* source, GAsyncResult* res, gpointer user_data) {
+	gint64 now = g_get_monotonic_time();
+	BenchRequest* request = user_data;
+	Bench* bench = request->bench;
+
+	g_autoptr(GError) error = NULL;
+	JsonNode* data = replit_client_query_finish(REPLIT_CLIENT (source), res, &error);
+
+	if (request->measured) {
+		if (data != NULL) {
+			gint64 latency = now - request->due;
+			g_array_append_val(bench->latencies, latency);
+		} else {
+			const gchar* key = bench_error_key(error);
+			guint64 errors = GPOINTER_TO_SIZE (g_hash_table_lookup(bench->errors, key));
+
+			g_hash_table_replace(bench->errors, g_strdup(key), GSIZE_TO_POINTER (errors + 1));
+			bench->failures++;
+		}
+
+		bench->last_completion = now;
+	}
+
+	if (data != NULL) json_node_unref(data);
+	g_free(request);
+
+	bench->in_flight--;
+
+	bench_fill(bench);
+}
+
+static void bench_send(Bench* bench, gint64 due) {
+	BenchRequest* request = g_new0(BenchRequest, 1);
+	request->bench = bench;
+	request->due = due;
+	request->measured = due >= bench->warmup_end;
+
+	if (request->measured) bench->measured++;
+
+	bench->launched++;
+	bench->in_flight++;
+
+	replit_client_query_async(
+		bench->client,
+		bench->query,
+		bench->variables != NULL ? json_node_copy(bench->variables) : NULL,
+		NULL,
+		bench_query_ready,
+		request
+	);
+}
+
+/* Sends every request that is due, as far as the concurrency allows, and
+ * quits once the run is over and nothing is left in flight. */
+static void bench_fill(Bench* bench) {
+	gint64 now = g_get_monotonic_time();
+
+	while (!bench->stopping && bench->in_flight < bench->concurrency) {
+		gint64 due = now;
+
+		if (bench->rate > 0) {
+			due = bench->start + (gint64) (bench->launched * G_USEC_PER_SEC / bench->rate);
+			if (due > now) break;
+		}
+
+		if (
+			(bench->end != 0 && due >= bench->end) ||
+			(bench->count != 0 && bench->measured >= bench->count)
+		) {
+			bench->stopping = TRUE;
+			break;
+		}
+
+		bench_send(bench, due);
+	}
+
+	if (bench->stopping && bench->in_flight == 0) g_main_loop_quit(bench->loop);
+}
+
+static gboolean bench_tick(gpointer user_data) {
+	bench_fill(user_data);
+
+	return G_SOURCE_CONTINUE;
+}
+
+static gboolean bench_interrupt(gpointer user_data) {
+	Bench* bench = user_data;
+
+	bench->stopping = TRUE;
+	bench_fill(bench);
+
+	return G_SOURCE_CONTINUE;
+}
+
+static gint bench_compare_int64(gconstpointer a, gconstpointer b) {
+	gint64 x = *(const gint64*) a;
+	gint64 y = *(const gint64*) b;
+
+	return (x > y) - (x < y);
+}
+
+static gint64 bench_percentile(GArray* sorted, gdouble fraction) {
+	if (sorted->len == 0) return 0;
+
+	guint index = (guint) (fraction * (sorted->len - 1) + 0.5);
+
+	return g_array_index(sorted, gint64, index);
+}
+
+static const gdouble bench_fractions[] = { 0.5, 0.9, 0.99, 0.999, 1.0 };
+static const gchar* bench_fraction_names[] = { "p50", "p90", "p99", "p99.9", "max" };
+
+static void bench_print_json(Bench* bench, gdouble seconds) {
+	JsonBuilder* builder = json_builder_new();
+	json_builder_begin_object(builder);
+
+	json_builder_set_member_name(builder, "requests");
+	json_builder_add_int_value(builder, bench->latencies->len + bench->failures);
+	json_builder_set_member_name(builder, "failures");
+	json_builder_add_int_value(builder, bench->failures);
+	json_builder_set_member_name(builder, "duration_s");
+	json_builder_add_double_value(builder, seconds);
+	json_builder_set_member_name(builder, "throughput_rps");
+	json_builder_add_double_value(builder, seconds > 0 ? bench->latencies->len / seconds : 0);
+
+	json_builder_set_member_name(builder, "latency_us");
+	json_builder_begin_object(builder);
+
+	for (guint i = 0; i < G_N_ELEMENTS (bench_fractions); i++) {
+		json_builder_set_member_name(builder, bench_fraction_names[i]);
+		json_builder_add_int_value(builder, bench_percentile(bench->latencies, bench_fractions[i]));
+	}
+
+	json_builder_end_object(builder);
+
+	json_builder_set_member_name(builder, "errors");
+	json_builder_begin_object(builder);
+
+	GHashTableIter iter;
+	gpointer key, value;
+	g_hash_table_iter_init(&iter, bench->errors);
+
+	while (g_hash_table_iter_next(&iter, &key, &value)) {
+		json_builder_set_member_name(builder, key);
+		json_builder_add_int_value(builder, GPOINTER_TO_SIZE (value));
+	}
+
+	json_builder_end_object(builder);
+	json_builder_end_object(builder);
+
+	JsonNode* root = json_builder_get_root(builder);
+	JsonGenerator* generator = json_generator_new();
+	json_generator_set_root(generator, root);
+
+	gchar* text = json_generator_to_data(generator, NULL);
+	g_print("%s\n", text);
+
+	g_free(text);
+	g_object_unref(generator);
+	json_node_unref(root);
+	g_object_unref(builder);
+}
+
+static void bench_print_text(Bench* bench, gdouble seconds) {
+	guint64 requests = bench->latencies->len + bench->failures;
+
+	g_print("Requests:    %" G_GUINT64_FORMAT " (%" G_GUINT64_FORMAT " failed)\n", requests, bench->failures);
+	g_print("Duration:    %.3f s\n", seconds);
+	g_print("Throughput:  %.1f req/s\n", seconds > 0 ? bench->latencies->len / seconds : 0);
+	g_print("Latency:\n");
+
+	for (guint i = 0; i < G_N_ELEMENTS (bench_fractions); i++) {
+		gint64 latency = bench_percentile(bench->latencies, bench_fractions[i]);
+		g_print("  %-6s %10.3f ms\n", bench_fraction_names[i], latency / 1000.0);
+	}
+
+	if (bench->failures == 0) return;
+
+	g_print("Errors:\n");
+
+	GHashTableIter iter;
+	gpointer key, value;
+	g_hash_table_iter_init(&iter, bench->errors);
+
+	while (g_hash_table_iter_next(&iter, &key, &value)) {
+		g_print("  %8" G_GSIZE_FORMAT "  %s\n", GPOINTER_TO_SIZE (value), (const gchar*) key);
+	}
+}
+
+gboolean run_bench(
+	ReplitClient* client,
+	const gchar* query,
+	JsonNode* variables,
+	const BenchOptions* options
+) {
+	Bench bench = {
+		.client = client,
+		.query = query,
+		.variables = variables,
+		.loop = g_main_loop_new(NULL, FALSE),
+		.concurrency = MAX(options->concurrency, 1),
+		.rate = options->rate,
+		.count = options->count,
+		.latencies = g_array_new(FALSE, FALSE, sizeof (gint64)),
+		.errors = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL),
+	};
+
+	bench.start = g_get_monotonic_time();
+	bench.warmup_end = bench.start + (gint64) (options->warmup * G_USEC_PER_SEC);
+	bench.last_completion = bench.warmup_end;
+
+	if (options->duration > 0) {
+		bench.end = bench.warmup_end + (gint64) (options->duration * G_USEC_PER_SEC);
+	}
+
+	guint tick_id = bench.rate > 0
+		? g_timeout_add(BENCH_TICK_MS, bench_tick, &bench)
+		: 0;
+
+	guint sigint_id = g_unix_signal_add(SIGINT, bench_interrupt, &bench);
+
+	bench_fill(&bench);
+	g_main_loop_run(bench.loop);
+
+	if (tick_id != 0) g_source_remove(tick_id);
+	g_source_remove(sigint_id);
+
+	gdouble seconds = MAX(bench.last_completion - bench.warmup_end, 0) / (gdouble) G_USEC_PER_SEC;
+	g_array_sort(bench.latencies, bench_compare_int64);
+
+	if (options->json) {
+		bench_print_json(&bench, seconds);
+	} else {
+		bench_print_text(&bench, seconds);
+	}
+
+	gboolean ok = bench.latencies->len > 0;
+
+	g_hash_table_unref(bench.errors);
+	g_array_unref(bench.latencies);
+	g_main_loop_unref(bench.loop);
+
+	return ok;
+}
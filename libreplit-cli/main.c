@@ -37,25 +37,58 @@
 #include <replit.h>
 #include <stdlib.h>
 
-#define CLI_NAME "rquery"
-#define CLI_SUMM "A command-line tool for interacting with Replit."
+#include "rquery.h"
 
-void output_response(JsonNode* res);
+#define DEFAULT_CONCURRENCY 8
+#define DEFAULT_BENCH_DURATION 10
+
+static const gchar* const output_formats[] = { "compact", "pretty", "raw", NULL };
 
 gint main(gint argc, gchar* argv[]) {
 	gboolean version = FALSE;
 	gboolean subscribe = FALSE;
+	gboolean batch = FALSE;
+	gint concurrency = DEFAULT_CONCURRENCY;
+	gint64 count = 0;
+	gdouble duration = 0;
+	gboolean timestamps = FALSE;
+	gboolean bench = FALSE;
+	gdouble rate = 0;
+	gdouble warmup = 0;
+	gboolean json = FALSE;
+	const gchar* serve = NULL;
+	gdouble cache_ttl = 0;
+	const gchar* disk_cache_path = NULL;
+	const gchar* cookie_file = NULL;
+	const gchar* base_uri = NULL;
+	const gchar* output = NULL;
 	const gchar* variables = NULL;
 	const gchar* token = NULL;
+	const gchar** tokens = NULL;
 	const gchar* query_file = NULL;
 	const gchar** query_strings = NULL;
 
 	GOptionEntry main_entries[] = {
 		{ "version", 'v', 0, G_OPTION_ARG_NONE, &version, "Show program version" },
 		{ "subscribe", 's', 0, G_OPTION_ARG_NONE, &subscribe, "Create subscription" },
-		{ "token", 't', 0, G_OPTION_ARG_STRING, &token, "Set connect.sid cookie" },
+		{ "token", 't', 0, G_OPTION_ARG_STRING_ARRAY, &tokens, "Set connect.sid cookie, repeatable with --serve" },
 		{ "variables", 'r', 0, G_OPTION_ARG_STRING, &variables, "Include variables" },
 		{ "query", 'f', 0, G_OPTION_ARG_FILENAME, &query_file, "Read query from file" },
+		{ "batch", 'b', 0, G_OPTION_ARG_NONE, &batch, "Read NDJSON requests from stdin" },
+		{ "concurrency", 'c', 0, G_OPTION_ARG_INT, &concurrency, "Requests in flight in batch mode", "N" },
+		{ "count", 'n', 0, G_OPTION_ARG_INT64, &count, "Stop after N events", "N" },
+		{ "duration", 'd', 0, G_OPTION_ARG_DOUBLE, &duration, "Stop after SECS seconds", "SECS" },
+		{ "timestamps", 'T', 0, G_OPTION_ARG_NONE, &timestamps, "Add monotonic timestamps to events" },
+		{ "bench", 'B', 0, G_OPTION_ARG_NONE, &bench, "Send query repeatedly and report latency" },
+		{ "rate", 'R', 0, G_OPTION_ARG_DOUBLE, &rate, "Send N requests per second when benchmarking", "N" },
+		{ "warmup", 'w', 0, G_OPTION_ARG_DOUBLE, &warmup, "Exclude the first SECS seconds of a benchmark", "SECS" },
+		{ "json", 'J', 0, G_OPTION_ARG_NONE, &json, "Print benchmark report as JSON" },
+		{ "serve", 'S', 0, G_OPTION_ARG_FILENAME, &serve, "Serve requests on a Unix socket", "PATH" },
+		{ "cache-ttl", 'C', 0, G_OPTION_ARG_DOUBLE, &cache_ttl, "Cache query results for SECS seconds", "SECS" },
+		{ "disk-cache", 'D', 0, G_OPTION_ARG_FILENAME, &disk_cache_path, "Cache query results in the file PATH", "PATH" },
+		{ "output", 'o', 0, G_OPTION_ARG_STRING, &output, "Print response as compact, pretty or raw", "FORMAT" },
+		{ "cookie-file", 'k', 0, G_OPTION_ARG_FILENAME, &cookie_file, "Keep cookies in the file PATH between runs", "PATH" },
+		{ "base-uri", 'u', 0, G_OPTION_ARG_STRING, &base_uri, "Send requests to URI instead of Replit", "URI" },
 		{ G_OPTION_REMAINING, 0, 0, G_OPTION_ARG_STRING_ARRAY, &query_strings },
 		{ NULL }
 	};
@@ -72,7 +105,7 @@ gint main(gint argc, gchar* argv[]) {
 	}
 
 	if (version) {
-		if (subscribe || variables || token || query_file || query_strings) {
+		if (subscribe || batch || bench || serve || variables || tokens || query_file || query_strings) {
 			g_printerr("%s\n", "Cannot specify --version with other options");
 			return EXIT_FAILURE;
 		}
@@ -81,7 +114,25 @@ gint main(gint argc, gchar* argv[]) {
 		return EXIT_SUCCESS;
 	}
 
-	if (token == NULL) {
+	if (tokens != NULL) {
+		token = tokens[0];
+
+		if (tokens[1] != NULL && serve == NULL) {
+			g_printerr("%s\n", "Cannot specify more than one --token without --serve");
+			return EXIT_FAILURE;
+		}
+
+		if (tokens[1] != NULL && cookie_file != NULL) {
+			g_printerr("%s\n", "Cannot specify more than one --token with --cookie-file");
+			return EXIT_FAILURE;
+		}
+
+		/* Results may depend on the token that asked, so are not shared. */
+		if (tokens[1] != NULL && serve != NULL && cache_ttl) {
+			g_printerr("%s\n", "Cannot specify more than one --token with --serve and --cache-ttl");
+			return EXIT_FAILURE;
+		}
+	} else {
 		do {
 			token = g_strdup(g_getenv("REPLIT_TOKEN"));
 			if (token != NULL) break;
@@ -89,11 +140,125 @@ gint main(gint argc, gchar* argv[]) {
 			token = g_strdup(g_getenv("CONNECT_SID"));
 			if (token != NULL) break;
 
+			if (cookie_file != NULL) break;
+
 			g_printerr("%s\n", "No token provided and no variable found");
 			return EXIT_FAILURE;
 		} while (0);
 	}
 
+	if (count < 0 || duration < 0 || rate < 0 || warmup < 0 || cache_ttl < 0) {
+		g_printerr("%s\n", "Count, duration, rate, warmup and cache TTL cannot be negative");
+		return EXIT_FAILURE;
+	}
+
+	if (subscribe + batch + bench + (serve != NULL) > 1) {
+		g_printerr("%s\n", "At most one of --subscribe, --batch, --bench and --serve may be specified");
+		return EXIT_FAILURE;
+	}
+
+	if (serve == NULL && disk_cache_path == NULL && cache_ttl) {
+		g_printerr("%s\n", "Cannot specify --cache-ttl without --serve or --disk-cache");
+		return EXIT_FAILURE;
+	}
+
+	if (disk_cache_path != NULL && (subscribe || (output != NULL && g_str_equal(output, "raw")))) {
+		g_printerr("%s\n", "Cannot specify --disk-cache with --subscribe or raw output");
+		return EXIT_FAILURE;
+	}
+
+	if (!subscribe && !bench && (count || duration)) {
+		g_printerr("%s\n", "Cannot specify --count or --duration without --subscribe or --bench");
+		return EXIT_FAILURE;
+	}
+
+	if (!subscribe && timestamps) {
+		g_printerr("%s\n", "Cannot specify --timestamps without --subscribe");
+		return EXIT_FAILURE;
+	}
+
+	if (!bench && (rate || warmup || json)) {
+		g_printerr("%s\n", "Cannot specify --rate, --warmup or --json without --bench");
+		return EXIT_FAILURE;
+	}
+
+	if (output != NULL) {
+		if (subscribe || batch || bench || serve) {
+			g_printerr("%s\n", "Cannot specify --output with --subscribe, --batch, --bench or --serve");
+			return EXIT_FAILURE;
+		}
+
+		if (!g_strv_contains(output_formats, output)) {
+			g_printerr("%s\n", "Output format must be compact, pretty or raw");
+			return EXIT_FAILURE;
+		}
+	} else {
+		output = "compact";
+	}
+
+	if (concurrency < 1) {
+		g_printerr("%s\n", "Concurrency must be at least 1");
+		return EXIT_FAILURE;
+	}
+
+	ReplitDiskCache* disk_cache = NULL;
+
+	if (disk_cache_path != NULL) {
+		disk_cache = replit_disk_cache_new(disk_cache_path, &error);
+
+		if (disk_cache == NULL) {
+			g_printerr("%s\n", error->message);
+			return EXIT_FAILURE;
+		}
+
+		if (cache_ttl) replit_disk_cache_set_ttl(disk_cache, cache_ttl);
+	}
+
+	if (batch) {
+		if (variables || query_file || query_strings) {
+			g_printerr("%s\n", "Cannot specify --batch with a query");
+			return EXIT_FAILURE;
+		}
+
+		ReplitClient* client = replit_client_new(token);
+		if (base_uri != NULL) replit_client_set_base_uri(client, base_uri);
+		replit_client_set_cookie_file(client, cookie_file);
+		replit_client_set_disk_cache(client, disk_cache);
+
+		gboolean ok = run_batch(client, concurrency);
+		g_object_unref(client);
+
+		return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	if (serve != NULL) {
+		if (variables || query_file || query_strings) {
+			g_printerr("%s\n", "Cannot specify --serve with a query");
+			return EXIT_FAILURE;
+		}
+
+		ReplitClientPool* pool = replit_client_pool_new();
+
+		if (tokens == NULL) replit_client_pool_add_token(pool, token, 1);
+
+		for (guint i = 0; tokens != NULL && tokens[i] != NULL; i++) {
+			replit_client_pool_add_token(pool, tokens[i], 1);
+		}
+
+		for (guint i = 0; i < replit_client_pool_get_size(pool); i++) {
+			ReplitClient* client = replit_client_pool_get_client(pool, i);
+
+			if (base_uri != NULL) replit_client_set_base_uri(client, base_uri);
+			replit_client_set_cookie_file(client, cookie_file);
+			replit_client_set_disk_cache(client, disk_cache);
+		}
+
+		gboolean ok = run_serve(pool, serve, cache_ttl);
+		g_object_unref(pool);
+
+		return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
 	gchar* query;
 
 	if (query_strings != NULL) {
@@ -123,43 +288,87 @@ gint main(gint argc, gchar* argv[]) {
 			return EXIT_FAILURE;
 		}
 
-		variables_json = json_parser_get_root(parser);
+		variables_json = json_node_copy(json_parser_get_root(parser));
+		g_object_unref(parser);
 	}
 
 	ReplitClient* client = replit_client_new(token);
+	if (base_uri != NULL) replit_client_set_base_uri(client, base_uri);
+	replit_client_set_cookie_file(client, cookie_file);
+	replit_client_set_disk_cache(client, disk_cache);
 
-	if (subscribe) {
-		//
+	if (bench) {
+		BenchOptions options = {
+			.concurrency = concurrency,
+			.rate = rate,
+			.count = count,
+			.duration = count == 0 && duration == 0 ? DEFAULT_BENCH_DURATION : duration,
+			.warmup = warmup,
+			.json = json,
+		};
+
+		gboolean ok = run_bench(client, query, variables_json, &options);
+
+		if (!ok) return EXIT_FAILURE;
+	} else if (subscribe) {
+		gboolean ok = run_subscribe(client, query, variables_json, count, duration, timestamps);
+
+		if (!ok) return EXIT_FAILURE;
+	} else if (g_str_equal(output, "raw")) {
+		if (!output_raw_response(client, query, variables_json)) return EXIT_FAILURE;
 	} else {
 		JsonNode* res = replit_client_query(client, query, variables_json, &error);
 
 		if (res == NULL) {
 			g_printerr("%s\n", error->message);
 			return EXIT_FAILURE;
-		} else {
-			output_response(res);
+		} else if (!output_response(res, g_str_equal(output, "pretty"))) {
+			return EXIT_FAILURE;
 		}
 	}
 
 	return EXIT_SUCCESS;
 }
 
-void output_response(JsonNode* res) {
+gboolean output_response(JsonNode* res, gboolean pretty) {
 	JsonGenerator* generator = json_generator_new();
 	json_generator_set_root(generator, res);
+	json_generator_set_pretty(generator, pretty);
+
+	GString* text = json_generator_to_gstring(generator, g_string_new(NULL));
+	g_string_append_c(text, '\n');
 
 	g_autoptr(GError) error = NULL;
 
 	GOutputStream* stdout = g_unix_output_stream_new(STDOUT_FILENO, FALSE);
-	gboolean ok = json_generator_to_stream(generator, stdout, NULL, &error);
+	gboolean ok = g_output_stream_write_all(stdout, text->str, text->len, NULL, NULL, &error);
 
 	g_object_unref(stdout);
 	g_object_unref(generator);
+	g_string_free(text, TRUE);
 
 	if (!ok) {
 		g_printerr("%s\n", error->message);
-		return;
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+/* Writes the response to a query to standard output exactly as it was
+ * received, without parsing it. */
+gboolean output_raw_response(ReplitClient* client, const gchar* query, JsonNode* variables) {
+	g_autoptr(GError) error = NULL;
+
+	GOutputStream* stdout = g_unix_output_stream_new(STDOUT_FILENO, FALSE);
+	gssize length = replit_client_query_to_stream(client, query, variables, stdout, &error);
+
+	g_object_unref(stdout);
+
+	if (length < 0) {
+		g_printerr("%s\n", error->message);
+		return FALSE;
 	}
 
-	g_print("\n");
+	return TRUE;
 }
@@ -0,0 +1,70 @@
+/* rquery.h
+ *
+ * Copyright 2022 Patrick Winters
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE X CONSORTIUM BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written
+ * authorization.
+ */
+
+#pragma once
+
+#include <glib.h>
+#include <json-glib/json-glib.h>
+#include <replit.h>
+
+#define CLI_NAME "rquery"
+#define CLI_SUMM "A command-line tool for interacting with Replit."
+
+gboolean output_response(JsonNode* res, gboolean pretty);
+
+gboolean output_raw_response(ReplitClient* client, const gchar* query, JsonNode* variables);
+
+gboolean run_batch(ReplitClient* client, guint concurrency);
+
+gboolean run_subscribe(
+	ReplitClient* client,
+	const gchar* query,
+	JsonNode* variables,
+	guint64 count,
+	gdouble duration,
+	gboolean timestamps
+);
+
+typedef struct {
+	guint concurrency;
+	gdouble rate;
+	guint64 count;
+	gdouble duration;
+	gdouble warmup;
+	gboolean json;
+} BenchOptions;
+
+gboolean run_bench(
+	ReplitClient* client,
+	const gchar* query,
+	JsonNode* variables,
+	const BenchOptions* options
+);
+
+gboolean run_serve(ReplitClientPool* pool, const gchar* path, gdouble cache_ttl);
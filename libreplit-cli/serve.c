@@ -0,0 +1,958 @@
+/* serve.c
+ *
+ * Copyright 2022 Patrick Winters
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE X CONSORTIUM BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written
+ * authorization.
+ */
+
+#include "replit-config.h"
+
+#include <gio/gio.h>
+#include <gio-unix-2.0/gio/gunixsocketaddress.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <glib-unix.h>
+#include <json-glib/json-glib.h>
+#include <replit.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "rquery.h"
+
+#define SERVE_CACHE_SIZE 4096
+
+/* Connections sending a longer line, or leaving more than this many bytes of
+ * answers unread, are dropped rather than buffered without limit. */
+#define SERVE_MAX_LINE_LENGTH (1024 * 1024)
+#define SERVE_MAX_QUEUED_BYTES (8 * 1024 * 1024)
+#define SERVE_READ_BUFFER_SIZE 4096
+
+/* Serve mode listens on a Unix socket and answers requests from any number of
+ * local processes, one JSON object per line, sharing one pool of upstream
+ * clients between them. Each request has a "type" of "query" (the default),
+ * "subscribe", "unsubscribe" or "stats", and an "id" which is echoed in every
+ * line written for it.
+ * 
+ * Queries are answered as in batch mode, with {"id": ..., "data": ...} or
+ * {"id": ..., "error": ...}. Identical queries in flight at the same time share
+ * one upstream request, and with a cache TTL their results are kept and
+ * reused for that long; mutations are never shared or cached. Subscriptions
+ * send {"id": ..., "data": ...} for every event until they are unsubscribed or
+ * their connection closes, and identical subscriptions share one upstream
+ * subscription. Stats are answered with {"id": ..., "stats": ...}.
+ * 
+ * Answers may depend on the token that asked for them, and the pool only picks
+ * a member once a request is sent, so nothing is shared between requests when
+ * the pool has more than one member. */
+
+typedef struct {
+	guint64 requests;
+	guint64 cache_hits;
+	guint64 shared;
+	guint64 errors;
+	guint64 subscriptions;
+	guint64 events;
+} ServeStats;
+
+typedef struct {
+	ReplitClientPool* pool;
+	GSocketService* service;
+	GMainLoop* loop;
+	gint64 cache_ttl;
+	GHashTable* cache;
+	GHashTable* subscriptions;
+	GQueue connections;
+	guint64 next_connection;
+	gboolean shared;
+	ServeStats stats;
+} Server;
+
+typedef struct {
+	Server* server;
+	guint64 id;
+	guint refs;
+	GSocketConnection* connection;
+	GBufferedInputStream* input;
+	GOutputStream* output;
+	GCancellable* cancellable;
+	GQueue writes;
+	gsize queued_bytes;
+	gboolean writing;
+	gboolean dropping;
+	gboolean closed;
+	GPtrArray* watchers;
+	ServeStats stats;
+} ServeConnection;
+
+/* A connection waiting for the result of a query, with its serialised ID. */
+typedef struct {
+	ServeConnection* connection;
+	gchar* id;
+} ServeWaiter;
+
+/* A query result in the cache, or a query in flight if it has no data yet. */
+typedef struct {
+	gchar* data;
+	gint64 expires;
+	GPtrArray* waiters;
+} ServeCacheEntry;
+
+typedef struct {
+	Server* server;
+	gchar* key;
+	ReplitSubscriber* subscriber;
+	guint upstream_id;
+	GPtrArray* watchers;
+} ServeSubscription;
+
+/* A connection's interest in a shared subscription. */
+typedef struct {
+	ServeConnection* connection;
+	ServeSubscription* subscription;
+	gchar* id;
+} ServeWatcher;
+
+typedef struct {
+	Server* server;
+	gchar* key;
+	ServeWaiter* waiter;
+} ServeQuery;
+
+static void serve_read_next(ServeConnection* connection);
+
+static ServeConnection* serve_connection_ref(ServeConnection* connection) {
+	connection->refs++;
+
+	return connection;
+}
+
+static void serve_connection_unref(ServeConnection* connection) {
+	if (--connection->refs > 0) return;
+
+	g_queue_clear_full(&connection->writes, (GDestroyNotify) g_bytes_unref);
+	g_ptr_array_unref(connection->watchers);
+	g_object_unref(connection->cancellable);
+	g_object_unref(connection->input);
+	g_object_unref(connection->connection);
+	g_free(connection);
+}
+
+static ServeWaiter* serve_waiter_new(ServeConnection* connection, const gchar* id) {
+	ServeWaiter* waiter = g_new0(ServeWaiter, 1);
+	waiter->connection = serve_connection_ref(connection);
+	waiter->id = g_strdup(id);
+
+	return waiter;
+}
+
+static void serve_waiter_free(ServeWaiter* waiter) {
+	serve_connection_unref(waiter->connection);
+	g_free(waiter->id);
+	g_free(waiter);
+}
+
+static void serve_cache_entry_free(ServeCacheEntry* entry) {
+	g_free(entry->data);
+	g_ptr_array_unref(entry->waiters);
+	g_free(entry);
+}
+
+static void serve_subscription_free(ServeSubscription* subscription) {
+	replit_subscriber_unsubscribe(subscription->subscriber, subscription->upstream_id);
+
+	g_object_unref(subscription->subscriber);
+	g_ptr_array_unref(subscription->watchers);
+	g_free(subscription->key);
+	g_free(subscription);
+}
+
+/* Returns the key identifying a request by its query and variables. */
+static gchar* serve_key(const gchar* query, JsonNode* variables) {
+	gchar* variables_text = variables != NULL ? json_to_string(variables, FALSE) : NULL;
+	gchar* key = g_strconcat(query, "\n", variables_text != NULL ? variables_text : "null", NULL);
+
+	g_free(variables_text);
+
+	return key;
+}
+
+static void serve_write_ready(GObject* source, GAsyncResult* res, gpointer user_data);
+
+static void serve_connection_close(ServeConnection* connection);
+
+static gboolean serve_connection_drop(gpointer user_data) {
+	ServeConnection* connection = user_data;
+
+	serve_connection_close(connection);
+
+	return G_SOURCE_REMOVE;
+}
+
+/* Writes a line to a connection once the lines before it have been written,
+ * taking ownership of it. Lines for a closed connection are dropped, and a
+ * connection which has fallen too far behind is closed, from an idle callback
+ * as the caller may be iterating over connections. */
+static void serve_connection_write(ServeConnection* connection, GString* line) {
+	if (connection->closed || connection->dropping) {
+		g_string_free(line, TRUE);
+		return;
+	}
+
+	if (connection->queued_bytes + line->len > SERVE_MAX_QUEUED_BYTES) {
+		g_string_free(line, TRUE);
+
+		connection->dropping = TRUE;
+		g_idle_add_full(
+			G_PRIORITY_DEFAULT,
+			serve_connection_drop,
+			serve_connection_ref(connection),
+			(GDestroyNotify) serve_connection_unref
+		);
+
+		return;
+	}
+
+	connection->queued_bytes += line->len;
+	g_queue_push_tail(&connection->writes, g_string_free_to_bytes(line));
+
+	if (connection->writing) return;
+
+	GBytes* bytes = g_queue_peek_head(&connection->writes);
+	connection->writing = TRUE;
+
+	g_output_stream_write_all_async(
+		connection->output,
+		g_bytes_get_data(bytes, NULL),
+		g_bytes_get_size(bytes),
+		G_PRIORITY_DEFAULT,
+		connection->cancellable,
+		serve_write_ready,
+		serve_connection_ref(connection)
+	);
+}
+
+/* Writes a result line, from a serialised ID and either serialised data or an
+ * error message. */
+static void serve_write_result(
+	ServeConnection* connection,
+	const gchar* id,
+	const gchar* data,
+	const gchar* message
+) {
+	GString* line = g_string_new("{\"id\":");
+	g_string_append(line, id);
+
+	if (data != NULL) {
+		g_string_append(line, ",\"data\":");
+		g_string_append(line, data);
+	} else {
+		JsonNode* message_node = json_node_init_string(json_node_alloc(), message);
+		gchar* message_text = json_to_string(message_node, FALSE);
+
+		g_string_append(line, ",\"error\":");
+		g_string_append(line, message_text);
+
+		g_free(message_text);
+		json_node_unref(message_node);
+
+		connection->stats.errors++;
+		connection->server->stats.errors++;
+	}
+
+	g_string_append(line, "}\n");
+
+	serve_connection_write(connection, line);
+}
+
+static void serve_watcher_free(ServeWatcher* watcher) {
+	g_free(watcher->id);
+	g_free(watcher);
+}
+
+/* Detaches a connection from a subscription, ending the upstream subscription
+ * once nobody is watching it. */
+static void serve_watcher_remove(ServeWatcher* watcher) {
+	ServeSubscription* subscription = watcher->subscription;
+
+	g_ptr_array_remove_fast(subscription->watchers, watcher);
+	g_ptr_array_remove_fast(watcher->connection->watchers, watcher);
+
+	if (subscription->watchers->len == 0) {
+		g_hash_table_remove(subscription->server->subscriptions, subscription->key);
+	}
+
+	serve_watcher_free(watcher);
+}
+
+static void serve_connection_close(ServeConnection* connection) {
+	if (connection->closed) return;
+
+	connection->closed = TRUE;
+	g_cancellable_cancel(connection->cancellable);
+
+	while (connection->watchers->len > 0) {
+		serve_watcher_remove(g_ptr_array_index(connection->watchers, 0));
+	}
+
+	g_io_stream_close(G_IO_STREAM (connection->connection), NULL, NULL);
+	g_queue_remove(&connection->server->connections, connection);
+
+	serve_connection_unref(connection);
+}
+
+static void serve_write_ready(GObject* source, GAsyncResult* res, gpointer user_data) {
+	ServeConnection* connection = user_data;
+
+	g_autoptr(GError) error = NULL;
+	gboolean ok = g_output_stream_write_all_finish(G_OUTPUT_STREAM (source), res, NULL, &error);
+	GBytes* written = g_queue_pop_head(&connection->writes);
+
+	connection->queued_bytes -= g_bytes_get_size(written);
+	connection->writing = FALSE;
+
+	g_bytes_unref(written);
+
+	if (!ok) {
+		serve_connection_close(connection);
+	} else if (!g_queue_is_empty(&connection->writes) && !connection->closed) {
+		GBytes* bytes = g_queue_peek_head(&connection->writes);
+		connection->writing = TRUE;
+
+		g_output_stream_write_all_async(
+			connection->output,
+			g_bytes_get_data(bytes, NULL),
+			g_bytes_get_size(bytes),
+			G_PRIORITY_DEFAULT,
+			connection->cancellable,
+			serve_write_ready,
+			serve_connection_ref(connection)
+		);
+	}
+
+	serve_connection_unref(connection);
+}
+
+static void serve_query_ready(GObject* source, GAsyncResult* res, gpointer user_data) {
+	ServeQuery* request = user_data;
+	Server* server = request->server;
+
+	g_autoptr(GError) error = NULL;
+	JsonNode* data = replit_client_pool_query_finish(REPLIT_CLIENT_POOL (source), res, &error);
+	gchar* data_text = data != NULL ? json_to_string(data, FALSE) : NULL;
+	const gchar* message = error != NULL ? error->message : NULL;
+
+	if (request->key == NULL) {
+		serve_write_result(request->waiter->connection, request->waiter->id, data_text, message);
+		serve_waiter_free(request->waiter);
+	} else {
+		ServeCacheEntry* entry = g_hash_table_lookup(server->cache, request->key);
+
+		for (guint i = 0; i < entry->waiters->len; i++) {
+			ServeWaiter* waiter = g_ptr_array_index(entry->waiters, i);
+
+			serve_write_result(waiter->connection, waiter->id, data_text, message);
+		}
+
+		g_ptr_array_set_size(entry->waiters, 0);
+
+		if (data_text != NULL && server->cache_ttl > 0) {
+			entry->data = g_strdup(data_text);
+			entry->expires = g_get_monotonic_time() + server->cache_ttl;
+		} else {
+			g_hash_table_remove(server->cache, request->key);
+		}
+	}
+
+	if (data != NULL) json_node_unref(data);
+	g_free(data_text);
+	g_free(request->key);
+	g_free(request);
+}
+
+static gboolean serve_cache_entry_expired(
+	gpointer key __attribute__((unused)),
+	gpointer value,
+	gpointer user_data
+) {
+	ServeCacheEntry* entry = value;
+	gint64* now = user_data;
+
+	return entry->data != NULL && entry->expires <= *now;
+}
+
+/* Answers a query from the cache, joins an identical query in flight, or sends
+ * it upstream. */
+static void serve_query(
+	ServeConnection* connection,
+	const gchar* id,
+	const gchar* query,
+	JsonNode* variables
+) {
+	Server* server = connection->server;
+	ServeQuery* request = g_new0(ServeQuery, 1);
+	request->server = server;
+
+	connection->stats.requests++;
+	server->stats.requests++;
+
+	if (server->shared && replit_graphql_is_query(query)) {
+		gint64 now = g_get_monotonic_time();
+		gchar* key = serve_key(query, variables);
+		ServeCacheEntry* entry = g_hash_table_lookup(server->cache, key);
+
+		if (entry != NULL && entry->data != NULL && entry->expires <= now) {
+			g_hash_table_remove(server->cache, key);
+			entry = NULL;
+		}
+
+		if (entry != NULL) {
+			if (entry->data != NULL) {
+				connection->stats.cache_hits++;
+				server->stats.cache_hits++;
+
+				serve_write_result(connection, id, entry->data, NULL);
+			} else {
+				connection->stats.shared++;
+				server->stats.shared++;
+
+				g_ptr_array_add(entry->waiters, serve_waiter_new(connection, id));
+			}
+
+			if (variables != NULL) json_node_unref(variables);
+			g_free(key);
+			g_free(request);
+
+			return;
+		}
+
+		if (g_hash_table_size(server->cache) >= SERVE_CACHE_SIZE) {
+			g_hash_table_foreach_remove(server->cache, serve_cache_entry_expired, &now);
+		}
+
+		if (g_hash_table_size(server->cache) < SERVE_CACHE_SIZE) {
+			entry = g_new0(ServeCacheEntry, 1);
+			entry->waiters = g_ptr_array_new_with_free_func((GDestroyNotify) serve_waiter_free);
+			g_ptr_array_add(entry->waiters, serve_waiter_new(connection, id));
+
+			g_hash_table_insert(server->cache, key, entry);
+			request->key = g_strdup(key);
+		} else {
+			g_free(key);
+		}
+	}
+
+	if (request->key == NULL) request->waiter = serve_waiter_new(connection, id);
+
+	replit_client_pool_query_async(
+		server->pool,
+		query,
+		variables,
+		REPLIT_REQUEST_PRIORITY_NORMAL,
+		0,
+		NULL,
+		serve_query_ready,
+		request
+	);
+}
+
+static void serve_subscription_on_data(
+	ReplitSubscriber* subscriber __attribute__((unused)),
+	guint id __attribute__((unused)),
+	JsonNode* data,
+	gpointer user_data
+) {
+	ServeSubscription* subscription = user_data;
+	gchar* data_text = json_to_string(data, FALSE);
+
+	for (guint i = 0; i < subscription->watchers->len; i++) {
+		ServeWatcher* watcher = g_ptr_array_index(subscription->watchers, i);
+
+		watcher->connection->stats.events++;
+		subscription->server->stats.events++;
+
+		serve_write_result(watcher->connection, watcher->id, data_text, NULL);
+	}
+
+	g_free(data_text);
+	json_node_unref(data);
+}
+
+/* Watches a subscription for a connection, subscribing upstream unless another
+ * connection already has the same subscription. */
+static void serve_subscribe(
+	ServeConnection* connection,
+	const gchar* id,
+	const gchar* query,
+	JsonNode* variables
+) {
+	Server* server = connection->server;
+	gchar* key = serve_key(query, variables);
+
+	if (!server->shared) {
+		gchar* unshared_key = g_strdup_printf("%" G_GUINT64_FORMAT "\n%s\n%s", connection->id, id, key);
+
+		g_free(key);
+		key = unshared_key;
+	}
+
+	ServeSubscription* subscription = g_hash_table_lookup(server->subscriptions, key);
+
+	connection->stats.subscriptions++;
+	server->stats.subscriptions++;
+
+	if (subscription == NULL) {
+		ReplitClient* client = replit_client_pool_choose(server->pool);
+
+		subscription = g_new0(ServeSubscription, 1);
+		subscription->server = server;
+		subscription->key = key;
+		subscription->subscriber = g_object_ref(replit_client_get_subscriber(client));
+		subscription->watchers = g_ptr_array_new();
+		subscription->upstream_id = replit_subscriber_subscribe(
+			subscription->subscriber,
+			query,
+			variables,
+			serve_subscription_on_data,
+			subscription
+		);
+
+		g_hash_table_insert(server->subscriptions, key, subscription);
+	} else {
+		connection->stats.shared++;
+		server->stats.shared++;
+
+		if (variables != NULL) json_node_unref(variables);
+		g_free(key);
+	}
+
+	ServeWatcher* watcher = g_new0(ServeWatcher, 1);
+	watcher->connection = connection;
+	watcher->subscription = subscription;
+	watcher->id = g_strdup(id);
+
+	g_ptr_array_add(subscription->watchers, watcher);
+	g_ptr_array_add(connection->watchers, watcher);
+}
+
+static void serve_unsubscribe(ServeConnection* connection, const gchar* id) {
+	for (guint i = 0; i < connection->watchers->len; i++) {
+		ServeWatcher* watcher = g_ptr_array_index(connection->watchers, i);
+
+		if (g_str_equal(watcher->id, id)) {
+			serve_watcher_remove(watcher);
+			return;
+		}
+	}
+
+	serve_write_result(connection, id, NULL, "No subscription with this ID");
+}
+
+static void serve_add_stats(JsonBuilder* builder, const ServeStats* stats) {
+	json_builder_set_member_name(builder, "requests");
+	json_builder_add_int_value(builder, stats->requests);
+	json_builder_set_member_name(builder, "cache_hits");
+	json_builder_add_int_value(builder, stats->cache_hits);
+	json_builder_set_member_name(builder, "shared");
+	json_builder_add_int_value(builder, stats->shared);
+	json_builder_set_member_name(builder, "errors");
+	json_builder_add_int_value(builder, stats->errors);
+	json_builder_set_member_name(builder, "subscriptions");
+	json_builder_add_int_value(builder, stats->subscriptions);
+	json_builder_set_member_name(builder, "events");
+	json_builder_add_int_value(builder, stats->events);
+}
+
+/* Answers with the counters of every connection, the totals for the server and
+ * the health of each upstream client. */
+static void serve_stats(ServeConnection* connection, const gchar* id) {
+	Server* server = connection->server;
+	JsonBuilder* builder = json_builder_new();
+	gint64 now = g_get_monotonic_time();
+
+	json_builder_begin_object(builder);
+	json_builder_set_member_name(builder, "connection");
+	json_builder_add_int_value(builder, connection->id);
+
+	json_builder_set_member_name(builder, "server");
+	json_builder_begin_object(builder);
+	serve_add_stats(builder, &server->stats);
+	json_builder_set_member_name(builder, "connections");
+	json_builder_add_int_value(builder, g_queue_get_length(&server->connections));
+	json_builder_set_member_name(builder, "cached");
+	json_builder_add_int_value(builder, g_hash_table_size(server->cache));
+	json_builder_set_member_name(builder, "upstream_subscriptions");
+	json_builder_add_int_value(builder, g_hash_table_size(server->subscriptions));
+	json_builder_end_object(builder);
+
+	json_builder_set_member_name(builder, "clients");
+	json_builder_begin_array(builder);
+
+	for (GList* link = server->connections.head; link != NULL; link = link->next) {
+		ServeConnection* client = link->data;
+
+		json_builder_begin_object(builder);
+		json_builder_set_member_name(builder, "connection");
+		json_builder_add_int_value(builder, client->id);
+		serve_add_stats(builder, &client->stats);
+		json_builder_set_member_name(builder, "watching");
+		json_builder_add_int_value(builder, client->watchers->len);
+		json_builder_end_object(builder);
+	}
+
+	json_builder_end_array(builder);
+
+	json_builder_set_member_name(builder, "upstream");
+	json_builder_begin_array(builder);
+
+	for (guint i = 0; i < replit_client_pool_get_size(server->pool); i++) {
+		ReplitPoolMemberStats stats;
+		replit_client_pool_get_member_stats(server->pool, i, &stats);
+
+		json_builder_begin_object(builder);
+		json_builder_set_member_name(builder, "weight");
+		json_builder_add_int_value(builder, stats.weight);
+		json_builder_set_member_name(builder, "outstanding");
+		json_builder_add_int_value(builder, stats.outstanding);
+		json_builder_set_member_name(builder, "ejected_for");
+		json_builder_add_double_value(
+			builder,
+			stats.ejected_until != 0 ? (gdouble) (stats.ejected_until - now) / G_USEC_PER_SEC : 0
+		);
+		json_builder_set_member_name(builder, "requests");
+		json_builder_add_int_value(builder, stats.requests);
+		json_builder_set_member_name(builder, "failures");
+		json_builder_add_int_value(builder, stats.failures);
+		json_builder_set_member_name(builder, "throttled");
+		json_builder_add_int_value(builder, stats.throttled);
+		json_builder_set_member_name(builder, "ejections");
+		json_builder_add_int_value(builder, stats.ejections);
+		json_builder_set_member_name(builder, "new_connections");
+		json_builder_add_int_value(builder, stats.client.new_connections);
+		json_builder_set_member_name(builder, "reused_connections");
+		json_builder_add_int_value(builder, stats.client.reused_connections);
+		json_builder_set_member_name(builder, "cache_hits");
+		json_builder_add_int_value(builder, stats.client.cache_hits);
+		json_builder_end_object(builder);
+	}
+
+	json_builder_end_array(builder);
+	json_builder_end_object(builder);
+
+	JsonNode* root = json_builder_get_root(builder);
+	gchar* stats_text = json_to_string(root, FALSE);
+
+	GString* line = g_string_new("{\"id\":");
+	g_string_append(line, id);
+	g_string_append(line, ",\"stats\":");
+	g_string_append(line, stats_text);
+	g_string_append(line, "}\n");
+
+	serve_connection_write(connection, line);
+
+	g_free(stats_text);
+	json_node_unref(root);
+	g_object_unref(builder);
+}
+
+/* Parses a line from a connection and handles the request it describes. */
+static void serve_handle(ServeConnection* connection, const gchar* line) {
+	g_autoptr(JsonParser) parser = json_parser_new();
+	g_autoptr(GError) error = NULL;
+
+	if (!json_parser_load_from_data(parser, line, -1, &error)) {
+		serve_write_result(connection, "null", NULL, error->message);
+		return;
+	}
+
+	JsonNode* root = json_parser_get_root(parser);
+
+	if (!JSON_NODE_HOLDS_OBJECT (root)) {
+		serve_write_result(connection, "null", NULL, "Expected an object");
+		return;
+	}
+
+	JsonObject* object = json_node_get_object(root);
+	JsonNode* id_node = json_object_get_member(object, "id");
+	JsonNode* query = json_object_get_member(object, "query");
+	JsonNode* variables = json_object_get_member(object, "variables");
+	JsonNode* type_node = json_object_get_member(object, "type");
+	const gchar* type = "query";
+
+	/* Anything but a string is an unknown type, rather than a NULL one. */
+	if (type_node != NULL && !JSON_NODE_HOLDS_NULL (type_node)) {
+		type = JSON_NODE_HOLDS_VALUE (type_node) && json_node_get_value_type(type_node) == G_TYPE_STRING
+			? json_node_get_string(type_node)
+			: "";
+	}
+
+	gchar* id = id_node != NULL ? json_to_string(id_node, FALSE) : g_strdup("null");
+
+	if (variables != NULL && JSON_NODE_HOLDS_NULL (variables)) variables = NULL;
+
+	if (g_str_equal(type, "stats")) {
+		serve_stats(connection, id);
+	} else if (g_str_equal(type, "unsubscribe")) {
+		serve_unsubscribe(connection, id);
+	} else if (!g_str_equal(type, "query") && !g_str_equal(type, "subscribe")) {
+		serve_write_result(connection, id, NULL, "Unknown request type");
+	} else if (
+		query == NULL ||
+		!JSON_NODE_HOLDS_VALUE (query) ||
+		json_node_get_value_type(query) != G_TYPE_STRING
+	) {
+		serve_write_result(connection, id, NULL, "Expected a string \"query\" member");
+	} else if (g_str_equal(type, "subscribe")) {
+		serve_subscribe(
+			connection,
+			id,
+			json_node_get_string(query),
+			variables != NULL ? json_node_copy(variables) : NULL
+		);
+	} else {
+		serve_query(
+			connection,
+			id,
+			json_node_get_string(query),
+			variables != NULL ? json_node_copy(variables) : NULL
+		);
+	}
+
+	g_free(id);
+}
+
+/* Handles the complete lines in the read buffer, closing the connection on a
+ * line which is not UTF-8. Returns FALSE once the connection is closed. */
+static gboolean serve_read_lines(ServeConnection* connection, gboolean eof) {
+	while (!connection->closed) {
+		gsize available;
+		const gchar* buffer = g_buffered_input_stream_peek_buffer(connection->input, &available);
+		const gchar* end = memchr(buffer, '\n', available);
+
+		if (end == NULL && (!eof || available == 0)) return TRUE;
+
+		gsize length = end != NULL ? (gsize) (end - buffer) : available;
+
+		if (!g_utf8_validate(buffer, length, NULL)) {
+			serve_connection_close(connection);
+
+			return FALSE;
+		}
+
+		gchar* line = g_strndup(buffer, length);
+
+		g_input_stream_skip(
+			G_INPUT_STREAM (connection->input),
+			end != NULL ? length + 1 : length,
+			NULL,
+			NULL
+		);
+
+		if (*g_strstrip(line) != '\0') serve_handle(connection, line);
+
+		g_free(line);
+	}
+
+	return FALSE;
+}
+
+static void serve_read_ready(GObject* source, GAsyncResult* res, gpointer user_data) {
+	ServeConnection* connection = user_data;
+
+	gssize read = g_buffered_input_stream_fill_finish(
+		G_BUFFERED_INPUT_STREAM (source),
+		res,
+		NULL
+	);
+
+	if (read < 0) {
+		serve_connection_close(connection);
+	} else if (serve_read_lines(connection, read == 0)) {
+		if (read == 0) {
+			serve_connection_close(connection);
+		} else {
+			serve_read_next(connection);
+		}
+	}
+
+	serve_connection_unref(connection);
+}
+
+/* Reads until the buffer holds a complete line, growing the buffer for long
+ * lines up to SERVE_MAX_LINE_LENGTH and closing the connection beyond that. */
+static void serve_read_next(ServeConnection* connection) {
+	gsize size = g_buffered_input_stream_get_buffer_size(connection->input);
+
+	if (g_buffered_input_stream_get_available(connection->input) == size) {
+		if (size > SERVE_MAX_LINE_LENGTH) {
+			serve_connection_close(connection);
+			return;
+		}
+
+		g_buffered_input_stream_set_buffer_size(
+			connection->input,
+			MIN (size * 2, SERVE_MAX_LINE_LENGTH + 1)
+		);
+	}
+
+	g_buffered_input_stream_fill_async(
+		connection->input,
+		-1,
+		G_PRIORITY_DEFAULT,
+		connection->cancellable,
+		serve_read_ready,
+		serve_connection_ref(connection)
+	);
+}
+
+static gboolean serve_incoming(
+	GSocketService* service __attribute__((unused)),
+	GSocketConnection* socket_connection,
+	GObject* source_object __attribute__((unused)),
+	gpointer user_data
+) {
+	Server* server = user_data;
+
+	ServeConnection* connection = g_new0(ServeConnection, 1);
+	connection->server = server;
+	connection->id = ++server->next_connection;
+	connection->refs = 1;
+	connection->connection = g_object_ref(socket_connection);
+	connection->input = G_BUFFERED_INPUT_STREAM (g_buffered_input_stream_new_sized(
+		g_io_stream_get_input_stream(G_IO_STREAM (socket_connection)),
+		SERVE_READ_BUFFER_SIZE
+	));
+	connection->output = g_io_stream_get_output_stream(G_IO_STREAM (socket_connection));
+	connection->cancellable = g_cancellable_new();
+	connection->watchers = g_ptr_array_new();
+	g_queue_init(&connection->writes);
+
+	g_queue_push_tail(&server->connections, connection);
+
+	serve_read_next(connection);
+
+	return TRUE;
+}
+
+static gboolean serve_stop(gpointer user_data) {
+	Server* server = user_data;
+	g_main_loop_quit(server->loop);
+
+	return G_SOURCE_CONTINUE;
+}
+
+/* Removes a socket left behind by a server which did not exit cleanly, but
+ * nothing else that may be at the path. */
+static void serve_remove_stale_socket(const gchar* path) {
+	GStatBuf buf;
+
+	if (g_lstat(path, &buf) == 0 && S_ISSOCK (buf.st_mode)) g_unlink(path);
+}
+
+gboolean run_serve(ReplitClientPool* pool, const gchar* path, gdouble cache_ttl) {
+	g_autoptr(GError) error = NULL;
+
+	Server server = {
+		.pool = pool,
+		.shared = replit_client_pool_get_size(pool) == 1,
+		.service = g_socket_service_new(),
+		.loop = g_main_loop_new(NULL, FALSE),
+		.cache_ttl = (gint64) (cache_ttl * G_USEC_PER_SEC),
+		.cache = g_hash_table_new_full(
+			g_str_hash,
+			g_str_equal,
+			g_free,
+			(GDestroyNotify) serve_cache_entry_free
+		),
+		.subscriptions = g_hash_table_new_full(
+			g_str_hash,
+			g_str_equal,
+			NULL,
+			(GDestroyNotify) serve_subscription_free
+		),
+	};
+
+	g_queue_init(&server.connections);
+
+	serve_remove_stale_socket(path);
+
+	/* Anyone who can connect can make requests with the pool's tokens, so the
+	 * socket is created accessible to its owner only. */
+	GSocketAddress* address = g_unix_socket_address_new(path);
+	mode_t mask = umask(S_IRWXG | S_IRWXO);
+	gboolean ok = g_socket_listener_add_address(
+		G_SOCKET_LISTENER (server.service),
+		address,
+		G_SOCKET_TYPE_STREAM,
+		G_SOCKET_PROTOCOL_DEFAULT,
+		NULL,
+		NULL,
+		&error
+	);
+
+	umask(mask);
+	g_object_unref(address);
+
+	if (ok && g_chmod(path, S_IRUSR | S_IWUSR) != 0) {
+		g_set_error(
+			&error,
+			G_IO_ERROR,
+			G_IO_ERROR_PERMISSION_DENIED,
+			"Cannot restrict access to %s",
+			path
+		);
+		ok = FALSE;
+	}
+
+	if (ok) {
+		g_signal_connect(server.service, "incoming", G_CALLBACK (serve_incoming), &server);
+		g_socket_service_start(server.service);
+
+		guint sigint_id = g_unix_signal_add(SIGINT, serve_stop, &server);
+		guint sigterm_id = g_unix_signal_add(SIGTERM, serve_stop, &server);
+
+		g_main_loop_run(server.loop);
+
+		g_source_remove(sigint_id);
+		g_source_remove(sigterm_id);
+
+		g_socket_service_stop(server.service);
+		g_socket_listener_close(G_SOCKET_LISTENER (server.service));
+		g_unlink(path);
+	} else {
+		g_printerr("%s\n", error->message);
+	}
+
+	while (!g_queue_is_empty(&server.connections)) {
+		serve_connection_close(g_queue_peek_head(&server.connections));
+	}
+
+	g_hash_table_unref(server.subscriptions);
+	g_hash_table_unref(server.cache);
+	g_main_loop_unref(server.loop);
+	g_object_unref(server.service);
+
+	return ok;
+}
@@ -0,0 +1,156 @@
+/* subscribe.c
+ *
+ * Copyright 2022 Patrick Winters
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE X CONSORTIUM BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written
+ * authorization.
+ */
+
+#include "replit-config.h"
+
+#include <gio/gio.h>
+#include <gio-unix-2.0/gio/gunixoutputstream.h>
+#include <glib.h>
+#include <glib-unix.h>
+#include <json-glib/json-glib.h>
+#include <replit.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include "rquery.h"
+
+/* Subscribe mode writes each event as one line of compact JSON, unbuffered so
+ * that a reader sees it as soon as it is received. With timestamps, each event
+ * is wrapped as {"time": ..., "data": ...}, where the time is taken from the
+ * monotonic clock in microseconds when the event is dispatched, before it is
+ * serialised. */
+
+typedef struct {
+	GOutputStream* output;
+	GMainLoop* loop;
+	guint64 count;
+	guint64 received;
+	gboolean timestamps;
+	gboolean ok;
+} Subscription;
+
+static void subscription_on_data(
+	ReplitSubscriber* subscriber __attribute__((unused)),
+	guint id __attribute__((unused)),
+	JsonNode* data,
+	gpointer user_data
+) {
+	gint64 time = g_get_monotonic_time();
+	Subscription* subscription = user_data;
+
+	if (subscription->count != 0 && subscription->received >= subscription->count) {
+		json_node_unref(data);
+		return;
+	}
+
+	GString* line = g_string_new(NULL);
+
+	if (subscription->timestamps) {
+		g_string_append_printf(line, "{\"time\":%" G_GINT64_FORMAT ",\"data\":", time);
+	}
+
+	JsonGenerator* generator = json_generator_new();
+	json_generator_set_root(generator, data);
+	json_generator_to_gstring(generator, line);
+
+	if (subscription->timestamps) g_string_append_c(line, '}');
+	g_string_append_c(line, '\n');
+
+	g_autoptr(GError) error = NULL;
+
+	if (!g_output_stream_write_all(subscription->output, line->str, line->len, NULL, NULL, &error)) {
+		g_printerr("%s\n", error->message);
+
+		subscription->ok = FALSE;
+		g_main_loop_quit(subscription->loop);
+	}
+
+	g_string_free(line, TRUE);
+	g_object_unref(generator);
+	json_node_unref(data);
+
+	subscription->received++;
+
+	if (subscription->count != 0 && subscription->received >= subscription->count) {
+		g_main_loop_quit(subscription->loop);
+	}
+}
+
+static gboolean subscription_stop(gpointer user_data) {
+	Subscription* subscription = user_data;
+	g_main_loop_quit(subscription->loop);
+
+	return G_SOURCE_CONTINUE;
+}
+
+gboolean run_subscribe(
+	ReplitClient* client,
+	const gchar* query,
+	JsonNode* variables,
+	guint64 count,
+	gdouble duration,
+	gboolean timestamps
+) {
+	Subscription subscription = {
+		.output = g_unix_output_stream_new(STDOUT_FILENO, FALSE),
+		.loop = g_main_loop_new(NULL, FALSE),
+		.count = count,
+		.timestamps = timestamps,
+		.ok = TRUE,
+	};
+
+	ReplitSubscriber* subscriber = replit_client_get_subscriber(client);
+	guint id = replit_subscriber_subscribe(
+		subscriber,
+		query,
+		variables,
+		subscription_on_data,
+		&subscription
+	);
+
+	guint timeout_id = duration > 0
+		? g_timeout_add((guint) (duration * 1000), subscription_stop, &subscription)
+		: 0;
+
+	guint sigint_id = g_unix_signal_add(SIGINT, subscription_stop, &subscription);
+	guint sigterm_id = g_unix_signal_add(SIGTERM, subscription_stop, &subscription);
+
+	g_main_loop_run(subscription.loop);
+
+	replit_subscriber_unsubscribe(subscriber, id);
+
+	if (timeout_id != 0) g_source_remove(timeout_id);
+	g_source_remove(sigint_id);
+	g_source_remove(sigterm_id);
+
+	g_main_loop_unref(subscription.loop);
+	g_object_unref(subscription.output);
+
+	return subscription.ok;
+}
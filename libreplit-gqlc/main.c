@@ -0,0 +1,252 @@
+/* main.c
+ *
+ * Copyright 2022 Patrick Winters
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE X CONSORTIUM BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written
+ * authorization.
+ */
+
+#include "replit-config.h"
+
+#include <gio/gio.h>
+#include <glib.h>
+#include <json-glib/json-glib.h>
+#include <replit.h>
+#include <stdlib.h>
+
+#define CLI_NAME "replit-gqlc"
+#define CLI_SUMM "Compiles GraphQL documents into prepared libreplit queries."
+#define LINE_WIDTH 64
+
+static gchar* constant_name(const gchar* prefix, const gchar* filename);
+static void append_literal(GString* out, const gchar* data, gsize length);
+static gboolean compile_document(
+	GString* out,
+	const gchar* prefix,
+	const gchar* filename,
+	GError** error
+);
+
+gint main(gint argc, gchar* argv[]) {
+	gboolean version = FALSE;
+	g_autofree gchar* output = NULL;
+	g_autofree gchar* prefix = NULL;
+	g_auto(GStrv) filenames = NULL;
+
+	GOptionEntry main_entries[] = {
+		{ "version", 'v', 0, G_OPTION_ARG_NONE, &version, "Show program version" },
+		{ "output", 'o', 0, G_OPTION_ARG_FILENAME, &output, "Write header to file" },
+		{ "prefix", 'p', 0, G_OPTION_ARG_STRING, &prefix, "Prefix constant names" },
+		{ G_OPTION_REMAINING, 0, 0, G_OPTION_ARG_FILENAME_ARRAY, &filenames },
+		{ NULL }
+	};
+
+	g_autoptr(GOptionContext) context = g_option_context_new("FILE…");
+	g_option_context_add_main_entries(context, main_entries, NULL);
+	g_option_context_set_summary(context, CLI_SUMM);
+
+	g_autoptr(GError) error = NULL;
+
+	if (!g_option_context_parse(context, &argc, &argv, &error)) {
+		g_printerr("%s\n", error->message);
+		return EXIT_FAILURE;
+	}
+
+	if (version) {
+		g_printerr("%s %s\n", CLI_NAME, PACKAGE_VERSION);
+		return EXIT_SUCCESS;
+	}
+
+	if (filenames == NULL) {
+		g_printerr("%s\n", "At least one file must be specified");
+		return EXIT_FAILURE;
+	}
+
+	g_autoptr(GString) out = g_string_new("");
+	g_string_append(out, "/* Generated by " CLI_NAME " " PACKAGE_VERSION ". Do not edit. */\n\n");
+	g_string_append(out, "#pragma once\n\n");
+	g_string_append(out, "#include <replit.h>\n");
+
+	for (guint i = 0; filenames[i] != NULL; i++) {
+		if (!compile_document(out, prefix != NULL ? prefix : "replit_query_", filenames[i], &error)) {
+			g_printerr("%s: %s\n", filenames[i], error->message);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (output == NULL) {
+		g_print("%s", out->str);
+	} else if (!g_file_set_contents(output, out->str, out->len, &error)) {
+		g_printerr("%s\n", error->message);
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+static gchar* constant_name(const gchar* prefix, const gchar* filename) {
+	gchar* basename = g_path_get_basename(filename);
+	gchar* extension = strrchr(basename, '.');
+
+	if (extension != NULL && extension != basename) *extension = '\0';
+
+	GString* name = g_string_new(prefix);
+
+	for (const gchar* c = basename; *c != '\0'; c++) {
+		g_string_append_c(name, g_ascii_isalnum(*c) ? g_ascii_tolower(*c) : '_');
+	}
+
+	g_free(basename);
+
+	return g_string_free(name, FALSE);
+}
+
+/* Appends data as one or more adjacent C string literals. Octal escapes are
+ * always three digits long, so splitting between literals is always safe. */
+static void append_literal(GString* out, const gchar* data, gsize length) {
+	g_string_append(out, "\n\t\t\"");
+
+	for (gsize i = 0; i < length; i++) {
+		guchar c = data[i];
+
+		if (i > 0 && i % LINE_WIDTH == 0) g_string_append(out, "\"\n\t\t\"");
+
+		switch (c) {
+			case '"':
+				g_string_append(out, "\\\"");
+				break;
+
+			case '\\':
+				g_string_append(out, "\\\\");
+				break;
+
+			case '\n':
+				g_string_append(out, "\\n");
+				break;
+
+			default:
+				if (c < 0x20 || c >= 0x7F) {
+					g_string_append_printf(out, "\\%03o", c);
+				} else {
+					g_string_append_c(out, c);
+				}
+
+				break;
+		}
+	}
+
+	g_string_append_c(out, '"');
+}
+
+static gboolean compile_document(
+	GString* out,
+	const gchar* prefix,
+	const gchar* filename,
+	GError** error
+) {
+	gchar* source;
+
+	if (!g_file_get_contents(filename, &source, NULL, error)) return FALSE;
+
+	gchar* document = replit_graphql_minify(source, error);
+
+	if (document == NULL) {
+		g_free(source);
+
+		return FALSE;
+	}
+
+	/* The minified document has already been tokenised successfully. */
+	gchar* operation_name = replit_graphql_get_operation_name(document, NULL);
+
+	g_free(source);
+
+	if (*document == '\0') {
+		g_set_error_literal(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "Document is empty");
+
+		g_free(document);
+
+		return FALSE;
+	}
+
+	gchar* hash = g_compute_checksum_for_string(G_CHECKSUM_SHA256, document, -1);
+
+	JsonBuilder* builder = json_builder_new();
+	json_builder_begin_object(builder);
+	json_builder_set_member_name(builder, "operationName");
+
+	if (operation_name != NULL) {
+		json_builder_add_string_value(builder, operation_name);
+	} else {
+		json_builder_add_null_value(builder);
+	}
+
+	json_builder_set_member_name(builder, "query");
+	json_builder_add_string_value(builder, document);
+	json_builder_end_object(builder);
+
+	JsonGenerator* generator = json_generator_new();
+	JsonNode* builder_root = json_builder_get_root(builder);
+	json_generator_set_root(generator, builder_root);
+
+	gsize envelope_length;
+	gchar* envelope = json_generator_to_data(generator, &envelope_length);
+
+	json_node_unref(builder_root);
+	g_object_unref(builder);
+	g_object_unref(generator);
+
+	/* The closing brace is added at runtime, after the variables. */
+	envelope_length--;
+
+	gchar* name = constant_name(prefix, filename);
+	gchar* basename = g_path_get_basename(filename);
+
+	g_string_append_printf(out, "\n/* %s */\n", basename);
+	g_string_append_printf(out, "static const ReplitPreparedQuery %s = {\n", name);
+	g_string_append(out, "\t.operation_name =");
+
+	if (operation_name != NULL) {
+		append_literal(out, operation_name, strlen(operation_name));
+	} else {
+		g_string_append(out, " NULL");
+	}
+
+	g_string_append(out, ",\n\t.document =");
+	append_literal(out, document, strlen(document));
+	g_string_append(out, ",\n\t.envelope =");
+	append_literal(out, envelope, envelope_length);
+	g_string_append_printf(out, ",\n\t.envelope_length = %" G_GSIZE_FORMAT ",\n", envelope_length);
+	g_string_append_printf(out, "\t.hash = \"%s\",\n", hash);
+	g_string_append(out, "};\n");
+
+	g_free(basename);
+	g_free(name);
+	g_free(envelope);
+	g_free(hash);
+	g_free(operation_name);
+	g_free(document);
+
+	return TRUE;
+}
@@ -0,0 +1,688 @@
+/* replit-client-pool.c
+ *
+ * Copyright 2022 Patrick Winters
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE X CONSORTIUM BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written
+ * authorization.
+ */
+
+#include <libsoup/soup.h>
+
+#include "replit-client-pool.h"
+
+#define DEFAULT_EJECTION_TIME 30.0
+#define MAX_EJECTION_SHIFT 4
+
+/**
+ * ReplitClientPool:
+ * 
+ * Spreads queries across several clients, each logged in with its own token.
+ * 
+ * Replit limits the requests each account may make, so a single #ReplitClient
+ * can only go so fast. A #ReplitClientPool holds any number of clients, added
+ * with [method@ClientPool.add_token] or [method@ClientPool.add_client], and
+ * sends each query through one of them, chosen by its [enum@PoolStrategy] and
+ * the weight each member was added with.
+ * 
+ * The pool watches the outcome of every request its members make. A member
+ * whose token is refused, or which the server throttles, is ejected: it is
+ * passed over for [property@ClientPool:ejection-time], doubled for each
+ * ejection in a row, before being tried again. If every member is ejected, the
+ * one due back soonest is used rather than failing.
+ * 
+ * Like a client, a pool may be shared by threads making queries once all of
+ * its members have been added, and asynchronous queries are answered in the
+ * thread-default main context of the caller.
+ */
+
+typedef struct _ReplitPoolMember ReplitPoolMember;
+
+struct _ReplitClientPool {
+	GObject parent_instance;
+
+	GPtrArray* members;
+	ReplitPoolStrategy strategy;
+	gdouble ejection_time;
+	guint cursor;
+};
+
+/* Members are reference counted, as queries in flight and the handler watching
+ * a member's client hold on to it, and may outlive the pool. The pool pointer
+ * is cleared when the pool is disposed. */
+struct _ReplitPoolMember {
+	ReplitClientPool* pool;
+	ReplitClient* client;
+	gulong finished_id;
+	guint weight;
+	gint64 current_weight;
+	guint outstanding;
+	gint64 ejected_until;
+	guint consecutive_ejections;
+	guint64 requests;
+	guint64 failures;
+	guint64 auth_failures;
+	guint64 throttled;
+	guint64 ejections;
+};
+
+/* Guards the health and counters of every member, and the state used to pick
+ * them, as clients report the outcome of synchronous requests from the threads
+ * that made them. It is static rather than per pool because a member's handler
+ * may run while its pool is being disposed. */
+G_LOCK_DEFINE_STATIC (members);
+
+G_DEFINE_TYPE (ReplitClientPool, replit_client_pool, G_TYPE_OBJECT)
+
+enum {
+	PROP_0,
+	PROP_EJECTION_TIME,
+	N_PROPERTIES,
+};
+
+static GParamSpec* properties[N_PROPERTIES] = { NULL };
+
+static void replit_client_pool_dispose(GObject* gobject);
+static void replit_client_pool_finalize(GObject* gobject);
+static void replit_client_pool_get_property(
+	GObject* gobject,
+	guint property_id,
+	GValue* value,
+	GParamSpec* pspec
+);
+static void replit_client_pool_set_property(
+	GObject* gobject,
+	guint property_id,
+	const GValue* value,
+	GParamSpec* pspec
+);
+
+static void replit_client_pool_class_init(ReplitClientPoolClass* klass) {
+	GObjectClass* object_class = G_OBJECT_CLASS (klass);
+
+	object_class->dispose = replit_client_pool_dispose;
+	object_class->finalize = replit_client_pool_finalize;
+	object_class->get_property = replit_client_pool_get_property;
+	object_class->set_property = replit_client_pool_set_property;
+
+	/**
+	 * ReplitClientPool:ejection-time:
+	 * 
+	 * The number of seconds a member is passed over for after its token is
+	 * refused or it is throttled.
+	 * 
+	 * Each ejection in a row doubles the time, up to sixteen times this value;
+	 * a successful request resets it.
+	 */
+	properties[PROP_EJECTION_TIME] = g_param_spec_double(
+		"ejection-time",
+		"Ejection time",
+		"The number of seconds a failing member is passed over for",
+		0,
+		G_MAXDOUBLE,
+		DEFAULT_EJECTION_TIME,
+		G_PARAM_READWRITE | G_PARAM_EXPLICIT_NOTIFY | G_PARAM_STATIC_STRINGS
+	);
+
+	g_object_class_install_properties(object_class, N_PROPERTIES, properties);
+}
+
+static ReplitPoolMember* replit_pool_member_ref(ReplitPoolMember* member) {
+	return g_atomic_rc_box_acquire(member);
+}
+
+static void replit_pool_member_clear(ReplitPoolMember* member) {
+	g_object_unref(member->client);
+}
+
+static void replit_pool_member_unref(ReplitPoolMember* member) {
+	g_atomic_rc_box_release_full(member, (GDestroyNotify) replit_pool_member_clear);
+}
+
+static void replit_pool_member_closure_notify(gpointer data, GClosure* closure __attribute__((unused))) {
+	replit_pool_member_unref(data);
+}
+
+static void replit_client_pool_init(ReplitClientPool* self) {
+	self->members = g_ptr_array_new_with_free_func((GDestroyNotify) replit_pool_member_unref);
+	self->strategy = REPLIT_POOL_STRATEGY_LEAST_OUTSTANDING;
+	self->ejection_time = DEFAULT_EJECTION_TIME;
+}
+
+static void replit_client_pool_dispose(GObject* gobject) {
+	ReplitClientPool* self = REPLIT_CLIENT_POOL (gobject);
+
+	for (guint i = 0; i < self->members->len; i++) {
+		ReplitPoolMember* member = g_ptr_array_index(self->members, i);
+
+		G_LOCK(members);
+		member->pool = NULL;
+		G_UNLOCK(members);
+
+		g_signal_handler_disconnect(member->client, member->finished_id);
+	}
+
+	g_ptr_array_set_size(self->members, 0);
+
+	G_OBJECT_CLASS (replit_client_pool_parent_class)->dispose(gobject);
+}
+
+static void replit_client_pool_finalize(GObject* gobject) {
+	ReplitClientPool* self = REPLIT_CLIENT_POOL (gobject);
+
+	g_ptr_array_unref(self->members);
+
+	G_OBJECT_CLASS (replit_client_pool_parent_class)->finalize(gobject);
+}
+
+static void replit_client_pool_get_property(
+	GObject* gobject,
+	guint property_id,
+	GValue* value,
+	GParamSpec* pspec
+) {
+	ReplitClientPool* self = REPLIT_CLIENT_POOL (gobject);
+
+	switch (property_id) {
+		case PROP_EJECTION_TIME:
+			g_value_set_double(value, self->ejection_time);
+			break;
+
+		default:
+			G_OBJECT_WARN_INVALID_PROPERTY_ID(gobject, property_id, pspec);
+			break;
+	}
+}
+
+static void replit_client_pool_set_property(
+	GObject* gobject,
+	guint property_id,
+	const GValue* value,
+	GParamSpec* pspec
+) {
+	ReplitClientPool* self = REPLIT_CLIENT_POOL (gobject);
+
+	switch (property_id) {
+		case PROP_EJECTION_TIME:
+			replit_client_pool_set_ejection_time(self, g_value_get_double(value));
+			break;
+
+		default:
+			G_OBJECT_WARN_INVALID_PROPERTY_ID(gobject, property_id, pspec);
+			break;
+	}
+}
+
+/**
+ * replit_client_pool_new:
+ * 
+ * Creates a new, empty #ReplitClientPool.
+ * 
+ * Returns: (transfer full): The new #ReplitClientPool.
+ */
+ReplitClientPool* replit_client_pool_new(void) {
+	return g_object_new(REPLIT_TYPE_CLIENT_POOL, NULL);
+}
+
+/* Passes over a member for the pool's ejection time, doubled for each ejection
+ * since its last successful request. Called with the members lock held. */
+static void replit_pool_member_eject(ReplitPoolMember* member) {
+	if (member->pool == NULL) return;
+
+	guint shift = MIN(member->consecutive_ejections, MAX_EJECTION_SHIFT);
+	gint64 duration = (gint64) (member->pool->ejection_time * G_USEC_PER_SEC) << shift;
+
+	member->ejected_until = g_get_monotonic_time() + duration;
+	member->consecutive_ejections++;
+	member->ejections++;
+}
+
+/* Updates a member's health from the outcome of each request its client makes,
+ * whether or not it was sent through the pool. Answers from the disk cache say
+ * nothing about the member's health, and are not counted. */
+static void replit_pool_member_request_finished(
+	ReplitClient* client __attribute__((unused)),
+	ReplitRequestRecord* record,
+	gpointer user_data
+) {
+	ReplitPoolMember* member = user_data;
+
+	if (record->cache_hit) return;
+
+	G_LOCK(members);
+
+	member->requests++;
+
+	if (record->error_domain != 0) member->failures++;
+
+	if (record->status == SOUP_STATUS_UNAUTHORIZED || record->status == SOUP_STATUS_FORBIDDEN) {
+		member->auth_failures++;
+		replit_pool_member_eject(member);
+	} else if (record->status == SOUP_STATUS_TOO_MANY_REQUESTS || record->retries > 0) {
+		member->throttled++;
+		replit_pool_member_eject(member);
+	} else if (record->error_domain == 0) {
+		member->consecutive_ejections = 0;
+	}
+
+	G_UNLOCK(members);
+}
+
+/**
+ * replit_client_pool_add_client:
+ * @pool: The pool.
+ * @client: (transfer none): The client to add.
+ * @weight: The client's share of requests relative to other members.
+ * 
+ * Adds an existing client to the pool.
+ * 
+ * A member with a weight of 2 is sent twice as many requests as one with a
+ * weight of 1, or allowed twice as many requests in flight. A weight of 0 is
+ * treated as 1.
+ * 
+ * Returns: The index of the new member.
+ */
+guint replit_client_pool_add_client(ReplitClientPool* self, ReplitClient* client, guint weight) {
+	ReplitPoolMember* member = g_atomic_rc_box_new0(ReplitPoolMember);
+	member->pool = self;
+	member->client = g_object_ref(client);
+	member->weight = MAX(weight, 1);
+	member->finished_id = g_signal_connect_data(
+		client,
+		"request-finished",
+		G_CALLBACK (replit_pool_member_request_finished),
+		replit_pool_member_ref(member),
+		replit_pool_member_closure_notify,
+		0
+	);
+
+	g_ptr_array_add(self->members, member);
+
+	return self->members->len - 1;
+}
+
+/**
+ * replit_client_pool_add_token:
+ * @pool: The pool.
+ * @token: (transfer none): The token to use as the `connect.sid` cookie.
+ * @weight: The member's share of requests relative to other members.
+ * 
+ * Creates a client with the given login token, as by [ctor@Client.new], and
+ * adds it to the pool.
+ * 
+ * Each client has its own session, and so its own connections. Use
+ * [method@ClientPool.get_client] to configure it further, such as to give it
+ * a [property@Client:rate-limit].
+ * 
+ * Returns: The index of the new member.
+ */
+guint replit_client_pool_add_token(ReplitClientPool* self, const gchar* token, guint weight) {
+	ReplitClient* client = replit_client_new(token);
+	guint index = replit_client_pool_add_client(self, client, weight);
+
+	g_object_unref(client);
+
+	return index;
+}
+
+/**
+ * replit_client_pool_get_size:
+ * @pool: The pool.
+ * 
+ * Gets the number of members in the pool.
+ * 
+ * Returns: The number of members.
+ */
+guint replit_client_pool_get_size(ReplitClientPool* self) {
+	return self->members->len;
+}
+
+/**
+ * replit_client_pool_get_client:
+ * @pool: The pool.
+ * @index: The index of the member.
+ * 
+ * Gets the client of a member of the pool.
+ * 
+ * Returns: (transfer none): The client.
+ */
+ReplitClient* replit_client_pool_get_client(ReplitClientPool* self, guint index) {
+	g_return_val_if_fail(index < self->members->len, NULL);
+
+	ReplitPoolMember* member = g_ptr_array_index(self->members, index);
+
+	return member->client;
+}
+
+/* Chooses the member to send the next request through. Members which have
+ * been ejected are passed over, unless every member has been. Called with the
+ * members lock held. */
+static ReplitPoolMember* replit_client_pool_pick(ReplitClientPool* self) {
+	gint64 now = g_get_monotonic_time();
+	guint length = self->members->len;
+	ReplitPoolMember* chosen = NULL;
+
+	if (self->strategy == REPLIT_POOL_STRATEGY_WEIGHTED_ROUND_ROBIN) {
+		/* Smooth weighted round-robin: every healthy member gains its weight,
+		 * and the one furthest ahead is chosen and set back by the total, which
+		 * interleaves heavier members with lighter ones rather than sending
+		 * them runs of requests. */
+		gint64 total = 0;
+
+		for (guint i = 0; i < length; i++) {
+			ReplitPoolMember* member = g_ptr_array_index(self->members, i);
+
+			if (member->ejected_until > now) continue;
+
+			member->current_weight += member->weight;
+			total += member->weight;
+
+			if (chosen == NULL || member->current_weight > chosen->current_weight) {
+				chosen = member;
+			}
+		}
+
+		if (chosen != NULL) chosen->current_weight -= total;
+	} else {
+		/* Ties are broken by starting from a different member each time, so
+		 * that idle members share requests evenly. */
+		for (guint i = 0; i < length; i++) {
+			ReplitPoolMember* member = g_ptr_array_index(self->members, (self->cursor + i) % length);
+
+			if (member->ejected_until > now) continue;
+
+			if (
+				chosen == NULL ||
+				(guint64) (member->outstanding + 1) * chosen->weight <
+					(guint64) (chosen->outstanding + 1) * member->weight
+			) {
+				chosen = member;
+			}
+		}
+
+		self->cursor = (self->cursor + 1) % length;
+	}
+
+	if (chosen != NULL) return chosen;
+
+	for (guint i = 0; i < length; i++) {
+		ReplitPoolMember* member = g_ptr_array_index(self->members, i);
+
+		if (chosen == NULL || member->ejected_until < chosen->ejected_until) chosen = member;
+	}
+
+	return chosen;
+}
+
+/**
+ * replit_client_pool_choose:
+ * @pool: The pool.
+ * 
+ * Chooses the client to use for a request which is not made through the pool,
+ * such as a subscription or a [class@Pager].
+ * 
+ * The client is chosen in the same way as for queries. Requests made directly
+ * through it still count towards the member's health, but not towards the
+ * requests it has in flight.
+ * 
+ * Returns: (transfer none): The chosen client.
+ */
+ReplitClient* replit_client_pool_choose(ReplitClientPool* self) {
+	g_return_val_if_fail(self->members->len > 0, NULL);
+
+	G_LOCK(members);
+	ReplitClient* client = replit_client_pool_pick(self)->client;
+	G_UNLOCK(members);
+
+	return client;
+}
+
+/**
+ * replit_client_pool_query:
+ * @pool: The pool.
+ * @query: (transfer none): The GraphQL query or mutation to perform.
+ * @variables: (transfer full) (nullable): Any variables to pass with the query.
+ * 
+ * Sends a GraphQL query or mutation through one of the pool's members.
+ * 
+ * Otherwise, this behaves exactly like [method@Client.query].
+ * 
+ * Returns: (transfer full) (nullable): The returned data, or %NULL on error.
+ */
+JsonNode* replit_client_pool_query(
+	ReplitClientPool* self,
+	const gchar* query,
+	JsonNode* variables,
+	GError** error
+) {
+	g_return_val_if_fail(self->members->len > 0, NULL);
+
+	G_LOCK(members);
+
+	ReplitPoolMember* member = replit_pool_member_ref(replit_client_pool_pick(self));
+	member->outstanding++;
+
+	G_UNLOCK(members);
+
+	JsonNode* data = replit_client_query(member->client, query, variables, error);
+
+	G_LOCK(members);
+	member->outstanding--;
+	G_UNLOCK(members);
+
+	replit_pool_member_unref(member);
+
+	return data;
+}
+
+static void replit_client_pool_query_ready(
+	GObject* source,
+	GAsyncResult* result,
+	gpointer user_data
+) {
+	GTask* task = user_data;
+	ReplitPoolMember* member = g_task_get_task_data(task);
+	GError* error = NULL;
+
+	G_LOCK(members);
+	member->outstanding--;
+	G_UNLOCK(members);
+
+	JsonNode* data = replit_client_query_finish(REPLIT_CLIENT (source), result, &error);
+
+	if (data != NULL) {
+		g_task_return_pointer(task, data, (GDestroyNotify) json_node_unref);
+	} else {
+		g_task_return_error(task, error);
+	}
+
+	g_object_unref(task);
+}
+
+/**
+ * replit_client_pool_query_async:
+ * @pool: The pool.
+ * @query: (transfer none): The GraphQL query or mutation to perform.
+ * @variables: (transfer full) (nullable): Any variables to pass with the query.
+ * @priority: The priority of the query.
+ * @deadline: The monotonic time by which the query must finish, or 0.
+ * @cancellable: (nullable): A #GCancellable.
+ * @callback: (scope async): The callback to call when the query is complete.
+ * @user_data: (closure): Data to pass to @callback.
+ * 
+ * Asynchronously sends a GraphQL query or mutation through one of the pool's
+ * members.
+ * 
+ * The member is chosen when the query is made, and the query then waits for
+ * that member's own rate limit, if it has one. Otherwise, this behaves exactly
+ * like [method@Client.query_full_async].
+ */
+void replit_client_pool_query_async(
+	ReplitClientPool* self,
+	const gchar* query,
+	JsonNode* variables,
+	ReplitRequestPriority priority,
+	gint64 deadline,
+	GCancellable* cancellable,
+	GAsyncReadyCallback callback,
+	gpointer user_data
+) {
+	g_return_if_fail(self->members->len > 0);
+
+	G_LOCK(members);
+
+	ReplitPoolMember* member = replit_client_pool_pick(self);
+	member->outstanding++;
+
+	G_UNLOCK(members);
+
+	GTask* task = g_task_new(self, cancellable, callback, user_data);
+	g_task_set_source_tag(task, replit_client_pool_query_async);
+	g_task_set_task_data(task, replit_pool_member_ref(member), (GDestroyNotify) replit_pool_member_unref);
+
+	replit_client_query_full_async(
+		member->client,
+		query,
+		variables,
+		priority,
+		deadline,
+		cancellable,
+		replit_client_pool_query_ready,
+		task
+	);
+}
+
+/**
+ * replit_client_pool_query_finish:
+ * @pool: The pool.
+ * @result: The #GAsyncResult passed to the callback.
+ * 
+ * Finishes a query started with [method@ClientPool.query_async].
+ * 
+ * Returns: (transfer full) (nullable): The returned data, or %NULL on error.
+ */
+JsonNode* replit_client_pool_query_finish(
+	ReplitClientPool* self,
+	GAsyncResult* result,
+	GError** error
+) {
+	g_return_val_if_fail(g_task_is_valid(result, self), NULL);
+
+	return g_task_propagate_pointer(G_TASK (result), error);
+}
+
+/**
+ * replit_client_pool_set_strategy:
+ * @pool: The pool.
+ * @strategy: How to choose the member for each request.
+ * 
+ * Sets how the pool chooses the member to send each request through.
+ * 
+ * The default is %REPLIT_POOL_STRATEGY_LEAST_OUTSTANDING.
+ */
+void replit_client_pool_set_strategy(ReplitClientPool* self, ReplitPoolStrategy strategy) {
+	self->strategy = strategy;
+}
+
+/**
+ * replit_client_pool_get_strategy:
+ * @pool: The pool.
+ * 
+ * Gets how the pool chooses the member to send each request through.
+ * 
+ * Returns: The strategy.
+ */
+ReplitPoolStrategy replit_client_pool_get_strategy(ReplitClientPool* self) {
+	return self->strategy;
+}
+
+/**
+ * replit_client_pool_set_ejection_time:
+ * @pool: The pool.
+ * @seconds: The number of seconds to pass over a failing member for.
+ * 
+ * Sets how long a member is passed over for after its token is refused or it
+ * is throttled.
+ * 
+ * See [property@ClientPool:ejection-time].
+ */
+void replit_client_pool_set_ejection_time(ReplitClientPool* self, gdouble seconds) {
+	seconds = MAX(seconds, 0);
+
+	if (self->ejection_time == seconds) return;
+
+	G_LOCK(members);
+	self->ejection_time = seconds;
+	G_UNLOCK(members);
+
+	g_object_notify_by_pspec(G_OBJECT (self), properties[PROP_EJECTION_TIME]);
+}
+
+/**
+ * replit_client_pool_get_ejection_time:
+ * @pool: The pool.
+ * 
+ * Gets how long a member is passed over for after its token is refused or it
+ * is throttled.
+ * 
+ * Returns: The ejection time, in seconds.
+ */
+gdouble replit_client_pool_get_ejection_time(ReplitClientPool* self) {
+	return self->ejection_time;
+}
+
+/**
+ * replit_client_pool_get_member_stats:
+ * @pool: The pool.
+ * @index: The index of the member.
+ * @stats: (out caller-allocates): The statistics to fill in.
+ * 
+ * Copies the health and counters of one member of the pool into @stats,
+ * including the statistics of its client.
+ */
+void replit_client_pool_get_member_stats(
+	ReplitClientPool* self,
+	guint index,
+	ReplitPoolMemberStats* stats
+) {
+	g_return_if_fail(index < self->members->len);
+
+	ReplitPoolMember* member = g_ptr_array_index(self->members, index);
+
+	memset(stats, 0, sizeof(ReplitPoolMemberStats));
+
+	G_LOCK(members);
+
+	stats->weight = member->weight;
+	stats->outstanding = member->outstanding;
+	stats->ejected_until = member->ejected_until > g_get_monotonic_time() ? member->ejected_until : 0;
+	stats->requests = member->requests;
+	stats->failures = member->failures;
+	stats->auth_failures = member->auth_failures;
+	stats->throttled = member->throttled;
+	stats->ejections = member->ejections;
+
+	G_UNLOCK(members);
+
+	replit_client_get_stats(member->client, &stats->client);
+}
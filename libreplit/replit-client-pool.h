@@ -0,0 +1,155 @@
+/* replit-client-pool.h
+ *
+ * Copyright 2022 Patrick Winters
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE X CONSORTIUM BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written
+ * authorization.
+ */
+
+#pragma once
+
+#if !defined(REPLIT_INSIDE) && !defined(REPLIT_COMPILATION)
+#error "Only <replit.h> can be included directly."
+#endif
+
+#include <gio/gio.h>
+#include <json-glib/json-glib.h>
+
+#include "replit-client.h"
+#include "replit-stats.h"
+
+G_BEGIN_DECLS
+
+/**
+ * ReplitPoolStrategy:
+ * 
+ * How a #ReplitClientPool chooses the member to send each request through.
+ */
+typedef enum {
+	/**
+	 * REPLIT_POOL_STRATEGY_LEAST_OUTSTANDING:
+	 * 
+	 * Send each request through the member with the fewest requests in flight
+	 * for its weight, so that slow members are given less work.
+	 */
+	REPLIT_POOL_STRATEGY_LEAST_OUTSTANDING,
+
+	/**
+	 * REPLIT_POOL_STRATEGY_WEIGHTED_ROUND_ROBIN:
+	 * 
+	 * Take turns between members, giving each a share of requests in
+	 * proportion to its weight.
+	 */
+	REPLIT_POOL_STRATEGY_WEIGHTED_ROUND_ROBIN,
+} ReplitPoolStrategy;
+
+/**
+ * ReplitPoolMemberStats:
+ * @weight: The member's share of requests relative to other members.
+ * @outstanding: The number of requests sent through the pool to the member
+ *   which have not finished yet.
+ * @ejected_until: The monotonic time until which the member is ejected, or
+ *   zero if it is not.
+ * @requests: The number of requests the member has finished.
+ * @failures: The number of those requests which failed.
+ * @auth_failures: The number of responses refusing the member's token, with a
+ *   401 or 403 status.
+ * @throttled: The number of requests the server throttled, with a 429 status
+ *   or a `Retry-After` header.
+ * @ejections: The number of times the member has been ejected.
+ * @client: The statistics of the member's own client, as returned by
+ *   [method@Client.get_stats].
+ * 
+ * The health and counters of one member of a #ReplitClientPool, as returned by
+ * [method@ClientPool.get_member_stats].
+ */
+typedef struct {
+	guint weight;
+	guint outstanding;
+	gint64 ejected_until;
+	guint64 requests;
+	guint64 failures;
+	guint64 auth_failures;
+	guint64 throttled;
+	guint64 ejections;
+	ReplitClientStats client;
+
+	/*< private >*/
+	guint64 reserved[8];
+} ReplitPoolMemberStats;
+
+#define REPLIT_TYPE_CLIENT_POOL replit_client_pool_get_type()
+G_DECLARE_FINAL_TYPE (ReplitClientPool, replit_client_pool, REPLIT, CLIENT_POOL, GObject)
+
+ReplitClientPool* replit_client_pool_new(void);
+
+guint replit_client_pool_add_client(ReplitClientPool* pool, ReplitClient* client, guint weight);
+
+guint replit_client_pool_add_token(ReplitClientPool* pool, const gchar* token, guint weight);
+
+guint replit_client_pool_get_size(ReplitClientPool* pool);
+
+ReplitClient* replit_client_pool_get_client(ReplitClientPool* pool, guint index);
+
+ReplitClient* replit_client_pool_choose(ReplitClientPool* pool);
+
+JsonNode* replit_client_pool_query(
+	ReplitClientPool* pool,
+	const gchar* query,
+	JsonNode* variables,
+	GError** error
+);
+
+void replit_client_pool_query_async(
+	ReplitClientPool* pool,
+	const gchar* query,
+	JsonNode* variables,
+	ReplitRequestPriority priority,
+	gint64 deadline,
+	GCancellable* cancellable,
+	GAsyncReadyCallback callback,
+	gpointer user_data
+);
+
+JsonNode* replit_client_pool_query_finish(
+	ReplitClientPool* pool,
+	GAsyncResult* result,
+	GError** error
+);
+
+void replit_client_pool_set_strategy(ReplitClientPool* pool, ReplitPoolStrategy strategy);
+
+ReplitPoolStrategy replit_client_pool_get_strategy(ReplitClientPool* pool);
+
+void replit_client_pool_set_ejection_time(ReplitClientPool* pool, gdouble seconds);
+
+gdouble replit_client_pool_get_ejection_time(ReplitClientPool* pool);
+
+void replit_client_pool_get_member_stats(
+	ReplitClientPool* pool,
+	guint index,
+	ReplitPoolMemberStats* stats
+);
+
+G_END_DECLS
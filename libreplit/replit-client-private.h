@@ -0,0 +1,64 @@
+/* replit-client-private.h
+ *
+ * Copyright 2022 Patrick Winters
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE X CONSORTIUM BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written
+ * authorization.
+ */
+
+#pragma once
+
+#include "replit-client.h"
+
+G_BEGIN_DECLS
+
+GBytes* replit_client_build_request(
+	ReplitClient* client,
+	const gchar* query,
+	const gchar* operation_name,
+	JsonNode* variables,
+	ReplitRequestRecord** record,
+	gboolean* idempotent
+);
+
+void replit_client_send_async(
+	ReplitClient* client,
+	GBytes* req_bytes,
+	ReplitRequestRecord* record,
+	ReplitRequestPriority priority,
+	gboolean idempotent,
+	gint64 deadline,
+	GCancellable* cancellable,
+	GAsyncReadyCallback callback,
+	gpointer user_data
+);
+
+JsonNode* replit_client_send_finish(
+	ReplitClient* client,
+	GAsyncResult* result,
+	gsize* length,
+	GError** error
+);
+
+G_END_DECLS
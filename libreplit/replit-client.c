@@ -30,9 +30,28 @@
 #include <libsoup/soup.h>
 
 #include "replit-client.h"
+#include "replit-client-private.h"
+#include "replit-config.h"
+#include "replit-deadline-private.h"
+#include "replit-graphql.h"
+#include "replit-json.h"
+#include "replit-json-stream-private.h"
+#include "replit-json-tape-private.h"
+#include "replit-recording-private.h"
+#include "replit-scheduler-private.h"
+#include "replit-stats-private.h"
+#include "replit-subscriber-private.h"
+#include "replit-trace-private.h"
 #include "replit-version.h"
 
 #define TOKEN_COOKIE "connect.sid"
+#define DOCUMENT_CACHE_SIZE 256
+#define STREAM_BUFFER_SIZE 16384
+#define COPY_BUFFER_SIZE 65536
+#define MAX_RETRIES 3
+#define DEFAULT_RETRY_AFTER G_USEC_PER_SEC
+#define MAX_RETRY_AFTER (300 * G_USEC_PER_SEC)
+#define HEDGE_MIN_SAMPLES 32
 
 G_DEFINE_QUARK (REPLIT_CLIENT_ERROR, replit_client_error)
 
@@ -48,30 +67,334 @@ G_DEFINE_QUARK (REPLIT_CLIENT_ERROR, replit_client_error)
  * 
  * Whilst the inner properties may be accessible, it is advised against using
  * them. All regular usage should be possible through the provided public API.
+ * 
+ * One client may be shared by any number of threads making synchronous
+ * queries, such as the workers of a #GThreadPool. Each blocking query runs in
+ * its calling thread, sharing the client's connections, rate limit, document
+ * cache and statistics, which are guarded by locks. Statistics and latencies
+ * may be read from any thread, and the client's subscriber is only ever
+ * created once.
+ * 
+ * Asynchronous queries must be made from the thread-default main context the
+ * client was created in, which acts as the client's dispatcher. A thread which
+ * runs a main context of its own should use a client of its own, created in
+ * that context.
+ * 
+ * Properties must be set before the client is shared. In particular, the
+ * transport, recorder and disk cache are read by every query without taking
+ * the client's lock; each of them may be used from several threads at once,
+ * but must not be replaced while queries are being made.
  */
 
 struct _ReplitClient {
 	GObject parent_instance;
 
+	GMutex mutex;
 	gchar* token;
 	SoupSession* session;
 	SoupCookieJar* jar;
+	gchar* cookie_file;
 	ReplitSubscriber* subscriber;
+	gchar* base_uri;
+	GUri* graphql_uri;
+	ReplitTransport* transport;
+	ReplitRecorder* recorder;
+	ReplitDiskCache* disk_cache;
+	ReplitScheduler* scheduler;
+	gdouble rate_limit;
+	guint rate_burst;
+	gdouble hedge_percentile;
+	gboolean minify_queries;
+	GHashTable* documents;
+	ReplitClientStats stats;
+	GHashTable* latencies;
 };
 
+typedef struct {
+	gchar* text;
+	gchar* operation_name;
+	gboolean query;
+} ReplitClientDocument;
+
 G_DEFINE_TYPE (ReplitClient, replit_client, G_TYPE_OBJECT)
 
+enum {
+	PROP_0,
+	PROP_BASE_URI,
+	PROP_COOKIE_FILE,
+	PROP_TRANSPORT,
+	PROP_RECORDER,
+	PROP_DISK_CACHE,
+	PROP_RATE_LIMIT,
+	PROP_RATE_BURST,
+	PROP_HEDGE_PERCENTILE,
+	PROP_MINIFY_QUERIES,
+	N_PROPERTIES,
+};
+
+static GParamSpec* properties[N_PROPERTIES] = { NULL };
+
+enum {
+	SIGNAL_REQUEST_FINISHED,
+	N_SIGNALS,
+};
+
+static guint signals[N_SIGNALS] = { 0 };
+
+G_STATIC_ASSERT (REPLIT_CLIENT_N_ERRORS == REPLIT_CLIENT_ERROR_TIMED_OUT + 1);
+G_STATIC_ASSERT (REPLIT_CLIENT_N_ERRORS <= REPLIT_CLIENT_MAX_ERRORS);
+
+/* New counters must take the place of reserved ones. */
+G_STATIC_ASSERT (sizeof(ReplitClientStats) == 40 * sizeof(guint64));
+
 static void replit_client_dispose(GObject* gobject);
 static void replit_client_finalize(GObject* gobject);
+static void replit_client_get_property(
+	GObject* gobject,
+	guint property_id,
+	GValue* value,
+	GParamSpec* pspec
+);
+static void replit_client_set_property(
+	GObject* gobject,
+	guint property_id,
+	const GValue* value,
+	GParamSpec* pspec
+);
 
 static void replit_client_class_init(ReplitClientClass* klass) {
 	GObjectClass* object_class = G_OBJECT_CLASS (klass);
 
 	object_class->dispose = replit_client_dispose;
 	object_class->finalize = replit_client_finalize;
+	object_class->get_property = replit_client_get_property;
+	object_class->set_property = replit_client_set_property;
+
+	/**
+	 * ReplitClient:base-uri:
+	 * 
+	 * The scheme, host and port of the server that requests are sent to.
+	 * 
+	 * This defaults to %REPLIT_BASE_URI, and is mainly useful for pointing the
+	 * client at a local server for testing and benchmarking. The client's
+	 * #ReplitSubscriber follows it.
+	 */
+	properties[PROP_BASE_URI] = g_param_spec_string(
+		"base-uri",
+		"Base URI",
+		"The scheme, host and port of the server that requests are sent to",
+		REPLIT_BASE_URI,
+		G_PARAM_READWRITE | G_PARAM_EXPLICIT_NOTIFY | G_PARAM_STATIC_STRINGS
+	);
+
+	/**
+	 * ReplitClient:cookie-file:
+	 * 
+	 * The file that the client's cookies are kept in, or %NULL to keep them in
+	 * memory only.
+	 * 
+	 * Cookies which the server sets or refreshes are written to the file as
+	 * they change, and read back by the next client to use it, so a session
+	 * outlives the process. If the client was created without a token, the
+	 * `connect.sid` cookie saved in the file is used as its token.
+	 */
+	properties[PROP_COOKIE_FILE] = g_param_spec_string(
+		"cookie-file",
+		"Cookie file",
+		"The file that the client's cookies are kept in",
+		NULL,
+		G_PARAM_READWRITE | G_PARAM_EXPLICIT_NOTIFY | G_PARAM_STATIC_STRINGS
+	);
+
+	/**
+	 * ReplitClient:transport:
+	 * 
+	 * The transport that requests and subscriptions are carried over, or %NULL
+	 * to talk to [property@Client:base-uri] directly.
+	 */
+	properties[PROP_TRANSPORT] = g_param_spec_object(
+		"transport",
+		"Transport",
+		"The transport that requests and subscriptions are carried over",
+		REPLIT_TYPE_TRANSPORT,
+		G_PARAM_READWRITE | G_PARAM_EXPLICIT_NOTIFY | G_PARAM_STATIC_STRINGS
+	);
+
+	/**
+	 * ReplitClient:recorder:
+	 * 
+	 * The recorder that requests, responses and subscription frames are
+	 * written to, if any.
+	 */
+	properties[PROP_RECORDER] = g_param_spec_object(
+		"recorder",
+		"Recorder",
+		"The recorder that requests, responses and subscription frames are written to",
+		REPLIT_TYPE_RECORDER,
+		G_PARAM_READWRITE | G_PARAM_EXPLICIT_NOTIFY | G_PARAM_STATIC_STRINGS
+	);
+
+	/**
+	 * ReplitClient:disk-cache:
+	 * 
+	 * The cache that the data returned by queries is kept in, if any.
+	 * 
+	 * Only queries sent with [method@Client.query], [method@Client.query_full]
+	 * and their asynchronous forms are cached, and only if the first operation
+	 * in the document is a query, never a mutation. Results are keyed by the
+	 * client's token as well as the request, so clients for different users
+	 * can share a cache.
+	 */
+	properties[PROP_DISK_CACHE] = g_param_spec_object(
+		"disk-cache",
+		"Disk cache",
+		"The cache that the data returned by queries is kept in",
+		REPLIT_TYPE_DISK_CACHE,
+		G_PARAM_READWRITE | G_PARAM_EXPLICIT_NOTIFY | G_PARAM_STATIC_STRINGS
+	);
+
+	/**
+	 * ReplitClient:rate-limit:
+	 * 
+	 * The number of requests the client may send per second, or 0 for no
+	 * limit.
+	 * 
+	 * Requests beyond the limit wait in a queue, ordered by their
+	 * #ReplitRequestPriority, until they may be sent. Whatever the limit, all
+	 * requests are held back for as long as the server asks with a 429 status
+	 * or a `Retry-After` header, and requests that were refused are sent again
+	 * up to three times.
+	 */
+	properties[PROP_RATE_LIMIT] = g_param_spec_double(
+		"rate-limit",
+		"Rate limit",
+		"The number of requests the client may send per second, or 0 for no limit",
+		0,
+		G_MAXDOUBLE,
+		0,
+		G_PARAM_READWRITE | G_PARAM_EXPLICIT_NOTIFY | G_PARAM_STATIC_STRINGS
+	);
+
+	/**
+	 * ReplitClient:rate-burst:
+	 * 
+	 * The number of requests the client may send at once without waiting for
+	 * [property@Client:rate-limit], after it has been idle.
+	 */
+	properties[PROP_RATE_BURST] = g_param_spec_uint(
+		"rate-burst",
+		"Rate burst",
+		"The number of requests the client may send at once after being idle",
+		1,
+		G_MAXUINT,
+		1,
+		G_PARAM_READWRITE | G_PARAM_EXPLICIT_NOTIFY | G_PARAM_STATIC_STRINGS
+	);
+
+	/**
+	 * ReplitClient:hedge-percentile:
+	 * 
+	 * The latency percentile after which an asynchronous query is sent a
+	 * second time, or 0 to never do so.
+	 * 
+	 * A query still waiting for its response after this percentile of the
+	 * latencies recorded for its operation's successful requests is hedged: a
+	 * second copy is sent, and whichever response arrives first is used while
+	 * the other request is cancelled. This trades a few extra requests for a shorter tail latency.
+	 * Only queries are hedged, never mutations; an operation is only hedged
+	 * once it has a few dozen recorded latencies, and a hedge is only sent if
+	 * [property@Client:rate-limit] allows it straight away.
+	 */
+	properties[PROP_HEDGE_PERCENTILE] = g_param_spec_double(
+		"hedge-percentile",
+		"Hedge percentile",
+		"The latency percentile after which a query is sent again, or 0 for never",
+		0,
+		100,
+		0,
+		G_PARAM_READWRITE | G_PARAM_EXPLICIT_NOTIFY | G_PARAM_STATIC_STRINGS
+	);
+
+	/**
+	 * ReplitClient:minify-queries:
+	 * 
+	 * Whether query documents are minified before being sent.
+	 * 
+	 * When enabled, comments and insignificant whitespace are stripped from
+	 * every query with [func@graphql_minify]. Minified documents are cached by
+	 * their source text, so repeated queries are only tokenised once.
+	 */
+	properties[PROP_MINIFY_QUERIES] = g_param_spec_boolean(
+		"minify-queries",
+		"Minify queries",
+		"Whether query documents are minified before being sent",
+		FALSE,
+		G_PARAM_READWRITE | G_PARAM_EXPLICIT_NOTIFY | G_PARAM_STATIC_STRINGS
+	);
+
+	g_object_class_install_properties(object_class, N_PROPERTIES, properties);
+
+	/**
+	 * ReplitClient::request-finished:
+	 * @client: The client.
+	 * @record: The timings and outcome of the request.
+	 * 
+	 * Emitted when a GraphQL request made by the client has finished, whether
+	 * or not it succeeded, after it has been added to the client's statistics.
+	 * 
+	 * For asynchronous requests, this is emitted just before the callback is
+	 * called. @record is only valid during the emission, and should be copied
+	 * with [method@RequestRecord.copy] if it is needed afterwards.
+	 * 
+	 * For synchronous requests, this is emitted in the thread which made the
+	 * request, so handlers must be thread-safe if the client is shared between
+	 * threads.
+	 */
+	signals[SIGNAL_REQUEST_FINISHED] = g_signal_new(
+		"request-finished",
+		G_TYPE_FROM_CLASS (klass),
+		G_SIGNAL_RUN_LAST,
+		0,
+		NULL,
+		NULL,
+		NULL,
+		G_TYPE_NONE,
+		1,
+		REPLIT_TYPE_REQUEST_RECORD | G_SIGNAL_TYPE_STATIC_SCOPE
+	);
+}
+
+static void replit_client_document_clear(ReplitClientDocument* document) {
+	g_free(document->text);
+	g_free(document->operation_name);
+}
+
+static void replit_client_document_release(ReplitClientDocument* document) {
+	g_atomic_rc_box_release_full(document, (GDestroyNotify) replit_client_document_clear);
 }
 
-static void replit_client_init(ReplitClient* self __attribute__((unused))) {}
+static void replit_client_init(ReplitClient* self) {
+	g_mutex_init(&self->mutex);
+
+	self->documents = g_hash_table_new_full(
+		g_str_hash,
+		g_str_equal,
+		g_free,
+		(GDestroyNotify) replit_client_document_release
+	);
+	self->latencies = g_hash_table_new_full(
+		g_str_hash,
+		g_str_equal,
+		g_free,
+		(GDestroyNotify) replit_histogram_free
+	);
+
+	self->base_uri = g_strdup(REPLIT_BASE_URI);
+	self->graphql_uri = g_uri_parse(REPLIT_BASE_URI "/graphql", SOUP_HTTP_URI_FLAGS, NULL);
+
+	self->scheduler = replit_scheduler_new();
+	self->rate_burst = 1;
+}
 
 static void replit_client_dispose(GObject* gobject) {
 	ReplitClient* self = REPLIT_CLIENT (gobject);
@@ -79,6 +402,9 @@ static void replit_client_dispose(GObject* gobject) {
 	g_clear_object(&self->session);
 	g_clear_object(&self->jar);
 	g_clear_object(&self->subscriber);
+	g_clear_object(&self->transport);
+	g_clear_object(&self->recorder);
+	g_clear_object(&self->disk_cache);
 
 	G_OBJECT_CLASS (replit_client_parent_class)->dispose(gobject);
 }
@@ -87,13 +413,165 @@ static void replit_client_finalize(GObject* gobject) {
 	ReplitClient* self = REPLIT_CLIENT (gobject);
 
 	g_free(self->token);
+	g_free(self->cookie_file);
+	g_free(self->base_uri);
+	g_uri_unref(self->graphql_uri);
+	g_hash_table_unref(self->documents);
+	g_hash_table_unref(self->latencies);
+	replit_scheduler_free(self->scheduler);
+	g_mutex_clear(&self->mutex);
 
 	G_OBJECT_CLASS (replit_client_parent_class)->finalize(gobject);
 }
 
+static void replit_client_get_property(
+	GObject* gobject,
+	guint property_id,
+	GValue* value,
+	GParamSpec* pspec
+) {
+	ReplitClient* self = REPLIT_CLIENT (gobject);
+
+	switch (property_id) {
+		case PROP_BASE_URI:
+			g_value_set_string(value, self->base_uri);
+			break;
+
+		case PROP_COOKIE_FILE:
+			g_value_set_string(value, self->cookie_file);
+			break;
+
+		case PROP_TRANSPORT:
+			g_value_set_object(value, self->transport);
+			break;
+
+		case PROP_RECORDER:
+			g_value_set_object(value, self->recorder);
+			break;
+
+		case PROP_DISK_CACHE:
+			g_value_set_object(value, self->disk_cache);
+			break;
+
+		case PROP_RATE_LIMIT:
+			g_value_set_double(value, self->rate_limit);
+			break;
+
+		case PROP_RATE_BURST:
+			g_value_set_uint(value, self->rate_burst);
+			break;
+
+		case PROP_HEDGE_PERCENTILE:
+			g_value_set_double(value, self->hedge_percentile);
+			break;
+
+		case PROP_MINIFY_QUERIES:
+			g_value_set_boolean(value, self->minify_queries);
+			break;
+
+		default:
+			G_OBJECT_WARN_INVALID_PROPERTY_ID(gobject, property_id, pspec);
+			break;
+	}
+}
+
+static void replit_client_set_property(
+	GObject* gobject,
+	guint property_id,
+	const GValue* value,
+	GParamSpec* pspec
+) {
+	ReplitClient* self = REPLIT_CLIENT (gobject);
+
+	switch (property_id) {
+		case PROP_BASE_URI:
+			replit_client_set_base_uri(self, g_value_get_string(value));
+			break;
+
+		case PROP_COOKIE_FILE:
+			replit_client_set_cookie_file(self, g_value_get_string(value));
+			break;
+
+		case PROP_TRANSPORT:
+			replit_client_set_transport(self, g_value_get_object(value));
+			break;
+
+		case PROP_RECORDER:
+			replit_client_set_recorder(self, g_value_get_object(value));
+			break;
+
+		case PROP_DISK_CACHE:
+			replit_client_set_disk_cache(self, g_value_get_object(value));
+			break;
+
+		case PROP_RATE_LIMIT:
+			replit_client_set_rate_limit(self, g_value_get_double(value));
+			break;
+
+		case PROP_RATE_BURST:
+			replit_client_set_rate_burst(self, g_value_get_uint(value));
+			break;
+
+		case PROP_HEDGE_PERCENTILE:
+			replit_client_set_hedge_percentile(self, g_value_get_double(value));
+			break;
+
+		case PROP_MINIFY_QUERIES:
+			replit_client_set_minify_queries(self, g_value_get_boolean(value));
+			break;
+
+		default:
+			G_OBJECT_WARN_INVALID_PROPERTY_ID(gobject, property_id, pspec);
+			break;
+	}
+}
+
+/* Returns a reference to the text to send for a query, the name of its first
+ * operation and whether that operation is a query, cached by the query's source
+ * text. The text is a minified copy if queries are being minified; documents
+ * which fail to tokenise are sent unchanged, so that Replit can report the
+ * error in full. Documents are prepared outside the lock, so two threads may
+ * both prepare a new one, and the last to finish is kept. */
+static ReplitClientDocument* replit_client_prepare_query(
+	ReplitClient* self,
+	const gchar* query
+) {
+	g_mutex_lock(&self->mutex);
+
+	ReplitClientDocument* document = g_hash_table_lookup(self->documents, query);
+	gboolean minify = self->minify_queries;
+
+	if (document != NULL) g_atomic_rc_box_acquire(document);
+
+	g_mutex_unlock(&self->mutex);
+
+	if (document != NULL) return document;
+
+	document = g_atomic_rc_box_new0(ReplitClientDocument);
+
+	if (minify) document->text = replit_graphql_minify(query, NULL);
+	if (document->text == NULL) document->text = g_strdup(query);
+
+	document->operation_name = replit_graphql_get_operation_name(document->text, NULL);
+	document->query = replit_graphql_is_query(document->text);
+
+	g_mutex_lock(&self->mutex);
+
+	if (g_hash_table_size(self->documents) >= DOCUMENT_CACHE_SIZE) {
+		g_hash_table_remove_all(self->documents);
+	}
+
+	g_hash_table_insert(self->documents, g_strdup(query), g_atomic_rc_box_acquire(document));
+
+	g_mutex_unlock(&self->mutex);
+
+	return document;
+}
+
 /**
  * replit_client_new:
- * @token: (transfer none): The token to use as the `connect.sid` cookie.
+ * @token: (transfer none) (nullable): The token to use as the `connect.sid`
+ *   cookie, or %NULL to take it from [property@Client:cookie-file].
  * 
  * Creates a new #ReplitClient with the given login token.
  * 
@@ -101,11 +579,12 @@ static void replit_client_finalize(GObject* gobject) {
  */
 ReplitClient* replit_client_new(const gchar* token) {
 	SoupSession* session = soup_session_new();
-
-	SoupCookie* cookie = soup_cookie_new(TOKEN_COOKIE, token, REPLIT_DOMAIN, "/", -1);
-
 	SoupCookieJar* jar = soup_cookie_jar_new();
-	soup_cookie_jar_add_cookie(jar, cookie);
+
+	if (token != NULL) {
+		SoupCookie* cookie = soup_cookie_new(TOKEN_COOKIE, token, REPLIT_DOMAIN, "/", -1);
+		soup_cookie_jar_add_cookie(jar, cookie);
+	}
 
 	soup_session_add_feature(session, SOUP_SESSION_FEATURE (jar));
 
@@ -118,174 +597,1720 @@ ReplitClient* replit_client_new(const gchar* token) {
 }
 
 /**
- * replit_client_query:
- * @client: The client.
- * @query: (transfer none): The GraphQL query or mutation to perform.
- * @variables: (transfer full) (nullable): Any variables to pass with the query.
+ * replit_client_new_with_session:
+ * @session: (transfer none): The session to send requests through.
+ * @token: (transfer none) (nullable): The token to send as the `connect.sid`
+ *   cookie, or %NULL to send none.
  * 
- * Sends a GraphQL query or mutation to Replit to perform as the current user.
+ * Creates a new #ReplitClient which sends its requests through an existing
+ * #SoupSession, such as one shared by clients for many users.
  * 
- * If @variables is %NULL, an empty object will be sent in its place. Otherwise,
- * it should usually be an object containing any variables used by the query.
+ * Rather than being added to the session's cookie jar, @token is attached to
+ * each request the client sends, so clients with different tokens can share a
+ * session, along with its pool of keep-alive connections and its TLS session
+ * cache. The session's cookie jar, if it has one, is not used for the client's
+ * requests. Its #ReplitSubscriber shares the session in the same way.
  * 
- * Returns: (transfer full) (nullable): The returned data, or %NULL on error.
+ * The client does not have a cookie jar of its own, so
+ * [property@Client:cookie-file] cannot be set. To share a
+ * [property@Client:transport] instead, create clients with this function or
+ * [ctor@Client.new] and set the same transport on each.
+ * 
+ * Returns: (transfer full): The new #ReplitClient.
  */
-JsonNode* replit_client_query(
-	ReplitClient* self,
-	const gchar* query,
-	JsonNode* variables,
-	GError** error
-) {
-	if (variables == NULL) {
-		variables = json_node_new(JSON_NODE_OBJECT);
-		json_node_set_object(variables, json_object_new());
-	}
-
-	JsonBuilder* builder = json_builder_new();
-	json_builder_begin_object(builder);
-	json_builder_set_member_name(builder, "operationName");
-	json_builder_add_null_value(builder);
-	json_builder_set_member_name(builder, "query");
-	json_builder_add_string_value(builder, query);
-	json_builder_set_member_name(builder, "variables");
-	json_builder_add_value(builder, variables);
-	json_builder_end_object(builder);
+ReplitClient* replit_client_new_with_session(SoupSession* session, const gchar* token) {
+	g_return_val_if_fail(SOUP_IS_SESSION (session), NULL);
 
-	JsonGenerator* generator = json_generator_new();
-	JsonNode* builder_root = json_builder_get_root(builder);
-	json_generator_set_root(generator, builder_root);
-
-	gsize req_length;
-	gchar* req_body = json_generator_to_data(generator, &req_length);
+	ReplitClient* self = g_object_new(REPLIT_TYPE_CLIENT, NULL);
+	self->token = g_strdup(token);
+	self->session = g_object_ref(session);
 
-	json_node_unref(builder_root);
-	g_object_unref(builder);
-	g_object_unref(generator);
+	return self;
+}
 
-	GBytes* req_bytes = g_bytes_new(req_body, req_length);
+/* Creates the message for a serialised GraphQL request body, taking ownership
+ * of it. */
+static SoupMessage* replit_client_new_message(ReplitClient* self, GBytes* req_bytes) {
+	SoupMessage* msg = soup_message_new_from_uri(SOUP_METHOD_POST, self->graphql_uri);
+	soup_message_set_request_body_from_bytes(msg, "application/json", req_bytes);
 
-	g_free(req_body);
+	soup_message_add_flags(msg, SOUP_MESSAGE_COLLECT_METRICS);
 
-	GUri* uri = g_uri_build(0, "https", NULL, REPLIT_DOMAIN, -1, "/graphql", NULL, NULL);
-	SoupMessage* msg = soup_message_new_from_uri(SOUP_METHOD_POST, uri);
-	soup_message_set_request_body_from_bytes(msg, "application/json", req_bytes);
+	g_bytes_unref(req_bytes);
 
 	SoupMessageHeaders* headers = soup_message_get_request_headers(msg);
 	soup_message_headers_append(headers, "Referrer", "https://replit.com/");
 	soup_message_headers_append(headers, "X-Requested-With", "XMLHttpRequest");
 	soup_message_headers_append(headers, "X-Libreplit-Version", REPLIT_VERSION_S);
 
-	GInputStream* stream = soup_session_send(self->session, msg, NULL, error);
+	if (self->jar == NULL && self->token != NULL) {
+		replit_subscriber_attach_token(msg, self->token);
+	}
+
+	return msg;
+}
 
+static gboolean replit_client_check_status(SoupMessage* msg, GError** error) {
 	SoupStatus status = soup_message_get_status(msg);
 
-	g_uri_unref(uri);
-	g_object_unref(msg);
+	if (status == SOUP_STATUS_OK) return TRUE;
 
-	if (stream == NULL) return NULL;
+	g_set_error(
+		error,
+		REPLIT_CLIENT_ERROR,
+		REPLIT_CLIENT_ERROR_RESPONSE_STATUS,
+		"Server responded with status %d",
+		status
+	);
 
-	if (status != SOUP_STATUS_OK) {
-		g_set_error(
-			error,
-			REPLIT_CLIENT_ERROR,
-			REPLIT_CLIENT_ERROR_RESPONSE_STATUS,
-			"Server responded with status %d",
-			status
+	return FALSE;
+}
+
+static ReplitRequestRecord* replit_client_begin_request(void) {
+	ReplitRequestRecord* record = g_new0(ReplitRequestRecord, 1);
+	record->start_time = g_get_monotonic_time();
+
+	return record;
+}
+
+static inline gint64 replit_client_metrics_span(guint64 start, guint64 end) {
+	return start != 0 && end >= start ? (gint64) (end - start) : 0;
+}
+
+/* Completes the record for a request from the metrics of its message, which
+ * may be %NULL if none was sent, and from the error it failed with, if any. The
+ * record is added to the client's statistics and emitted with
+ * ReplitClient::request-finished, and then freed. */
+static void replit_client_finish_request(
+	ReplitClient* self,
+	SoupMessage* msg,
+	ReplitRequestRecord* record,
+	const GError* error
+) {
+	record->total_time = g_get_monotonic_time() - record->start_time;
+
+	SoupMessageMetrics* metrics = msg != NULL ? soup_message_get_metrics(msg) : NULL;
+	gboolean new_connection = FALSE;
+
+	if (metrics != NULL) {
+		guint64 connect_start = soup_message_metrics_get_connect_start(metrics);
+		guint64 connect_end = soup_message_metrics_get_connect_end(metrics);
+		guint64 tls_start = soup_message_metrics_get_tls_start(metrics);
+		guint64 request_start = soup_message_metrics_get_request_start(metrics);
+		guint64 response_start = soup_message_metrics_get_response_start(metrics);
+
+		record->dns_time = replit_client_metrics_span(
+			soup_message_metrics_get_dns_start(metrics),
+			soup_message_metrics_get_dns_end(metrics)
+		);
+		record->connect_time = replit_client_metrics_span(
+			connect_start,
+			tls_start != 0 ? tls_start : connect_end
+		);
+		record->tls_time = replit_client_metrics_span(tls_start, connect_end);
+		record->wait_time = replit_client_metrics_span(request_start, response_start);
+		record->download_time = replit_client_metrics_span(
+			response_start,
+			soup_message_metrics_get_response_end(metrics)
 		);
 
-		return NULL;
+		record->bytes_out =
+			soup_message_metrics_get_request_header_bytes_sent(metrics) +
+			soup_message_metrics_get_request_body_bytes_sent(metrics);
+		record->bytes_in =
+			soup_message_metrics_get_response_header_bytes_received(metrics) +
+			soup_message_metrics_get_response_body_bytes_received(metrics);
+
+		if (connect_start != 0) {
+			new_connection = TRUE;
+		} else if (request_start != 0) {
+			record->reused_connection = TRUE;
+		}
 	}
 
-	JsonParser* parser = json_parser_new_immutable();
-	gboolean ok = json_parser_load_from_stream(parser, stream, NULL, error);
+	if (msg != NULL) record->status = soup_message_get_status(msg);
+
+	g_mutex_lock(&self->mutex);
+
+	if (new_connection) self->stats.new_connections++;
+	if (record->reused_connection) self->stats.reused_connections++;
+
+	self->stats.requests++;
+	self->stats.bytes_out += record->bytes_out;
+	self->stats.bytes_in += record->bytes_in;
+	self->stats.queue_time += record->queue_time;
+	self->stats.max_queue_time = MAX(self->stats.max_queue_time, record->queue_time);
+
+	if (error != NULL) {
+		record->error_domain = error->domain;
+		record->error_code = error->code;
+
+		if (
+			error->domain == REPLIT_CLIENT_ERROR &&
+			error->code >= 0 &&
+			error->code < REPLIT_CLIENT_N_ERRORS
+		) {
+			self->stats.errors[error->code]++;
+		} else {
+			self->stats.other_errors++;
+		}
+	}
+
+	/* Answers from the disk cache, and requests that failed or were cancelled
+	 * before a response came back, would pull the percentiles that hedging
+	 * relies on down to nothing. */
+	if (!record->cache_hit && error == NULL) {
+		const gchar* operation_name = record->operation_name != NULL ? record->operation_name : "";
+		ReplitHistogram* histogram = g_hash_table_lookup(self->latencies, operation_name);
+
+		if (histogram == NULL) {
+			histogram = replit_histogram_new();
+			g_hash_table_insert(self->latencies, g_strdup(operation_name), histogram);
+		}
+
+		replit_histogram_record(histogram, record->total_time);
+	}
+
+	g_mutex_unlock(&self->mutex);
+
+	REPLIT_TRACE_MARK(request, record->start_time, REPLIT_TRACE_NAME(record->operation_name));
+
+	g_signal_emit(self, signals[SIGNAL_REQUEST_FINISHED], 0, record);
+
+	replit_request_record_free(record);
+}
+
+/* Appends a request and its response to the client's recording. */
+static void replit_client_record(
+	ReplitClient* self,
+	GBytes* request,
+	gint64 sent_at,
+	GBytes* response
+) {
+	guint32 id = replit_recorder_next_id(self->recorder);
+
+	replit_recorder_add(self->recorder, REPLIT_RECORD_REQUEST, id, sent_at, request);
+	replit_recorder_add(self->recorder, REPLIT_RECORD_RESPONSE, id, g_get_real_time(), response);
+}
+
+/* Reads a response body in full so that it can be recorded, and returns a new
+ * stream of it. */
+static GInputStream* replit_client_record_stream(
+	ReplitClient* self,
+	GBytes* request,
+	gint64 sent_at,
+	GInputStream* stream,
+	GError** error
+) {
+	GOutputStream* buffer = g_memory_output_stream_new_resizable();
+	gssize length = g_output_stream_splice(
+		buffer,
+		stream,
+		G_OUTPUT_STREAM_SPLICE_CLOSE_SOURCE | G_OUTPUT_STREAM_SPLICE_CLOSE_TARGET,
+		NULL,
+		error
+	);
 
 	g_object_unref(stream);
 
-	if (!ok) {
-		g_object_unref(parser);
+	if (length < 0) {
+		g_object_unref(buffer);
 
 		return NULL;
 	}
 
-	JsonNode* root = json_parser_steal_root(parser);
-	JsonObject* root_object = json_node_get_object(root);
-	
-	g_object_unref(parser);
+	GBytes* response = g_memory_output_stream_steal_as_bytes(G_MEMORY_OUTPUT_STREAM (buffer));
 
-	JsonNode* error_node = json_object_get_member(root_object, "error");
+	g_object_unref(buffer);
 
-	if (error_node != NULL) {
-		switch (json_node_get_node_type(error_node)) {
-			case JSON_NODE_OBJECT:
-				JsonObject* error_object = json_node_get_object(error_node);
-
-				if (json_object_has_member(error_object, "errors")) {
-					JsonArray* errors = json_object_get_array_member(error_object, "errors");
-					guint errors_length = json_array_get_length(errors);
-
-					if (errors_length > 0) {
-						GString* error_object_buffer = g_string_new("");
-
-						for (guint i = 0; i < errors_length; i++) {
-							g_string_append(error_object_buffer, ", ");
-
-							JsonObject* errors_element = json_array_get_object_element(errors, i);
-							const gchar* errors_element_message =
-								json_object_get_string_member(errors_element, "message");
-
-							g_string_append(error_object_buffer, errors_element_message);
-						}
-						
-						g_set_error_literal(
-							error,
-							REPLIT_CLIENT_ERROR,
-							REPLIT_CLIENT_ERROR_GRAPHQL_ERROR,
-							error_object_buffer->str + 2
-						);
-
-						g_string_free(error_object_buffer, TRUE);
-				
-						break;
-					}
-				}
+	replit_client_record(self, request, sent_at, response);
+
+	stream = g_memory_input_stream_new_from_bytes(response);
+
+	g_bytes_unref(response);
+
+	return stream;
+}
+
+/* Parses a `Retry-After` header, which holds either a number of seconds or an
+ * HTTP date, into a delay in microseconds. */
+static gint64 replit_client_parse_retry_after(const gchar* value) {
+	if (value == NULL) return DEFAULT_RETRY_AFTER;
+
+	gchar* end;
+	guint64 seconds = g_ascii_strtoull(value, &end, 10);
+
+	if (end != value && *end == '\0') return MIN(seconds, MAX_RETRY_AFTER / G_USEC_PER_SEC) * G_USEC_PER_SEC;
+
+	GDateTime* date = soup_date_time_new_from_http_string(value);
+	if (date == NULL) return DEFAULT_RETRY_AFTER;
+
+	GDateTime* now = g_date_time_new_now_utc();
+	gint64 delay = g_date_time_difference(date, now);
+
+	g_date_time_unref(now);
+	g_date_time_unref(date);
+
+	return CLAMP (delay, 0, MAX_RETRY_AFTER);
+}
+
+/* Checks whether the server has asked the client to slow down, with a 429
+ * status or a 503 status and a `Retry-After` header. If so, every request is
+ * held back for as long as it asked, or for a second if it did not say. */
+static gboolean replit_client_throttled(ReplitClient* self, SoupMessage* msg) {
+	SoupStatus status = soup_message_get_status(msg);
+	SoupMessageHeaders* headers = soup_message_get_response_headers(msg);
+	const gchar* retry_after = soup_message_headers_get_one(headers, "Retry-After");
+
+	if (
+		status != SOUP_STATUS_TOO_MANY_REQUESTS &&
+		(status != SOUP_STATUS_SERVICE_UNAVAILABLE || retry_after == NULL)
+	) {
+		return FALSE;
+	}
+
+	gint64 delay = replit_client_parse_retry_after(retry_after);
+
+	g_mutex_lock(&self->mutex);
+	self->stats.throttled++;
+	g_mutex_unlock(&self->mutex);
+
+	replit_scheduler_pause(self->scheduler, g_get_monotonic_time() + delay);
+
+	return TRUE;
+}
+
+static void replit_client_set_timed_out_error(GError** error) {
+	g_set_error_literal(
+		error,
+		REPLIT_CLIENT_ERROR,
+		REPLIT_CLIENT_ERROR_TIMED_OUT,
+		"Request timed out"
+	);
+}
+
+/* Replaces the cancellation error of a request which was cancelled because its
+ * deadline passed. */
+static void replit_client_check_timed_out(gboolean timed_out, GError** error) {
+	if (!timed_out || !g_error_matches(*error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) return;
+
+	g_clear_error(error);
+	replit_client_set_timed_out_error(error);
+}
+
+/* Sends a serialised GraphQL request body, taking ownership of it, and returns
+ * the response body once the status has been checked. The message is returned
+ * through @msg_out, even on error, so that the request can be finished; it is
+ * %NULL if the request went through the client's transport. Requests which the
+ * rate limit would hold past @deadline fail straight away. */
+static GInputStream* replit_client_send_stream(
+	ReplitClient* self,
+	GBytes* req_bytes,
+	ReplitRequestRecord* record,
+	gint64 deadline,
+	GCancellable* cancellable,
+	SoupMessage** msg_out,
+	GError** error
+) {
+	SoupMessage* msg = NULL;
+	GInputStream* stream = NULL;
+
+	GBytes* request = self->recorder != NULL ? g_bytes_ref(req_bytes) : NULL;
+	gint64 sent_at = request != NULL ? g_get_real_time() : 0;
+
+	*msg_out = NULL;
+
+	gboolean acquired = replit_scheduler_acquire(
+		self->scheduler,
+		REPLIT_REQUEST_PRIORITY_NORMAL,
+		FALSE,
+		deadline,
+		&record->queue_time
+	);
+
+	if (!acquired) {
+		replit_client_set_timed_out_error(error);
+		g_bytes_unref(req_bytes);
+		g_clear_pointer(&request, g_bytes_unref);
+
+		return NULL;
+	}
+
+	REPLIT_TRACE_BEGIN(send);
+
+	if (self->transport != NULL) {
+		stream = replit_transport_send(self->transport, req_bytes, cancellable, error);
+
+		g_bytes_unref(req_bytes);
+	} else {
+		msg = replit_client_new_message(self, g_bytes_ref(req_bytes));
+		stream = soup_session_send(self->session, msg, cancellable, error);
+
+		while (
+			stream != NULL &&
+			replit_client_throttled(self, msg) &&
+			record->retries < MAX_RETRIES
+		) {
+			g_clear_object(&stream);
+
+			record->retries++;
+
+			g_mutex_lock(&self->mutex);
+			self->stats.retries++;
+			g_mutex_unlock(&self->mutex);
+
+			acquired = replit_scheduler_acquire(
+				self->scheduler,
+				REPLIT_REQUEST_PRIORITY_NORMAL,
+				TRUE,
+				deadline,
+				&record->queue_time
+			);
+
+			if (!acquired) {
+				replit_client_set_timed_out_error(error);
+
+				break;
+			}
 
-				__attribute__ ((fallthrough));
+			/* A message cannot be sent twice, so the retry gets a new one, as
+			 * asynchronous retries do. */
+			g_object_unref(msg);
+			msg = replit_client_new_message(self, g_bytes_ref(req_bytes));
+			stream = soup_session_send(self->session, msg, cancellable, error);
+		}
+
+		g_bytes_unref(req_bytes);
+
+		if (stream != NULL && !replit_client_check_status(msg, error)) {
+			g_clear_object(&stream);
+		}
+	}
+
+	REPLIT_TRACE_END(send, g_uri_get_path(self->graphql_uri));
+
+	if (stream != NULL && request != NULL) {
+		stream = replit_client_record_stream(self, request, sent_at, stream, error);
+	}
+
+	if (request != NULL) g_bytes_unref(request);
+
+	*msg_out = msg;
+
+	return stream;
+}
+
+/* Converts the `error` member of a GraphQL response into a #GError. */
+static void replit_client_set_response_error(JsonNode* error_node, GError** error) {
+	switch (json_node_get_node_type(error_node)) {
+		case JSON_NODE_OBJECT:
+			JsonObject* error_object = json_node_get_object(error_node);
+
+			if (json_object_has_member(error_object, "errors")) {
+				JsonArray* errors = json_object_get_array_member(error_object, "errors");
+				guint errors_length = json_array_get_length(errors);
+
+				if (errors_length > 0) {
+					GString* error_object_buffer = g_string_new("");
+
+					for (guint i = 0; i < errors_length; i++) {
+						g_string_append(error_object_buffer, ", ");
 
-			case JSON_NODE_VALUE:
-				const gchar* error_string = json_node_get_string(error_node);
+						JsonObject* errors_element = json_array_get_object_element(errors, i);
+						const gchar* errors_element_message =
+							json_object_get_string_member(errors_element, "message");
 
-				if (error_string != NULL) {
+						g_string_append(error_object_buffer, errors_element_message);
+					}
+					
 					g_set_error_literal(
 						error,
 						REPLIT_CLIENT_ERROR,
 						REPLIT_CLIENT_ERROR_GRAPHQL_ERROR,
-						error_string
+						error_object_buffer->str + 2
 					);
 
+					g_string_free(error_object_buffer, TRUE);
+			
 					break;
 				}
+			}
+
+			__attribute__ ((fallthrough));
 
-				__attribute__ ((fallthrough));
+		case JSON_NODE_VALUE:
+			const gchar* error_string = json_node_get_string(error_node);
 
-			default:
+			if (error_string != NULL) {
 				g_set_error_literal(
 					error,
 					REPLIT_CLIENT_ERROR,
 					REPLIT_CLIENT_ERROR_GRAPHQL_ERROR,
-					"Server returned error in JSON response"
+					error_string
 				);
-				
+
 				break;
-		}
-		
-		json_node_unref(root);
+			}
+
+			__attribute__ ((fallthrough));
+
+		default:
+			g_set_error_literal(
+				error,
+				REPLIT_CLIENT_ERROR,
+				REPLIT_CLIENT_ERROR_GRAPHQL_ERROR,
+				"Server returned error in JSON response"
+			);
+			
+			break;
+	}
+}
 
-		return NULL;
+#ifdef HAVE_JSON_TAPE
+/* Each thread parses into a tape of its own, which keeps its buffers from one
+ * response to the next, so that threads sharing a client never wait for each
+ * other to parse. */
+static GPrivate replit_client_tape = G_PRIVATE_INIT ((GDestroyNotify) replit_json_tape_free);
+#endif
+
+/* Parses a JSON document into an immutable tree, with the tape decoder if
+ * libreplit was built to use it, or json-glib otherwise. */
+static JsonNode* replit_client_parse(const gchar* text, gsize length, GError** error) {
+	JsonNode* root = NULL;
+
+#ifdef HAVE_JSON_TAPE
+	ReplitJsonTape* tape = g_private_get(&replit_client_tape);
+
+	if (tape == NULL) {
+		tape = replit_json_tape_new();
+		g_private_set(&replit_client_tape, tape);
 	}
 
-	JsonNode* data_node = json_object_get_member(root_object, "data");
+	if (replit_json_tape_parse(tape, text, length, error)) {
+		root = replit_json_tape_to_node(tape, REPLIT_JSON_TAPE_ROOT);
+		json_node_seal(root);
+	}
+#else
+	JsonParser* parser = json_parser_new_immutable();
 
-	if (data_node == NULL) {
+	if (json_parser_load_from_data(parser, text, length, error)) {
+		root = json_parser_steal_root(parser);
+	}
+
+	g_object_unref(parser);
+#endif
+
+	return root;
+}
+
+#ifdef HAVE_JSON_TAPE
+/* Reads the rest of a stream into memory, as the tape decoder needs the whole
+ * document at once. */
+static GBytes* replit_client_read_all(
+	GInputStream* stream,
+	GCancellable* cancellable,
+	GError** error
+) {
+	GByteArray* buffer = g_byte_array_sized_new(STREAM_BUFFER_SIZE);
+
+	for (;;) {
+		guint start = buffer->len;
+
+		g_byte_array_set_size(buffer, start + STREAM_BUFFER_SIZE);
+
+		gssize length = g_input_stream_read(
+			stream,
+			buffer->data + start,
+			STREAM_BUFFER_SIZE,
+			cancellable,
+			error
+		);
+
+		g_byte_array_set_size(buffer, start + MAX(length, 0));
+
+		if (length < 0) {
+			g_byte_array_unref(buffer);
+
+			return NULL;
+		}
+
+		if (length == 0) return g_byte_array_free_to_bytes(buffer);
+	}
+}
+#endif
+
+/* Takes the root of a GraphQL response and returns its `data` member, or sets
+ * an error from its `error` member. */
+static JsonNode* replit_client_take_data(JsonNode* root, GError** error) {
+	JsonObject* root_object = json_node_get_object(root);
+	JsonNode* error_node = json_object_get_member(root_object, "error");
+
+	if (error_node != NULL) {
+		replit_client_set_response_error(error_node, error);
+		json_node_unref(root);
+
+		return NULL;
+	}
+
+	JsonNode* data_node = json_object_get_member(root_object, "data");
+
+	if (data_node == NULL) {
+		g_set_error_literal(
+			error,
+			REPLIT_CLIENT_ERROR,
+			REPLIT_CLIENT_ERROR_GRAPHQL_EMPTY,
+			"Server returned no data in JSON response"
+		);
+
+		json_node_unref(root);
+
+		return NULL;
+	}
+
+	data_node = json_object_dup_member(root_object, "data");
+
+	json_node_unref(root);
+
+	return data_node;
+}
+
+/* Returns the key a request's result is cached under, which includes the token
+ * so that users never see each other's results. */
+static GBytes* replit_client_cache_key(ReplitClient* self, GBytes* req_bytes) {
+	GByteArray* key = g_byte_array_new();
+	const gchar* token = self->token != NULL ? self->token : "";
+	gsize length;
+	const guint8* body = g_bytes_get_data(req_bytes, &length);
+
+	g_byte_array_append(key, (const guint8*) token, strlen(token) + 1);
+	g_byte_array_append(key, body, length);
+
+	return g_byte_array_free_to_bytes(key);
+}
+
+/* Returns the cached data for a request, if there is any, setting @length to
+ * the size of its text. */
+static JsonNode* replit_client_cache_lookup(ReplitClient* self, GBytes* key, gsize* length) {
+	GBytes* cached = replit_disk_cache_lookup(self->disk_cache, key);
+
+	if (cached == NULL) return NULL;
+
+	const gchar* text = g_bytes_get_data(cached, length);
+	JsonNode* data_node = replit_client_parse(text, *length, NULL);
+
+	if (data_node != NULL) {
+		g_mutex_lock(&self->mutex);
+		self->stats.cache_hits++;
+		g_mutex_unlock(&self->mutex);
+	}
+
+	g_bytes_unref(cached);
+
+	return data_node;
+}
+
+/* Stores the data returned for a request. A cache which cannot be written to
+ * only makes later queries slower, so errors are ignored. */
+static void replit_client_cache_store(ReplitClient* self, GBytes* key, JsonNode* data_node) {
+	gchar* text = json_to_string(data_node, FALSE);
+	GBytes* value = g_bytes_new_take(text, strlen(text));
+
+	replit_disk_cache_store(self->disk_cache, key, value, NULL);
+	g_bytes_unref(value);
+}
+
+/* Sends a serialised GraphQL request body, taking ownership of it, and returns
+ * the `data` member of the response. The request is cancelled if it is still
+ * running at the monotonic time @deadline, unless that is zero. If the request
+ * is @idempotent, its result is taken from and kept in the disk cache. */
+static JsonNode* replit_client_send(
+	ReplitClient* self,
+	GBytes* req_bytes,
+	ReplitRequestRecord* record,
+	gboolean idempotent,
+	gint64 deadline,
+	GCancellable* cancellable,
+	GError** error
+) {
+	GError* local_error = NULL;
+	SoupMessage* msg;
+	JsonNode* data_node = NULL;
+	ReplitDeadline* timer = NULL;
+	GBytes* cache_key = NULL;
+
+	if (self->disk_cache != NULL && idempotent) {
+		gsize length;
+
+		cache_key = replit_client_cache_key(self, req_bytes);
+		data_node = replit_client_cache_lookup(self, cache_key, &length);
+
+		if (data_node != NULL) {
+			g_bytes_unref(cache_key);
+			g_bytes_unref(req_bytes);
+
+			record->cache_hit = TRUE;
+			replit_client_finish_request(self, NULL, record, NULL);
+
+			return data_node;
+		}
+	}
+
+	if (deadline != 0) {
+		timer = replit_deadline_new(deadline, cancellable);
+		cancellable = replit_deadline_get_cancellable(timer);
+	}
+
+	GInputStream* stream = replit_client_send_stream(
+		self,
+		req_bytes,
+		record,
+		deadline,
+		cancellable,
+		&msg,
+		&local_error
+	);
+
+	if (stream != NULL) {
+		REPLIT_TRACE_BEGIN(parse);
+
+		gint64 parse_start = g_get_monotonic_time();
+
+		JsonNode* root = NULL;
+
+#ifdef HAVE_JSON_TAPE
+		GBytes* body = replit_client_read_all(stream, cancellable, &local_error);
+
+		if (body != NULL) {
+			gsize length;
+			const gchar* text = g_bytes_get_data(body, &length);
+
+			root = replit_client_parse(text, length, &local_error);
+			g_bytes_unref(body);
+		}
+#else
+		/* json-glib parses the body as it arrives. */
+		JsonParser* parser = json_parser_new_immutable();
+
+		if (json_parser_load_from_stream(parser, stream, cancellable, &local_error)) {
+			root = json_parser_steal_root(parser);
+		}
+
+		g_object_unref(parser);
+#endif
+
+		g_object_unref(stream);
+
+		record->parse_time = g_get_monotonic_time() - parse_start;
+
+		REPLIT_TRACE_END(parse, REPLIT_TRACE_NAME(record->operation_name));
+
+		if (root != NULL) data_node = replit_client_take_data(root, &local_error);
+	}
+
+	if (timer != NULL) {
+		if (local_error != NULL) {
+			replit_client_check_timed_out(replit_deadline_expired(timer), &local_error);
+		}
+
+		replit_deadline_free(timer);
+	}
+
+	replit_client_finish_request(self, msg, record, local_error);
+	g_clear_object(&msg);
+
+	if (cache_key != NULL) {
+		if (data_node != NULL) replit_client_cache_store(self, cache_key, data_node);
+		g_bytes_unref(cache_key);
+	}
+
+	if (local_error != NULL) g_propagate_error(error, local_error);
+
+	return data_node;
+}
+
+typedef struct {
+	GBytes* req_bytes;
+	GBytes* cache_key;
+	SoupMessage* msg;
+	ReplitRequestRecord* record;
+	ReplitRequestPriority priority;
+	gboolean idempotent;
+	gboolean raw;
+	gint64 queued_at;
+	gint64 send_start;
+	gint64 sent_at;
+	gsize length;
+	gboolean queued;
+	gboolean timed_out;
+	GPtrArray* attempts;
+	guint generation;
+	gulong cancelled_id;
+	GSource* deadline_source;
+	GSource* hedge_source;
+} ReplitClientSendData;
+
+/* One send of an asynchronous request. A query which takes longer than usual
+ * may be sent a second time as a hedge, and whichever attempt answers first is
+ * used. Attempts from before a retry belong to an older generation, and their
+ * results are ignored. */
+typedef struct {
+	GTask* task;
+	SoupMessage* msg;
+	GCancellable* cancellable;
+	guint generation;
+	gboolean hedge;
+} ReplitClientAttempt;
+
+static void replit_client_clear_source(GSource** source) {
+	if (*source == NULL) return;
+
+	g_source_destroy(*source);
+	g_clear_pointer(source, g_source_unref);
+}
+
+static void replit_client_send_data_free(ReplitClientSendData* data) {
+	g_bytes_unref(data->req_bytes);
+	g_clear_pointer(&data->cache_key, g_bytes_unref);
+	g_clear_object(&data->msg);
+	g_clear_pointer(&data->record, replit_request_record_free);
+	g_ptr_array_unref(data->attempts);
+	g_free(data);
+}
+
+static ReplitClientAttempt* replit_client_attempt_new(
+	GTask* task,
+	SoupMessage* msg,
+	gboolean hedge
+) {
+	ReplitClientSendData* data = g_task_get_task_data(task);
+	ReplitClientAttempt* attempt = g_new0(ReplitClientAttempt, 1);
+
+	attempt->task = g_object_ref(task);
+	attempt->msg = msg != NULL ? g_object_ref(msg) : NULL;
+	attempt->cancellable = g_cancellable_new();
+	attempt->generation = data->generation;
+	attempt->hedge = hedge;
+
+	g_ptr_array_add(data->attempts, attempt);
+
+	return attempt;
+}
+
+static void replit_client_attempt_free(ReplitClientAttempt* attempt) {
+	g_object_unref(attempt->task);
+	g_clear_object(&attempt->msg);
+	g_object_unref(attempt->cancellable);
+	g_free(attempt);
+}
+
+static void replit_client_cancel_attempts(ReplitClientSendData* data) {
+	for (guint i = 0; i < data->attempts->len; i++) {
+		ReplitClientAttempt* attempt = g_ptr_array_index(data->attempts, i);
+
+		g_cancellable_cancel(attempt->cancellable);
+	}
+}
+
+/* Returns whether an attempt of the current generation is still running. */
+static gboolean replit_client_attempts_pending(ReplitClientSendData* data) {
+	for (guint i = 0; i < data->attempts->len; i++) {
+		ReplitClientAttempt* attempt = g_ptr_array_index(data->attempts, i);
+
+		if (attempt->generation == data->generation) return TRUE;
+	}
+
+	return FALSE;
+}
+
+static gboolean replit_client_dispatch(gpointer user_data);
+
+static gboolean replit_client_check_body(GBytes* body, GError** error);
+
+/* Parses the response body of an asynchronous request, if there is one, and
+ * returns its data through the task. */
+static void replit_client_send_complete(GTask* task, GBytes* body, GError* error) {
+	ReplitClientSendData* data = g_task_get_task_data(task);
+	ReplitClient* self = g_task_get_source_object(task);
+	JsonNode* data_node = NULL;
+	GBytes* raw_body = NULL;
+
+	REPLIT_TRACE_MARK(send, data->send_start, REPLIT_TRACE_NAME(data->record->operation_name));
+
+	if (
+		body != NULL &&
+		data->msg != NULL &&
+		replit_client_throttled(self, data->msg) &&
+		data->record->retries < MAX_RETRIES
+	) {
+		g_bytes_unref(body);
+
+		data->record->retries++;
+
+		g_mutex_lock(&self->mutex);
+		self->stats.retries++;
+		g_mutex_unlock(&self->mutex);
+		data->queued_at = g_get_monotonic_time();
+		data->queued = TRUE;
+
+		/* A message cannot be sent twice, so dispatch builds a new one. */
+		g_clear_object(&data->msg);
+
+		replit_scheduler_enqueue(
+			self->scheduler,
+			data->priority,
+			TRUE,
+			replit_client_dispatch,
+			task
+		);
+
+		return;
+	}
+
+	replit_client_clear_source(&data->deadline_source);
+	replit_client_clear_source(&data->hedge_source);
+
+	if (data->cancelled_id != 0) {
+		g_cancellable_disconnect(g_task_get_cancellable(task), data->cancelled_id);
+		data->cancelled_id = 0;
+	}
+
+	if (error != NULL) replit_client_check_timed_out(data->timed_out, &error);
+
+	if (body != NULL) {
+		data->length = g_bytes_get_size(body);
+
+		if (data->msg == NULL || replit_client_check_status(data->msg, &error)) {
+			if (self->recorder != NULL) {
+				replit_client_record(self, data->req_bytes, data->sent_at, body);
+			}
+
+			REPLIT_TRACE_BEGIN(parse);
+
+			gint64 parse_start = g_get_monotonic_time();
+
+			if (data->raw) {
+				if (replit_client_check_body(body, &error)) raw_body = g_bytes_ref(body);
+			} else {
+				gsize length;
+				const gchar* text = g_bytes_get_data(body, &length);
+				JsonNode* root = replit_client_parse(text, length, &error);
+
+				if (root != NULL) data_node = replit_client_take_data(root, &error);
+			}
+
+			data->record->parse_time = g_get_monotonic_time() - parse_start;
+
+			REPLIT_TRACE_END(parse, REPLIT_TRACE_NAME(data->record->operation_name));
+		}
+
+		g_bytes_unref(body);
+	}
+
+	replit_client_finish_request(self, data->msg, data->record, error);
+	data->record = NULL;
+
+	if (data->cache_key != NULL && data_node != NULL) {
+		replit_client_cache_store(self, data->cache_key, data_node);
+	}
+
+	if (raw_body != NULL) {
+		g_task_return_pointer(task, raw_body, (GDestroyNotify) g_bytes_unref);
+	} else if (data_node != NULL) {
+		g_task_return_pointer(task, data_node, (GDestroyNotify) json_node_unref);
+	} else {
+		g_task_return_error(task, error);
+	}
+
+	g_object_unref(task);
+}
+
+/* Completes the request with the first attempt to succeed, cancelling any
+ * others. A failed attempt is only used if no other is left to succeed, or if
+ * the whole request has been cancelled. */
+static void replit_client_attempt_done(ReplitClientAttempt* attempt, GBytes* body, GError* error) {
+	GTask* task = attempt->task;
+	ReplitClientSendData* data = g_task_get_task_data(task);
+	ReplitClient* self = g_task_get_source_object(task);
+
+	g_ptr_array_remove_fast(data->attempts, attempt);
+
+	if (
+		attempt->generation != data->generation || (
+			body == NULL &&
+			!g_cancellable_is_cancelled(attempt->cancellable) &&
+			replit_client_attempts_pending(data)
+		)
+	) {
+		if (body != NULL) g_bytes_unref(body);
+		if (error != NULL) g_error_free(error);
+
+		replit_client_attempt_free(attempt);
+
+		return;
+	}
+
+	data->generation++;
+	replit_client_cancel_attempts(data);
+	replit_client_clear_source(&data->hedge_source);
+
+	if (attempt->hedge && body != NULL) {
+		g_mutex_lock(&self->mutex);
+		self->stats.hedge_wins++;
+		g_mutex_unlock(&self->mutex);
+	}
+
+	if (attempt->msg != NULL) g_set_object(&data->msg, attempt->msg);
+
+	g_object_ref(task);
+	replit_client_attempt_free(attempt);
+
+	replit_client_send_complete(task, body, error);
+	g_object_unref(task);
+}
+
+static void replit_client_send_ready(
+	GObject* source,
+	GAsyncResult* result,
+	gpointer user_data
+) {
+	GError* error = NULL;
+	GBytes* body = soup_session_send_and_read_finish(SOUP_SESSION (source), result, &error);
+
+	replit_client_attempt_done(user_data, body, error);
+}
+
+static void replit_client_transport_ready(
+	GObject* source,
+	GAsyncResult* result,
+	gpointer user_data
+) {
+	GError* error = NULL;
+	GBytes* body = replit_transport_send_finish(REPLIT_TRANSPORT (source), result, &error);
+
+	replit_client_attempt_done(user_data, body, error);
+}
+
+static void replit_client_send_attempt(GTask* task, SoupMessage* msg, gboolean hedge) {
+	ReplitClient* self = g_task_get_source_object(task);
+	ReplitClientAttempt* attempt = replit_client_attempt_new(task, msg, hedge);
+
+	soup_session_send_and_read_async(
+		self->session,
+		msg,
+		G_PRIORITY_DEFAULT,
+		attempt->cancellable,
+		replit_client_send_ready,
+		attempt
+	);
+}
+
+/* Sends a second copy of a query which has not answered within the usual time
+ * for its operation, if the rate limit has a token to spare for it. */
+static gboolean replit_client_hedge(gpointer user_data) {
+	GTask* task = user_data;
+	ReplitClientSendData* data = g_task_get_task_data(task);
+	ReplitClient* self = g_task_get_source_object(task);
+
+	g_clear_pointer(&data->hedge_source, g_source_unref);
+
+	if (replit_scheduler_try_acquire(self->scheduler)) {
+		SoupMessage* msg = replit_client_new_message(self, g_bytes_ref(data->req_bytes));
+
+		g_mutex_lock(&self->mutex);
+		self->stats.hedged++;
+		g_mutex_unlock(&self->mutex);
+
+		replit_client_send_attempt(task, msg, TRUE);
+
+		g_object_unref(msg);
+	}
+
+	return G_SOURCE_REMOVE;
+}
+
+/* Returns how long to wait before hedging a request, or zero if it should not
+ * be hedged: only queries are, and only once their operation has enough
+ * recorded latencies to tell what is slow. */
+static gint64 replit_client_hedge_delay(ReplitClient* self, ReplitClientSendData* data) {
+	if (self->hedge_percentile <= 0 || !data->idempotent) return 0;
+
+	const gchar* operation_name = data->record->operation_name;
+	gint64 delay = 0;
+
+	g_mutex_lock(&self->mutex);
+
+	ReplitHistogram* histogram = g_hash_table_lookup(
+		self->latencies,
+		operation_name != NULL ? operation_name : ""
+	);
+
+	if (histogram != NULL && replit_histogram_get_count(histogram) >= HEDGE_MIN_SAMPLES) {
+		delay = MAX(replit_histogram_percentile(histogram, self->hedge_percentile), 1000);
+	}
+
+	g_mutex_unlock(&self->mutex);
+
+	return delay;
+}
+
+/* Sends a queued asynchronous request once the client's scheduler allows it,
+ * unless it has been cancelled or timed out while it waited. */
+static gboolean replit_client_dispatch(gpointer user_data) {
+	GTask* task = user_data;
+	ReplitClientSendData* data = g_task_get_task_data(task);
+	ReplitClient* self = g_task_get_source_object(task);
+	GCancellable* cancellable = g_task_get_cancellable(task);
+	GError* error = NULL;
+
+	data->queued = FALSE;
+	data->send_start = g_get_monotonic_time();
+	data->sent_at = g_get_real_time();
+	data->record->queue_time += data->send_start - data->queued_at;
+
+	if (data->timed_out) {
+		replit_client_set_timed_out_error(&error);
+		replit_client_send_complete(task, NULL, error);
+
+		return FALSE;
+	}
+
+	if (g_cancellable_set_error_if_cancelled(cancellable, &error)) {
+		replit_client_send_complete(task, NULL, error);
+
+		return FALSE;
+	}
+
+	if (self->transport != NULL) {
+		g_clear_object(&data->msg);
+
+		ReplitClientAttempt* attempt = replit_client_attempt_new(task, NULL, FALSE);
+
+		replit_transport_send_async(
+			self->transport,
+			data->req_bytes,
+			attempt->cancellable,
+			replit_client_transport_ready,
+			attempt
+		);
+
+		return TRUE;
+	}
+
+	if (data->msg == NULL) {
+		data->msg = replit_client_new_message(self, g_bytes_ref(data->req_bytes));
+	}
+
+	replit_client_send_attempt(task, data->msg, FALSE);
+
+	gint64 hedge_delay = replit_client_hedge_delay(self, data);
+
+	if (hedge_delay > 0 && data->hedge_source == NULL) {
+		data->hedge_source = g_timeout_source_new((guint) (hedge_delay / 1000));
+		g_source_set_callback(data->hedge_source, replit_client_hedge, task, NULL);
+		g_source_attach(data->hedge_source, g_task_get_context(task));
+	}
+
+	return TRUE;
+}
+
+/* Stops an asynchronous request which has been cancelled or has timed out: a
+ * queued request fails straight away, while running attempts are cancelled and
+ * fail as they finish. */
+static void replit_client_abort(GTask* task) {
+	ReplitClientSendData* data = g_task_get_task_data(task);
+	ReplitClient* self = g_task_get_source_object(task);
+
+	if (!data->queued) {
+		replit_client_cancel_attempts(data);
+
+		return;
+	}
+
+	replit_scheduler_remove(self->scheduler, task);
+	data->queued = FALSE;
+
+	replit_client_send_complete(
+		task,
+		NULL,
+		g_error_new_literal(G_IO_ERROR, G_IO_ERROR_CANCELLED, "Operation was cancelled")
+	);
+}
+
+static gboolean replit_client_deadline_expired(gpointer user_data) {
+	GTask* task = user_data;
+	ReplitClientSendData* data = g_task_get_task_data(task);
+
+	g_clear_pointer(&data->deadline_source, g_source_unref);
+	data->timed_out = TRUE;
+
+	replit_client_abort(task);
+
+	return G_SOURCE_REMOVE;
+}
+
+static gboolean replit_client_cancel_dispatch(gpointer user_data) {
+	GTask* task = user_data;
+	ReplitClientSendData* data = g_task_get_task_data(task);
+
+	/* The request may have finished before the abort got here. */
+	if (data->record != NULL) replit_client_abort(task);
+
+	return G_SOURCE_REMOVE;
+}
+
+/* Cancellation may come from any thread, so the abort is left to the context
+ * the task runs in. */
+static void replit_client_cancelled(GCancellable* cancellable __attribute__((unused)), gpointer user_data) {
+	GTask* task = user_data;
+	GSource* source = g_idle_source_new();
+
+	g_source_set_priority(source, G_PRIORITY_DEFAULT);
+	g_source_set_callback(source, replit_client_cancel_dispatch, g_object_ref(task), g_object_unref);
+	g_source_attach(source, g_task_get_context(task));
+	g_source_unref(source);
+}
+
+/* Queues a request body to be sent asynchronously, completing the task with the
+ * `data` member of the response, or with the whole body if @raw is set. */
+static void replit_client_send_async_full(
+	ReplitClient* self,
+	GBytes* req_bytes,
+	ReplitRequestRecord* record,
+	ReplitRequestPriority priority,
+	gboolean idempotent,
+	gboolean raw,
+	gint64 deadline,
+	GCancellable* cancellable,
+	GAsyncReadyCallback callback,
+	gpointer user_data
+) {
+	ReplitClientSendData* data = g_new0(ReplitClientSendData, 1);
+	data->req_bytes = req_bytes;
+	data->record = record;
+	data->priority = priority;
+	data->idempotent = idempotent;
+	data->raw = raw;
+	data->queued_at = g_get_monotonic_time();
+	data->attempts = g_ptr_array_new();
+
+	GTask* task = g_task_new(self, cancellable, callback, user_data);
+	g_task_set_source_tag(task, replit_client_send_async);
+	g_task_set_task_data(task, data, (GDestroyNotify) replit_client_send_data_free);
+
+	if (self->disk_cache != NULL && idempotent && !raw) {
+		data->cache_key = replit_client_cache_key(self, req_bytes);
+
+		JsonNode* data_node = replit_client_cache_lookup(self, data->cache_key, &data->length);
+
+		if (data_node != NULL) {
+			data->record->cache_hit = TRUE;
+			replit_client_finish_request(self, NULL, data->record, NULL);
+			data->record = NULL;
+
+			g_task_return_pointer(task, data_node, (GDestroyNotify) json_node_unref);
+			g_object_unref(task);
+
+			return;
+		}
+	}
+
+	if (deadline != 0) {
+		gint64 remaining = MAX(deadline - data->queued_at, 0);
+
+		data->deadline_source = g_timeout_source_new((guint) ((remaining + 999) / 1000));
+		g_source_set_callback(data->deadline_source, replit_client_deadline_expired, task, NULL);
+		g_source_attach(data->deadline_source, g_task_get_context(task));
+	}
+
+	if (cancellable != NULL) {
+		data->cancelled_id = g_cancellable_connect(
+			cancellable,
+			G_CALLBACK (replit_client_cancelled),
+			task,
+			NULL
+		);
+	}
+
+	data->queued = TRUE;
+
+	replit_scheduler_enqueue(self->scheduler, priority, FALSE, replit_client_dispatch, task);
+}
+
+/* Queues a serialised GraphQL request body to be sent asynchronously, taking
+ * ownership of it. The response is read in full before it is parsed, so that
+ * its size can be reported by replit_client_send_finish(). The request fails
+ * with %REPLIT_CLIENT_ERROR_TIMED_OUT if it has not finished by the monotonic
+ * time @deadline, unless that is zero. If the request is @idempotent, it may be
+ * answered from the disk cache without being sent. */
+void replit_client_send_async(
+	ReplitClient* self,
+	GBytes* req_bytes,
+	ReplitRequestRecord* record,
+	ReplitRequestPriority priority,
+	gboolean idempotent,
+	gint64 deadline,
+	GCancellable* cancellable,
+	GAsyncReadyCallback callback,
+	gpointer user_data
+) {
+	replit_client_send_async_full(
+		self,
+		req_bytes,
+		record,
+		priority,
+		idempotent,
+		FALSE,
+		deadline,
+		cancellable,
+		callback,
+		user_data
+	);
+}
+
+JsonNode* replit_client_send_finish(
+	ReplitClient* self,
+	GAsyncResult* result,
+	gsize* length,
+	GError** error
+) {
+	g_return_val_if_fail(g_task_is_valid(result, self), NULL);
+
+	if (length != NULL) {
+		ReplitClientSendData* data = g_task_get_task_data(G_TASK (result));
+		*length = data->length;
+	}
+
+	return g_task_propagate_pointer(G_TASK (result), error);
+}
+
+/* Serialises a GraphQL request body for a query, taking ownership of its
+ * variables, and starts the record for the request. If @idempotent is given,
+ * it is set to whether the operation selected by @operation_name, or else the
+ * document's first operation, is a query, which is safe to send more than
+ * once. */
+GBytes* replit_client_build_request(
+	ReplitClient* self,
+	const gchar* query,
+	const gchar* operation_name,
+	JsonNode* variables,
+	ReplitRequestRecord** record,
+	gboolean* idempotent
+) {
+	*record = replit_client_begin_request();
+
+	if (variables == NULL) {
+		variables = json_node_new(JSON_NODE_OBJECT);
+		json_node_set_object(variables, json_object_new());
+	}
+
+	ReplitClientDocument* document = replit_client_prepare_query(self, query);
+
+	if (idempotent != NULL) {
+		if (operation_name == NULL || g_strcmp0(operation_name, document->operation_name) == 0) {
+			*idempotent = document->query;
+		} else {
+			*idempotent = replit_graphql_operation_is_query(document->text, operation_name);
+		}
+	}
+
+	if (operation_name == NULL) operation_name = document->operation_name;
+
+	(*record)->operation_name = g_strdup(operation_name);
+
+	JsonBuilder* builder = json_builder_new();
+	json_builder_begin_object(builder);
+	json_builder_set_member_name(builder, "operationName");
+
+	if (operation_name != NULL) {
+		json_builder_add_string_value(builder, operation_name);
+	} else {
+		json_builder_add_null_value(builder);
+	}
+
+	json_builder_set_member_name(builder, "query");
+	json_builder_add_string_value(builder, document->text);
+	json_builder_set_member_name(builder, "variables");
+	json_builder_add_value(builder, variables);
+	json_builder_end_object(builder);
+
+	JsonGenerator* generator = json_generator_new();
+	JsonNode* builder_root = json_builder_get_root(builder);
+	json_generator_set_root(generator, builder_root);
+
+	gsize req_length;
+	gchar* req_body = json_generator_to_data(generator, &req_length);
+
+	json_node_unref(builder_root);
+	g_object_unref(builder);
+	g_object_unref(generator);
+
+	(*record)->serialize_time = g_get_monotonic_time() - (*record)->start_time;
+
+	REPLIT_TRACE_MARK(build, (*record)->start_time, REPLIT_TRACE_NAME(operation_name));
+
+	replit_client_document_release(document);
+
+	return g_bytes_new_take(req_body, req_length);
+}
+
+/**
+ * replit_client_query:
+ * @client: The client.
+ * @query: (transfer none): The GraphQL query or mutation to perform.
+ * @variables: (transfer full) (nullable): Any variables to pass with the query.
+ * 
+ * Sends a GraphQL query or mutation to Replit to perform as the current user.
+ * 
+ * If @variables is %NULL, an empty object will be sent in its place. Otherwise,
+ * it should usually be an object containing any variables used by the query.
+ * 
+ * The name of the first operation in @query is sent as the `operationName`; use
+ * [method@Client.query_operation] to perform another operation in the document.
+ * 
+ * Returns: (transfer full) (nullable): The returned data, or %NULL on error.
+ */
+JsonNode* replit_client_query(
+	ReplitClient* self,
+	const gchar* query,
+	JsonNode* variables,
+	GError** error
+) {
+	return replit_client_query_operation(self, query, NULL, variables, error);
+}
+
+/**
+ * replit_client_query_operation:
+ * @client: The client.
+ * @query: (transfer none): The GraphQL document to perform an operation from.
+ * @operation_name: (transfer none) (nullable): The name of the operation in
+ *   @query to perform.
+ * @variables: (transfer full) (nullable): Any variables to pass with the query.
+ * 
+ * Sends a GraphQL query or mutation to Replit to perform as the current user,
+ * selecting the operation to perform by name.
+ * 
+ * If @operation_name is %NULL, the name of the first operation in @query is
+ * sent, as by [method@Client.query]. The name also identifies the operation in
+ * the client's latency histograms; see [method@Client.get_latencies].
+ * 
+ * Returns: (transfer full) (nullable): The returned data, or %NULL on error.
+ */
+JsonNode* replit_client_query_operation(
+	ReplitClient* self,
+	const gchar* query,
+	const gchar* operation_name,
+	JsonNode* variables,
+	GError** error
+) {
+	ReplitRequestRecord* record;
+	gboolean idempotent;
+	GBytes* req_bytes = replit_client_build_request(
+		self,
+		query,
+		operation_name,
+		variables,
+		&record,
+		&idempotent
+	);
+
+	return replit_client_send(self, req_bytes, record, idempotent, 0, NULL, error);
+}
+
+/**
+ * replit_client_query_full:
+ * @client: The client.
+ * @query: (transfer none): The GraphQL query or mutation to perform.
+ * @variables: (transfer full) (nullable): Any variables to pass with the query.
+ * @deadline: The monotonic time by which the query must finish, or 0.
+ * @cancellable: (nullable): A #GCancellable.
+ * 
+ * Sends a GraphQL query or mutation to Replit to perform as the current user,
+ * giving up if it has not finished in time.
+ * 
+ * @deadline is compared with g_get_monotonic_time(). If the query has not
+ * finished by then, it fails with %REPLIT_CLIENT_ERROR_TIMED_OUT, including if
+ * [property@Client:rate-limit] would hold it back past the deadline. It fails
+ * with %G_IO_ERROR_CANCELLED if @cancellable is cancelled first, which may be
+ * done from another thread. Otherwise, this behaves exactly like
+ * [method@Client.query].
+ * 
+ * Returns: (transfer full) (nullable): The returned data, or %NULL on error.
+ */
+JsonNode* replit_client_query_full(
+	ReplitClient* self,
+	const gchar* query,
+	JsonNode* variables,
+	gint64 deadline,
+	GCancellable* cancellable,
+	GError** error
+) {
+	ReplitRequestRecord* record;
+	gboolean idempotent;
+	GBytes* req_bytes = replit_client_build_request(
+		self,
+		query,
+		NULL,
+		variables,
+		&record,
+		&idempotent
+	);
+
+	return replit_client_send(self, req_bytes, record, idempotent, deadline, cancellable, error);
+}
+
+/**
+ * replit_client_query_async:
+ * @client: The client.
+ * @query: (transfer none): The GraphQL query or mutation to perform.
+ * @variables: (transfer full) (nullable): Any variables to pass with the query.
+ * @cancellable: (nullable): A #GCancellable.
+ * @callback: (scope async): The callback to call when the query is complete.
+ * @user_data: (closure): Data to pass to @callback.
+ * 
+ * Asynchronously sends a GraphQL query or mutation to Replit to perform as the
+ * current user.
+ * 
+ * When the query is complete, @callback is called in the thread-default main
+ * context of the caller, and should call [method@Client.query_finish] to get
+ * the result. Otherwise, this behaves exactly like [method@Client.query].
+ * 
+ * The query is sent with %REPLIT_REQUEST_PRIORITY_NORMAL; see
+ * [method@Client.query_with_priority_async].
+ */
+void replit_client_query_async(
+	ReplitClient* self,
+	const gchar* query,
+	JsonNode* variables,
+	GCancellable* cancellable,
+	GAsyncReadyCallback callback,
+	gpointer user_data
+) {
+	replit_client_query_with_priority_async(
+		self,
+		query,
+		variables,
+		REPLIT_REQUEST_PRIORITY_NORMAL,
+		cancellable,
+		callback,
+		user_data
+	);
+}
+
+/**
+ * replit_client_query_with_priority_async:
+ * @client: The client.
+ * @query: (transfer none): The GraphQL query or mutation to perform.
+ * @variables: (transfer full) (nullable): Any variables to pass with the query.
+ * @priority: The priority of the query.
+ * @cancellable: (nullable): A #GCancellable.
+ * @callback: (scope async): The callback to call when the query is complete.
+ * @user_data: (closure): Data to pass to @callback.
+ * 
+ * Asynchronously sends a GraphQL query or mutation to Replit to perform as the
+ * current user, with the given priority.
+ * 
+ * While the client is held back by [property@Client:rate-limit] or by the
+ * server, waiting queries are sent in order of @priority, so that interactive
+ * queries are not stuck behind bulk ones. A query cancelled while waiting fails
+ * without being sent. Otherwise, this behaves exactly like
+ * [method@Client.query_async].
+ */
+void replit_client_query_with_priority_async(
+	ReplitClient* self,
+	const gchar* query,
+	JsonNode* variables,
+	ReplitRequestPriority priority,
+	GCancellable* cancellable,
+	GAsyncReadyCallback callback,
+	gpointer user_data
+) {
+	replit_client_query_full_async(
+		self,
+		query,
+		variables,
+		priority,
+		0,
+		cancellable,
+		callback,
+		user_data
+	);
+}
+
+/**
+ * replit_client_query_full_async:
+ * @client: The client.
+ * @query: (transfer none): The GraphQL query or mutation to perform.
+ * @variables: (transfer full) (nullable): Any variables to pass with the query.
+ * @priority: The priority of the query.
+ * @deadline: The monotonic time by which the query must finish, or 0.
+ * @cancellable: (nullable): A #GCancellable.
+ * @callback: (scope async): The callback to call when the query is complete.
+ * @user_data: (closure): Data to pass to @callback.
+ * 
+ * Asynchronously sends a GraphQL query or mutation to Replit to perform as the
+ * current user, with the given priority, giving up if it has not finished in
+ * time.
+ * 
+ * If the query is still waiting to be sent or running at @deadline, compared
+ * with g_get_monotonic_time(), it is stopped and fails with
+ * %REPLIT_CLIENT_ERROR_TIMED_OUT. Cancelling @cancellable stops it in the same
+ * way, and should be done from the thread-default main context of the caller.
+ * 
+ * Queries may also be hedged; see [property@Client:hedge-percentile].
+ * Otherwise, this behaves exactly like
+ * [method@Client.query_with_priority_async].
+ */
+void replit_client_query_full_async(
+	ReplitClient* self,
+	const gchar* query,
+	JsonNode* variables,
+	ReplitRequestPriority priority,
+	gint64 deadline,
+	GCancellable* cancellable,
+	GAsyncReadyCallback callback,
+	gpointer user_data
+) {
+	ReplitRequestRecord* record;
+	gboolean idempotent;
+	GBytes* req_bytes = replit_client_build_request(
+		self,
+		query,
+		NULL,
+		variables,
+		&record,
+		&idempotent
+	);
+
+	replit_client_send_async(
+		self,
+		req_bytes,
+		record,
+		priority,
+		idempotent,
+		deadline,
+		cancellable,
+		callback,
+		user_data
+	);
+}
+
+/**
+ * replit_client_query_finish:
+ * @client: The client.
+ * @result: The #GAsyncResult passed to the callback.
+ * 
+ * Finishes a query started with [method@Client.query_async].
+ * 
+ * Returns: (transfer full) (nullable): The returned data, or %NULL on error.
+ */
+JsonNode* replit_client_query_finish(
+	ReplitClient* self,
+	GAsyncResult* result,
+	GError** error
+) {
+	return replit_client_send_finish(self, result, NULL, error);
+}
+
+/**
+ * replit_client_query_prepared:
+ * @client: The client.
+ * @prepared: (transfer none): The prepared query to perform.
+ * @variables: (transfer full) (nullable): Any variables to pass with the query.
+ * 
+ * Sends a prepared GraphQL query or mutation to Replit to perform as the
+ * current user.
+ * 
+ * The request body is assembled directly from the pre-escaped envelope held by
+ * @prepared, so the document is neither escaped, minified nor hashed at
+ * runtime; only @variables are serialised. Prepared queries are usually
+ * generated at build time by `replit-gqlc`.
+ * 
+ * Otherwise, this behaves exactly like [method@Client.query].
+ * 
+ * Returns: (transfer full) (nullable): The returned data, or %NULL on error.
+ */
+JsonNode* replit_client_query_prepared(
+	ReplitClient* self,
+	const ReplitPreparedQuery* prepared,
+	JsonNode* variables,
+	GError** error
+) {
+	ReplitRequestRecord* record = replit_client_begin_request();
+	record->operation_name = g_strdup(prepared->operation_name);
+
+	GString* body = g_string_sized_new(prepared->envelope_length + 64);
+	g_string_append_len(body, prepared->envelope, prepared->envelope_length);
+	g_string_append(body, ",\"variables\":");
+
+	if (variables != NULL) {
+		JsonGenerator* generator = json_generator_new();
+		json_generator_set_root(generator, variables);
+		json_generator_to_gstring(generator, body);
+
+		g_object_unref(generator);
+		json_node_unref(variables);
+	} else {
+		g_string_append(body, "{}");
+	}
+
+	g_string_append_c(body, '}');
+
+	record->serialize_time = g_get_monotonic_time() - record->start_time;
+
+	REPLIT_TRACE_MARK(build, record->start_time, REPLIT_TRACE_NAME(record->operation_name));
+
+	return replit_client_send(self, g_string_free_to_bytes(body), record, FALSE, 0, NULL, error);
+}
+
+typedef struct {
+	ReplitClient* client;
+	ReplitQueryElementCallback callback;
+	gpointer user_data;
+	JsonParser* parser;
+	ReplitRequestRecord* record;
+	GError* error;
+} ReplitClientForeachData;
+
+static gboolean replit_client_foreach_element(
+	const gchar* element,
+	gsize length,
+	gpointer user_data
+) {
+	ReplitClientForeachData* data = user_data;
+	gint64 parse_start = g_get_monotonic_time();
+
+	gboolean ok = json_parser_load_from_data(data->parser, element, length, &data->error);
+
+	data->record->parse_time += g_get_monotonic_time() - parse_start;
+
+	REPLIT_TRACE_MARK(parse_element, parse_start, REPLIT_TRACE_NAME(data->record->operation_name));
+
+	if (!ok) return FALSE;
+
+	JsonNode* node = json_parser_steal_root(data->parser);
+
+	return data->callback(data->client, node, data->user_data);
+}
+
+/* Fails if a response which has been scanned to the end holds an `error`
+ * member, or no `data` member. */
+static gboolean replit_client_check_scanner(ReplitJsonStream* scanner, GError** error) {
+	gsize error_length;
+	const gchar* error_text = replit_json_stream_get_error(scanner, &error_length);
+
+	if (error_text != NULL) {
+		JsonParser* parser = json_parser_new_immutable();
+
+		if (json_parser_load_from_data(parser, error_text, error_length, error)) {
+			replit_client_set_response_error(json_parser_get_root(parser), error);
+		}
+
+		g_object_unref(parser);
+
+		return FALSE;
+	}
+
+	if (!replit_json_stream_has_data(scanner)) {
 		g_set_error_literal(
 			error,
 			REPLIT_CLIENT_ERROR,
@@ -293,16 +2318,425 @@ JsonNode* replit_client_query(
 			"Server returned no data in JSON response"
 		);
 
-		json_node_unref(root);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+static gboolean replit_client_ignore_element(
+	const gchar* element __attribute__((unused)),
+	gsize length __attribute__((unused)),
+	gpointer user_data __attribute__((unused))
+) {
+	return TRUE;
+}
+
+/* Checks that a response body holds data rather than an error, with a single
+ * pass of the scanner and without building a tree. */
+static gboolean replit_client_check_body(GBytes* body, GError** error) {
+	ReplitJsonStream* scanner = replit_json_stream_new("", replit_client_ignore_element, NULL);
+	gsize length;
+	const gchar* text = g_bytes_get_data(body, &length);
+
+	gboolean ok =
+		replit_json_stream_feed(scanner, text, length, error) &&
+		replit_json_stream_finish(scanner, error) &&
+		replit_client_check_scanner(scanner, error);
+
+	replit_json_stream_free(scanner);
+
+	return ok;
+}
+
+/* Reads a response body in full, scanning each chunk as it arrives, and returns
+ * it if it holds data rather than an error. */
+static GBytes* replit_client_read_body(GInputStream* stream, GError** error) {
+	ReplitJsonStream* scanner = replit_json_stream_new("", replit_client_ignore_element, NULL);
+	GByteArray* body = g_byte_array_sized_new(STREAM_BUFFER_SIZE);
+	gboolean ok = TRUE;
+
+	while (ok) {
+		guint start = body->len;
+
+		g_byte_array_set_size(body, start + STREAM_BUFFER_SIZE);
+
+		gssize length = g_input_stream_read(
+			stream,
+			body->data + start,
+			STREAM_BUFFER_SIZE,
+			NULL,
+			error
+		);
+
+		g_byte_array_set_size(body, start + MAX(length, 0));
+
+		if (length < 0) {
+			ok = FALSE;
+		} else if (length == 0) {
+			ok = replit_json_stream_finish(scanner, error) &&
+				replit_client_check_scanner(scanner, error);
+
+			break;
+		} else {
+			ok = replit_json_stream_feed(scanner, (const gchar*) body->data + start, length, error);
+		}
+	}
+
+	replit_json_stream_free(scanner);
+
+	if (!ok) {
+		g_byte_array_unref(body);
+
+		return NULL;
+	}
+
+	return g_byte_array_free_to_bytes(body);
+}
+
+static gboolean replit_client_read_elements(
+	ReplitClient* self,
+	GInputStream* stream,
+	const gchar* path,
+	ReplitQueryElementCallback callback,
+	gpointer user_data,
+	ReplitRequestRecord* record,
+	GError** error
+) {
+	ReplitClientForeachData data = {
+		.client = self,
+		.callback = callback,
+		.user_data = user_data,
+		.parser = json_parser_new_immutable(),
+		.record = record,
+	};
+
+	ReplitJsonStream* scanner = replit_json_stream_new(
+		path,
+		replit_client_foreach_element,
+		&data
+	);
+
+	gchar buffer[STREAM_BUFFER_SIZE];
+	gboolean ok = TRUE;
+
+	while (ok && !replit_json_stream_is_stopped(scanner)) {
+		gssize length = g_input_stream_read(stream, buffer, sizeof(buffer), NULL, error);
+
+		if (length < 0) {
+			ok = FALSE;
+		} else if (length == 0) {
+			ok = replit_json_stream_finish(scanner, error);
+
+			break;
+		} else {
+			ok = replit_json_stream_feed(scanner, buffer, length, error);
+		}
+	}
+
+	g_object_unref(data.parser);
+
+	if (data.error != NULL) {
+		g_propagate_error(error, data.error);
+		replit_json_stream_free(scanner);
+
+		return FALSE;
+	}
+
+	if (ok && !replit_json_stream_is_stopped(scanner)) {
+		ok = replit_client_check_scanner(scanner, error);
+	}
+
+	replit_json_stream_free(scanner);
+
+	return ok;
+}
+
+/**
+ * replit_client_query_foreach:
+ * @client: The client.
+ * @query: (transfer none): The GraphQL query or mutation to perform.
+ * @variables: (transfer full) (nullable): Any variables to pass with the query.
+ * @path: (transfer none): The dot-separated path to an array in the response,
+ *   such as `data.user.repls.items`.
+ * @callback: (scope call): The function to call with each element of the array.
+ * @user_data: (closure): Data to pass to @callback.
+ * 
+ * Sends a GraphQL query or mutation to Replit to perform as the current user,
+ * and calls @callback with each element of the array at @path as it is read
+ * from the response.
+ * 
+ * Unlike [method@Client.query], the response is never held in memory as a
+ * whole; only the element being decoded is, so this is suited to queries
+ * returning very large lists. @path starts from the root of the response, and
+ * may only pass through objects. If nothing in the response matches @path,
+ * @callback is never called.
+ * 
+ * If @callback returns %FALSE, the rest of the response is discarded and this
+ * method returns %TRUE. Elements may already have been passed to @callback
+ * when an error is returned.
+ * 
+ * Returns: %TRUE on success, or %FALSE on error.
+ */
+gboolean replit_client_query_foreach(
+	ReplitClient* self,
+	const gchar* query,
+	JsonNode* variables,
+	const gchar* path,
+	ReplitQueryElementCallback callback,
+	gpointer user_data,
+	GError** error
+) {
+	ReplitRequestRecord* record;
+	GBytes* req_bytes = replit_client_build_request(self, query, NULL, variables, &record, NULL);
+	GError* local_error = NULL;
+	SoupMessage* msg;
+
+	GInputStream* stream = replit_client_send_stream(
+		self,
+		req_bytes,
+		record,
+		0,
+		NULL,
+		&msg,
+		&local_error
+	);
+
+	if (stream != NULL) {
+		replit_client_read_elements(
+			self,
+			stream,
+			path,
+			callback,
+			user_data,
+			record,
+			&local_error
+		);
+
+		g_object_unref(stream);
+	}
+
+	replit_client_finish_request(self, msg, record, local_error);
+	g_clear_object(&msg);
+
+	if (local_error != NULL) {
+		g_propagate_error(error, local_error);
+
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+/* Copies a response body to @output in large chunks, returning the number of
+ * bytes written or -1 on error. */
+static gssize replit_client_copy_stream(
+	GInputStream* stream,
+	GOutputStream* output,
+	GError** error
+) {
+	gchar* buffer = g_malloc(COPY_BUFFER_SIZE);
+	gssize total = 0;
+
+	while (TRUE) {
+		gssize length = g_input_stream_read(stream, buffer, COPY_BUFFER_SIZE, NULL, error);
+
+		if (length <= 0) {
+			if (length < 0) total = -1;
+			break;
+		}
+
+		if (!g_output_stream_write_all(output, buffer, length, NULL, NULL, error)) {
+			total = -1;
+			break;
+		}
+
+		total += length;
+	}
+
+	g_free(buffer);
+
+	return total;
+}
+
+/**
+ * replit_client_query_to_stream:
+ * @client: The client.
+ * @query: (transfer none): The GraphQL query or mutation to perform.
+ * @variables: (transfer full) (nullable): Any variables to pass with the query.
+ * @output: (transfer none): The stream to write the response to.
+ * @error: The return location for a recoverable error.
+ * 
+ * Sends a GraphQL query or mutation to Replit to perform as the current user,
+ * and writes the body of the response to @output as it is received.
+ * 
+ * The response is neither parsed nor validated; only its HTTP status is
+ * checked, so GraphQL errors are written to @output like any other response.
+ * This avoids decoding and re-encoding responses that are only passed on.
+ * @output is not closed.
+ * 
+ * Returns: The number of bytes written, or -1 on error.
+ */
+gssize replit_client_query_to_stream(
+	ReplitClient* self,
+	const gchar* query,
+	JsonNode* variables,
+	GOutputStream* output,
+	GError** error
+) {
+	ReplitRequestRecord* record;
+	GBytes* req_bytes = replit_client_build_request(self, query, NULL, variables, &record, NULL);
+	GError* local_error = NULL;
+	SoupMessage* msg;
+	gssize length = -1;
+
+	GInputStream* stream = replit_client_send_stream(
+		self,
+		req_bytes,
+		record,
+		0,
+		NULL,
+		&msg,
+		&local_error
+	);
+
+	if (stream != NULL) {
+		length = replit_client_copy_stream(stream, output, &local_error);
+
+		g_object_unref(stream);
+	}
+
+	replit_client_finish_request(self, msg, record, local_error);
+	g_clear_object(&msg);
+
+	if (local_error != NULL) g_propagate_error(error, local_error);
+
+	return length;
+}
+
+/**
+ * replit_client_query_bytes:
+ * @client: The client.
+ * @query: (transfer none): The GraphQL query or mutation to perform.
+ * @variables: (transfer full) (nullable): Any variables to pass with the query.
+ * @error: The return location for a recoverable error.
+ * 
+ * Sends a GraphQL query or mutation to Replit to perform as the current user,
+ * and returns the body of the response as it was received.
+ * 
+ * Unlike [method@Client.query_to_stream], the response is checked for errors:
+ * it is scanned once as it arrives, without being parsed into a tree, and this
+ * fails as [method@Client.query] would if it holds an `error` member, has no
+ * `data` member, or is not valid JSON. The body is returned whole, including
+ * the `data` member's enclosing object, so it can be passed on to another
+ * client without being decoded and encoded again.
+ * 
+ * Returns: (transfer full) (nullable): The response body, or %NULL on error.
+ */
+GBytes* replit_client_query_bytes(
+	ReplitClient* self,
+	const gchar* query,
+	JsonNode* variables,
+	GError** error
+) {
+	ReplitRequestRecord* record;
+	GBytes* req_bytes = replit_client_build_request(self, query, NULL, variables, &record, NULL);
+	GError* local_error = NULL;
+	SoupMessage* msg;
+	GBytes* body = NULL;
+
+	GInputStream* stream = replit_client_send_stream(
+		self,
+		req_bytes,
+		record,
+		0,
+		NULL,
+		&msg,
+		&local_error
+	);
+
+	if (stream != NULL) {
+		body = replit_client_read_body(stream, &local_error);
+
+		g_object_unref(stream);
+	}
+
+	replit_client_finish_request(self, msg, record, local_error);
+	g_clear_object(&msg);
 
-		return NULL;
-	}
+	if (local_error != NULL) g_propagate_error(error, local_error);
 
-	data_node = json_object_dup_member(root_object, "data");
+	return body;
+}
 
-	json_node_unref(root);
+/**
+ * replit_client_query_bytes_async:
+ * @client: The client.
+ * @query: (transfer none): The GraphQL query or mutation to perform.
+ * @variables: (transfer full) (nullable): Any variables to pass with the query.
+ * @cancellable: (nullable): A #GCancellable.
+ * @callback: (scope async): The callback to call when the query is complete.
+ * @user_data: (closure): Data to pass to @callback.
+ * 
+ * Asynchronously sends a GraphQL query or mutation to Replit to perform as the
+ * current user, and gets the body of the response as it was received.
+ * 
+ * When the query is complete, @callback is called in the thread-default main
+ * context of the caller, and should call [method@Client.query_bytes_finish] to
+ * get the result. Otherwise, this behaves exactly like
+ * [method@Client.query_bytes], except that the query is subject to
+ * [property@Client:hedge-percentile] like other asynchronous queries.
+ */
+void replit_client_query_bytes_async(
+	ReplitClient* self,
+	const gchar* query,
+	JsonNode* variables,
+	GCancellable* cancellable,
+	GAsyncReadyCallback callback,
+	gpointer user_data
+) {
+	ReplitRequestRecord* record;
+	gboolean idempotent;
+	GBytes* req_bytes = replit_client_build_request(
+		self,
+		query,
+		NULL,
+		variables,
+		&record,
+		&idempotent
+	);
+
+	replit_client_send_async_full(
+		self,
+		req_bytes,
+		record,
+		REPLIT_REQUEST_PRIORITY_NORMAL,
+		idempotent,
+		TRUE,
+		0,
+		cancellable,
+		callback,
+		user_data
+	);
+}
 
-	return data_node;
+/**
+ * replit_client_query_bytes_finish:
+ * @client: The client.
+ * @result: The #GAsyncResult passed to the callback.
+ * 
+ * Finishes a query started with [method@Client.query_bytes_async].
+ * 
+ * Returns: (transfer full) (nullable): The response body, or %NULL on error.
+ */
+GBytes* replit_client_query_bytes_finish(
+	ReplitClient* self,
+	GAsyncResult* result,
+	GError** error
+) {
+	g_return_val_if_fail(g_task_is_valid(result, self), NULL);
+
+	return g_task_propagate_pointer(G_TASK (result), error);
 }
 
 /**
@@ -316,7 +2750,7 @@ JsonNode* replit_client_query(
  * and converts the response data to a GObject of the given type.
  * 
  * Internally, this method calls [method@Client.query] with its arguments, and
- * then uses GObject to turn the #JsonNode into the object.
+ * then uses [func@json_deserialize] to turn the #JsonNode into the object.
  * 
  * Returns: (transfer full) (nullable): The object, or %NULL on error.
  */
@@ -329,7 +2763,7 @@ GObject* replit_client_query_to_object(
 ) {
 	JsonNode* data = replit_client_query(self, query, variables, error);
 	if (data == NULL) return NULL;
-	GObject* object = json_gobject_deserialize(gtype, data);
+	GObject* object = replit_json_deserialize(gtype, data);
 
 	json_node_unref(data);
 
@@ -472,13 +2906,493 @@ gchar* replit_client_login(
  * associated with the #ReplitClient is passed to the #ReplitSubscriber for
  * authentication purposes.
  * 
+ * This may be called from any thread, and the subscriber is only created once,
+ * but the subscriber itself runs in the thread-default main context of the
+ * thread which first called this, and should only be used from there.
+ * 
  * Returns: (transfer none): The subscriber instance.
  */
 ReplitSubscriber* replit_client_get_subscriber(ReplitClient* self) {
+	g_mutex_lock(&self->mutex);
+
+	/* With a cookie jar, the session's cookies authenticate the subscriber. */
 	if (self->subscriber == NULL) {
-		g_object_ref(self->session);
-		self->subscriber = replit_subscriber_new_with_session(self->session);
+		self->subscriber = replit_subscriber_new_shared(
+			g_object_ref(self->session),
+			self->jar != NULL ? NULL : self->token,
+			self->base_uri,
+			self->transport,
+			self->recorder
+		);
+
+		replit_subscriber_set_minify_queries(self->subscriber, self->minify_queries);
 	}
 
+	g_mutex_unlock(&self->mutex);
+
 	return self->subscriber;
 }
+
+/**
+ * replit_client_set_cookie_file:
+ * @client: The client.
+ * @path: (type filename) (nullable): The file to keep cookies in, or %NULL to
+ *   keep them in memory only.
+ * 
+ * Sets the file that the client's cookies are kept in, in the Mozilla
+ * `cookies.txt` format.
+ * 
+ * Cookies already held by the client are moved to the file, replacing any saved
+ * there with the same name. Only cookies with an expiry time are written, so a
+ * token passed to [ctor@Client.new] is never saved, but one which the server
+ * refreshes is. Clients created with [ctor@Client.new_with_session] have no
+ * cookie jar, and cannot keep cookies in a file.
+ * 
+ * See [property@Client:cookie-file].
+ */
+void replit_client_set_cookie_file(ReplitClient* self, const gchar* path) {
+	if (g_strcmp0(self->cookie_file, path) == 0) return;
+
+	g_return_if_fail(self->jar != NULL);
+
+	SoupCookieJar* jar = path != NULL ? soup_cookie_jar_text_new(path, FALSE) : soup_cookie_jar_new();
+	GSList* cookies = soup_cookie_jar_all_cookies(self->jar);
+
+	for (GSList* link = cookies; link != NULL; link = link->next) {
+		soup_cookie_jar_add_cookie(jar, link->data);
+	}
+
+	g_slist_free(cookies);
+
+	soup_session_remove_feature(self->session, SOUP_SESSION_FEATURE (self->jar));
+	soup_session_add_feature(self->session, SOUP_SESSION_FEATURE (jar));
+	g_object_unref(self->jar);
+	self->jar = jar;
+
+	if (self->token == NULL) {
+		cookies = soup_cookie_jar_get_cookie_list(jar, self->graphql_uri, TRUE);
+
+		for (GSList* link = cookies; link != NULL; link = link->next) {
+			if (g_str_equal(soup_cookie_get_name(link->data), TOKEN_COOKIE)) {
+				self->token = g_strdup(soup_cookie_get_value(link->data));
+				break;
+			}
+		}
+
+		g_slist_free_full(cookies, (GDestroyNotify) soup_cookie_free);
+	}
+
+	g_free(self->cookie_file);
+	self->cookie_file = g_strdup(path);
+
+	g_object_notify_by_pspec(G_OBJECT (self), properties[PROP_COOKIE_FILE]);
+}
+
+/**
+ * replit_client_get_cookie_file:
+ * @client: The client.
+ * 
+ * Gets the file that the client's cookies are kept in.
+ * 
+ * Returns: (type filename) (nullable): The path of the file, or %NULL if
+ *   cookies are kept in memory only.
+ */
+const gchar* replit_client_get_cookie_file(ReplitClient* self) {
+	return self->cookie_file;
+}
+
+/**
+ * replit_client_set_transport:
+ * @client: The client.
+ * @transport: (transfer none) (nullable): The transport to use, or %NULL to
+ *   talk to [property@Client:base-uri] directly.
+ * 
+ * Sets the transport that requests and subscriptions are carried over.
+ * 
+ * While a transport is set, requests and subscriptions go through it instead
+ * of over HTTP and WebSockets. Requests made through a transport have no
+ * connection timings or status in their [struct@RequestRecord], and
+ * transports such as #ReplitReplay serve whole responses, so
+ * [method@Client.query_foreach] does not stream them from the network.
+ * 
+ * This must not be called while other threads are making queries with the
+ * client.
+ */
+void replit_client_set_transport(ReplitClient* self, ReplitTransport* transport) {
+	if (!g_set_object(&self->transport, transport)) return;
+
+	if (self->subscriber != NULL) {
+		replit_subscriber_set_transport(self->subscriber, transport);
+	}
+
+	g_object_notify_by_pspec(G_OBJECT (self), properties[PROP_TRANSPORT]);
+}
+
+/**
+ * replit_client_get_transport:
+ * @client: The client.
+ * 
+ * Gets the transport that requests and subscriptions are carried over.
+ * 
+ * Returns: (transfer none) (nullable): The transport, or %NULL if requests are
+ *   sent directly.
+ */
+ReplitTransport* replit_client_get_transport(ReplitClient* self) {
+	return self->transport;
+}
+
+/**
+ * replit_client_set_recorder:
+ * @client: The client.
+ * @recorder: (transfer none) (nullable): The recorder to write to, or %NULL to
+ *   stop recording.
+ * 
+ * Sets a recorder to write the client's traffic to.
+ * 
+ * Each request body is recorded along with its response, once the response has
+ * been received successfully; responses are read in full to do so, even by
+ * [method@Client.query_foreach]. Frames sent and received by the client's
+ * #ReplitSubscriber are recorded as well.
+ * 
+ * This must not be called while other threads are making queries with the
+ * client.
+ */
+void replit_client_set_recorder(ReplitClient* self, ReplitRecorder* recorder) {
+	if (!g_set_object(&self->recorder, recorder)) return;
+
+	if (self->subscriber != NULL) {
+		replit_subscriber_set_recorder(self->subscriber, recorder);
+	}
+
+	g_object_notify_by_pspec(G_OBJECT (self), properties[PROP_RECORDER]);
+}
+
+/**
+ * replit_client_get_recorder:
+ * @client: The client.
+ * 
+ * Gets the recorder that the client's traffic is written to.
+ * 
+ * Returns: (transfer none) (nullable): The recorder, or %NULL if not recording.
+ */
+ReplitRecorder* replit_client_get_recorder(ReplitClient* self) {
+	return self->recorder;
+}
+
+/**
+ * replit_client_set_disk_cache:
+ * @client: The client.
+ * @cache: (transfer none) (nullable): The cache to keep results in, or %NULL to
+ *   stop caching.
+ * 
+ * Sets a cache to answer repeated queries from.
+ * 
+ * This must not be called while other threads are making queries with the
+ * client. See [property@Client:disk-cache].
+ */
+void replit_client_set_disk_cache(ReplitClient* self, ReplitDiskCache* cache) {
+	if (!g_set_object(&self->disk_cache, cache)) return;
+
+	g_object_notify_by_pspec(G_OBJECT (self), properties[PROP_DISK_CACHE]);
+}
+
+/**
+ * replit_client_get_disk_cache:
+ * @client: The client.
+ * 
+ * Gets the cache that the results of queries are kept in.
+ * 
+ * Returns: (transfer none) (nullable): The cache, or %NULL if not caching.
+ */
+ReplitDiskCache* replit_client_get_disk_cache(ReplitClient* self) {
+	return self->disk_cache;
+}
+
+/**
+ * replit_client_set_base_uri:
+ * @client: The client.
+ * @base_uri: (transfer none): The scheme, host and port to send requests to.
+ * 
+ * Sets the server that requests are sent to, such as `http://127.0.0.1:8080`.
+ * 
+ * Any path in @base_uri is ignored. The client's token is added as a cookie for
+ * the new host, and its #ReplitSubscriber reconnects to the new server.
+ */
+void replit_client_set_base_uri(ReplitClient* self, const gchar* base_uri) {
+	g_return_if_fail(base_uri != NULL);
+
+	if (g_strcmp0(self->base_uri, base_uri) == 0) return;
+
+	GUri* uri = g_uri_parse(base_uri, SOUP_HTTP_URI_FLAGS, NULL);
+	g_return_if_fail(uri != NULL);
+
+	g_uri_unref(self->graphql_uri);
+	self->graphql_uri = g_uri_parse_relative(uri, "/graphql", SOUP_HTTP_URI_FLAGS, NULL);
+
+	g_free(self->base_uri);
+	self->base_uri = g_strdup(base_uri);
+
+	if (self->jar != NULL && self->token != NULL) {
+		const gchar* host = g_uri_get_host(uri);
+		SoupCookie* cookie = soup_cookie_new(TOKEN_COOKIE, self->token, host, "/", -1);
+		soup_cookie_jar_add_cookie(self->jar, cookie);
+	}
+
+	g_uri_unref(uri);
+
+	if (self->subscriber != NULL) {
+		replit_subscriber_set_base_uri(self->subscriber, base_uri);
+	}
+
+	g_object_notify_by_pspec(G_OBJECT (self), properties[PROP_BASE_URI]);
+}
+
+/**
+ * replit_client_get_base_uri:
+ * @client: The client.
+ * 
+ * Gets the server that requests are sent to.
+ * 
+ * Returns: (transfer none): The base URI.
+ */
+const gchar* replit_client_get_base_uri(ReplitClient* self) {
+	return self->base_uri;
+}
+
+/**
+ * replit_client_set_rate_limit:
+ * @client: The client.
+ * @rate: The number of requests to allow per second, or 0 for no limit.
+ * 
+ * Sets the number of requests the client may send per second.
+ * 
+ * See [property@Client:rate-limit].
+ */
+void replit_client_set_rate_limit(ReplitClient* self, gdouble rate) {
+	rate = MAX(rate, 0);
+
+	if (self->rate_limit == rate) return;
+
+	self->rate_limit = rate;
+	replit_scheduler_set_rate(self->scheduler, self->rate_limit, self->rate_burst);
+
+	g_object_notify_by_pspec(G_OBJECT (self), properties[PROP_RATE_LIMIT]);
+}
+
+/**
+ * replit_client_get_rate_limit:
+ * @client: The client.
+ * 
+ * Gets the number of requests the client may send per second.
+ * 
+ * Returns: The rate limit, or 0 if there is none.
+ */
+gdouble replit_client_get_rate_limit(ReplitClient* self) {
+	return self->rate_limit;
+}
+
+/**
+ * replit_client_set_rate_burst:
+ * @client: The client.
+ * @burst: The number of requests to allow at once.
+ * 
+ * Sets the number of requests the client may send at once after being idle.
+ * 
+ * See [property@Client:rate-burst].
+ */
+void replit_client_set_rate_burst(ReplitClient* self, guint burst) {
+	burst = MAX(burst, 1);
+
+	if (self->rate_burst == burst) return;
+
+	self->rate_burst = burst;
+	replit_scheduler_set_rate(self->scheduler, self->rate_limit, self->rate_burst);
+
+	g_object_notify_by_pspec(G_OBJECT (self), properties[PROP_RATE_BURST]);
+}
+
+/**
+ * replit_client_get_rate_burst:
+ * @client: The client.
+ * 
+ * Gets the number of requests the client may send at once after being idle.
+ * 
+ * Returns: The burst size.
+ */
+guint replit_client_get_rate_burst(ReplitClient* self) {
+	return self->rate_burst;
+}
+
+/**
+ * replit_client_set_hedge_percentile:
+ * @client: The client.
+ * @percentile: The latency percentile after which to hedge, or 0 for never.
+ * 
+ * Sets the latency percentile after which an asynchronous query is sent a
+ * second time.
+ * 
+ * See [property@Client:hedge-percentile].
+ */
+void replit_client_set_hedge_percentile(ReplitClient* self, gdouble percentile) {
+	percentile = CLAMP(percentile, 0, 100);
+
+	if (self->hedge_percentile == percentile) return;
+
+	self->hedge_percentile = percentile;
+
+	g_object_notify_by_pspec(G_OBJECT (self), properties[PROP_HEDGE_PERCENTILE]);
+}
+
+/**
+ * replit_client_get_hedge_percentile:
+ * @client: The client.
+ * 
+ * Gets the latency percentile after which an asynchronous query is sent a
+ * second time.
+ * 
+ * Returns: The percentile, or 0 if queries are never hedged.
+ */
+gdouble replit_client_get_hedge_percentile(ReplitClient* self) {
+	return self->hedge_percentile;
+}
+
+/**
+ * replit_client_set_minify_queries:
+ * @client: The client.
+ * @minify: Whether to minify queries.
+ * 
+ * Sets whether query documents are minified before being sent.
+ * 
+ * This applies to every query made through the #ReplitClient, as well as to
+ * subscriptions made through its #ReplitSubscriber. To minify only individual
+ * queries, pass them through [func@graphql_minify] instead.
+ */
+void replit_client_set_minify_queries(ReplitClient* self, gboolean minify) {
+	minify = !!minify;
+
+	if (self->minify_queries == minify) return;
+
+	g_mutex_lock(&self->mutex);
+	self->minify_queries = minify;
+	g_hash_table_remove_all(self->documents);
+	g_mutex_unlock(&self->mutex);
+
+	if (self->subscriber != NULL) {
+		replit_subscriber_set_minify_queries(self->subscriber, minify);
+	}
+
+	g_object_notify_by_pspec(G_OBJECT (self), properties[PROP_MINIFY_QUERIES]);
+}
+
+/**
+ * replit_client_get_minify_queries:
+ * @client: The client.
+ * 
+ * Gets whether query documents are minified before being sent.
+ * 
+ * Returns: %TRUE if queries are minified.
+ */
+gboolean replit_client_get_minify_queries(ReplitClient* self) {
+	return self->minify_queries;
+}
+
+/**
+ * replit_client_get_stats:
+ * @client: The client.
+ * @stats: (out caller-allocates): The statistics to fill in.
+ * 
+ * Gets the cumulative statistics for the GraphQL requests made by the client
+ * since it was created, or since [method@Client.reset_stats] was last called.
+ * 
+ * Use the [signal@Client::request-finished] signal for the timings of
+ * individual requests.
+ */
+void replit_client_get_stats(ReplitClient* self, ReplitClientStats* stats) {
+	g_mutex_lock(&self->mutex);
+	*stats = self->stats;
+	g_mutex_unlock(&self->mutex);
+
+	stats->queued = replit_scheduler_get_queued(self->scheduler);
+}
+
+/**
+ * replit_client_reset_stats:
+ * @client: The client.
+ * 
+ * Resets the cumulative statistics for the client to zero.
+ */
+void replit_client_reset_stats(ReplitClient* self) {
+	g_mutex_lock(&self->mutex);
+	self->stats = (ReplitClientStats) { 0 };
+	g_mutex_unlock(&self->mutex);
+}
+
+/* Summarises each operation's histogram. Called with the lock held. */
+static GPtrArray* replit_client_summarize_latencies(ReplitClient* self) {
+	GPtrArray* latencies = g_ptr_array_new_full(
+		g_hash_table_size(self->latencies),
+		(GDestroyNotify) replit_operation_latency_free
+	);
+
+	GHashTableIter iter;
+	const gchar* operation_name;
+	ReplitHistogram* histogram;
+
+	g_hash_table_iter_init(&iter, self->latencies);
+
+	while (g_hash_table_iter_next(&iter, (gpointer*) &operation_name, (gpointer*) &histogram)) {
+		ReplitOperationLatency* latency = replit_histogram_summarize(histogram);
+		latency->operation_name = operation_name[0] != '\0' ? g_strdup(operation_name) : NULL;
+
+		g_ptr_array_add(latencies, latency);
+	}
+
+	return latencies;
+}
+
+/**
+ * replit_client_get_latencies:
+ * @client: The client.
+ * 
+ * Takes a snapshot of the latency histogram kept for each operation performed
+ * by the client.
+ * 
+ * Every GraphQL request that succeeded is recorded by the name of its
+ * operation, with its [struct@RequestRecord] `total_time`, apart from those
+ * answered from [property@Client:disk-cache]. Anonymous operations are
+ * recorded together, with a %NULL name. Latencies are kept in log-linear
+ * buckets, so percentiles are accurate to within about 3%.
+ * 
+ * Returns: (transfer full) (element-type ReplitOperationLatency): The latencies
+ *   of each operation.
+ */
+GPtrArray* replit_client_get_latencies(ReplitClient* self) {
+	g_mutex_lock(&self->mutex);
+
+	GPtrArray* latencies = replit_client_summarize_latencies(self);
+
+	g_mutex_unlock(&self->mutex);
+
+	return latencies;
+}
+
+/**
+ * replit_client_reset_latencies:
+ * @client: The client.
+ * 
+ * Takes a snapshot of the latency histogram kept for each operation, as with
+ * [method@Client.get_latencies], and then clears every histogram.
+ * 
+ * Returns: (transfer full) (element-type ReplitOperationLatency): The latencies
+ *   of each operation before they were reset.
+ */
+GPtrArray* replit_client_reset_latencies(ReplitClient* self) {
+	g_mutex_lock(&self->mutex);
+
+	GPtrArray* latencies = replit_client_summarize_latencies(self);
+	g_hash_table_remove_all(self->latencies);
+
+	g_mutex_unlock(&self->mutex);
+
+	return latencies;
+}
@@ -33,10 +33,14 @@
 #error "Only <replit.h> can be included directly."
 #endif
 
-#include <glib.h>
+#include <gio/gio.h>
 #include <json-glib/json-glib.h>
 
+#include "replit-disk-cache.h"
+#include "replit-recorder.h"
+#include "replit-stats.h"
 #include "replit-subscriber.h"
+#include "replit-transport.h"
 
 G_BEGIN_DECLS
 
@@ -45,11 +49,19 @@ G_BEGIN_DECLS
  * 
  * The host name connected to by #ReplitClient.
  * 
- * It may be useful to library users performing other requests to Replit. This
- * is not configurable at runtime.
+ * It may be useful to library users performing other requests to Replit. The
+ * server a #ReplitClient talks to can be changed with
+ * [method@Client.set_base_uri].
  */
 #define REPLIT_DOMAIN "replit.com"
 
+/**
+ * REPLIT_BASE_URI:
+ * 
+ * The default value of [property@Client:base-uri].
+ */
+#define REPLIT_BASE_URI "https://" REPLIT_DOMAIN
+
 /**
  * REPLIT_HC_KEY:
  * 
@@ -104,13 +116,93 @@ typedef enum {
 	 * Replit returned a GraphQL response containing no data.
 	 */
 	REPLIT_CLIENT_ERROR_GRAPHQL_EMPTY,
+
+	/**
+	 * REPLIT_CLIENT_ERROR_TIMED_OUT:
+	 * 
+	 * The request did not finish before its deadline.
+	 */
+	REPLIT_CLIENT_ERROR_TIMED_OUT,
 } ReplitClientError;
 
+/**
+ * ReplitRequestPriority:
+ * 
+ * The order in which requests waiting for the client's rate limit are sent.
+ * 
+ * Requests of a higher priority are always sent before those of a lower one;
+ * requests of the same priority are sent in the order they were made.
+ */
+typedef enum {
+	/**
+	 * REPLIT_REQUEST_PRIORITY_INTERACTIVE:
+	 * 
+	 * A request that someone is waiting on.
+	 */
+	REPLIT_REQUEST_PRIORITY_INTERACTIVE,
+
+	/**
+	 * REPLIT_REQUEST_PRIORITY_NORMAL:
+	 * 
+	 * The priority of requests made without one.
+	 */
+	REPLIT_REQUEST_PRIORITY_NORMAL,
+
+	/**
+	 * REPLIT_REQUEST_PRIORITY_BACKGROUND:
+	 * 
+	 * A bulk or speculative request, sent with whatever capacity is left.
+	 */
+	REPLIT_REQUEST_PRIORITY_BACKGROUND,
+} ReplitRequestPriority;
+
+/**
+ * ReplitPreparedQuery:
+ * @operation_name: (nullable): The name of the operation in @document.
+ * @document: The validated and minified GraphQL document.
+ * @envelope: The start of the JSON request body, up to but excluding the
+ *   variables, with @document already escaped.
+ * @envelope_length: The length of @envelope in bytes.
+ * @hash: The hex-encoded SHA-256 hash of @document.
+ * 
+ * A GraphQL document which has been validated, minified and serialised ahead of
+ * time, to be sent with [method@Client.query_prepared].
+ * 
+ * Prepared queries are normally declared as constants in a header generated by
+ * the `replit-gqlc` tool from `.graphql` files at build time. @hash matches the
+ * result of [func@graphql_hash] for the original document.
+ */
+typedef struct {
+	const gchar* operation_name;
+	const gchar* document;
+	const gchar* envelope;
+	gsize envelope_length;
+	const gchar* hash;
+} ReplitPreparedQuery;
+
 #define REPLIT_TYPE_CLIENT replit_client_get_type()
 G_DECLARE_FINAL_TYPE (ReplitClient, replit_client, REPLIT, CLIENT, GObject)
 
+/**
+ * ReplitQueryElementCallback:
+ * @client: The client performing the query.
+ * @element: (transfer full): The next element of the streamed array.
+ * @user_data: (closure): The data passed to [method@Client.query_foreach].
+ * 
+ * The callback called by [method@Client.query_foreach] for each element.
+ * 
+ * Returns: %TRUE to continue with the next element, or %FALSE to stop.
+ */
+typedef gboolean (* ReplitQueryElementCallback)(
+	ReplitClient* client,
+	JsonNode* element,
+	gpointer user_data
+);
+
 ReplitClient* replit_client_new(const gchar* token);
 
+ReplitClient* replit_client_new_with_session(SoupSession* session, const gchar* token);
+
 JsonNode* replit_client_query(
 	ReplitClient* client,
 	const gchar* query,
@@ -118,6 +210,106 @@ JsonNode* replit_client_query(
 	GError** error
 );
 
+void replit_client_query_async(
+	ReplitClient* client,
+	const gchar* query,
+	JsonNode* variables,
+	GCancellable* cancellable,
+	GAsyncReadyCallback callback,
+	gpointer user_data
+);
+
+void replit_client_query_with_priority_async(
+	ReplitClient* client,
+	const gchar* query,
+	JsonNode* variables,
+	ReplitRequestPriority priority,
+	GCancellable* cancellable,
+	GAsyncReadyCallback callback,
+	gpointer user_data
+);
+
+JsonNode* replit_client_query_full(
+	ReplitClient* client,
+	const gchar* query,
+	JsonNode* variables,
+	gint64 deadline,
+	GCancellable* cancellable,
+	GError** error
+);
+
+void replit_client_query_full_async(
+	ReplitClient* client,
+	const gchar* query,
+	JsonNode* variables,
+	ReplitRequestPriority priority,
+	gint64 deadline,
+	GCancellable* cancellable,
+	GAsyncReadyCallback callback,
+	gpointer user_data
+);
+
+JsonNode* replit_client_query_finish(
+	ReplitClient* client,
+	GAsyncResult* result,
+	GError** error
+);
+
+JsonNode* replit_client_query_operation(
+	ReplitClient* client,
+	const gchar* query,
+	const gchar* operation_name,
+	JsonNode* variables,
+	GError** error
+);
+
+JsonNode* replit_client_query_prepared(
+	ReplitClient* client,
+	const ReplitPreparedQuery* prepared,
+	JsonNode* variables,
+	GError** error
+);
+
+gboolean replit_client_query_foreach(
+	ReplitClient* client,
+	const gchar* query,
+	JsonNode* variables,
+	const gchar* path,
+	ReplitQueryElementCallback callback,
+	gpointer user_data,
+	GError** error
+);
+
+gssize replit_client_query_to_stream(
+	ReplitClient* client,
+	const gchar* query,
+	JsonNode* variables,
+	GOutputStream* output,
+	GError** error
+);
+
+GBytes* replit_client_query_bytes(
+	ReplitClient* client,
+	const gchar* query,
+	JsonNode* variables,
+	GError** error
+);
+
+void replit_client_query_bytes_async(
+	ReplitClient* client,
+	const gchar* query,
+	JsonNode* variables,
+	GCancellable* cancellable,
+	GAsyncReadyCallback callback,
+	gpointer user_data
+);
+
+GBytes* replit_client_query_bytes_finish(
+	ReplitClient* client,
+	GAsyncResult* result,
+	GError** error
+);
+
 GObject* replit_client_query_to_object(
 	ReplitClient* client,
 	const gchar* query,
@@ -135,4 +327,48 @@ gchar* replit_client_login(
 
 ReplitSubscriber* replit_client_get_subscriber(ReplitClient* client);
 
+void replit_client_set_cookie_file(ReplitClient* client, const gchar* path);
+
+const gchar* replit_client_get_cookie_file(ReplitClient* client);
+
+void replit_client_set_base_uri(ReplitClient* client, const gchar* base_uri);
+
+const gchar* replit_client_get_base_uri(ReplitClient* client);
+
+void replit_client_set_transport(ReplitClient* client, ReplitTransport* transport);
+
+ReplitTransport* replit_client_get_transport(ReplitClient* client);
+
+void replit_client_set_recorder(ReplitClient* client, ReplitRecorder* recorder);
+
+ReplitRecorder* replit_client_get_recorder(ReplitClient* client);
+
+void replit_client_set_disk_cache(ReplitClient* client, ReplitDiskCache* cache);
+
+ReplitDiskCache* replit_client_get_disk_cache(ReplitClient* client);
+
+void replit_client_set_rate_limit(ReplitClient* client, gdouble rate);
+
+gdouble replit_client_get_rate_limit(ReplitClient* client);
+
+void replit_client_set_rate_burst(ReplitClient* client, guint burst);
+
+guint replit_client_get_rate_burst(ReplitClient* client);
+
+void replit_client_set_hedge_percentile(ReplitClient* client, gdouble percentile);
+
+gdouble replit_client_get_hedge_percentile(ReplitClient* client);
+
+void replit_client_set_minify_queries(ReplitClient* client, gboolean minify);
+
+gboolean replit_client_get_minify_queries(ReplitClient* client);
+
+void replit_client_get_stats(ReplitClient* client, ReplitClientStats* stats);
+
+void replit_client_reset_stats(ReplitClient* client);
+
+GPtrArray* replit_client_get_latencies(ReplitClient* client);
+
+GPtrArray* replit_client_reset_latencies(ReplitClient* client);
+
 G_END_DECLS
@@ -0,0 +1,151 @@
+/* replit-deadline.c
+ *
+ * Copyright 2022 Patrick Winters
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE X CONSORTIUM BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written
+ * authorization.
+ */
+
+#include "replit-deadline-private.h"
+
+/* A deadline for a blocking request is a cancellable which is cancelled when
+ * either the caller's cancellable is, or the monotonic time reaches the
+ * deadline. Blocking I/O can only be interrupted from another thread, so the
+ * timeouts run on a single watcher thread shared by every deadline. */
+
+typedef struct {
+	GCancellable* cancellable;
+	gint expired;
+} ReplitDeadlineState;
+
+struct _ReplitDeadline {
+	ReplitDeadlineState* state;
+	GCancellable* parent;
+	gulong cancelled_id;
+	GSource* source;
+};
+
+static gpointer replit_deadline_watch(gpointer user_data) {
+	GMainContext* context = user_data;
+	GMainLoop* loop = g_main_loop_new(context, FALSE);
+
+	g_main_loop_run(loop);
+
+	return NULL;
+}
+
+static GMainContext* replit_deadline_get_context(void) {
+	static GMainContext* context = NULL;
+
+	if (g_once_init_enter(&context)) {
+		GMainContext* new_context = g_main_context_new();
+
+		g_thread_unref(g_thread_new("replit-deadline", replit_deadline_watch, new_context));
+		g_once_init_leave(&context, new_context);
+	}
+
+	return context;
+}
+
+static void replit_deadline_state_clear(ReplitDeadlineState* state) {
+	g_object_unref(state->cancellable);
+}
+
+static void replit_deadline_state_release(gpointer state) {
+	g_atomic_rc_box_release_full(state, (GDestroyNotify) replit_deadline_state_clear);
+}
+
+static gboolean replit_deadline_expire(gpointer user_data) {
+	ReplitDeadlineState* state = user_data;
+
+	g_atomic_int_set(&state->expired, TRUE);
+	g_cancellable_cancel(state->cancellable);
+
+	return G_SOURCE_REMOVE;
+}
+
+static void replit_deadline_cancelled(GCancellable* parent __attribute__((unused)), gpointer user_data) {
+	ReplitDeadlineState* state = user_data;
+
+	g_cancellable_cancel(state->cancellable);
+}
+
+/* Creates a deadline at the monotonic time @deadline, or with no time limit if
+ * it is zero. */
+ReplitDeadline* replit_deadline_new(gint64 deadline, GCancellable* cancellable) {
+	ReplitDeadline* self = g_new0(ReplitDeadline, 1);
+
+	self->state = g_atomic_rc_box_new0(ReplitDeadlineState);
+	self->state->cancellable = g_cancellable_new();
+
+	if (cancellable != NULL) {
+		self->parent = g_object_ref(cancellable);
+		self->cancelled_id = g_cancellable_connect(
+			cancellable,
+			G_CALLBACK (replit_deadline_cancelled),
+			g_atomic_rc_box_acquire(self->state),
+			replit_deadline_state_release
+		);
+	}
+
+	if (deadline != 0) {
+		gint64 remaining = MAX(deadline - g_get_monotonic_time(), 0);
+
+		self->source = g_timeout_source_new((guint) ((remaining + 999) / 1000));
+		g_source_set_callback(
+			self->source,
+			replit_deadline_expire,
+			g_atomic_rc_box_acquire(self->state),
+			replit_deadline_state_release
+		);
+		g_source_attach(self->source, replit_deadline_get_context());
+	}
+
+	return self;
+}
+
+GCancellable* replit_deadline_get_cancellable(ReplitDeadline* self) {
+	return self->state->cancellable;
+}
+
+/* Returns whether the deadline has passed, rather than the request having been
+ * cancelled by the caller. */
+gboolean replit_deadline_expired(ReplitDeadline* self) {
+	return g_atomic_int_get(&self->state->expired);
+}
+
+void replit_deadline_free(ReplitDeadline* self) {
+	if (self->source != NULL) {
+		g_source_destroy(self->source);
+		g_source_unref(self->source);
+	}
+
+	if (self->parent != NULL) {
+		g_cancellable_disconnect(self->parent, self->cancelled_id);
+		g_object_unref(self->parent);
+	}
+
+	replit_deadline_state_release(self->state);
+	g_free(self);
+}
@@ -0,0 +1,821 @@
+/* replit-disk-cache.c
+ *
+ * Copyright 2022 Patrick Winters
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE X CONSORTIUM BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written
+ * authorization.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <glib/gstdio.h>
+#include <string.h>
+#include <sys/file.h>
+#include <unistd.h>
+
+#include "replit-disk-cache.h"
+#include "replit-file-private.h"
+
+#define DISK_CACHE_MAGIC "LRPLCCH\n"
+#define DISK_CACHE_VERSION 1
+#define DISK_CACHE_KEY_LENGTH 32
+#define DEFAULT_TTL 300.0
+#define DEFAULT_MAX_SIZE (64 * 1024 * 1024)
+
+/* A cache file is a file in the format of replit-file-private.h whose records
+ * have 48 byte headers. Records are only ever appended, under an
+ * exclusive lock on a separate lock file, and the last record for a key wins.
+ * Readers map the file without locking: a record is only used once its
+ * checksum matches, so one which is still being written is passed over until
+ * it is complete. Compaction writes the live records to a new file and renames
+ * it into place, so that readers which have mapped the old file can carry on
+ * using it. Expiry times are wall-clock microseconds, so that they mean the
+ * same to every process. */
+
+typedef struct {
+	guint32 length;
+	guint32 checksum;
+	gint64 expires;
+	guint8 key[DISK_CACHE_KEY_LENGTH];
+} ReplitDiskCacheRecord;
+
+G_STATIC_ASSERT (sizeof(ReplitDiskCacheRecord) == 48);
+
+/**
+ * ReplitDiskCache:
+ * 
+ * Keeps the results of queries in a file, so that they can be reused by later
+ * runs of a program, or by other programs, without asking Replit again.
+ * 
+ * Once set with [method@Client.set_disk_cache], the data returned by every
+ * successful query, but never by a mutation, is stored for
+ * [property@DiskCache:ttl] seconds, keyed by a SHA-256 hash of the client's
+ * token and the request body, which holds the query and its variables. Until
+ * then, the same query is answered from the file, which is memory-mapped, so
+ * a hit costs no more than parsing the stored data.
+ * 
+ * Any number of processes may share a cache file. Writes are serialised with a
+ * lock on a `.lock` file next to it, while reads take no lock at all, and the
+ * file is only checked for other processes' writes when a value is stored or
+ * is not found. When the file grows beyond [property@DiskCache:max-size], it is
+ * compacted to half that size, keeping the most recently stored results which
+ * have not expired.
+ * 
+ * The file holds the data of every cached query in plain text, so it is
+ * created readable by its owner only.
+ */
+
+struct _ReplitDiskCache {
+	GObject parent_instance;
+
+	GMutex mutex;
+	gchar* path;
+	gchar* lock_path;
+	gint lock_fd;
+	gint64 ttl;
+	guint64 max_size;
+	GBytes* contents;
+	guint64 inode;
+	gsize scanned;
+	gboolean damaged;
+	GHashTable* index;
+};
+
+G_DEFINE_TYPE (ReplitDiskCache, replit_disk_cache, G_TYPE_OBJECT)
+
+enum {
+	PROP_0,
+	PROP_TTL,
+	PROP_MAX_SIZE,
+	N_PROPERTIES,
+};
+
+static GParamSpec* properties[N_PROPERTIES] = { NULL };
+
+static void replit_disk_cache_finalize(GObject* gobject);
+static void replit_disk_cache_get_property(
+	GObject* gobject,
+	guint property_id,
+	GValue* value,
+	GParamSpec* pspec
+);
+static void replit_disk_cache_set_property(
+	GObject* gobject,
+	guint property_id,
+	const GValue* value,
+	GParamSpec* pspec
+);
+
+static void replit_disk_cache_class_init(ReplitDiskCacheClass* klass) {
+	GObjectClass* object_class = G_OBJECT_CLASS (klass);
+
+	object_class->finalize = replit_disk_cache_finalize;
+	object_class->get_property = replit_disk_cache_get_property;
+	object_class->set_property = replit_disk_cache_set_property;
+
+	/**
+	 * ReplitDiskCache:ttl:
+	 * 
+	 * The number of seconds a stored result may be reused for, or 0 to stop
+	 * storing results.
+	 * 
+	 * Each result keeps the time to live it was stored with, so changing this
+	 * does not affect results which are already in the file.
+	 */
+	properties[PROP_TTL] = g_param_spec_double(
+		"ttl",
+		"Time to live",
+		"The number of seconds a stored result may be reused for",
+		0,
+		G_MAXDOUBLE,
+		DEFAULT_TTL,
+		G_PARAM_READWRITE | G_PARAM_EXPLICIT_NOTIFY | G_PARAM_STATIC_STRINGS
+	);
+
+	/**
+	 * ReplitDiskCache:max-size:
+	 * 
+	 * The size in bytes beyond which the cache file is compacted, or 0 for no
+	 * limit.
+	 */
+	properties[PROP_MAX_SIZE] = g_param_spec_uint64(
+		"max-size",
+		"Maximum size",
+		"The size in bytes beyond which the cache file is compacted",
+		0,
+		G_MAXUINT64,
+		DEFAULT_MAX_SIZE,
+		G_PARAM_READWRITE | G_PARAM_EXPLICIT_NOTIFY | G_PARAM_STATIC_STRINGS
+	);
+
+	g_object_class_install_properties(object_class, N_PROPERTIES, properties);
+}
+
+static guint replit_disk_cache_key_hash(gconstpointer key) {
+	guint hash;
+	memcpy(&hash, key, sizeof(hash));
+
+	return hash;
+}
+
+static gboolean replit_disk_cache_key_equal(gconstpointer a, gconstpointer b) {
+	return memcmp(a, b, DISK_CACHE_KEY_LENGTH) == 0;
+}
+
+static void replit_disk_cache_init(ReplitDiskCache* self) {
+	g_mutex_init(&self->mutex);
+
+	self->lock_fd = -1;
+	self->ttl = (gint64) (DEFAULT_TTL * G_USEC_PER_SEC);
+	self->max_size = DEFAULT_MAX_SIZE;
+	self->index = g_hash_table_new_full(
+		replit_disk_cache_key_hash,
+		replit_disk_cache_key_equal,
+		g_free,
+		NULL
+	);
+}
+
+static void replit_disk_cache_finalize(GObject* gobject) {
+	ReplitDiskCache* self = REPLIT_DISK_CACHE (gobject);
+
+	if (self->lock_fd >= 0) g_close(self->lock_fd, NULL);
+
+	g_free(self->path);
+	g_free(self->lock_path);
+	g_clear_pointer(&self->contents, g_bytes_unref);
+	g_hash_table_unref(self->index);
+	g_mutex_clear(&self->mutex);
+
+	G_OBJECT_CLASS (replit_disk_cache_parent_class)->finalize(gobject);
+}
+
+static void replit_disk_cache_get_property(
+	GObject* gobject,
+	guint property_id,
+	GValue* value,
+	GParamSpec* pspec
+) {
+	ReplitDiskCache* self = REPLIT_DISK_CACHE (gobject);
+
+	switch (property_id) {
+		case PROP_TTL:
+			g_value_set_double(value, replit_disk_cache_get_ttl(self));
+			break;
+
+		case PROP_MAX_SIZE:
+			g_value_set_uint64(value, self->max_size);
+			break;
+
+		default:
+			G_OBJECT_WARN_INVALID_PROPERTY_ID(gobject, property_id, pspec);
+			break;
+	}
+}
+
+static void replit_disk_cache_set_property(
+	GObject* gobject,
+	guint property_id,
+	const GValue* value,
+	GParamSpec* pspec
+) {
+	ReplitDiskCache* self = REPLIT_DISK_CACHE (gobject);
+
+	switch (property_id) {
+		case PROP_TTL:
+			replit_disk_cache_set_ttl(self, g_value_get_double(value));
+			break;
+
+		case PROP_MAX_SIZE:
+			replit_disk_cache_set_max_size(self, g_value_get_uint64(value));
+			break;
+
+		default:
+			G_OBJECT_WARN_INVALID_PROPERTY_ID(gobject, property_id, pspec);
+			break;
+	}
+}
+
+static guint32 replit_disk_cache_fnv1a(guint32 hash, const guint8* data, gsize length) {
+	for (gsize i = 0; i < length; i++) {
+		hash ^= data[i];
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+/* Checksums a record's header, apart from the checksum itself, and its value,
+ * so that a record which has not been written in full is never used. */
+static guint32 replit_disk_cache_checksum(const ReplitDiskCacheRecord* record, const guint8* value) {
+	guint32 hash = 2166136261u;
+
+	hash = replit_disk_cache_fnv1a(hash, (const guint8*) &record->length, sizeof(record->length));
+	hash = replit_disk_cache_fnv1a(hash, (const guint8*) &record->expires, sizeof(record->expires));
+	hash = replit_disk_cache_fnv1a(hash, record->key, sizeof(record->key));
+
+	return replit_disk_cache_fnv1a(hash, value, GUINT32_FROM_LE(record->length));
+}
+
+static void replit_disk_cache_digest(GBytes* key, guint8* digest) {
+	GChecksum* checksum = g_checksum_new(G_CHECKSUM_SHA256);
+	gsize key_length;
+	const guint8* key_data = g_bytes_get_data(key, &key_length);
+	gsize digest_length = DISK_CACHE_KEY_LENGTH;
+
+	g_checksum_update(checksum, key_data, key_length);
+	g_checksum_get_digest(checksum, digest, &digest_length);
+	g_checksum_free(checksum);
+}
+
+static void replit_disk_cache_reset(ReplitDiskCache* self) {
+	g_clear_pointer(&self->contents, g_bytes_unref);
+	g_hash_table_remove_all(self->index);
+
+	self->inode = 0;
+	self->scanned = 0;
+	self->damaged = FALSE;
+}
+
+/* Indexes the records which have been added since the file was last scanned,
+ * stopping at the first which is incomplete. Anything else which fails its
+ * checksum is damage, which the next write compacts away. */
+static void replit_disk_cache_scan(ReplitDiskCache* self) {
+	gsize size;
+	const guint8* data = g_bytes_get_data(self->contents, &size);
+
+	if (self->scanned == 0) {
+		const ReplitFileHeader* header = (gconstpointer) data;
+
+		if (size < sizeof(*header)) return;
+
+		if (!replit_file_header_check(header, DISK_CACHE_MAGIC, DISK_CACHE_VERSION)) {
+			self->damaged = TRUE;
+
+			return;
+		}
+
+		self->scanned = sizeof(*header);
+	}
+
+	while (self->scanned + sizeof(ReplitDiskCacheRecord) <= size) {
+		const ReplitDiskCacheRecord* record = (gconstpointer) (data + self->scanned);
+		gsize end = self->scanned + sizeof(*record) +
+			replit_file_padded(GUINT32_FROM_LE(record->length));
+
+		if (end > size) break;
+
+		if (GUINT32_FROM_LE(record->checksum) != replit_disk_cache_checksum(record, (const guint8*) (record + 1))) {
+			if (end < size) self->damaged = TRUE;
+
+			break;
+		}
+
+		g_hash_table_insert(
+			self->index,
+			g_memdup2(record->key, DISK_CACHE_KEY_LENGTH),
+			GSIZE_TO_POINTER (self->scanned)
+		);
+
+		self->scanned = end;
+	}
+}
+
+/* Maps the cache file again if it has grown or been replaced since it was last
+ * mapped, so that records written by other processes are seen. */
+static void replit_disk_cache_refresh(ReplitDiskCache* self) {
+	GStatBuf buf;
+	gsize mapped = self->contents != NULL ? g_bytes_get_size(self->contents) : 0;
+
+	if (g_stat(self->path, &buf) != 0) {
+		replit_disk_cache_reset(self);
+
+		return;
+	}
+
+	if (self->contents != NULL && (guint64) buf.st_ino == self->inode && (gsize) buf.st_size == mapped) {
+		return;
+	}
+
+	gint fd = g_open(self->path, O_RDONLY | O_CLOEXEC, 0);
+
+	if (fd < 0 || fstat(fd, &buf) != 0) {
+		if (fd >= 0) g_close(fd, NULL);
+		replit_disk_cache_reset(self);
+
+		return;
+	}
+
+	GMappedFile* file = g_mapped_file_new_from_fd(fd, FALSE, NULL);
+
+	g_close(fd, NULL);
+
+	if (file == NULL) {
+		replit_disk_cache_reset(self);
+
+		return;
+	}
+
+	if (self->contents == NULL || (guint64) buf.st_ino != self->inode || g_mapped_file_get_length(file) < mapped) {
+		replit_disk_cache_reset(self);
+		self->inode = buf.st_ino;
+	} else {
+		g_bytes_unref(self->contents);
+	}
+
+	self->contents = g_mapped_file_get_bytes(file);
+	g_mapped_file_unref(file);
+
+	replit_disk_cache_scan(self);
+}
+
+static void replit_disk_cache_set_errno_error(
+	ReplitDiskCache* self,
+	gint saved_errno,
+	GError** error
+) {
+	g_set_error(
+		error,
+		G_IO_ERROR,
+		g_io_error_from_errno(saved_errno),
+		"Cannot write to cache %s: %s",
+		self->path,
+		g_strerror(saved_errno)
+	);
+}
+
+static gboolean replit_disk_cache_lock(ReplitDiskCache* self, GError** error) {
+	if (self->lock_fd < 0) {
+		self->lock_fd = g_open(self->lock_path, O_RDWR | O_CREAT | O_CLOEXEC, S_IRUSR | S_IWUSR);
+	}
+
+	gint result = -1;
+
+	if (self->lock_fd >= 0) {
+		do {
+			result = flock(self->lock_fd, LOCK_EX);
+		} while (result != 0 && errno == EINTR);
+	}
+
+	if (result != 0) {
+		replit_disk_cache_set_errno_error(self, errno, error);
+
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+static void replit_disk_cache_unlock(ReplitDiskCache* self) {
+	flock(self->lock_fd, LOCK_UN);
+}
+
+static gboolean replit_disk_cache_write_all(gint fd, const guint8* data, gsize length) {
+	while (length > 0) {
+		gssize written = write(fd, data, length);
+
+		if (written < 0) {
+			if (errno == EINTR) continue;
+
+			return FALSE;
+		}
+
+		data += written;
+		length -= written;
+	}
+
+	return TRUE;
+}
+
+static void replit_disk_cache_append_header(GByteArray* buffer) {
+	ReplitFileHeader header;
+
+	replit_file_header_init(&header, DISK_CACHE_MAGIC, DISK_CACHE_VERSION);
+	g_byte_array_append(buffer, (const guint8*) &header, sizeof(header));
+}
+
+/* Appends a record, with the file header first if the file is new, in a
+ * single write so that readers never see a header without a record. Called
+ * with the lock held. */
+static gboolean replit_disk_cache_append(
+	ReplitDiskCache* self,
+	GByteArray* record,
+	GError** error
+) {
+	gint fd = g_open(
+		self->path,
+		O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC,
+		S_IRUSR | S_IWUSR
+	);
+	GStatBuf buf;
+
+	if (fd < 0 || fstat(fd, &buf) != 0) {
+		replit_disk_cache_set_errno_error(self, errno, error);
+		if (fd >= 0) g_close(fd, NULL);
+
+		return FALSE;
+	}
+
+	GByteArray* buffer = g_byte_array_sized_new(sizeof(ReplitFileHeader) + record->len);
+
+	if (buf.st_size == 0) replit_disk_cache_append_header(buffer);
+	g_byte_array_append(buffer, record->data, record->len);
+
+	gboolean ok = replit_disk_cache_write_all(fd, buffer->data, buffer->len);
+
+	if (!ok) replit_disk_cache_set_errno_error(self, errno, error);
+
+	g_byte_array_unref(buffer);
+	g_close(fd, NULL);
+
+	return ok;
+}
+
+static gint replit_disk_cache_compare_offsets(gconstpointer a, gconstpointer b) {
+	gsize offset_a = *(const gsize*) a;
+	gsize offset_b = *(const gsize*) b;
+
+	return offset_a < offset_b ? -1 : offset_a > offset_b;
+}
+
+/* Rewrites the cache file with only the latest live record for each key, the
+ * most recently stored first, until half of the maximum size is used. Called
+ * with the lock held. */
+static gboolean replit_disk_cache_compact_locked(ReplitDiskCache* self, GError** error) {
+	replit_disk_cache_refresh(self);
+
+	gint64 now = g_get_real_time();
+	GArray* offsets = g_array_new(FALSE, FALSE, sizeof(gsize));
+	const guint8* data = self->contents != NULL ? g_bytes_get_data(self->contents, NULL) : NULL;
+
+	GHashTableIter iter;
+	gpointer value;
+
+	g_hash_table_iter_init(&iter, self->index);
+
+	while (g_hash_table_iter_next(&iter, NULL, &value)) {
+		gsize offset = GPOINTER_TO_SIZE (value);
+		const ReplitDiskCacheRecord* record = (gconstpointer) (data + offset);
+
+		if (GINT64_FROM_LE(record->expires) > now) g_array_append_val(offsets, offset);
+	}
+
+	g_array_sort(offsets, replit_disk_cache_compare_offsets);
+
+	guint64 budget = self->max_size != 0 ? self->max_size / 2 : G_MAXUINT64;
+	guint64 total = sizeof(ReplitFileHeader);
+	guint first = offsets->len;
+
+	while (first > 0) {
+		gsize offset = g_array_index(offsets, gsize, first - 1);
+		const ReplitDiskCacheRecord* record = (gconstpointer) (data + offset);
+		gsize size = sizeof(*record) + replit_file_padded(GUINT32_FROM_LE(record->length));
+
+		if (total + size > budget) break;
+
+		total += size;
+		first--;
+	}
+
+	GByteArray* buffer = g_byte_array_sized_new(total);
+	replit_disk_cache_append_header(buffer);
+
+	for (guint i = first; i < offsets->len; i++) {
+		gsize offset = g_array_index(offsets, gsize, i);
+		const ReplitDiskCacheRecord* record = (gconstpointer) (data + offset);
+		gsize size = sizeof(*record) + replit_file_padded(GUINT32_FROM_LE(record->length));
+
+		g_byte_array_append(buffer, data + offset, size);
+	}
+
+	g_array_unref(offsets);
+
+	gchar* temp_path = g_strconcat(self->path, ".XXXXXX", NULL);
+	gint fd = g_mkstemp_full(temp_path, O_WRONLY | O_CLOEXEC, S_IRUSR | S_IWUSR);
+	gboolean ok = fd >= 0 && replit_disk_cache_write_all(fd, buffer->data, buffer->len);
+	gint saved_errno = errno;
+
+	if (fd >= 0) g_close(fd, NULL);
+
+	if (ok && g_rename(temp_path, self->path) != 0) {
+		saved_errno = errno;
+		ok = FALSE;
+	}
+
+	if (!ok) {
+		replit_disk_cache_set_errno_error(self, saved_errno, error);
+		if (fd >= 0) g_unlink(temp_path);
+	}
+
+	g_free(temp_path);
+	g_byte_array_unref(buffer);
+
+	replit_disk_cache_refresh(self);
+
+	return ok;
+}
+
+/**
+ * replit_disk_cache_new:
+ * @path: (type filename): The cache file.
+ * 
+ * Creates a new #ReplitDiskCache which uses the cache file at @path. The file
+ * is created when the first result is stored.
+ * 
+ * Returns: (transfer full) (nullable): The new #ReplitDiskCache, or %NULL if
+ *   the file exists but is not a cache.
+ */
+ReplitDiskCache* replit_disk_cache_new(const gchar* path, GError** error) {
+	ReplitDiskCache* self = g_object_new(REPLIT_TYPE_DISK_CACHE, NULL);
+	self->path = g_strdup(path);
+	self->lock_path = g_strconcat(path, ".lock", NULL);
+
+	replit_disk_cache_refresh(self);
+
+	if (self->damaged && self->scanned == 0) {
+		g_set_error(
+			error,
+			G_IO_ERROR,
+			G_IO_ERROR_INVALID_DATA,
+			"%s is not a version %d libreplit cache",
+			path,
+			DISK_CACHE_VERSION
+		);
+
+		g_object_unref(self);
+
+		return NULL;
+	}
+
+	return self;
+}
+
+/* Returns the live value stored for a key in the file as it is mapped, or %NULL
+ * if there is none. Called with the mutex held. */
+static GBytes* replit_disk_cache_find(ReplitDiskCache* self, const guint8* digest) {
+	gpointer value;
+
+	if (self->contents == NULL || !g_hash_table_lookup_extended(self->index, digest, NULL, &value)) {
+		return NULL;
+	}
+
+	gsize offset = GPOINTER_TO_SIZE (value);
+	const ReplitDiskCacheRecord* record =
+		(gconstpointer) ((const guint8*) g_bytes_get_data(self->contents, NULL) + offset);
+
+	if (GINT64_FROM_LE(record->expires) <= g_get_real_time()) return NULL;
+
+	return g_bytes_new_from_bytes(
+		self->contents,
+		offset + sizeof(*record),
+		GUINT32_FROM_LE(record->length)
+	);
+}
+
+/**
+ * replit_disk_cache_lookup:
+ * @cache: The cache.
+ * @key: (transfer none): The key the value was stored with.
+ * 
+ * Looks up a value which has not expired.
+ * 
+ * The value is read straight from the mapped file, without being copied. A hit
+ * is answered from the file as it was last mapped, without checking it; only a
+ * miss looks for records written since by other processes, as it is about to
+ * cost a request anyway.
+ * 
+ * Returns: (transfer full) (nullable): The value, or %NULL if there is none.
+ */
+GBytes* replit_disk_cache_lookup(ReplitDiskCache* self, GBytes* key) {
+	guint8 digest[DISK_CACHE_KEY_LENGTH];
+
+	replit_disk_cache_digest(key, digest);
+
+	g_mutex_lock(&self->mutex);
+
+	GBytes* bytes = replit_disk_cache_find(self, digest);
+
+	if (bytes == NULL) {
+		replit_disk_cache_refresh(self);
+		bytes = replit_disk_cache_find(self, digest);
+	}
+
+	g_mutex_unlock(&self->mutex);
+
+	return bytes;
+}
+
+/**
+ * replit_disk_cache_store:
+ * @cache: The cache.
+ * @key: (transfer none): The key to store the value with.
+ * @value: (transfer none): The value to store.
+ * 
+ * Stores a value for [property@DiskCache:ttl] seconds, replacing any earlier
+ * value for the same key. Nothing is stored if the time to live is 0.
+ * 
+ * If the file has grown beyond [property@DiskCache:max-size], it is compacted.
+ * 
+ * Returns: %TRUE on success, or %FALSE if the file could not be written.
+ */
+gboolean replit_disk_cache_store(
+	ReplitDiskCache* self,
+	GBytes* key,
+	GBytes* value,
+	GError** error
+) {
+	static const guint8 padding[REPLIT_FILE_ALIGN] = { 0 };
+
+	gsize length;
+	const guint8* value_data = g_bytes_get_data(value, &length);
+
+	g_return_val_if_fail(length <= G_MAXUINT32, FALSE);
+
+	if (self->ttl == 0) return TRUE;
+
+	ReplitDiskCacheRecord header = {
+		.length = GUINT32_TO_LE((guint32) length),
+		.expires = GINT64_TO_LE(g_get_real_time() + self->ttl),
+	};
+
+	replit_disk_cache_digest(key, header.key);
+	header.checksum = GUINT32_TO_LE(replit_disk_cache_checksum(&header, value_data));
+
+	GByteArray* record = g_byte_array_sized_new(sizeof(header) + replit_file_padded(length));
+	g_byte_array_append(record, (const guint8*) &header, sizeof(header));
+	g_byte_array_append(record, value_data, length);
+	g_byte_array_append(record, padding, replit_file_padded(length) - length);
+
+	g_mutex_lock(&self->mutex);
+
+	gboolean ok = replit_disk_cache_lock(self, error);
+
+	if (ok) {
+		ok = replit_disk_cache_append(self, record, error);
+
+		if (ok) {
+			replit_disk_cache_refresh(self);
+
+			gsize size = self->contents != NULL ? g_bytes_get_size(self->contents) : 0;
+
+			if ((self->max_size != 0 && size > self->max_size) || self->damaged || self->scanned < size) {
+				ok = replit_disk_cache_compact_locked(self, error);
+			}
+		}
+
+		replit_disk_cache_unlock(self);
+	}
+
+	g_mutex_unlock(&self->mutex);
+	g_byte_array_unref(record);
+
+	return ok;
+}
+
+/**
+ * replit_disk_cache_compact:
+ * @cache: The cache.
+ * 
+ * Rewrites the cache file without expired values or values which have been
+ * replaced, and within half of [property@DiskCache:max-size].
+ * 
+ * Processes which are reading the file at the same time carry on reading the
+ * old file until they next miss a value.
+ * 
+ * Returns: %TRUE on success, or %FALSE if the file could not be written.
+ */
+gboolean replit_disk_cache_compact(ReplitDiskCache* self, GError** error) {
+	g_mutex_lock(&self->mutex);
+
+	gboolean ok = replit_disk_cache_lock(self, error);
+
+	if (ok) {
+		ok = replit_disk_cache_compact_locked(self, error);
+		replit_disk_cache_unlock(self);
+	}
+
+	g_mutex_unlock(&self->mutex);
+
+	return ok;
+}
+
+/**
+ * replit_disk_cache_set_ttl:
+ * @cache: The cache.
+ * @seconds: The number of seconds to reuse values for, or 0 to stop storing.
+ * 
+ * Sets the number of seconds a stored value may be reused for.
+ * 
+ * See [property@DiskCache:ttl].
+ */
+void replit_disk_cache_set_ttl(ReplitDiskCache* self, gdouble seconds) {
+	gint64 ttl = (gint64) (MAX(seconds, 0) * G_USEC_PER_SEC);
+
+	if (self->ttl == ttl) return;
+
+	self->ttl = ttl;
+
+	g_object_notify_by_pspec(G_OBJECT (self), properties[PROP_TTL]);
+}
+
+/**
+ * replit_disk_cache_get_ttl:
+ * @cache: The cache.
+ * 
+ * Gets the number of seconds a stored value may be reused for.
+ * 
+ * Returns: The time to live, in seconds.
+ */
+gdouble replit_disk_cache_get_ttl(ReplitDiskCache* self) {
+	return (gdouble) self->ttl / G_USEC_PER_SEC;
+}
+
+/**
+ * replit_disk_cache_set_max_size:
+ * @cache: The cache.
+ * @bytes: The size beyond which to compact the file, or 0 for no limit.
+ * 
+ * Sets the size in bytes beyond which the cache file is compacted.
+ * 
+ * See [property@DiskCache:max-size].
+ */
+void replit_disk_cache_set_max_size(ReplitDiskCache* self, guint64 bytes) {
+	if (self->max_size == bytes) return;
+
+	self->max_size = bytes;
+
+	g_object_notify_by_pspec(G_OBJECT (self), properties[PROP_MAX_SIZE]);
+}
+
+/**
+ * replit_disk_cache_get_max_size:
+ * @cache: The cache.
+ * 
+ * Gets the size in bytes beyond which the cache file is compacted.
+ * 
+ * Returns: The maximum size, or 0 if there is no limit.
+ */
+guint64 replit_disk_cache_get_max_size(ReplitDiskCache* self) {
+	return self->max_size;
+}
@@ -0,0 +1,64 @@
+/* replit-disk-cache.h
+ *
+ * Copyright 2022 Patrick Winters
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE X CONSORTIUM BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written
+ * authorization.
+ */
+
+#pragma once
+
+#if !defined(REPLIT_INSIDE) && !defined(REPLIT_COMPILATION)
+#error "Only <replit.h> can be included directly."
+#endif
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+#define REPLIT_TYPE_DISK_CACHE replit_disk_cache_get_type()
+G_DECLARE_FINAL_TYPE (ReplitDiskCache, replit_disk_cache, REPLIT, DISK_CACHE, GObject)
+
+ReplitDiskCache* replit_disk_cache_new(const gchar* path, GError** error);
+
+GBytes* replit_disk_cache_lookup(ReplitDiskCache* cache, GBytes* key);
+
+gboolean replit_disk_cache_store(
+	ReplitDiskCache* cache,
+	GBytes* key,
+	GBytes* value,
+	GError** error
+);
+
+gboolean replit_disk_cache_compact(ReplitDiskCache* cache, GError** error);
+
+void replit_disk_cache_set_ttl(ReplitDiskCache* cache, gdouble seconds);
+
+gdouble replit_disk_cache_get_ttl(ReplitDiskCache* cache);
+
+void replit_disk_cache_set_max_size(ReplitDiskCache* cache, guint64 bytes);
+
+guint64 replit_disk_cache_get_max_size(ReplitDiskCache* cache);
+
+G_END_DECLS
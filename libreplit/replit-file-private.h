@@ -0,0 +1,77 @@
+/* replit-file-private.h
+ *
+ * Copyright 2022 Patrick Winters
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE X CONSORTIUM BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written
+ * authorization.
+ */
+
+#pragma once
+
+#include <glib.h>
+#include <string.h>
+
+G_BEGIN_DECLS
+
+/* Recordings and disk caches are both a 16 byte file header, naming the format
+ * and its version, followed by records, each of which is a fixed size header
+ * and its data, padded to a multiple of 8 bytes so that every header in a
+ * mapped file is aligned. All integers are little-endian. */
+
+#define REPLIT_FILE_ALIGN 8
+
+typedef struct {
+	gchar magic[8];
+	guint32 version;
+	guint32 reserved;
+} ReplitFileHeader;
+
+G_STATIC_ASSERT (sizeof(ReplitFileHeader) == 16);
+
+/* Returns the length of a record's data with the padding which follows it. */
+static inline gsize replit_file_padded(gsize length) {
+	return (length + REPLIT_FILE_ALIGN - 1) & ~((gsize) REPLIT_FILE_ALIGN - 1);
+}
+
+static inline void replit_file_header_init(
+	ReplitFileHeader* header,
+	const gchar* magic,
+	guint32 version
+) {
+	memset(header, 0, sizeof(*header));
+	memcpy(header->magic, magic, sizeof(header->magic));
+	header->version = GUINT32_TO_LE(version);
+}
+
+/* Returns whether a file header names the given format and version. */
+static inline gboolean replit_file_header_check(
+	const ReplitFileHeader* header,
+	const gchar* magic,
+	guint32 version
+) {
+	return memcmp(header->magic, magic, sizeof(header->magic)) == 0 &&
+		GUINT32_FROM_LE(header->version) == version;
+}
+
+G_END_DECLS
@@ -0,0 +1,586 @@
+/* replit-graphql.c
+ *
+ * Copyright 2022 Patrick Winters
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE X CONSORTIUM BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written
+ * authorization.
+ */
+
+#include "replit-graphql.h"
+
+#define MAX_NESTING 256
+
+G_DEFINE_QUARK (REPLIT_GRAPHQL_ERROR, replit_graphql_error)
+
+typedef enum {
+	TOKEN_EOF,
+	TOKEN_PUNCTUATOR,
+	TOKEN_SPREAD,
+	TOKEN_NAME,
+	TOKEN_NUMBER,
+	TOKEN_STRING,
+	TOKEN_BLOCK_STRING,
+} ReplitGraphqlTokenKind;
+
+typedef struct {
+	ReplitGraphqlTokenKind kind;
+	const gchar* start;
+	gsize length;
+} ReplitGraphqlToken;
+
+typedef struct {
+	const gchar* document;
+	const gchar* cursor;
+} ReplitGraphqlLexer;
+
+enum {
+	CLASS_OTHER = 0,
+	CLASS_IGNORED,
+	CLASS_COMMENT,
+	CLASS_PUNCTUATOR,
+	CLASS_NAME_START,
+	CLASS_DIGIT,
+};
+
+/* Character classes for the first byte of a token; everything past ASCII is
+ * invalid outside strings and comments, except for a leading byte-order mark. */
+static const guint8 char_class[256] = {
+	['\t'] = CLASS_IGNORED, ['\n'] = CLASS_IGNORED, ['\r'] = CLASS_IGNORED,
+	[' '] = CLASS_IGNORED, [','] = CLASS_IGNORED,
+	['#'] = CLASS_COMMENT,
+	['!'] = CLASS_PUNCTUATOR, ['$'] = CLASS_PUNCTUATOR, ['&'] = CLASS_PUNCTUATOR,
+	['('] = CLASS_PUNCTUATOR, [')'] = CLASS_PUNCTUATOR, [':'] = CLASS_PUNCTUATOR,
+	['='] = CLASS_PUNCTUATOR, ['@'] = CLASS_PUNCTUATOR, ['['] = CLASS_PUNCTUATOR,
+	[']'] = CLASS_PUNCTUATOR, ['{'] = CLASS_PUNCTUATOR, ['|'] = CLASS_PUNCTUATOR,
+	['}'] = CLASS_PUNCTUATOR,
+	['_'] = CLASS_NAME_START,
+	['A' ... 'Z'] = CLASS_NAME_START, ['a' ... 'z'] = CLASS_NAME_START,
+	['-'] = CLASS_DIGIT, ['0' ... '9'] = CLASS_DIGIT,
+};
+
+static inline gboolean is_name_continue(gchar c) {
+	return g_ascii_isalnum(c) || c == '_';
+}
+
+static void replit_graphql_set_error(
+	ReplitGraphqlLexer* lexer,
+	const gchar* position,
+	GError** error,
+	gint code,
+	const gchar* message
+) {
+	guint line = 1;
+	guint column = 1;
+
+	for (const gchar* c = lexer->document; c < position; c++) {
+		if (*c == '\n') {
+			line++;
+			column = 1;
+		} else {
+			column++;
+		}
+	}
+
+	g_set_error(
+		error,
+		REPLIT_GRAPHQL_ERROR,
+		code,
+		"%u:%u: %s",
+		line,
+		column,
+		message
+	);
+}
+
+static gboolean replit_graphql_lex_number(
+	ReplitGraphqlLexer* lexer,
+	GError** error
+) {
+	const gchar* c = lexer->cursor;
+
+	if (*c == '-') c++;
+
+	if (*c == '0') {
+		c++;
+	} else if (g_ascii_isdigit(*c)) {
+		while (g_ascii_isdigit(*c)) c++;
+	} else {
+		goto invalid;
+	}
+
+	if (*c == '.') {
+		c++;
+		if (!g_ascii_isdigit(*c)) goto invalid;
+		while (g_ascii_isdigit(*c)) c++;
+	}
+
+	if (*c == 'e' || *c == 'E') {
+		c++;
+		if (*c == '+' || *c == '-') c++;
+		if (!g_ascii_isdigit(*c)) goto invalid;
+		while (g_ascii_isdigit(*c)) c++;
+	}
+
+	if (*c == '.' || *c == '_' || g_ascii_isalnum(*c)) goto invalid;
+
+	lexer->cursor = c;
+
+	return TRUE;
+
+invalid:
+	replit_graphql_set_error(
+		lexer,
+		c,
+		error,
+		REPLIT_GRAPHQL_ERROR_SYNTAX,
+		"Invalid number"
+	);
+
+	return FALSE;
+}
+
+static gboolean replit_graphql_lex_string(
+	ReplitGraphqlLexer* lexer,
+	GError** error
+) {
+	const gchar* c = lexer->cursor + 1;
+
+	for (;;) {
+		switch (*c) {
+			case '"':
+				lexer->cursor = c + 1;
+				return TRUE;
+
+			case '\\':
+				if (c[1] == '\0') break;
+				c += 2;
+				continue;
+
+			case '\n':
+			case '\r':
+			case '\0':
+				break;
+
+			default:
+				c++;
+				continue;
+		}
+
+		break;
+	}
+
+	replit_graphql_set_error(
+		lexer,
+		lexer->cursor,
+		error,
+		REPLIT_GRAPHQL_ERROR_SYNTAX,
+		"Unterminated string"
+	);
+
+	return FALSE;
+}
+
+static gboolean replit_graphql_lex_block_string(
+	ReplitGraphqlLexer* lexer,
+	GError** error
+) {
+	const gchar* c = lexer->cursor + 3;
+
+	while (*c != '\0') {
+		if (c[0] == '\\' && c[1] == '"' && c[2] == '"' && c[3] == '"') {
+			c += 4;
+		} else if (c[0] == '"' && c[1] == '"' && c[2] == '"') {
+			lexer->cursor = c + 3;
+			return TRUE;
+		} else {
+			c++;
+		}
+	}
+
+	replit_graphql_set_error(
+		lexer,
+		lexer->cursor,
+		error,
+		REPLIT_GRAPHQL_ERROR_SYNTAX,
+		"Unterminated block string"
+	);
+
+	return FALSE;
+}
+
+/* Advances to the next significant token, skipping whitespace, commas,
+ * comments and byte-order marks. String tokens keep their quotes and escapes
+ * exactly as written, since they are copied to the output without decoding. */
+static gboolean replit_graphql_lexer_next(
+	ReplitGraphqlLexer* lexer,
+	ReplitGraphqlToken* token,
+	GError** error
+) {
+	const gchar* c = lexer->cursor;
+
+	for (;;) {
+		guchar byte = (guchar) *c;
+
+		if (char_class[byte] == CLASS_IGNORED) {
+			c++;
+		} else if (char_class[byte] == CLASS_COMMENT) {
+			while (*c != '\0' && *c != '\n' && *c != '\r') c++;
+		} else if (byte == 0xEF && (guchar) c[1] == 0xBB && (guchar) c[2] == 0xBF) {
+			c += 3;
+		} else {
+			break;
+		}
+	}
+
+	lexer->cursor = c;
+	token->start = c;
+
+	switch (char_class[(guchar) *c]) {
+		case CLASS_PUNCTUATOR:
+			token->kind = TOKEN_PUNCTUATOR;
+			lexer->cursor++;
+			break;
+
+		case CLASS_NAME_START:
+			token->kind = TOKEN_NAME;
+			do lexer->cursor++; while (is_name_continue(*lexer->cursor));
+			break;
+
+		case CLASS_DIGIT:
+			token->kind = TOKEN_NUMBER;
+			if (!replit_graphql_lex_number(lexer, error)) return FALSE;
+			break;
+
+		default:
+			if (*c == '\0') {
+				token->kind = TOKEN_EOF;
+			} else if (c[0] == '.' && c[1] == '.' && c[2] == '.') {
+				token->kind = TOKEN_SPREAD;
+				lexer->cursor += 3;
+			} else if (c[0] == '"' && c[1] == '"' && c[2] == '"') {
+				token->kind = TOKEN_BLOCK_STRING;
+				if (!replit_graphql_lex_block_string(lexer, error)) return FALSE;
+			} else if (c[0] == '"') {
+				token->kind = TOKEN_STRING;
+				if (!replit_graphql_lex_string(lexer, error)) return FALSE;
+			} else {
+				replit_graphql_set_error(
+					lexer,
+					c,
+					error,
+					REPLIT_GRAPHQL_ERROR_SYNTAX,
+					"Unexpected character"
+				);
+
+				return FALSE;
+			}
+
+			break;
+	}
+
+	token->length = lexer->cursor - token->start;
+
+	return TRUE;
+}
+
+/**
+ * replit_graphql_minify:
+ * @document: (transfer none): The GraphQL document to minify.
+ *
+ * Removes all insignificant characters from a GraphQL document.
+ *
+ * Comments, commas, byte-order marks and whitespace between tokens are
+ * removed, and a single space is kept only where two adjacent tokens would
+ * otherwise merge. String literals and block strings are copied exactly as
+ * written, so the minified document has the same meaning as the original.
+ *
+ * The output is deterministic for a given sequence of tokens, so two documents
+ * that differ only in formatting will minify to the same string.
+ *
+ * Returns: (transfer full) (nullable): The minified document, or %NULL if the
+ *   document could not be tokenised.
+ */
+gchar* replit_graphql_minify(const gchar* document, GError** error) {
+	g_return_val_if_fail(document != NULL, NULL);
+
+	ReplitGraphqlLexer lexer = { document, document };
+	ReplitGraphqlToken token;
+
+	GString* buffer = g_string_sized_new(strlen(document));
+	gchar stack[MAX_NESTING];
+	guint depth = 0;
+	gboolean last_word = FALSE;
+
+	for (;;) {
+		if (!replit_graphql_lexer_next(&lexer, &token, error)) {
+			g_string_free(buffer, TRUE);
+
+			return NULL;
+		}
+
+		if (token.kind == TOKEN_EOF) break;
+
+		gboolean word = token.kind != TOKEN_PUNCTUATOR && token.kind != TOKEN_SPREAD;
+
+		if (last_word && (word || token.kind == TOKEN_SPREAD)) {
+			g_string_append_c(buffer, ' ');
+		}
+
+		if (token.kind == TOKEN_PUNCTUATOR) {
+			gchar c = *token.start;
+			gchar open = c == ')' ? '(' : c == ']' ? '[' : c == '}' ? '{' : '\0';
+
+			if (c == '(' || c == '[' || c == '{') {
+				if (depth == MAX_NESTING) {
+					replit_graphql_set_error(
+						&lexer,
+						token.start,
+						error,
+						REPLIT_GRAPHQL_ERROR_UNBALANCED,
+						"Document is nested too deeply"
+					);
+
+					g_string_free(buffer, TRUE);
+
+					return NULL;
+				}
+
+				stack[depth++] = c;
+			} else if (open != '\0') {
+				if (depth == 0 || stack[depth - 1] != open) {
+					replit_graphql_set_error(
+						&lexer,
+						token.start,
+						error,
+						REPLIT_GRAPHQL_ERROR_UNBALANCED,
+						"Unmatched closing bracket"
+					);
+
+					g_string_free(buffer, TRUE);
+
+					return NULL;
+				}
+
+				depth--;
+			}
+		}
+
+		g_string_append_len(buffer, token.start, token.length);
+		last_word = word;
+	}
+
+	if (depth != 0) {
+		replit_graphql_set_error(
+			&lexer,
+			lexer.cursor,
+			error,
+			REPLIT_GRAPHQL_ERROR_UNBALANCED,
+			"Unclosed bracket at end of document"
+		);
+
+		g_string_free(buffer, TRUE);
+
+		return NULL;
+	}
+
+	return g_string_free(buffer, FALSE);
+}
+
+/**
+ * replit_graphql_hash:
+ * @document: (transfer none): The GraphQL document to hash.
+ *
+ * Computes a canonical hash of a GraphQL document.
+ *
+ * The hash is the hex-encoded SHA-256 digest of the minified document (see
+ * [func@graphql_minify]), so it does not change when only formatting or
+ * comments are edited. It is suitable as a key for caching and deduplicating
+ * queries, and matches the hash of the exact text sent when query minification
+ * is enabled on a #ReplitClient.
+ *
+ * Returns: (transfer full) (nullable): The hash, or %NULL if the document could
+ *   not be tokenised.
+ */
+gchar* replit_graphql_hash(const gchar* document, GError** error) {
+	gchar* minified = replit_graphql_minify(document, error);
+	if (minified == NULL) return NULL;
+
+	gchar* hash = g_compute_checksum_for_string(G_CHECKSUM_SHA256, minified, -1);
+
+	g_free(minified);
+
+	return hash;
+}
+
+/* Finds the first operation defined in a document, or the first named
+ * @operation_name if that is not %NULL, setting @type to its keyword and @name
+ * to its name. Either token is left as %TOKEN_EOF when it is absent: the
+ * keyword for the `{ ... }` shorthand, the name for an anonymous operation.
+ * The shorthand may only start a definition, at the start of the document or
+ * straight after the `}` closing an earlier one. Returns %FALSE if the document has no such operation or fails to tokenise. */
+static gboolean replit_graphql_find_operation(
+	const gchar* document,
+	const gchar* operation_name,
+	ReplitGraphqlToken* type,
+	ReplitGraphqlToken* name,
+	GError** error
+) {
+	ReplitGraphqlLexer lexer = { document, document };
+	ReplitGraphqlToken token;
+	ReplitGraphqlToken previous = { TOKEN_EOF, NULL, 0 };
+	gboolean operation = FALSE;
+	gsize operation_name_length = operation_name != NULL ? strlen(operation_name) : 0;
+	guint depth = 0;
+
+	*type = previous;
+	*name = previous;
+
+	for (;;) {
+		if (!replit_graphql_lexer_next(&lexer, &token, error)) return FALSE;
+
+		if (token.kind == TOKEN_EOF) return operation && operation_name == NULL;
+
+		if (operation) {
+			if (token.kind == TOKEN_NAME) *name = token;
+
+			if (operation_name == NULL || (
+				name->kind == TOKEN_NAME &&
+				name->length == operation_name_length &&
+				strncmp(name->start, operation_name, operation_name_length) == 0
+			)) {
+				return TRUE;
+			}
+
+			/* Not the operation wanted, so carry on past it. Its name cannot
+			 * start another operation. */
+			operation = FALSE;
+			*type = (ReplitGraphqlToken) { TOKEN_EOF, NULL, 0 };
+			*name = *type;
+
+			if (token.kind == TOKEN_NAME) {
+				previous = token;
+
+				continue;
+			}
+		}
+
+		if (token.kind == TOKEN_PUNCTUATOR) {
+			gchar c = *token.start;
+
+			if (c == '{' && depth == 0 && operation_name == NULL && (
+				previous.kind == TOKEN_EOF ||
+				(previous.kind == TOKEN_PUNCTUATOR && *previous.start == '}')
+			)) {
+				return TRUE;
+			}
+
+			if (c == '(' || c == '[' || c == '{') depth++;
+			if ((c == ')' || c == ']' || c == '}') && depth > 0) depth--;
+		} else if (token.kind == TOKEN_NAME && depth == 0) {
+			gboolean after_keyword = previous.kind == TOKEN_NAME && (
+				(previous.length == 2 && strncmp(previous.start, "on", 2) == 0) ||
+				(previous.length == 8 && strncmp(previous.start, "fragment", 8) == 0)
+			);
+
+			operation = !after_keyword && (
+				(token.length == 5 && strncmp(token.start, "query", 5) == 0) ||
+				(token.length == 8 && strncmp(token.start, "mutation", 8) == 0) ||
+				(token.length == 12 && strncmp(token.start, "subscription", 12) == 0)
+			);
+
+			if (operation) *type = token;
+		}
+
+		previous = token;
+	}
+}
+
+/**
+ * replit_graphql_get_operation_name:
+ * @document: (transfer none): The GraphQL document to inspect.
+ * 
+ * Finds the name of the first operation defined in a GraphQL document.
+ * 
+ * Fragment definitions are skipped. If the first operation is anonymous, such
+ * as a query written in the `{ ... }` shorthand form, %NULL is returned without
+ * setting @error.
+ * 
+ * Returns: (transfer full) (nullable): The operation name, or %NULL.
+ */
+gchar* replit_graphql_get_operation_name(const gchar* document, GError** error) {
+	g_return_val_if_fail(document != NULL, NULL);
+
+	ReplitGraphqlToken type;
+	ReplitGraphqlToken name;
+
+	if (!replit_graphql_find_operation(document, NULL, &type, &name, error)) return NULL;
+
+	if (name.kind == TOKEN_EOF) return NULL;
+
+	return g_strndup(name.start, name.length);
+}
+
+/**
+ * replit_graphql_is_query:
+ * @document: (transfer none): The GraphQL document to inspect.
+ * 
+ * Checks whether the first operation defined in a GraphQL document is a query,
+ * including the `{ ... }` shorthand form, rather than a mutation or a
+ * subscription.
+ * 
+ * Queries have no side effects, so their results may be cached and they may be
+ * sent more than once. Documents with no operation, or which fail to tokenise,
+ * are not queries.
+ * 
+ * Returns: Whether the first operation is a query.
+ */
+gboolean replit_graphql_is_query(const gchar* document) {
+	return replit_graphql_operation_is_query(document, NULL);
+}
+
+/**
+ * replit_graphql_operation_is_query:
+ * @document: (transfer none): The GraphQL document to inspect.
+ * @operation_name: (nullable): The name of the operation to check, or %NULL
+ *   for the first one.
+ * 
+ * Checks whether the operation a request would select from a GraphQL document
+ * is a query, as [func@graphql_is_query] does for its first operation.
+ * 
+ * Documents with several operations are sent with the name of the one to run,
+ * which need not be the first. Documents with no operation of that name are
+ * not queries.
+ * 
+ * Returns: Whether the operation named @operation_name is a query.
+ */
+gboolean replit_graphql_operation_is_query(const gchar* document, const gchar* operation_name) {
+	g_return_val_if_fail(document != NULL, FALSE);
+
+	ReplitGraphqlToken type;
+	ReplitGraphqlToken name;
+
+	if (!replit_graphql_find_operation(document, operation_name, &type, &name, NULL)) return FALSE;
+
+	return type.kind == TOKEN_EOF || (type.length == 5 && strncmp(type.start, "query", 5) == 0);
+}
@@ -0,0 +1,81 @@
+/* replit-graphql.h
+ *
+ * Copyright 2022 Patrick Winters
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE X CONSORTIUM BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written
+ * authorization.
+ */
+
+#pragma once
+
+#if !defined(REPLIT_INSIDE) && !defined(REPLIT_COMPILATION)
+#error "Only <replit.h> can be included directly."
+#endif
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/**
+ * replit_graphql_error_quark: (skip)
+ * 
+ * Creates and returns the quark for #ReplitGraphqlError.
+ * 
+ * Returns: The created quark.
+ */
+GQuark replit_graphql_error_quark(void);
+#define REPLIT_GRAPHQL_ERROR replit_graphql_error_quark()
+
+/**
+ * ReplitGraphqlError:
+ * 
+ * Error codes to be returned when processing GraphQL documents.
+ */
+typedef enum {
+	/**
+	 * REPLIT_GRAPHQL_ERROR_SYNTAX:
+	 * 
+	 * The document contains a character or token that is not valid GraphQL.
+	 */
+	REPLIT_GRAPHQL_ERROR_SYNTAX,
+
+	/**
+	 * REPLIT_GRAPHQL_ERROR_UNBALANCED:
+	 * 
+	 * The document contains unmatched brackets, braces or parentheses.
+	 */
+	REPLIT_GRAPHQL_ERROR_UNBALANCED,
+} ReplitGraphqlError;
+
+gchar* replit_graphql_minify(const gchar* document, GError** error);
+
+gchar* replit_graphql_hash(const gchar* document, GError** error);
+
+gchar* replit_graphql_get_operation_name(const gchar* document, GError** error);
+
+gboolean replit_graphql_is_query(const gchar* document);
+
+gboolean replit_graphql_operation_is_query(const gchar* document, const gchar* operation_name);
+
+G_END_DECLS
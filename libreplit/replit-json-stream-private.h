@@ -0,0 +1,69 @@
+/* replit-json-stream-private.h
+ *
+ * Copyright 2022 Patrick Winters
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE X CONSORTIUM BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written
+ * authorization.
+ */
+
+#pragma once
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* Called with the raw JSON text of each element of the streamed array. Return
+ * FALSE to stop scanning. */
+typedef gboolean (* ReplitJsonStreamFunc)(
+	const gchar* element,
+	gsize length,
+	gpointer user_data
+);
+
+typedef struct _ReplitJsonStream ReplitJsonStream;
+
+ReplitJsonStream* replit_json_stream_new(
+	const gchar* path,
+	ReplitJsonStreamFunc func,
+	gpointer user_data
+);
+
+void replit_json_stream_free(ReplitJsonStream* stream);
+
+gboolean replit_json_stream_feed(
+	ReplitJsonStream* stream,
+	const gchar* data,
+	gsize length,
+	GError** error
+);
+
+gboolean replit_json_stream_finish(ReplitJsonStream* stream, GError** error);
+
+gboolean replit_json_stream_is_stopped(ReplitJsonStream* stream);
+
+gboolean replit_json_stream_has_data(ReplitJsonStream* stream);
+
+const gchar* replit_json_stream_get_error(ReplitJsonStream* stream, gsize* length);
+
+G_END_DECLS
@@ -0,0 +1,498 @@
+/* replit-json-stream.c
+ *
+ * Copyright 2022 Patrick Winters
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE X CONSORTIUM BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written
+ * authorization.
+ */
+
+#include <json-glib/json-glib.h>
+
+#include "replit-json-stream-private.h"
+
+/* An incremental scanner over a JSON document which never builds a tree. It
+ * only tracks enough structure (a stack of containers and the current member
+ * name where it matters) to find the array at the requested path, and copies
+ * the text of one element of that array at a time into a reusable buffer. The
+ * root `error` member is kept aside in the same way so that failed requests can
+ * still be reported. */
+
+typedef enum {
+	LEX_NORMAL,
+	LEX_STRING,
+	LEX_STRING_ESCAPE,
+	LEX_SCALAR,
+} ReplitJsonLexState;
+
+typedef enum {
+	EXPECT_VALUE,
+	EXPECT_KEY,
+	EXPECT_COLON,
+	EXPECT_COMMA,
+} ReplitJsonExpect;
+
+typedef enum {
+	CAPTURE_NONE,
+	CAPTURE_ELEMENT,
+	CAPTURE_ERROR,
+} ReplitJsonCapture;
+
+typedef struct {
+	gchar kind;
+	ReplitJsonExpect expect;
+	/* How many path components lead to this container, or -1 if it is off the
+	 * path. */
+	gint prefix;
+	gboolean key_matches;
+	gboolean target;
+} ReplitJsonFrame;
+
+struct _ReplitJsonStream {
+	gchar** path;
+	gint path_length;
+	ReplitJsonStreamFunc func;
+	gpointer user_data;
+
+	GArray* frames;
+	ReplitJsonLexState lex;
+	gboolean string_is_key;
+	gboolean key_wanted;
+	GString* key;
+	gboolean root_done;
+	gboolean root_error_key;
+	gboolean has_data;
+	gboolean stopped;
+
+	ReplitJsonCapture capture;
+	guint capture_depth;
+	GString* buffer;
+	GString* error_member;
+
+	gsize offset;
+};
+
+static inline gboolean is_scalar_char(gchar c) {
+	return g_ascii_isalnum(c) || c == '-' || c == '+' || c == '.';
+}
+
+static inline ReplitJsonFrame* replit_json_stream_top(ReplitJsonStream* self) {
+	if (self->frames->len == 0) return NULL;
+
+	return &g_array_index(self->frames, ReplitJsonFrame, self->frames->len - 1);
+}
+
+static void replit_json_stream_set_error(
+	ReplitJsonStream* self,
+	gchar c,
+	GError** error
+) {
+	g_set_error(
+		error,
+		JSON_PARSER_ERROR,
+		JSON_PARSER_ERROR_INVALID_DATA,
+		"Unexpected character '%c' at offset %" G_GSIZE_FORMAT " in JSON response",
+		c,
+		self->offset
+	);
+}
+
+/**
+ * replit_json_stream_new: (skip)
+ * @path: (transfer none): A dot-separated path of member names from the root of
+ *   the document to the array to stream.
+ * @func: (scope call): The function to call with each element.
+ * @user_data: (closure): Data to pass to @func.
+ * 
+ * Creates a scanner which calls @func with the text of every element of the
+ * array at @path as the document is fed to it.
+ * 
+ * Returns: (transfer full): The scanner.
+ */
+ReplitJsonStream* replit_json_stream_new(
+	const gchar* path,
+	ReplitJsonStreamFunc func,
+	gpointer user_data
+) {
+	ReplitJsonStream* self = g_new0(ReplitJsonStream, 1);
+
+	self->path = path[0] != '\0' ? g_strsplit(path, ".", -1) : g_new0(gchar*, 1);
+	self->path_length = g_strv_length(self->path);
+	self->func = func;
+	self->user_data = user_data;
+	self->frames = g_array_sized_new(FALSE, FALSE, sizeof(ReplitJsonFrame), 16);
+	self->key = g_string_sized_new(32);
+	self->buffer = g_string_sized_new(4096);
+
+	return self;
+}
+
+/**
+ * replit_json_stream_free: (skip)
+ * @stream: The scanner.
+ * 
+ * Frees the scanner and its buffers.
+ */
+void replit_json_stream_free(ReplitJsonStream* self) {
+	g_strfreev(self->path);
+	g_array_unref(self->frames);
+	g_string_free(self->key, TRUE);
+	g_string_free(self->buffer, TRUE);
+
+	if (self->error_member != NULL) g_string_free(self->error_member, TRUE);
+
+	g_free(self);
+}
+
+static void replit_json_stream_begin_value(ReplitJsonStream* self) {
+	if (self->capture != CAPTURE_NONE) return;
+
+	ReplitJsonFrame* top = replit_json_stream_top(self);
+
+	if (top == NULL) return;
+
+	if (top->target) {
+		self->capture = CAPTURE_ELEMENT;
+	} else if (self->frames->len == 1 && top->kind == '{' && self->root_error_key) {
+		self->capture = CAPTURE_ERROR;
+	} else {
+		return;
+	}
+
+	self->capture_depth = self->frames->len;
+	g_string_truncate(self->buffer, 0);
+}
+
+static void replit_json_stream_end_value(ReplitJsonStream* self) {
+	ReplitJsonFrame* top = replit_json_stream_top(self);
+
+	if (top != NULL) {
+		top->expect = EXPECT_COMMA;
+	} else {
+		self->root_done = TRUE;
+	}
+
+	if (self->capture == CAPTURE_NONE || self->frames->len != self->capture_depth) {
+		return;
+	}
+
+	if (self->capture == CAPTURE_ERROR) {
+		if (self->error_member == NULL) self->error_member = g_string_new(NULL);
+
+		g_string_assign(self->error_member, self->buffer->str);
+	} else if (!self->func(self->buffer->str, self->buffer->len, self->user_data)) {
+		self->stopped = TRUE;
+	}
+
+	self->capture = CAPTURE_NONE;
+	g_string_truncate(self->buffer, 0);
+}
+
+static void replit_json_stream_end_key(ReplitJsonStream* self) {
+	ReplitJsonFrame* top = replit_json_stream_top(self);
+
+	top->expect = EXPECT_COLON;
+	top->key_matches = FALSE;
+
+	if (!self->key_wanted) return;
+
+	if (top->prefix >= 0 && top->prefix < self->path_length) {
+		top->key_matches = g_str_equal(self->key->str, self->path[top->prefix]);
+	}
+
+	if (self->frames->len == 1) {
+		self->root_error_key = g_str_equal(self->key->str, "error");
+
+		if (g_str_equal(self->key->str, "data")) self->has_data = TRUE;
+	}
+}
+
+static void replit_json_stream_push(ReplitJsonStream* self, gchar kind) {
+	ReplitJsonFrame* top = replit_json_stream_top(self);
+	ReplitJsonFrame frame = {
+		.kind = kind,
+		.expect = kind == '{' ? EXPECT_KEY : EXPECT_VALUE,
+		.prefix = -1,
+	};
+
+	if (top == NULL) {
+		frame.prefix = 0;
+	} else if (top->kind == '{' && top->prefix >= 0 && top->key_matches) {
+		frame.prefix = top->prefix + 1;
+	}
+
+	frame.target = kind == '[' && frame.prefix == self->path_length;
+
+	g_array_append_val(self->frames, frame);
+}
+
+static void replit_json_stream_pop(ReplitJsonStream* self) {
+	g_array_set_size(self->frames, self->frames->len - 1);
+	replit_json_stream_end_value(self);
+}
+
+static gboolean replit_json_stream_value(
+	ReplitJsonStream* self,
+	gchar c,
+	GError** error
+) {
+	replit_json_stream_begin_value(self);
+
+	if (self->capture != CAPTURE_NONE) g_string_append_c(self->buffer, c);
+
+	if (c == '{' || c == '[') {
+		replit_json_stream_push(self, c);
+	} else if (c == '"') {
+		self->string_is_key = FALSE;
+		self->key_wanted = FALSE;
+		self->lex = LEX_STRING;
+	} else if (is_scalar_char(c)) {
+		self->lex = LEX_SCALAR;
+	} else {
+		replit_json_stream_set_error(self, c, error);
+
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+/**
+ * replit_json_stream_feed: (skip)
+ * @stream: The scanner.
+ * @data: (array length=length): The next chunk of the document.
+ * @length: The length of @data in bytes.
+ * 
+ * Scans the next chunk of the document, calling the element function for every
+ * element which is completed within it.
+ * 
+ * Scanning stops early, without error, if the element function returns %FALSE.
+ * 
+ * Returns: %FALSE if the document is malformed.
+ */
+gboolean replit_json_stream_feed(
+	ReplitJsonStream* self,
+	const gchar* data,
+	gsize length,
+	GError** error
+) {
+	for (gsize i = 0; i < length && !self->stopped; i++, self->offset++) {
+		gchar c = data[i];
+
+		switch (self->lex) {
+			case LEX_STRING:
+				if (self->capture != CAPTURE_NONE) g_string_append_c(self->buffer, c);
+
+				if (c == '"') {
+					self->lex = LEX_NORMAL;
+
+					if (self->string_is_key) {
+						replit_json_stream_end_key(self);
+					} else {
+						replit_json_stream_end_value(self);
+					}
+
+					continue;
+				}
+
+				if (c == '\\') self->lex = LEX_STRING_ESCAPE;
+				if (self->key_wanted) g_string_append_c(self->key, c);
+
+				continue;
+
+			case LEX_STRING_ESCAPE:
+				if (self->capture != CAPTURE_NONE) g_string_append_c(self->buffer, c);
+				if (self->key_wanted) g_string_append_c(self->key, c);
+
+				self->lex = LEX_STRING;
+
+				continue;
+
+			case LEX_SCALAR:
+				if (is_scalar_char(c)) {
+					if (self->capture != CAPTURE_NONE) g_string_append_c(self->buffer, c);
+
+					continue;
+				}
+
+				self->lex = LEX_NORMAL;
+				replit_json_stream_end_value(self);
+
+				if (self->stopped) return TRUE;
+
+				break;
+
+			case LEX_NORMAL:
+				break;
+		}
+
+		if (c == ' ' || c == '\t' || c == '\n' || c == '\r') {
+			if (self->capture != CAPTURE_NONE) g_string_append_c(self->buffer, c);
+
+			continue;
+		}
+
+		ReplitJsonFrame* top = replit_json_stream_top(self);
+
+		if (top == NULL) {
+			if (self->root_done) {
+				replit_json_stream_set_error(self, c, error);
+
+				return FALSE;
+			}
+
+			if (!replit_json_stream_value(self, c, error)) return FALSE;
+
+			continue;
+		}
+
+		switch (top->expect) {
+			case EXPECT_KEY:
+				if (self->capture != CAPTURE_NONE) g_string_append_c(self->buffer, c);
+
+				if (c == '"') {
+					self->string_is_key = TRUE;
+					self->key_wanted = self->frames->len == 1 ||
+						(top->prefix >= 0 && top->prefix < self->path_length);
+					self->lex = LEX_STRING;
+
+					g_string_truncate(self->key, 0);
+				} else if (c == '}') {
+					replit_json_stream_pop(self);
+				} else {
+					replit_json_stream_set_error(self, c, error);
+
+					return FALSE;
+				}
+
+				break;
+
+			case EXPECT_COLON:
+				if (c != ':') {
+					replit_json_stream_set_error(self, c, error);
+
+					return FALSE;
+				}
+
+				if (self->capture != CAPTURE_NONE) g_string_append_c(self->buffer, c);
+
+				top->expect = EXPECT_VALUE;
+
+				break;
+
+			case EXPECT_VALUE:
+				if (c == ']' && top->kind == '[') {
+					if (self->capture != CAPTURE_NONE) g_string_append_c(self->buffer, c);
+
+					replit_json_stream_pop(self);
+				} else if (!replit_json_stream_value(self, c, error)) {
+					return FALSE;
+				}
+
+				break;
+
+			case EXPECT_COMMA:
+				if (self->capture != CAPTURE_NONE) g_string_append_c(self->buffer, c);
+
+				if (c == ',') {
+					top->expect = top->kind == '{' ? EXPECT_KEY : EXPECT_VALUE;
+				} else if (c == (top->kind == '{' ? '}' : ']')) {
+					replit_json_stream_pop(self);
+				} else {
+					replit_json_stream_set_error(self, c, error);
+
+					return FALSE;
+				}
+
+				break;
+		}
+	}
+
+	return TRUE;
+}
+
+/**
+ * replit_json_stream_finish: (skip)
+ * @stream: The scanner.
+ * 
+ * Signals the end of the document, completing a trailing root scalar.
+ * 
+ * Returns: %FALSE if the document ended before it was complete.
+ */
+gboolean replit_json_stream_finish(ReplitJsonStream* self, GError** error) {
+	if (self->stopped) return TRUE;
+
+	if (self->lex == LEX_SCALAR) {
+		self->lex = LEX_NORMAL;
+		replit_json_stream_end_value(self);
+	}
+
+	if (self->lex != LEX_NORMAL || !self->root_done) {
+		g_set_error_literal(
+			error,
+			JSON_PARSER_ERROR,
+			JSON_PARSER_ERROR_INVALID_DATA,
+			"JSON response ended unexpectedly"
+		);
+
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+/**
+ * replit_json_stream_is_stopped: (skip)
+ * @stream: The scanner.
+ * 
+ * Returns: %TRUE if the element function asked to stop scanning.
+ */
+gboolean replit_json_stream_is_stopped(ReplitJsonStream* self) {
+	return self->stopped;
+}
+
+/**
+ * replit_json_stream_has_data: (skip)
+ * @stream: The scanner.
+ * 
+ * Returns: %TRUE if the root object has had a `data` member.
+ */
+gboolean replit_json_stream_has_data(ReplitJsonStream* self) {
+	return self->has_data;
+}
+
+/**
+ * replit_json_stream_get_error: (skip)
+ * @stream: The scanner.
+ * @length: (out) (optional): The length of the returned text in bytes.
+ * 
+ * Returns: (transfer none) (nullable): The text of the root `error` member, or
+ *   %NULL if there was none.
+ */
+const gchar* replit_json_stream_get_error(ReplitJsonStream* self, gsize* length) {
+	if (self->error_member == NULL) return NULL;
+
+	if (length != NULL) *length = self->error_member->len;
+
+	return self->error_member->str;
+}
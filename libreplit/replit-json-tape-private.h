@@ -0,0 +1,66 @@
+/* replit-json-tape-private.h
+ *
+ * Copyright 2022 Patrick Winters
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE X CONSORTIUM BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written
+ * authorization.
+ */
+
+#pragma once
+
+#include <json-glib/json-glib.h>
+
+G_BEGIN_DECLS
+
+/* The index of the root value of a parsed document. */
+#define REPLIT_JSON_TAPE_ROOT 0
+
+/* Returned by lookups which find nothing, and accepted in place of an index by
+ * all of them, so that lookups can be chained. */
+#define REPLIT_JSON_TAPE_NONE G_MAXSIZE
+
+typedef struct _ReplitJsonTape ReplitJsonTape;
+
+ReplitJsonTape* replit_json_tape_new(void);
+
+void replit_json_tape_free(ReplitJsonTape* tape);
+
+gboolean replit_json_tape_parse(
+	ReplitJsonTape* tape,
+	const gchar* data,
+	gsize length,
+	GError** error
+);
+
+gsize replit_json_tape_get_member(ReplitJsonTape* tape, gsize index, const gchar* name);
+
+const gchar* replit_json_tape_get_string(ReplitJsonTape* tape, gsize index);
+
+gboolean replit_json_tape_get_int(ReplitJsonTape* tape, gsize index, gint64* value);
+
+JsonNode* replit_json_tape_to_node(ReplitJsonTape* tape, gsize index);
+
+const gchar* replit_json_tape_get_kernel(void);
+
+G_END_DECLS
@@ -0,0 +1,1212 @@
+/* replit-json-tape.c
+ *
+ * Copyright 2022 Patrick Winters
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE X CONSORTIUM BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written
+ * authorization.
+ */
+
+#include <errno.h>
+#include <string.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+#include "replit-json-tape-private.h"
+
+/* A two-stage JSON decoder in the style of simdjson. The first stage classifies
+ * the document 64 bytes at a time with vector comparisons, and produces the
+ * offset of every structural character (brackets, braces, colons, commas and
+ * unescaped quotes) outside of strings. The second stage walks those offsets to
+ * check the grammar and write a flat tape of 64-bit words, in which containers
+ * record where they end, so that lookups can skip over them. Strings are copied
+ * once, unescaped and NUL-terminated, into a separate arena; as #JsonNode holds
+ * strings without their length, `\u0000` escapes are rejected rather than
+ * truncating them.
+ * 
+ * Nothing is allocated per value, so callers who need only part of a document
+ * can look it up on the tape and convert only that part into #JsonNode. */
+
+#define BLOCK_SIZE 64
+
+#define TAPE_WORD(kind, payload) (((guint64) (kind) << 56) | (guint64) (payload))
+#define TAPE_KIND(word) ((gchar) ((word) >> 56))
+#define TAPE_PAYLOAD(word) ((word) & G_GUINT64_CONSTANT(0x00ffffffffffffff))
+
+/* Classification of one block, with bit i describing byte i. */
+typedef struct {
+	guint64 quote;
+	guint64 backslash;
+	guint64 op;
+	guint64 control;
+	gboolean high;
+} ReplitJsonBlock;
+
+typedef struct {
+	guint32* indices;
+	gsize count;
+	gsize capacity;
+	/* Whether the first byte of the next block is escaped. */
+	gboolean escaped;
+	/* All ones if the previous block ended inside a string. */
+	guint64 in_string;
+	/* Whether any byte so far has been outside ASCII. */
+	gboolean high;
+	/* Whether any byte so far has been a backslash. */
+	gboolean backslash;
+	/* Whether any string so far has held a control character. */
+	gboolean control;
+} ReplitJsonIndexer;
+
+typedef void (* ReplitJsonScanFunc)(
+	ReplitJsonIndexer* indexer,
+	const guint8* data,
+	gsize length,
+	gsize offset
+);
+
+typedef struct {
+	const gchar* name;
+	ReplitJsonScanFunc scan;
+	gboolean (* supported)(void);
+} ReplitJsonKernel;
+
+typedef enum {
+	STATE_VALUE,
+	STATE_VALUE_OR_END,
+	STATE_KEY,
+	STATE_KEY_OR_END,
+	STATE_COLON,
+	STATE_AFTER_VALUE,
+} ReplitJsonState;
+
+struct _ReplitJsonTape {
+	guint64* words;
+	gsize length;
+	gsize capacity;
+
+	GByteArray* strings;
+	GArray* stack;
+	ReplitJsonIndexer indexer;
+};
+
+/* Returns the bits of @backslash-escaped characters, given the backslashes in a
+ * block. Backslashes are rare in API responses, so this loops over them. */
+static inline guint64 replit_json_tape_find_escaped(guint64 backslash, gboolean* carry) {
+	guint64 escaped = 0;
+
+	if (*carry) {
+		escaped = 1;
+		backslash &= ~G_GUINT64_CONSTANT(1);
+		*carry = FALSE;
+	}
+
+	while (backslash != 0) {
+		guint bit = __builtin_ctzll(backslash);
+
+		if (bit == 63) {
+			*carry = TRUE;
+
+			break;
+		}
+
+		escaped |= G_GUINT64_CONSTANT(1) << (bit + 1);
+		backslash &= ~(G_GUINT64_CONSTANT(3) << bit);
+	}
+
+	return escaped;
+}
+
+/* Returns a mask with each bit set if an odd number of bits are set at or below
+ * it in @bits, which marks the insides of strings given their quotes. */
+static inline guint64 replit_json_tape_prefix_xor(guint64 bits) {
+	bits ^= bits << 1;
+	bits ^= bits << 2;
+	bits ^= bits << 4;
+	bits ^= bits << 8;
+	bits ^= bits << 16;
+	bits ^= bits << 32;
+
+	return bits;
+}
+
+static void replit_json_tape_grow_indices(ReplitJsonIndexer* indexer) {
+	indexer->capacity = MAX(indexer->capacity * 2, 256);
+	indexer->indices = g_renew(guint32, indexer->indices, indexer->capacity);
+}
+
+/* Appends the offsets of the structural characters in a classified block. */
+static inline void replit_json_tape_index_block(
+	ReplitJsonIndexer* indexer,
+	const ReplitJsonBlock* block,
+	gsize offset
+) {
+	guint64 escaped = replit_json_tape_find_escaped(block->backslash, &indexer->escaped);
+	guint64 quote = block->quote & ~escaped;
+	guint64 in_string = replit_json_tape_prefix_xor(quote) ^ indexer->in_string;
+	guint64 structural = (block->op & ~in_string) | quote;
+
+	indexer->in_string = (guint64) ((gint64) in_string >> 63);
+	indexer->high |= block->high;
+	indexer->backslash |= block->backslash != 0;
+	indexer->control |= (block->control & in_string) != 0;
+
+	if (indexer->count + BLOCK_SIZE > indexer->capacity) replit_json_tape_grow_indices(indexer);
+
+	/* Offsets are written four at a time without checking how many remain,
+	 * which is cheaper than a branch for each, and those past the count are
+	 * overwritten by the next block. Setting the top bit keeps the count of
+	 * trailing zeros defined once the mask runs out. */
+	guint32* out = indexer->indices + indexer->count;
+	guint count = __builtin_popcountll(structural);
+
+	for (guint i = 0; i < count; i += 4) {
+		for (guint j = 0; j < 4; j++) {
+			out[i + j] = offset + __builtin_ctzll(structural | G_GUINT64_CONSTANT(1) << 63);
+			structural &= structural - 1;
+		}
+	}
+
+	indexer->count += count;
+}
+
+static gboolean replit_json_tape_always_supported(void) {
+	return TRUE;
+}
+
+static void replit_json_tape_scan_scalar(
+	ReplitJsonIndexer* indexer,
+	const guint8* data,
+	gsize length,
+	gsize offset
+) {
+	for (gsize i = 0; i < length; i += BLOCK_SIZE) {
+		ReplitJsonBlock block = { 0 };
+
+		for (guint j = 0; j < BLOCK_SIZE; j++) {
+			guint64 bit = G_GUINT64_CONSTANT(1) << j;
+
+			switch (data[i + j]) {
+				case '"':
+					block.quote |= bit;
+					break;
+
+				case '\\':
+					block.backslash |= bit;
+					break;
+
+				case '{':
+				case '}':
+				case '[':
+				case ']':
+				case ':':
+				case ',':
+					block.op |= bit;
+					break;
+
+				default:
+					if (data[i + j] >= 0x80) block.high = TRUE;
+					if (data[i + j] < 0x20) block.control |= bit;
+					break;
+			}
+		}
+
+		replit_json_tape_index_block(indexer, &block, offset + i);
+	}
+}
+
+#if defined(__x86_64__)
+
+/* Braces and brackets differ from each other only in bit 5, so setting it
+ * leaves two comparisons to find all four. */
+
+static inline guint64 replit_json_tape_sse2_mask(__m128i bytes) {
+	return (guint64) (guint16) _mm_movemask_epi8(bytes);
+}
+
+static void replit_json_tape_scan_sse2(
+	ReplitJsonIndexer* indexer,
+	const guint8* data,
+	gsize length,
+	gsize offset
+) {
+	const __m128i quote = _mm_set1_epi8('"');
+	const __m128i backslash = _mm_set1_epi8('\\');
+	const __m128i open_brace = _mm_set1_epi8('{');
+	const __m128i close_brace = _mm_set1_epi8('}');
+	const __m128i colon = _mm_set1_epi8(':');
+	const __m128i comma = _mm_set1_epi8(',');
+	const __m128i case_bit = _mm_set1_epi8(0x20);
+	const __m128i last_control = _mm_set1_epi8(0x1f);
+
+	for (gsize i = 0; i < length; i += BLOCK_SIZE) {
+		ReplitJsonBlock block = { 0 };
+		__m128i high = _mm_setzero_si128();
+
+		for (guint j = 0; j < BLOCK_SIZE; j += 16) {
+			__m128i bytes = _mm_loadu_si128((const __m128i*) (data + i + j));
+			__m128i folded = _mm_or_si128(bytes, case_bit);
+			__m128i op = _mm_or_si128(
+				_mm_or_si128(_mm_cmpeq_epi8(folded, open_brace), _mm_cmpeq_epi8(folded, close_brace)),
+				_mm_or_si128(_mm_cmpeq_epi8(bytes, colon), _mm_cmpeq_epi8(bytes, comma))
+			);
+
+			block.quote |= replit_json_tape_sse2_mask(_mm_cmpeq_epi8(bytes, quote)) << j;
+			block.backslash |= replit_json_tape_sse2_mask(_mm_cmpeq_epi8(bytes, backslash)) << j;
+			block.op |= replit_json_tape_sse2_mask(op) << j;
+			block.control |= replit_json_tape_sse2_mask(
+				_mm_cmpeq_epi8(_mm_min_epu8(bytes, last_control), bytes)
+			) << j;
+			high = _mm_or_si128(high, bytes);
+		}
+
+		block.high = _mm_movemask_epi8(high) != 0;
+
+		replit_json_tape_index_block(indexer, &block, offset + i);
+	}
+}
+
+static inline __attribute__((target("avx2"))) guint64 replit_json_tape_avx2_mask(__m256i bytes) {
+	return (guint64) (guint32) _mm256_movemask_epi8(bytes);
+}
+
+static __attribute__((target("avx2"))) void replit_json_tape_scan_avx2(
+	ReplitJsonIndexer* indexer,
+	const guint8* data,
+	gsize length,
+	gsize offset
+) {
+	const __m256i quote = _mm256_set1_epi8('"');
+	const __m256i backslash = _mm256_set1_epi8('\\');
+	const __m256i open_brace = _mm256_set1_epi8('{');
+	const __m256i close_brace = _mm256_set1_epi8('}');
+	const __m256i colon = _mm256_set1_epi8(':');
+	const __m256i comma = _mm256_set1_epi8(',');
+	const __m256i case_bit = _mm256_set1_epi8(0x20);
+	const __m256i last_control = _mm256_set1_epi8(0x1f);
+
+	for (gsize i = 0; i < length; i += BLOCK_SIZE) {
+		ReplitJsonBlock block = { 0 };
+		__m256i high = _mm256_setzero_si256();
+
+		for (guint j = 0; j < BLOCK_SIZE; j += 32) {
+			__m256i bytes = _mm256_loadu_si256((const __m256i*) (data + i + j));
+			__m256i folded = _mm256_or_si256(bytes, case_bit);
+			__m256i op = _mm256_or_si256(
+				_mm256_or_si256(
+					_mm256_cmpeq_epi8(folded, open_brace),
+					_mm256_cmpeq_epi8(folded, close_brace)
+				),
+				_mm256_or_si256(_mm256_cmpeq_epi8(bytes, colon), _mm256_cmpeq_epi8(bytes, comma))
+			);
+
+			block.quote |= replit_json_tape_avx2_mask(_mm256_cmpeq_epi8(bytes, quote)) << j;
+			block.backslash |= replit_json_tape_avx2_mask(_mm256_cmpeq_epi8(bytes, backslash)) << j;
+			block.op |= replit_json_tape_avx2_mask(op) << j;
+			block.control |= replit_json_tape_avx2_mask(
+				_mm256_cmpeq_epi8(_mm256_min_epu8(bytes, last_control), bytes)
+			) << j;
+			high = _mm256_or_si256(high, bytes);
+		}
+
+		block.high = _mm256_movemask_epi8(high) != 0;
+
+		replit_json_tape_index_block(indexer, &block, offset + i);
+	}
+}
+
+static gboolean replit_json_tape_avx2_supported(void) {
+	return __builtin_cpu_supports("avx2");
+}
+
+#elif defined(__aarch64__)
+
+/* NEON has no movemask, so the comparison results of a whole block are reduced
+ * to one bit per byte with pairwise additions of weighted lanes. */
+static inline guint64 replit_json_tape_neon_mask(
+	uint8x16_t m0,
+	uint8x16_t m1,
+	uint8x16_t m2,
+	uint8x16_t m3
+) {
+	const uint8x16_t weights = {
+		0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80,
+		0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80,
+	};
+
+	uint8x16_t sum0 = vpaddq_u8(vandq_u8(m0, weights), vandq_u8(m1, weights));
+	uint8x16_t sum1 = vpaddq_u8(vandq_u8(m2, weights), vandq_u8(m3, weights));
+
+	sum0 = vpaddq_u8(sum0, sum1);
+	sum0 = vpaddq_u8(sum0, sum0);
+
+	return vgetq_lane_u64(vreinterpretq_u64_u8(sum0), 0);
+}
+
+static void replit_json_tape_scan_neon(
+	ReplitJsonIndexer* indexer,
+	const guint8* data,
+	gsize length,
+	gsize offset
+) {
+	const uint8x16_t quote = vdupq_n_u8('"');
+	const uint8x16_t backslash = vdupq_n_u8('\\');
+	const uint8x16_t open_brace = vdupq_n_u8('{');
+	const uint8x16_t close_brace = vdupq_n_u8('}');
+	const uint8x16_t colon = vdupq_n_u8(':');
+	const uint8x16_t comma = vdupq_n_u8(',');
+	const uint8x16_t case_bit = vdupq_n_u8(0x20);
+
+	for (gsize i = 0; i < length; i += BLOCK_SIZE) {
+		ReplitJsonBlock block = { 0 };
+		uint8x16_t bytes[4];
+		uint8x16_t quotes[4];
+		uint8x16_t backslashes[4];
+		uint8x16_t ops[4];
+		uint8x16_t controls[4];
+
+		for (guint j = 0; j < 4; j++) {
+			bytes[j] = vld1q_u8(data + i + j * 16);
+
+			uint8x16_t folded = vorrq_u8(bytes[j], case_bit);
+
+			quotes[j] = vceqq_u8(bytes[j], quote);
+			backslashes[j] = vceqq_u8(bytes[j], backslash);
+			ops[j] = vorrq_u8(
+				vorrq_u8(vceqq_u8(folded, open_brace), vceqq_u8(folded, close_brace)),
+				vorrq_u8(vceqq_u8(bytes[j], colon), vceqq_u8(bytes[j], comma))
+			);
+			controls[j] = vcltq_u8(bytes[j], case_bit);
+		}
+
+		block.quote = replit_json_tape_neon_mask(quotes[0], quotes[1], quotes[2], quotes[3]);
+		block.backslash = replit_json_tape_neon_mask(
+			backslashes[0],
+			backslashes[1],
+			backslashes[2],
+			backslashes[3]
+		);
+		block.op = replit_json_tape_neon_mask(ops[0], ops[1], ops[2], ops[3]);
+		block.control = replit_json_tape_neon_mask(controls[0], controls[1], controls[2], controls[3]);
+		block.high = vmaxvq_u8(
+			vorrq_u8(vorrq_u8(bytes[0], bytes[1]), vorrq_u8(bytes[2], bytes[3]))
+		) >= 0x80;
+
+		replit_json_tape_index_block(indexer, &block, offset + i);
+	}
+}
+
+#endif
+
+/* In order of preference. */
+static const ReplitJsonKernel kernels[] = {
+#if defined(__x86_64__)
+	{ "avx2", replit_json_tape_scan_avx2, replit_json_tape_avx2_supported },
+	{ "sse2", replit_json_tape_scan_sse2, replit_json_tape_always_supported },
+#elif defined(__aarch64__)
+	{ "neon", replit_json_tape_scan_neon, replit_json_tape_always_supported },
+#endif
+	{ "scalar", replit_json_tape_scan_scalar, replit_json_tape_always_supported },
+};
+
+/* Picks the best kernel the CPU supports, unless another is named by the
+ * `REPLIT_JSON_KERNEL` environment variable, which is useful for comparing
+ * them. */
+static const ReplitJsonKernel* replit_json_tape_get_kernel_info(void) {
+	static gsize kernel = 0;
+
+	if (g_once_init_enter(&kernel)) {
+		const gchar* requested = g_getenv("REPLIT_JSON_KERNEL");
+		const ReplitJsonKernel* chosen = NULL;
+
+		for (guint i = 0; i < G_N_ELEMENTS(kernels); i++) {
+			if (!kernels[i].supported()) continue;
+
+			if (chosen == NULL) chosen = &kernels[i];
+
+			if (requested != NULL && g_str_equal(requested, kernels[i].name)) {
+				chosen = &kernels[i];
+
+				break;
+			}
+		}
+
+		g_once_init_leave(&kernel, (gsize) chosen);
+	}
+
+	return (const ReplitJsonKernel*) kernel;
+}
+
+/**
+ * replit_json_tape_get_kernel: (skip)
+ * 
+ * Gets the name of the instruction set used to scan documents: one of `avx2`,
+ * `sse2`, `neon` or `scalar`.
+ * 
+ * Returns: (transfer none): The name of the kernel.
+ */
+const gchar* replit_json_tape_get_kernel(void) {
+	return replit_json_tape_get_kernel_info()->name;
+}
+
+/**
+ * replit_json_tape_new: (skip)
+ * 
+ * Creates an empty tape, which can be used to parse any number of documents one
+ * after another, reusing its buffers.
+ * 
+ * Returns: (transfer full): The tape.
+ */
+ReplitJsonTape* replit_json_tape_new(void) {
+	ReplitJsonTape* self = g_new0(ReplitJsonTape, 1);
+
+	self->strings = g_byte_array_new();
+	self->stack = g_array_sized_new(FALSE, FALSE, sizeof(gsize), 16);
+
+	return self;
+}
+
+/**
+ * replit_json_tape_free: (skip)
+ * @tape: The tape.
+ * 
+ * Frees the tape and everything parsed into it.
+ */
+void replit_json_tape_free(ReplitJsonTape* self) {
+	g_free(self->words);
+	g_byte_array_unref(self->strings);
+	g_array_unref(self->stack);
+	g_free(self->indexer.indices);
+	g_free(self);
+}
+
+static inline void replit_json_tape_push(ReplitJsonTape* self, guint64 word) {
+	if (self->length == self->capacity) {
+		self->capacity = MAX(self->capacity * 2, 256);
+		self->words = g_renew(guint64, self->words, self->capacity);
+	}
+
+	self->words[self->length++] = word;
+}
+
+static gboolean replit_json_tape_set_error(
+	const gchar* data,
+	gsize length,
+	gsize offset,
+	GError** error
+) {
+	if (offset >= length) {
+		g_set_error_literal(
+			error,
+			JSON_PARSER_ERROR,
+			JSON_PARSER_ERROR_INVALID_DATA,
+			"Unexpected end of JSON document"
+		);
+	} else {
+		g_set_error(
+			error,
+			JSON_PARSER_ERROR,
+			JSON_PARSER_ERROR_INVALID_DATA,
+			"Unexpected character '%c' at offset %" G_GSIZE_FORMAT " in JSON document",
+			data[offset],
+			offset
+		);
+	}
+
+	return FALSE;
+}
+
+static inline gboolean is_space(gchar c) {
+	return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+}
+
+static inline gint hex_value(gchar c) {
+	if (c >= '0' && c <= '9') return c - '0';
+	if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+
+	return -1;
+}
+
+/* Reads the four hex digits of a `\u` escape. */
+static gint replit_json_tape_read_hex(const gchar* text, gsize length) {
+	if (length < 4) return -1;
+
+	gint value = 0;
+
+	for (guint i = 0; i < 4; i++) {
+		gint digit = hex_value(text[i]);
+
+		if (digit < 0) return -1;
+
+		value = value << 4 | digit;
+	}
+
+	return value;
+}
+
+/* Decodes the escapes in the body of a string, appending it to the arena.
+ * Returns the offset of the first bad escape, counting `\u0000`, or -1. */
+static gssize replit_json_tape_unescape(GByteArray* out, const gchar* text, gsize length) {
+	gsize i = 0;
+
+	while (i < length) {
+		const gchar* backslash = memchr(text + i, '\\', length - i);
+		gsize end = backslash != NULL ? (gsize) (backslash - text) : length;
+
+		g_byte_array_append(out, (const guint8*) text + i, end - i);
+		i = end;
+
+		if (i == length) break;
+
+		if (i + 1 == length) return i;
+
+		gchar c = text[i + 1];
+		gchar simple = 0;
+
+		switch (c) {
+			case '"': simple = '"'; break;
+			case '\\': simple = '\\'; break;
+			case '/': simple = '/'; break;
+			case 'b': simple = '\b'; break;
+			case 'f': simple = '\f'; break;
+			case 'n': simple = '\n'; break;
+			case 'r': simple = '\r'; break;
+			case 't': simple = '\t'; break;
+			case 'u': break;
+			default: return i;
+		}
+
+		if (simple != 0) {
+			g_byte_array_append(out, (const guint8*) &simple, 1);
+			i += 2;
+
+			continue;
+		}
+
+		gint unit = replit_json_tape_read_hex(text + i + 2, length - i - 2);
+		gunichar character = unit;
+		gsize consumed = 6;
+
+		if (unit <= 0 || (unit >= 0xdc00 && unit <= 0xdfff)) return i;
+
+		if (unit >= 0xd800 && unit <= 0xdbff) {
+			gint low = -1;
+
+			if (i + 12 <= length && text[i + 6] == '\\' && text[i + 7] == 'u') {
+				low = replit_json_tape_read_hex(text + i + 8, length - i - 8);
+			}
+
+			if (low < 0xdc00 || low > 0xdfff) return i;
+
+			character = 0x10000 + ((unit - 0xd800) << 10) + (low - 0xdc00);
+			consumed = 12;
+		}
+
+		gchar utf8[6];
+		gint utf8_length = g_unichar_to_utf8(character, utf8);
+
+		g_byte_array_append(out, (const guint8*) utf8, utf8_length);
+		i += consumed;
+	}
+
+	return -1;
+}
+
+/* Copies a string into the arena, prefixed with its length and followed by a
+ * NUL, and writes its tape word. */
+static gboolean replit_json_tape_add_string(
+	ReplitJsonTape* self,
+	const gchar* data,
+	gsize length,
+	gsize start,
+	gsize end,
+	GError** error
+) {
+	guint offset = self->strings->len;
+	const gchar* text = data + start;
+	guint32 text_length = end - start;
+
+	if (!self->indexer.backslash || memchr(text, '\\', text_length) == NULL) {
+		g_byte_array_set_size(self->strings, offset + sizeof(text_length) + text_length + 1);
+
+		guint8* out = self->strings->data + offset;
+
+		memcpy(out, &text_length, sizeof(text_length));
+		memcpy(out + sizeof(text_length), text, text_length);
+		out[sizeof(text_length) + text_length] = '\0';
+	} else {
+		g_byte_array_set_size(self->strings, offset + sizeof(text_length));
+
+		gssize bad = replit_json_tape_unescape(self->strings, text, text_length);
+
+		if (bad >= 0) return replit_json_tape_set_error(data, length, start + bad, error);
+
+		guint32 string_length = self->strings->len - offset - sizeof(string_length);
+
+		memcpy(self->strings->data + offset, &string_length, sizeof(string_length));
+		g_byte_array_append(self->strings, (const guint8*) "", 1);
+	}
+
+	replit_json_tape_push(self, TAPE_WORD('"', offset));
+
+	return TRUE;
+}
+
+static inline gboolean is_digit(gchar c) {
+	return c >= '0' && c <= '9';
+}
+
+/* Writes a literal or number, which must make up the whole of @text. */
+static gboolean replit_json_tape_add_scalar(ReplitJsonTape* self, const gchar* text, gsize length) {
+	switch (text[0]) {
+		case 't':
+			if (length != 4 || memcmp(text, "true", 4) != 0) return FALSE;
+
+			replit_json_tape_push(self, TAPE_WORD('t', 0));
+
+			return TRUE;
+
+		case 'f':
+			if (length != 5 || memcmp(text, "false", 5) != 0) return FALSE;
+
+			replit_json_tape_push(self, TAPE_WORD('f', 0));
+
+			return TRUE;
+
+		case 'n':
+			if (length != 4 || memcmp(text, "null", 4) != 0) return FALSE;
+
+			replit_json_tape_push(self, TAPE_WORD('n', 0));
+
+			return TRUE;
+	}
+
+	gsize i = text[0] == '-' ? 1 : 0;
+	gsize digits_start = i;
+	gboolean integer = TRUE;
+
+	if (i < length && text[i] == '0') {
+		i++;
+	} else {
+		while (i < length && is_digit(text[i])) i++;
+	}
+
+	if (i == digits_start) return FALSE;
+
+	gsize digits = i - digits_start;
+
+	if (i < length && text[i] == '.') {
+		gsize fraction_start = ++i;
+
+		while (i < length && is_digit(text[i])) i++;
+
+		if (i == fraction_start) return FALSE;
+
+		integer = FALSE;
+	}
+
+	if (i < length && (text[i] == 'e' || text[i] == 'E')) {
+		i++;
+
+		if (i < length && (text[i] == '+' || text[i] == '-')) i++;
+
+		gsize exponent_start = i;
+
+		while (i < length && is_digit(text[i])) i++;
+
+		if (i == exponent_start) return FALSE;
+
+		integer = FALSE;
+	}
+
+	if (i != length) return FALSE;
+
+	/* Up to 18 digits cannot overflow, so the common case is read inline. */
+	if (integer && digits <= 18) {
+		gint64 value = 0;
+
+		for (gsize j = digits_start; j < length; j++) value = value * 10 + (text[j] - '0');
+
+		replit_json_tape_push(self, TAPE_WORD('l', 0));
+		replit_json_tape_push(self, (guint64) (text[0] == '-' ? -value : value));
+
+		return TRUE;
+	}
+
+	gchar buffer[64];
+	gchar* copy = length < sizeof(buffer) ? buffer : g_malloc(length + 1);
+
+	memcpy(copy, text, length);
+	copy[length] = '\0';
+
+	/* Longer integers are kept if they fit, and otherwise read as doubles. */
+	if (integer) {
+		errno = 0;
+
+		gint64 value = g_ascii_strtoll(copy, NULL, 10);
+
+		if (errno == 0) {
+			if (copy != buffer) g_free(copy);
+
+			replit_json_tape_push(self, TAPE_WORD('l', 0));
+			replit_json_tape_push(self, (guint64) value);
+
+			return TRUE;
+		}
+	}
+
+	gdouble value = g_ascii_strtod(copy, NULL);
+	guint64 bits;
+
+	if (copy != buffer) g_free(copy);
+
+	memcpy(&bits, &value, sizeof(bits));
+
+	replit_json_tape_push(self, TAPE_WORD('d', 0));
+	replit_json_tape_push(self, bits);
+
+	return TRUE;
+}
+
+static void replit_json_tape_open(ReplitJsonTape* self, gchar kind) {
+	g_array_append_val(self->stack, self->length);
+	replit_json_tape_push(self, TAPE_WORD(kind, 0));
+}
+
+/* Closes the innermost container, pointing its opening word past its end and
+ * its closing word back at its start. */
+static gboolean replit_json_tape_close(ReplitJsonTape* self, gchar kind) {
+	if (self->stack->len == 0) return FALSE;
+
+	gsize start = g_array_index(self->stack, gsize, self->stack->len - 1);
+	gchar open = TAPE_KIND(self->words[start]);
+
+	if ((open == '{' && kind != '}') || (open == '[' && kind != ']')) return FALSE;
+
+	g_array_set_size(self->stack, self->stack->len - 1);
+	replit_json_tape_push(self, TAPE_WORD(kind, start));
+	self->words[start] = TAPE_WORD(open, self->length);
+
+	return TRUE;
+}
+
+/* Walks the structural characters found by the first stage, checking the
+ * grammar and writing the tape. Literals and numbers are not indexed, and are
+ * read from the text between structural characters where a value is
+ * expected. */
+static gboolean replit_json_tape_build_tape(
+	ReplitJsonTape* self,
+	const gchar* data,
+	gsize length,
+	GError** error
+) {
+	const guint32* indices = self->indexer.indices;
+	gsize count = self->indexer.count;
+	gsize next = 0;
+	gsize cursor = 0;
+	ReplitJsonState state = STATE_VALUE;
+
+	for (;;) {
+		gsize start = cursor;
+
+		while (start < length && is_space(data[start])) start++;
+
+		if (state == STATE_AFTER_VALUE && self->stack->len == 0) {
+			if (start != length) return replit_json_tape_set_error(data, length, start, error);
+
+			return TRUE;
+		}
+
+		if (start == length) return replit_json_tape_set_error(data, length, start, error);
+
+		gsize position = next < count ? indices[next] : length;
+
+		if (start < position) {
+			if (state != STATE_VALUE && state != STATE_VALUE_OR_END) {
+				return replit_json_tape_set_error(data, length, start, error);
+			}
+
+			gsize end = position;
+
+			while (is_space(data[end - 1])) end--;
+
+			if (!replit_json_tape_add_scalar(self, data + start, end - start)) {
+				return replit_json_tape_set_error(data, length, start, error);
+			}
+
+			cursor = end;
+			state = STATE_AFTER_VALUE;
+
+			continue;
+		}
+
+		gchar c = data[position];
+
+		next++;
+		cursor = position + 1;
+
+		switch (state) {
+			case STATE_VALUE_OR_END:
+				if (c == ']') {
+					replit_json_tape_close(self, c);
+					state = STATE_AFTER_VALUE;
+
+					break;
+				}
+
+				__attribute__ ((fallthrough));
+
+			case STATE_VALUE:
+				if (c == '{') {
+					replit_json_tape_open(self, c);
+					state = STATE_KEY_OR_END;
+				} else if (c == '[') {
+					replit_json_tape_open(self, c);
+					state = STATE_VALUE_OR_END;
+				} else if (c == '"') {
+					/* Everything inside a string is masked out, so the next
+					 * structural character is always its closing quote. */
+					gsize end = indices[next++];
+
+					if (!replit_json_tape_add_string(self, data, length, cursor, end, error)) {
+						return FALSE;
+					}
+
+					cursor = end + 1;
+					state = STATE_AFTER_VALUE;
+				} else {
+					return replit_json_tape_set_error(data, length, position, error);
+				}
+
+				break;
+
+			case STATE_KEY_OR_END:
+				if (c == '}') {
+					replit_json_tape_close(self, c);
+					state = STATE_AFTER_VALUE;
+
+					break;
+				}
+
+				__attribute__ ((fallthrough));
+
+			case STATE_KEY:
+				if (c != '"') return replit_json_tape_set_error(data, length, position, error);
+
+				gsize end = indices[next++];
+
+				if (!replit_json_tape_add_string(self, data, length, cursor, end, error)) {
+					return FALSE;
+				}
+
+				cursor = end + 1;
+				state = STATE_COLON;
+
+				break;
+
+			case STATE_COLON:
+				if (c != ':') return replit_json_tape_set_error(data, length, position, error);
+
+				state = STATE_VALUE;
+
+				break;
+
+			case STATE_AFTER_VALUE:
+				if (c == ',') {
+					gsize top = g_array_index(self->stack, gsize, self->stack->len - 1);
+
+					state = TAPE_KIND(self->words[top]) == '{' ? STATE_KEY : STATE_VALUE;
+				} else if (!replit_json_tape_close(self, c)) {
+					return replit_json_tape_set_error(data, length, position, error);
+				}
+
+				break;
+		}
+	}
+}
+
+/**
+ * replit_json_tape_parse: (skip)
+ * @tape: The tape.
+ * @data: (array length=length): The JSON document.
+ * @length: The length of @data.
+ * @error: The return location for a recoverable error.
+ * 
+ * Parses a JSON document into the tape, replacing whatever was parsed into it
+ * before. Indices and strings returned for the previous document are no longer
+ * valid afterwards.
+ * 
+ * Returns: Whether the document was valid.
+ */
+gboolean replit_json_tape_parse(
+	ReplitJsonTape* self,
+	const gchar* data,
+	gsize length,
+	GError** error
+) {
+	self->length = 0;
+	g_byte_array_set_size(self->strings, 0);
+	g_array_set_size(self->stack, 0);
+
+	if (length > G_MAXUINT32) {
+		g_set_error_literal(
+			error,
+			JSON_PARSER_ERROR,
+			JSON_PARSER_ERROR_INVALID_DATA,
+			"JSON document is too large"
+		);
+
+		return FALSE;
+	}
+
+	ReplitJsonIndexer* indexer = &self->indexer;
+	gsize full_length = length - length % BLOCK_SIZE;
+	guint8 tail[BLOCK_SIZE];
+
+	indexer->count = 0;
+	indexer->escaped = FALSE;
+	indexer->in_string = 0;
+	indexer->high = FALSE;
+	indexer->backslash = FALSE;
+	indexer->control = FALSE;
+
+	/* The last partial block is padded with spaces, which are never
+	 * structural. */
+	memset(tail, ' ', sizeof(tail));
+	memcpy(tail, data + full_length, length - full_length);
+
+	ReplitJsonScanFunc scan = replit_json_tape_get_kernel_info()->scan;
+
+	scan(indexer, (const guint8*) data, full_length, 0);
+	scan(indexer, tail, BLOCK_SIZE, full_length);
+
+	if (indexer->in_string != 0) {
+		g_set_error_literal(
+			error,
+			JSON_PARSER_ERROR,
+			JSON_PARSER_ERROR_INVALID_DATA,
+			"Unterminated string in JSON document"
+		);
+
+		return FALSE;
+	}
+
+	if (indexer->control) {
+		g_set_error_literal(
+			error,
+			JSON_PARSER_ERROR,
+			JSON_PARSER_ERROR_INVALID_DATA,
+			"Unescaped control character in JSON string"
+		);
+
+		return FALSE;
+	}
+
+	if (indexer->high && !g_utf8_validate(data, length, NULL)) {
+		g_set_error_literal(
+			error,
+			JSON_PARSER_ERROR,
+			JSON_PARSER_ERROR_INVALID_DATA,
+			"JSON document is not valid UTF-8"
+		);
+
+		return FALSE;
+	}
+
+	/* Reserve enough that the second stage rarely has to grow its buffers:
+	 * no document needs more than two words of tape per structural character,
+	 * and unescaping never makes a string longer. */
+	gsize words = indexer->count * 2 + 2;
+
+	if (self->capacity < words) {
+		self->capacity = words;
+		self->words = g_renew(guint64, self->words, self->capacity);
+	}
+
+	g_byte_array_set_size(self->strings, length + (indexer->count / 2 + 1) * (sizeof(guint32) + 1));
+	g_byte_array_set_size(self->strings, 0);
+
+	return replit_json_tape_build_tape(self, data, length, error);
+}
+
+/* Returns the index of the value after the one at @index. */
+static inline gsize replit_json_tape_skip(ReplitJsonTape* self, gsize index) {
+	guint64 word = self->words[index];
+
+	switch (TAPE_KIND(word)) {
+		case '{':
+		case '[':
+			return TAPE_PAYLOAD(word);
+
+		case 'l':
+		case 'd':
+			return index + 2;
+
+		default:
+			return index + 1;
+	}
+}
+
+static inline gchar replit_json_tape_kind(ReplitJsonTape* self, gsize index) {
+	return index < self->length ? TAPE_KIND(self->words[index]) : 0;
+}
+
+static inline const gchar* replit_json_tape_string_at(ReplitJsonTape* self, gsize index) {
+	return (const gchar*) self->strings->data + TAPE_PAYLOAD(self->words[index]) + sizeof(guint32);
+}
+
+/**
+ * replit_json_tape_get_member: (skip)
+ * @tape: The tape.
+ * @index: The index of an object.
+ * @name: (transfer none): The name of the member to find.
+ * 
+ * Finds a member of an object by name, skipping over the values of the members
+ * before it. If there is more than one member with the name, the last is found,
+ * as json-glib would keep it.
+ * 
+ * Returns: The index of the member's value, or %REPLIT_JSON_TAPE_NONE if it has
+ *   none or the value at @index is not an object.
+ */
+gsize replit_json_tape_get_member(ReplitJsonTape* self, gsize index, const gchar* name) {
+	if (replit_json_tape_kind(self, index) != '{') return REPLIT_JSON_TAPE_NONE;
+
+	gsize end = TAPE_PAYLOAD(self->words[index]) - 1;
+	gsize found = REPLIT_JSON_TAPE_NONE;
+
+	for (gsize i = index + 1; i < end; i = replit_json_tape_skip(self, i + 1)) {
+		if (g_str_equal(replit_json_tape_string_at(self, i), name)) found = i + 1;
+	}
+
+	return found;
+}
+
+/**
+ * replit_json_tape_get_string: (skip)
+ * @tape: The tape.
+ * @index: The index of a string.
+ * 
+ * Gets a string from the tape, which remains valid until another document is
+ * parsed into it.
+ * 
+ * Returns: (transfer none) (nullable): The string, or %NULL if the value at
+ *   @index is not a string.
+ */
+const gchar* replit_json_tape_get_string(ReplitJsonTape* self, gsize index) {
+	if (replit_json_tape_kind(self, index) != '"') return NULL;
+
+	return replit_json_tape_string_at(self, index);
+}
+
+/**
+ * replit_json_tape_get_int: (skip)
+ * @tape: The tape.
+ * @index: The index of an integer.
+ * @value: (out): The return location for the integer.
+ * 
+ * Gets an integer from the tape.
+ * 
+ * Returns: Whether the value at @index is an integer.
+ */
+gboolean replit_json_tape_get_int(ReplitJsonTape* self, gsize index, gint64* value) {
+	if (replit_json_tape_kind(self, index) != 'l') return FALSE;
+
+	*value = (gint64) self->words[index + 1];
+
+	return TRUE;
+}
+
+/**
+ * replit_json_tape_to_node: (skip)
+ * @tape: The tape.
+ * @index: The index of a value.
+ * 
+ * Builds a tree of #JsonNode from a value on the tape, which owns its data and
+ * so outlives the tape.
+ * 
+ * Returns: (transfer full) (nullable): The node, or %NULL if @index is
+ *   %REPLIT_JSON_TAPE_NONE.
+ */
+JsonNode* replit_json_tape_to_node(ReplitJsonTape* self, gsize index) {
+	if (index >= self->length) return NULL;
+
+	guint64 word = self->words[index];
+
+	switch (TAPE_KIND(word)) {
+		case '{':
+			JsonObject* object = json_object_new();
+			gsize object_end = TAPE_PAYLOAD(word) - 1;
+
+			for (gsize i = index + 1; i < object_end; i = replit_json_tape_skip(self, i + 1)) {
+				json_object_set_member(
+					object,
+					replit_json_tape_string_at(self, i),
+					replit_json_tape_to_node(self, i + 1)
+				);
+			}
+
+			JsonNode* object_node = json_node_new(JSON_NODE_OBJECT);
+			json_node_take_object(object_node, object);
+
+			return object_node;
+
+		case '[':
+			JsonArray* array = json_array_new();
+			gsize array_end = TAPE_PAYLOAD(word) - 1;
+
+			for (gsize i = index + 1; i < array_end; i = replit_json_tape_skip(self, i)) {
+				json_array_add_element(array, replit_json_tape_to_node(self, i));
+			}
+
+			JsonNode* array_node = json_node_new(JSON_NODE_ARRAY);
+			json_node_take_array(array_node, array);
+
+			return array_node;
+
+		case '"':
+			return json_node_init_string(json_node_alloc(), replit_json_tape_string_at(self, index));
+
+		case 'l':
+			return json_node_init_int(json_node_alloc(), (gint64) self->words[index + 1]);
+
+		case 'd':
+			gdouble value;
+			memcpy(&value, &self->words[index + 1], sizeof(value));
+
+			return json_node_init_double(json_node_alloc(), value);
+
+		case 't':
+			return json_node_init_boolean(json_node_alloc(), TRUE);
+
+		case 'f':
+			return json_node_init_boolean(json_node_alloc(), FALSE);
+
+		default:
+			return json_node_init_null(json_node_alloc());
+	}
+}
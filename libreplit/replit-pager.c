@@ -0,0 +1,650 @@
+/* replit-pager.c
+ *
+ * Copyright 2022 Patrick Winters
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE X CONSORTIUM BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written
+ * authorization.
+ */
+
+#include "replit-client-private.h"
+#include "replit-pager.h"
+
+#define DEFAULT_READ_AHEAD 1
+#define DEFAULT_MAX_BUFFERED_BYTES (16 * 1024 * 1024)
+
+/**
+ * ReplitPager:
+ * 
+ * Iterates over every item of a paginated connection, such as a user's repls,
+ * fetching further pages in the background.
+ * 
+ * A #ReplitPager repeats a query, passing the cursor returned by each page as a
+ * variable to fetch the next, until no cursor is returned. While the items of
+ * one page are being consumed, up to [property@Pager:read-ahead] further pages
+ * are requested ahead of time, so the round trip for each page is mostly hidden
+ * from the consumer. [property@Pager:max-buffered-bytes] bounds the memory held
+ * by pages which have not been consumed yet.
+ * 
+ * Pages are fetched with [method@Client.query_async], so they are only received
+ * whilst the thread-default main context of the thread which created the pager
+ * is being run.
+ */
+
+typedef struct {
+	JsonNode* data;
+	JsonArray* items;
+	guint index;
+	gsize length;
+} ReplitPagerPage;
+
+struct _ReplitPager {
+	GObject parent_instance;
+
+	ReplitClient* client;
+	gchar* query;
+	JsonNode* variables;
+	gchar** items_path;
+	gchar** cursor_path;
+	gchar* cursor_variable;
+	guint read_ahead;
+	guint64 max_buffered_bytes;
+
+	GQueue pages;
+	gsize buffered_bytes;
+	gchar* cursor;
+	gboolean fetching;
+	gboolean done;
+	gboolean started;
+	GError* error;
+	GQueue waiters;
+};
+
+G_DEFINE_TYPE (ReplitPager, replit_pager, G_TYPE_OBJECT)
+
+enum {
+	PROP_0,
+	PROP_READ_AHEAD,
+	PROP_MAX_BUFFERED_BYTES,
+	N_PROPERTIES,
+};
+
+static GParamSpec* properties[N_PROPERTIES] = { NULL };
+
+static void replit_pager_dispose(GObject* gobject);
+static void replit_pager_finalize(GObject* gobject);
+static void replit_pager_get_property(
+	GObject* gobject,
+	guint property_id,
+	GValue* value,
+	GParamSpec* pspec
+);
+static void replit_pager_set_property(
+	GObject* gobject,
+	guint property_id,
+	const GValue* value,
+	GParamSpec* pspec
+);
+static void replit_pager_fill(ReplitPager* self);
+
+static void replit_pager_class_init(ReplitPagerClass* klass) {
+	GObjectClass* object_class = G_OBJECT_CLASS (klass);
+
+	object_class->dispose = replit_pager_dispose;
+	object_class->finalize = replit_pager_finalize;
+	object_class->get_property = replit_pager_get_property;
+	object_class->set_property = replit_pager_set_property;
+
+	/**
+	 * ReplitPager:read-ahead:
+	 * 
+	 * The number of pages to fetch ahead of the page being consumed.
+	 * 
+	 * Pages are still requested one after another, as each request needs the
+	 * cursor from the page before it. If zero, a page is only requested once
+	 * every item of the previous page has been consumed.
+	 */
+	properties[PROP_READ_AHEAD] = g_param_spec_uint(
+		"read-ahead",
+		"Read ahead",
+		"The number of pages to fetch ahead of the page being consumed",
+		0,
+		G_MAXUINT,
+		DEFAULT_READ_AHEAD,
+		G_PARAM_READWRITE | G_PARAM_EXPLICIT_NOTIFY | G_PARAM_STATIC_STRINGS
+	);
+
+	/**
+	 * ReplitPager:max-buffered-bytes:
+	 * 
+	 * The size of unconsumed responses above which no more pages are fetched
+	 * ahead, or zero for no limit.
+	 * 
+	 * Pages are measured by the size of their response bodies. The next page is
+	 * always fetched once every buffered item has been consumed, however large
+	 * it is.
+	 */
+	properties[PROP_MAX_BUFFERED_BYTES] = g_param_spec_uint64(
+		"max-buffered-bytes",
+		"Maximum buffered bytes",
+		"The size of unconsumed responses above which no more pages are fetched",
+		0,
+		G_MAXUINT64,
+		DEFAULT_MAX_BUFFERED_BYTES,
+		G_PARAM_READWRITE | G_PARAM_EXPLICIT_NOTIFY | G_PARAM_STATIC_STRINGS
+	);
+
+	g_object_class_install_properties(object_class, N_PROPERTIES, properties);
+}
+
+static void replit_pager_init(ReplitPager* self) {
+	self->read_ahead = DEFAULT_READ_AHEAD;
+	self->max_buffered_bytes = DEFAULT_MAX_BUFFERED_BYTES;
+	g_queue_init(&self->pages);
+	g_queue_init(&self->waiters);
+}
+
+static void replit_pager_page_free(ReplitPagerPage* page) {
+	json_node_unref(page->data);
+	g_free(page);
+}
+
+static void replit_pager_dispose(GObject* gobject) {
+	ReplitPager* self = REPLIT_PAGER (gobject);
+
+	g_clear_object(&self->client);
+
+	G_OBJECT_CLASS (replit_pager_parent_class)->dispose(gobject);
+}
+
+static void replit_pager_finalize(GObject* gobject) {
+	ReplitPager* self = REPLIT_PAGER (gobject);
+
+	g_free(self->query);
+	g_free(self->cursor_variable);
+	g_free(self->cursor);
+	g_strfreev(self->items_path);
+	g_strfreev(self->cursor_path);
+	g_clear_pointer(&self->variables, json_node_unref);
+	g_clear_error(&self->error);
+	g_queue_clear_full(&self->pages, (GDestroyNotify) replit_pager_page_free);
+
+	G_OBJECT_CLASS (replit_pager_parent_class)->finalize(gobject);
+}
+
+static void replit_pager_get_property(
+	GObject* gobject,
+	guint property_id,
+	GValue* value,
+	GParamSpec* pspec
+) {
+	ReplitPager* self = REPLIT_PAGER (gobject);
+
+	switch (property_id) {
+		case PROP_READ_AHEAD:
+			g_value_set_uint(value, self->read_ahead);
+			break;
+
+		case PROP_MAX_BUFFERED_BYTES:
+			g_value_set_uint64(value, self->max_buffered_bytes);
+			break;
+
+		default:
+			G_OBJECT_WARN_INVALID_PROPERTY_ID(gobject, property_id, pspec);
+			break;
+	}
+}
+
+static void replit_pager_set_property(
+	GObject* gobject,
+	guint property_id,
+	const GValue* value,
+	GParamSpec* pspec
+) {
+	ReplitPager* self = REPLIT_PAGER (gobject);
+
+	switch (property_id) {
+		case PROP_READ_AHEAD:
+			replit_pager_set_read_ahead(self, g_value_get_uint(value));
+			break;
+
+		case PROP_MAX_BUFFERED_BYTES:
+			replit_pager_set_max_buffered_bytes(self, g_value_get_uint64(value));
+			break;
+
+		default:
+			G_OBJECT_WARN_INVALID_PROPERTY_ID(gobject, property_id, pspec);
+			break;
+	}
+}
+
+/**
+ * replit_pager_new:
+ * @client: The client to perform the query with.
+ * @query: (transfer none): The GraphQL query which fetches one page.
+ * @variables: (transfer full) (nullable): The variables to pass with every
+ *   page, which must be an object if given.
+ * @items_path: (transfer none): The dot-separated path to the array of items in
+ *   each response, such as `data.user.repls.items`.
+ * @cursor_path: (transfer none): The dot-separated path to the cursor of the
+ *   next page in each response, such as `data.user.repls.pageInfo.nextCursor`.
+ * @cursor_variable: (transfer none): The name of the variable to pass the
+ *   cursor in, such as `after`.
+ * 
+ * Creates a new #ReplitPager for a paginated query.
+ * 
+ * The first page is fetched without @cursor_variable set. Paths start from the
+ * root of the response, as for [method@Client.query_foreach]. Pagination ends
+ * when a page has no items, or when its cursor is missing, %NULL or the same as
+ * the previous cursor.
+ * 
+ * Nothing is fetched until the first item is requested.
+ * 
+ * Returns: (transfer full): The new #ReplitPager.
+ */
+ReplitPager* replit_pager_new(
+	ReplitClient* client,
+	const gchar* query,
+	JsonNode* variables,
+	const gchar* items_path,
+	const gchar* cursor_path,
+	const gchar* cursor_variable
+) {
+	ReplitPager* self = g_object_new(REPLIT_TYPE_PAGER, NULL);
+	self->client = g_object_ref(client);
+	self->query = g_strdup(query);
+	self->variables = variables;
+	self->items_path = g_strsplit(items_path, ".", -1);
+	self->cursor_path = g_strsplit(cursor_path, ".", -1);
+	self->cursor_variable = g_strdup(cursor_variable);
+
+	return self;
+}
+
+/* Looks up a path from the root of a response, given its `data` member. */
+static JsonNode* replit_pager_lookup(JsonNode* data, gchar** path) {
+	if (path[0] == NULL || !g_str_equal(path[0], "data")) return NULL;
+
+	JsonNode* node = data;
+
+	for (guint i = 1; path[i] != NULL; i++) {
+		if (!JSON_NODE_HOLDS_OBJECT (node)) return NULL;
+
+		node = json_object_get_member(json_node_get_object(node), path[i]);
+		if (node == NULL) return NULL;
+	}
+
+	return node;
+}
+
+static JsonNode* replit_pager_pop(ReplitPager* self) {
+	ReplitPagerPage* page = g_queue_peek_head(&self->pages);
+	if (page == NULL) return NULL;
+
+	JsonNode* item = json_array_dup_element(page->items, page->index++);
+
+	if (page->index >= json_array_get_length(page->items)) {
+		g_queue_pop_head(&self->pages);
+		self->buffered_bytes -= page->length;
+		replit_pager_page_free(page);
+	}
+
+	return item;
+}
+
+/* Completes as many waiting calls to replit_pager_next_async() as possible,
+ * and then fetches more pages if there is room for them. */
+static void replit_pager_dispatch(ReplitPager* self) {
+	while (!g_queue_is_empty(&self->waiters)) {
+		GTask* waiter = g_queue_peek_head(&self->waiters);
+
+		if (g_task_return_error_if_cancelled(waiter)) {
+			g_queue_pop_head(&self->waiters);
+			g_object_unref(waiter);
+
+			continue;
+		}
+
+		JsonNode* item = replit_pager_pop(self);
+
+		if (item != NULL) {
+			GTask* task = g_queue_pop_head(&self->waiters);
+			g_task_return_pointer(task, item, (GDestroyNotify) json_node_unref);
+			g_object_unref(task);
+		} else if (self->error != NULL) {
+			GTask* task = g_queue_pop_head(&self->waiters);
+			g_task_return_error(task, g_error_copy(self->error));
+			g_object_unref(task);
+		} else if (self->done) {
+			GTask* task = g_queue_pop_head(&self->waiters);
+			g_task_return_pointer(task, NULL, NULL);
+			g_object_unref(task);
+		} else {
+			break;
+		}
+	}
+
+	replit_pager_fill(self);
+}
+
+static void replit_pager_fetch_ready(
+	GObject* source,
+	GAsyncResult* result,
+	gpointer user_data
+) {
+	ReplitPager* self = user_data;
+	GError* error = NULL;
+	gsize length;
+
+	JsonNode* data = replit_client_send_finish(REPLIT_CLIENT (source), result, &length, &error);
+
+	self->fetching = FALSE;
+
+	if (data == NULL) {
+		self->error = error;
+		replit_pager_dispatch(self);
+		g_object_unref(self);
+
+		return;
+	}
+
+	JsonNode* items = replit_pager_lookup(data, self->items_path);
+
+	if (items == NULL || !JSON_NODE_HOLDS_ARRAY (items)) {
+		gchar* items_path = g_strjoinv(".", self->items_path);
+
+		g_set_error(
+			&self->error,
+			REPLIT_CLIENT_ERROR,
+			REPLIT_CLIENT_ERROR_GRAPHQL_EMPTY,
+			"Server returned no array of items at %s",
+			items_path
+		);
+
+		g_free(items_path);
+		json_node_unref(data);
+		replit_pager_dispatch(self);
+		g_object_unref(self);
+
+		return;
+	}
+
+	JsonArray* items_array = json_node_get_array(items);
+	JsonNode* cursor = replit_pager_lookup(data, self->cursor_path);
+	const gchar* next_cursor = NULL;
+
+	if (cursor != NULL && JSON_NODE_HOLDS_VALUE (cursor)) {
+		next_cursor = json_node_get_string(cursor);
+	}
+
+	if (
+		json_array_get_length(items_array) == 0 ||
+		next_cursor == NULL ||
+		g_strcmp0(next_cursor, self->cursor) == 0
+	) {
+		self->done = TRUE;
+	} else {
+		g_free(self->cursor);
+		self->cursor = g_strdup(next_cursor);
+	}
+
+	if (json_array_get_length(items_array) > 0) {
+		ReplitPagerPage* page = g_new0(ReplitPagerPage, 1);
+		page->data = data;
+		page->items = items_array;
+		page->length = length;
+
+		g_queue_push_tail(&self->pages, page);
+		self->buffered_bytes += length;
+	} else {
+		json_node_unref(data);
+	}
+
+	replit_pager_dispatch(self);
+	g_object_unref(self);
+}
+
+/* Requests the next page if one is not already being fetched, and there is
+ * room for it within the read-ahead depth and memory cap. */
+static void replit_pager_fill(ReplitPager* self) {
+	if (!self->started || self->fetching || self->done || self->error != NULL) return;
+
+	if (!g_queue_is_empty(&self->pages)) {
+		if (g_queue_get_length(&self->pages) > self->read_ahead) return;
+
+		if (
+			self->max_buffered_bytes > 0 &&
+			self->buffered_bytes >= self->max_buffered_bytes
+		) {
+			return;
+		}
+	}
+
+	JsonObject* variables_object = json_object_new();
+
+	if (self->variables != NULL) {
+		JsonObjectIter iter;
+		const gchar* name;
+		JsonNode* member;
+
+		json_object_iter_init(&iter, json_node_get_object(self->variables));
+
+		while (json_object_iter_next(&iter, &name, &member)) {
+			json_object_set_member(variables_object, name, json_node_copy(member));
+		}
+	}
+
+	if (self->cursor != NULL) {
+		json_object_set_string_member(variables_object, self->cursor_variable, self->cursor);
+	}
+
+	JsonNode* variables = json_node_new(JSON_NODE_OBJECT);
+	json_node_set_object(variables, variables_object);
+	json_object_unref(variables_object);
+
+	ReplitRequestRecord* record;
+	gboolean idempotent;
+	GBytes* req_bytes = replit_client_build_request(
+		self->client,
+		self->query,
+		NULL,
+		variables,
+		&record,
+		&idempotent
+	);
+
+	self->fetching = TRUE;
+
+	replit_client_send_async(
+		self->client,
+		req_bytes,
+		record,
+		REPLIT_REQUEST_PRIORITY_NORMAL,
+		idempotent,
+		0,
+		NULL,
+		replit_pager_fetch_ready,
+		g_object_ref(self)
+	);
+}
+
+/**
+ * replit_pager_next_async:
+ * @pager: The pager.
+ * @cancellable: (nullable): A #GCancellable.
+ * @callback: (scope async): The callback to call when the next item is ready.
+ * @user_data: (closure): Data to pass to @callback.
+ * 
+ * Asynchronously gets the next item, fetching more pages if needed.
+ * 
+ * When the item is ready, @callback is called in the thread-default main
+ * context of the caller, and should call [method@Pager.next_finish] to get it.
+ * Items are returned in order, even when this method is called again before an
+ * earlier call has completed.
+ * 
+ * A call cancelled through @cancellable consumes no item, and completes with
+ * %G_IO_ERROR_CANCELLED once the pager next has an item or page to hand out.
+ */
+void replit_pager_next_async(
+	ReplitPager* self,
+	GCancellable* cancellable,
+	GAsyncReadyCallback callback,
+	gpointer user_data
+) {
+	GTask* task = g_task_new(self, cancellable, callback, user_data);
+	g_task_set_source_tag(task, replit_pager_next_async);
+	g_task_set_check_cancellable(task, FALSE);
+
+	g_queue_push_tail(&self->waiters, task);
+	self->started = TRUE;
+
+	replit_pager_dispatch(self);
+}
+
+/**
+ * replit_pager_next_finish:
+ * @pager: The pager.
+ * @result: The #GAsyncResult passed to the callback.
+ * 
+ * Finishes getting an item started with [method@Pager.next_async].
+ * 
+ * Returns: (transfer full) (nullable): The next item, or %NULL either on error
+ *   or once every item has been returned.
+ */
+JsonNode* replit_pager_next_finish(
+	ReplitPager* self,
+	GAsyncResult* result,
+	GError** error
+) {
+	g_return_val_if_fail(g_task_is_valid(result, self), NULL);
+
+	return g_task_propagate_pointer(G_TASK (result), error);
+}
+
+static void replit_pager_next_ready(
+	GObject* source __attribute__((unused)),
+	GAsyncResult* result,
+	gpointer user_data
+) {
+	GAsyncResult** result_out = user_data;
+	*result_out = g_object_ref(result);
+}
+
+/**
+ * replit_pager_next:
+ * @pager: The pager.
+ * 
+ * Gets the next item, fetching more pages if needed.
+ * 
+ * Buffered items are returned immediately. Otherwise, this blocks whilst
+ * running the thread-default main context until the next page is received.
+ * Pages are only fetched ahead whilst that context runs, so consumers which
+ * spend a long time on each item without returning to the main loop should
+ * prefer [method@Pager.next_async].
+ * 
+ * Returns: (transfer full) (nullable): The next item, or %NULL either on error
+ *   or once every item has been returned.
+ */
+JsonNode* replit_pager_next(ReplitPager* self, GError** error) {
+	if (g_queue_is_empty(&self->waiters)) {
+		JsonNode* item = replit_pager_pop(self);
+
+		if (item != NULL) {
+			replit_pager_fill(self);
+
+			return item;
+		}
+	}
+
+	GMainContext* context = g_main_context_ref_thread_default();
+	GAsyncResult* result = NULL;
+
+	replit_pager_next_async(self, NULL, replit_pager_next_ready, &result);
+
+	while (result == NULL) g_main_context_iteration(context, TRUE);
+
+	JsonNode* item = replit_pager_next_finish(self, result, error);
+
+	g_object_unref(result);
+	g_main_context_unref(context);
+
+	return item;
+}
+
+/**
+ * replit_pager_set_read_ahead:
+ * @pager: The pager.
+ * @pages: The number of pages to fetch ahead.
+ * 
+ * Sets the number of pages to fetch ahead of the page being consumed.
+ */
+void replit_pager_set_read_ahead(ReplitPager* self, guint pages) {
+	if (self->read_ahead == pages) return;
+
+	self->read_ahead = pages;
+	replit_pager_fill(self);
+
+	g_object_notify_by_pspec(G_OBJECT (self), properties[PROP_READ_AHEAD]);
+}
+
+/**
+ * replit_pager_get_read_ahead:
+ * @pager: The pager.
+ * 
+ * Gets the number of pages to fetch ahead of the page being consumed.
+ * 
+ * Returns: The number of pages.
+ */
+guint replit_pager_get_read_ahead(ReplitPager* self) {
+	return self->read_ahead;
+}
+
+/**
+ * replit_pager_set_max_buffered_bytes:
+ * @pager: The pager.
+ * @bytes: The maximum size of unconsumed responses, or zero for no limit.
+ * 
+ * Sets the size of unconsumed responses above which no more pages are fetched
+ * ahead.
+ */
+void replit_pager_set_max_buffered_bytes(ReplitPager* self, guint64 bytes) {
+	if (self->max_buffered_bytes == bytes) return;
+
+	self->max_buffered_bytes = bytes;
+	replit_pager_fill(self);
+
+	g_object_notify_by_pspec(G_OBJECT (self), properties[PROP_MAX_BUFFERED_BYTES]);
+}
+
+/**
+ * replit_pager_get_max_buffered_bytes:
+ * @pager: The pager.
+ * 
+ * Gets the size of unconsumed responses above which no more pages are fetched
+ * ahead.
+ * 
+ * Returns: The maximum size in bytes, or zero for no limit.
+ */
+guint64 replit_pager_get_max_buffered_bytes(ReplitPager* self) {
+	return self->max_buffered_bytes;
+}
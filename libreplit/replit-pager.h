@@ -0,0 +1,78 @@
+/* replit-pager.h
+ *
+ * Copyright 2022 Patrick Winters
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE X CONSORTIUM BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written
+ * authorization.
+ */
+
+#pragma once
+
+#if !defined(REPLIT_INSIDE) && !defined(REPLIT_COMPILATION)
+#error "Only <replit.h> can be included directly."
+#endif
+
+#include <gio/gio.h>
+#include <json-glib/json-glib.h>
+
+#include "replit-client.h"
+
+G_BEGIN_DECLS
+
+#define REPLIT_TYPE_PAGER replit_pager_get_type()
+G_DECLARE_FINAL_TYPE (ReplitPager, replit_pager, REPLIT, PAGER, GObject)
+
+ReplitPager* replit_pager_new(
+	ReplitClient* client,
+	const gchar* query,
+	JsonNode* variables,
+	const gchar* items_path,
+	const gchar* cursor_path,
+	const gchar* cursor_variable
+);
+
+JsonNode* replit_pager_next(ReplitPager* pager, GError** error);
+
+void replit_pager_next_async(
+	ReplitPager* pager,
+	GCancellable* cancellable,
+	GAsyncReadyCallback callback,
+	gpointer user_data
+);
+
+JsonNode* replit_pager_next_finish(
+	ReplitPager* pager,
+	GAsyncResult* result,
+	GError** error
+);
+
+void replit_pager_set_read_ahead(ReplitPager* pager, guint pages);
+
+guint replit_pager_get_read_ahead(ReplitPager* pager);
+
+void replit_pager_set_max_buffered_bytes(ReplitPager* pager, guint64 bytes);
+
+guint64 replit_pager_get_max_buffered_bytes(ReplitPager* pager);
+
+G_END_DECLS
@@ -0,0 +1,267 @@
+/* replit-recorder.c
+ *
+ * Copyright 2022 Patrick Winters
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE X CONSORTIUM BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written
+ * authorization.
+ */
+
+#include <string.h>
+
+#include "replit-recorder.h"
+#include "replit-recording-private.h"
+
+/**
+ * ReplitRecorder:
+ * 
+ * Records the traffic of a #ReplitClient and its #ReplitSubscriber to a file.
+ * 
+ * Once set with [method@Client.set_recorder], every GraphQL request body and
+ * successful response body, and every subscription frame sent and received, is
+ * appended to the file with the time it was seen. The file can be played back
+ * with #ReplitReplay, to reproduce the same traffic without a network.
+ * 
+ * Recordings are appended to, so one file may hold several runs. Writes are
+ * buffered, and reach the file when the buffer fills, when
+ * [method@Recorder.flush] is called, or when the recorder is finalized. The
+ * first write error is reported with a warning, and recording stops.
+ */
+
+struct _ReplitRecorder {
+	GObject parent_instance;
+
+	GMutex mutex;
+	GOutputStream* stream;
+	gint next_id;
+	GError* error;
+};
+
+G_DEFINE_TYPE (ReplitRecorder, replit_recorder, G_TYPE_OBJECT)
+
+static void replit_recorder_finalize(GObject* gobject);
+
+static void replit_recorder_class_init(ReplitRecorderClass* klass) {
+	GObjectClass* object_class = G_OBJECT_CLASS (klass);
+
+	object_class->finalize = replit_recorder_finalize;
+}
+
+static void replit_recorder_init(ReplitRecorder* self) {
+	g_mutex_init(&self->mutex);
+}
+
+static void replit_recorder_finalize(GObject* gobject) {
+	ReplitRecorder* self = REPLIT_RECORDER (gobject);
+
+	if (self->stream != NULL && self->error == NULL) {
+		g_output_stream_close(self->stream, NULL, NULL);
+	}
+
+	g_clear_object(&self->stream);
+	g_clear_error(&self->error);
+	g_mutex_clear(&self->mutex);
+
+	G_OBJECT_CLASS (replit_recorder_parent_class)->finalize(gobject);
+}
+
+/* Checks whether an existing file is a recording that can be appended to, and
+ * whether it still needs its header. */
+static gboolean replit_recorder_check_file(
+	GFile* file,
+	const gchar* path,
+	gboolean* needs_header,
+	GError** error
+) {
+	GError* local_error = NULL;
+	GFileInputStream* input = g_file_read(file, NULL, &local_error);
+
+	if (input == NULL) {
+		if (!g_error_matches(local_error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND)) {
+			g_propagate_error(error, local_error);
+
+			return FALSE;
+		}
+
+		g_error_free(local_error);
+		*needs_header = TRUE;
+
+		return TRUE;
+	}
+
+	ReplitFileHeader header;
+	gsize length;
+	gboolean ok = g_input_stream_read_all(
+		G_INPUT_STREAM (input),
+		&header,
+		sizeof(header),
+		&length,
+		NULL,
+		error
+	);
+
+	g_object_unref(input);
+
+	if (!ok) return FALSE;
+
+	*needs_header = length == 0;
+
+	if (
+		length != 0 && (
+			length < sizeof(header) ||
+			!replit_file_header_check(&header, REPLIT_RECORDING_MAGIC, REPLIT_RECORDING_VERSION)
+		)
+	) {
+		g_set_error(
+			error,
+			G_IO_ERROR,
+			G_IO_ERROR_INVALID_DATA,
+			"%s is not a version %d libreplit recording",
+			path,
+			REPLIT_RECORDING_VERSION
+		);
+
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+/**
+ * replit_recorder_new:
+ * @path: (type filename): The file to record to.
+ * 
+ * Creates a new #ReplitRecorder which appends to the recording at @path, or
+ * creates it if it does not exist.
+ * 
+ * Returns: (transfer full) (nullable): The new #ReplitRecorder, or %NULL if the
+ *   file could not be opened or is not a recording.
+ */
+ReplitRecorder* replit_recorder_new(const gchar* path, GError** error) {
+	GFile* file = g_file_new_for_path(path);
+	gboolean needs_header;
+
+	if (!replit_recorder_check_file(file, path, &needs_header, error)) {
+		g_object_unref(file);
+
+		return NULL;
+	}
+
+	GFileOutputStream* output = g_file_append_to(file, G_FILE_CREATE_NONE, NULL, error);
+
+	g_object_unref(file);
+
+	if (output == NULL) return NULL;
+
+	ReplitRecorder* self = g_object_new(REPLIT_TYPE_RECORDER, NULL);
+	self->stream = g_buffered_output_stream_new(G_OUTPUT_STREAM (output));
+
+	g_object_unref(output);
+
+	if (needs_header) {
+		ReplitFileHeader header;
+
+		replit_file_header_init(&header, REPLIT_RECORDING_MAGIC, REPLIT_RECORDING_VERSION);
+
+		if (!g_output_stream_write_all(self->stream, &header, sizeof(header), NULL, NULL, error)) {
+			g_object_unref(self);
+
+			return NULL;
+		}
+	}
+
+	return self;
+}
+
+/* Returns an ID for a new request or channel, unique within this recorder. */
+guint32 replit_recorder_next_id(ReplitRecorder* self) {
+	return (guint32) g_atomic_int_add(&self->next_id, 1) + 1;
+}
+
+/* Appends a record with the wall-clock @timestamp it was seen at. */
+void replit_recorder_add(
+	ReplitRecorder* self,
+	ReplitRecordKind kind,
+	guint32 id,
+	gint64 timestamp,
+	GBytes* data
+) {
+	static const guint8 padding[REPLIT_FILE_ALIGN] = { 0 };
+
+	gsize length = 0;
+	gconstpointer bytes = data != NULL ? g_bytes_get_data(data, &length) : NULL;
+
+	if (length > G_MAXUINT32) {
+		g_warning("Not recording a message of %" G_GSIZE_FORMAT " bytes", length);
+
+		return;
+	}
+
+	ReplitRecordHeader header = {
+		.kind = GUINT32_TO_LE(kind),
+		.length = GUINT32_TO_LE((guint32) length),
+		.id = GUINT32_TO_LE(id),
+		.timestamp = GINT64_TO_LE(timestamp),
+	};
+
+	gsize padding_length = replit_file_padded(length) - length;
+
+	g_mutex_lock(&self->mutex);
+
+	if (
+		self->error == NULL && (
+			!g_output_stream_write_all(self->stream, &header, sizeof(header), NULL, NULL, &self->error) ||
+			!g_output_stream_write_all(self->stream, bytes, length, NULL, NULL, &self->error) ||
+			!g_output_stream_write_all(self->stream, padding, padding_length, NULL, NULL, &self->error)
+		)
+	) {
+		g_warning("Recording stopped: %s", self->error->message);
+	}
+
+	g_mutex_unlock(&self->mutex);
+}
+
+/**
+ * replit_recorder_flush:
+ * @recorder: The recorder.
+ * 
+ * Writes any buffered records to the file.
+ * 
+ * Returns: %TRUE on success, or %FALSE if writing to the recording has failed.
+ */
+gboolean replit_recorder_flush(ReplitRecorder* self, GError** error) {
+	gboolean ok;
+
+	g_mutex_lock(&self->mutex);
+
+	if (self->error != NULL) {
+		g_propagate_error(error, g_error_copy(self->error));
+		ok = FALSE;
+	} else {
+		ok = g_output_stream_flush(self->stream, NULL, error);
+	}
+
+	g_mutex_unlock(&self->mutex);
+
+	return ok;
+}
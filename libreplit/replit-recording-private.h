@@ -0,0 +1,82 @@
+/* replit-recording-private.h
+ *
+ * Copyright 2022 Patrick Winters
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE X CONSORTIUM BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written
+ * authorization.
+ */
+
+#pragma once
+
+#include "replit-file-private.h"
+#include "replit-recorder.h"
+
+G_BEGIN_DECLS
+
+/* A recording is a file in the format of replit-file-private.h whose records
+ * have 24 byte headers. Timestamps are wall-clock microseconds, so that
+ * recordings from separate runs can be appended to the same file. A record cut
+ * short by a crash is ignored when the file is read. */
+
+#define REPLIT_RECORDING_MAGIC "LRPLREC\n"
+#define REPLIT_RECORDING_VERSION 1
+
+typedef enum {
+	/* The body of a GraphQL request; the ID pairs it with its response. */
+	REPLIT_RECORD_REQUEST = 1,
+
+	/* The body of a successful response to the request with the same ID. */
+	REPLIT_RECORD_RESPONSE,
+
+	/* A subscription connection was opened; the ID names the channel. */
+	REPLIT_RECORD_CHANNEL_OPEN,
+
+	/* A frame received on the channel with the same ID. */
+	REPLIT_RECORD_FRAME_IN,
+
+	/* A frame sent on the channel with the same ID. */
+	REPLIT_RECORD_FRAME_OUT,
+} ReplitRecordKind;
+
+typedef struct {
+	guint32 kind;
+	guint32 length;
+	guint32 id;
+	guint32 reserved;
+	gint64 timestamp;
+} ReplitRecordHeader;
+
+G_STATIC_ASSERT (sizeof(ReplitRecordHeader) == 24);
+
+guint32 replit_recorder_next_id(ReplitRecorder* recorder);
+
+void replit_recorder_add(
+	ReplitRecorder* recorder,
+	ReplitRecordKind kind,
+	guint32 id,
+	gint64 timestamp,
+	GBytes* data
+);
+
+G_END_DECLS
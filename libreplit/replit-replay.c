@@ -0,0 +1,667 @@
+/* replit-replay.c
+ *
+ * Copyright 2022 Patrick Winters
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE X CONSORTIUM BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written
+ * authorization.
+ */
+
+#include <string.h>
+
+#include "replit-recording-private.h"
+#include "replit-replay.h"
+#include "replit-transport.h"
+
+/* The most frames delivered in one main loop iteration, so that replaying as
+ * fast as possible doesn't starve other sources. */
+#define FRAME_BURST 64
+
+/**
+ * ReplitReplay:
+ * 
+ * A #ReplitTransport which plays back a recording made with #ReplitRecorder.
+ * 
+ * Each request is answered with the response recorded for an identical request
+ * body; when the same request was recorded several times, its responses are
+ * given in turn, starting again from the first once all have been used.
+ * Requests that were never recorded fail with %G_IO_ERROR_NOT_FOUND.
+ * 
+ * Each subscription channel opened on the replay plays back the frames
+ * received on the corresponding connection in the recording, in order: the
+ * first channel plays the first connection, and so on. Channels opened beyond
+ * the number recorded receive nothing.
+ * 
+ * Responses and frames are delivered at the pace they were recorded at,
+ * scaled by [property@Replay:speed]. The recording is memory-mapped, and
+ * bodies are passed on without being copied.
+ * 
+ * Requests may be sent from any number of threads at once, so a replay can
+ * stand in for the network under a client shared between threads. Channels
+ * must be opened and closed in the main context their frames are delivered
+ * in, and the speed should be set before the replay is shared.
+ */
+
+typedef struct {
+	GBytes* response;
+	gint64 duration;
+} ReplitReplayExchange;
+
+typedef struct {
+	GPtrArray* exchanges;
+	guint next;
+} ReplitReplayQueue;
+
+typedef struct {
+	GBytes* data;
+	gint64 offset;
+} ReplitReplayFrame;
+
+typedef struct {
+	gint64 open_time;
+	GPtrArray* frames;
+} ReplitReplayConnection;
+
+typedef struct {
+	ReplitReplay* replay;
+	guint id;
+	ReplitReplayConnection* connection;
+	guint next;
+	gint64 start_time;
+	GSource* source;
+	ReplitTransportFrameFunc func;
+	gpointer user_data;
+} ReplitReplayChannel;
+
+typedef struct {
+	GBytes* request;
+	gint64 timestamp;
+} ReplitReplayPending;
+
+struct _ReplitReplay {
+	GObject parent_instance;
+
+	GMutex mutex;
+	GMappedFile* file;
+	GBytes* contents;
+	GHashTable* requests;
+	guint n_exchanges;
+	GPtrArray* connections;
+	GHashTable* channels;
+	guint n_opened;
+	gdouble speed;
+};
+
+static void replit_replay_transport_init(ReplitTransportInterface* iface);
+
+G_DEFINE_TYPE_WITH_CODE (
+	ReplitReplay,
+	replit_replay,
+	G_TYPE_OBJECT,
+	G_IMPLEMENT_INTERFACE (REPLIT_TYPE_TRANSPORT, replit_replay_transport_init)
+)
+
+enum {
+	PROP_0,
+	PROP_SPEED,
+	N_PROPERTIES,
+};
+
+static GParamSpec* properties[N_PROPERTIES] = { NULL };
+
+static void replit_replay_dispose(GObject* gobject);
+static void replit_replay_finalize(GObject* gobject);
+static void replit_replay_get_property(
+	GObject* gobject,
+	guint property_id,
+	GValue* value,
+	GParamSpec* pspec
+);
+static void replit_replay_set_property(
+	GObject* gobject,
+	guint property_id,
+	const GValue* value,
+	GParamSpec* pspec
+);
+
+static void replit_replay_class_init(ReplitReplayClass* klass) {
+	GObjectClass* object_class = G_OBJECT_CLASS (klass);
+
+	object_class->dispose = replit_replay_dispose;
+	object_class->finalize = replit_replay_finalize;
+	object_class->get_property = replit_replay_get_property;
+	object_class->set_property = replit_replay_set_property;
+
+	/**
+	 * ReplitReplay:speed:
+	 * 
+	 * How many times faster than recorded responses and frames are delivered.
+	 * 
+	 * The default of 1 reproduces the original timing. 0 delivers everything
+	 * as fast as possible.
+	 */
+	properties[PROP_SPEED] = g_param_spec_double(
+		"speed",
+		"Speed",
+		"How many times faster than recorded responses and frames are delivered",
+		0,
+		G_MAXDOUBLE,
+		1,
+		G_PARAM_READWRITE | G_PARAM_EXPLICIT_NOTIFY | G_PARAM_STATIC_STRINGS
+	);
+
+	g_object_class_install_properties(object_class, N_PROPERTIES, properties);
+}
+
+static void replit_replay_queue_free(ReplitReplayQueue* queue) {
+	g_ptr_array_unref(queue->exchanges);
+	g_free(queue);
+}
+
+static void replit_replay_exchange_free(ReplitReplayExchange* exchange) {
+	g_bytes_unref(exchange->response);
+	g_free(exchange);
+}
+
+static void replit_replay_frame_free(ReplitReplayFrame* frame) {
+	g_bytes_unref(frame->data);
+	g_free(frame);
+}
+
+static void replit_replay_connection_free(ReplitReplayConnection* connection) {
+	g_ptr_array_unref(connection->frames);
+	g_free(connection);
+}
+
+static void replit_replay_channel_free(ReplitReplayChannel* channel) {
+	if (channel->source != NULL) {
+		g_source_destroy(channel->source);
+		g_source_unref(channel->source);
+	}
+
+	g_free(channel);
+}
+
+static void replit_replay_pending_free(ReplitReplayPending* pending) {
+	g_bytes_unref(pending->request);
+	g_free(pending);
+}
+
+static void replit_replay_init(ReplitReplay* self) {
+	g_mutex_init(&self->mutex);
+
+	self->requests = g_hash_table_new_full(
+		g_bytes_hash,
+		g_bytes_equal,
+		(GDestroyNotify) g_bytes_unref,
+		(GDestroyNotify) replit_replay_queue_free
+	);
+	self->connections = g_ptr_array_new_with_free_func(
+		(GDestroyNotify) replit_replay_connection_free
+	);
+	self->channels = g_hash_table_new_full(
+		g_direct_hash,
+		g_direct_equal,
+		NULL,
+		(GDestroyNotify) replit_replay_channel_free
+	);
+	self->speed = 1;
+}
+
+static void replit_replay_dispose(GObject* gobject) {
+	ReplitReplay* self = REPLIT_REPLAY (gobject);
+
+	g_hash_table_remove_all(self->channels);
+
+	G_OBJECT_CLASS (replit_replay_parent_class)->dispose(gobject);
+}
+
+static void replit_replay_finalize(GObject* gobject) {
+	ReplitReplay* self = REPLIT_REPLAY (gobject);
+
+	g_hash_table_unref(self->channels);
+	g_hash_table_unref(self->requests);
+	g_ptr_array_unref(self->connections);
+	g_clear_pointer(&self->contents, g_bytes_unref);
+	g_clear_pointer(&self->file, g_mapped_file_unref);
+	g_mutex_clear(&self->mutex);
+
+	G_OBJECT_CLASS (replit_replay_parent_class)->finalize(gobject);
+}
+
+static void replit_replay_get_property(
+	GObject* gobject,
+	guint property_id,
+	GValue* value,
+	GParamSpec* pspec
+) {
+	ReplitReplay* self = REPLIT_REPLAY (gobject);
+
+	switch (property_id) {
+		case PROP_SPEED:
+			g_value_set_double(value, self->speed);
+			break;
+
+		default:
+			G_OBJECT_WARN_INVALID_PROPERTY_ID(gobject, property_id, pspec);
+			break;
+	}
+}
+
+static void replit_replay_set_property(
+	GObject* gobject,
+	guint property_id,
+	const GValue* value,
+	GParamSpec* pspec
+) {
+	ReplitReplay* self = REPLIT_REPLAY (gobject);
+
+	switch (property_id) {
+		case PROP_SPEED:
+			replit_replay_set_speed(self, g_value_get_double(value));
+			break;
+
+		default:
+			G_OBJECT_WARN_INVALID_PROPERTY_ID(gobject, property_id, pspec);
+			break;
+	}
+}
+
+/* Pairs a recorded response with the request it answered. */
+static void replit_replay_add_exchange(
+	ReplitReplay* self,
+	ReplitReplayPending* pending,
+	GBytes* response,
+	gint64 timestamp
+) {
+	ReplitReplayQueue* queue = g_hash_table_lookup(self->requests, pending->request);
+
+	if (queue == NULL) {
+		queue = g_new0(ReplitReplayQueue, 1);
+		queue->exchanges = g_ptr_array_new_with_free_func(
+			(GDestroyNotify) replit_replay_exchange_free
+		);
+
+		g_hash_table_insert(self->requests, g_bytes_ref(pending->request), queue);
+	}
+
+	ReplitReplayExchange* exchange = g_new(ReplitReplayExchange, 1);
+	exchange->response = g_bytes_ref(response);
+	exchange->duration = MAX(timestamp - pending->timestamp, 0);
+
+	g_ptr_array_add(queue->exchanges, exchange);
+	self->n_exchanges++;
+}
+
+/* Indexes the records of the mapped recording. */
+static gboolean replit_replay_load(ReplitReplay* self, const gchar* path, GError** error) {
+	gsize size;
+	const guint8* data = g_bytes_get_data(self->contents, &size);
+	ReplitFileHeader file_header;
+
+	if (size >= sizeof(file_header)) memcpy(&file_header, data, sizeof(file_header));
+
+	if (
+		size < sizeof(file_header) ||
+		!replit_file_header_check(&file_header, REPLIT_RECORDING_MAGIC, REPLIT_RECORDING_VERSION)
+	) {
+		g_set_error(
+			error,
+			G_IO_ERROR,
+			G_IO_ERROR_INVALID_DATA,
+			"%s is not a version %d libreplit recording",
+			path,
+			REPLIT_RECORDING_VERSION
+		);
+
+		return FALSE;
+	}
+
+	/* IDs are only unique within one run, so each is forgotten when reused. */
+	GHashTable* pending = g_hash_table_new_full(
+		g_direct_hash,
+		g_direct_equal,
+		NULL,
+		(GDestroyNotify) replit_replay_pending_free
+	);
+	GHashTable* open = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+	gsize offset = sizeof(file_header);
+
+	while (size - offset >= sizeof(ReplitRecordHeader)) {
+		ReplitRecordHeader header;
+		memcpy(&header, data + offset, sizeof(header));
+		offset += sizeof(header);
+
+		guint32 kind = GUINT32_FROM_LE(header.kind);
+		gsize length = GUINT32_FROM_LE(header.length);
+		gpointer id = GUINT_TO_POINTER(GUINT32_FROM_LE(header.id));
+		gint64 timestamp = GINT64_FROM_LE(header.timestamp);
+		gsize padded = replit_file_padded(length);
+
+		/* The last record was cut short. */
+		if (padded > size - offset) break;
+
+		GBytes* record = g_bytes_new_from_bytes(self->contents, offset, length);
+		offset += padded;
+
+		ReplitReplayPending* request;
+		ReplitReplayConnection* connection;
+
+		switch (kind) {
+			case REPLIT_RECORD_REQUEST:
+				request = g_new(ReplitReplayPending, 1);
+				request->request = g_bytes_ref(record);
+				request->timestamp = timestamp;
+
+				g_hash_table_replace(pending, id, request);
+				break;
+
+			case REPLIT_RECORD_RESPONSE:
+				request = g_hash_table_lookup(pending, id);
+				if (request == NULL) break;
+
+				replit_replay_add_exchange(self, request, record, timestamp);
+				g_hash_table_remove(pending, id);
+				break;
+
+			case REPLIT_RECORD_CHANNEL_OPEN:
+				connection = g_new(ReplitReplayConnection, 1);
+				connection->open_time = timestamp;
+				connection->frames = g_ptr_array_new_with_free_func(
+					(GDestroyNotify) replit_replay_frame_free
+				);
+
+				g_ptr_array_add(self->connections, connection);
+				g_hash_table_replace(open, id, connection);
+				break;
+
+			case REPLIT_RECORD_FRAME_IN:
+				connection = g_hash_table_lookup(open, id);
+				if (connection == NULL) break;
+
+				ReplitReplayFrame* frame = g_new(ReplitReplayFrame, 1);
+				frame->data = g_bytes_ref(record);
+				frame->offset = MAX(timestamp - connection->open_time, 0);
+
+				g_ptr_array_add(connection->frames, frame);
+				break;
+
+			default:
+				break;
+		}
+
+		g_bytes_unref(record);
+	}
+
+	g_hash_table_unref(pending);
+	g_hash_table_unref(open);
+
+	return TRUE;
+}
+
+/**
+ * replit_replay_new:
+ * @path: (type filename): The recording to play back.
+ * 
+ * Creates a new #ReplitReplay from a recording made with #ReplitRecorder.
+ * 
+ * Returns: (transfer full) (nullable): The new #ReplitReplay, or %NULL if the
+ *   file could not be read or is not a recording.
+ */
+ReplitReplay* replit_replay_new(const gchar* path, GError** error) {
+	GMappedFile* file = g_mapped_file_new(path, FALSE, error);
+
+	if (file == NULL) return NULL;
+
+	ReplitReplay* self = g_object_new(REPLIT_TYPE_REPLAY, NULL);
+	self->file = file;
+	self->contents = g_mapped_file_get_bytes(file);
+
+	if (!replit_replay_load(self, path, error)) {
+		g_object_unref(self);
+
+		return NULL;
+	}
+
+	return self;
+}
+
+static gboolean replit_replay_respond(gpointer user_data) {
+	GTask* task = user_data;
+	GBytes* response = g_task_get_task_data(task);
+
+	g_task_return_pointer(task, g_bytes_ref(response), (GDestroyNotify) g_bytes_unref);
+	g_object_unref(task);
+
+	return G_SOURCE_REMOVE;
+}
+
+static void replit_replay_send_async(
+	ReplitTransport* transport,
+	GBytes* request,
+	GCancellable* cancellable,
+	GAsyncReadyCallback callback,
+	gpointer user_data
+) {
+	ReplitReplay* self = REPLIT_REPLAY (transport);
+
+	GTask* task = g_task_new(self, cancellable, callback, user_data);
+	g_task_set_source_tag(task, replit_replay_send_async);
+
+	ReplitReplayQueue* queue = g_hash_table_lookup(self->requests, request);
+
+	if (queue == NULL) {
+		g_task_return_new_error(
+			task,
+			G_IO_ERROR,
+			G_IO_ERROR_NOT_FOUND,
+			"%s",
+			"No response to this request was recorded"
+		);
+
+		g_object_unref(task);
+
+		return;
+	}
+
+	/* The queue itself is only written while loading. */
+	g_mutex_lock(&self->mutex);
+
+	ReplitReplayExchange* exchange = g_ptr_array_index(queue->exchanges, queue->next);
+	queue->next = (queue->next + 1) % queue->exchanges->len;
+
+	g_mutex_unlock(&self->mutex);
+
+	g_task_set_task_data(task, g_bytes_ref(exchange->response), (GDestroyNotify) g_bytes_unref);
+
+	gint64 delay = self->speed > 0 ? (gint64) (exchange->duration / self->speed) : 0;
+
+	if (delay < 1000) {
+		replit_replay_respond(task);
+
+		return;
+	}
+
+	GSource* source = g_timeout_source_new((guint) MIN(delay / 1000, G_MAXUINT));
+	g_task_attach_source(task, source, replit_replay_respond);
+	g_source_unref(source);
+}
+
+static GBytes* replit_replay_send_finish(
+	ReplitTransport* transport,
+	GAsyncResult* result,
+	GError** error
+) {
+	g_return_val_if_fail(g_task_is_valid(result, transport), NULL);
+
+	return g_task_propagate_pointer(G_TASK (result), error);
+}
+
+static gboolean replit_replay_channel_dispatch(gpointer user_data);
+
+/* Schedules the delivery of the channel's next frame, if there is one. */
+static void replit_replay_channel_schedule(ReplitReplayChannel* channel) {
+	ReplitReplayConnection* connection = channel->connection;
+
+	if (connection == NULL || channel->next >= connection->frames->len) return;
+
+	gdouble speed = channel->replay->speed;
+	GSource* source;
+
+	if (speed > 0) {
+		ReplitReplayFrame* frame = g_ptr_array_index(connection->frames, channel->next);
+		gint64 due = channel->start_time + (gint64) (frame->offset / speed);
+		gint64 delay = MAX(due - g_get_monotonic_time(), 0);
+
+		source = g_timeout_source_new((guint) MIN((delay + 999) / 1000, G_MAXUINT));
+	} else {
+		source = g_idle_source_new();
+	}
+
+	g_source_set_callback(source, replit_replay_channel_dispatch, channel, NULL);
+	g_source_attach(source, g_main_context_get_thread_default());
+
+	channel->source = source;
+}
+
+static gboolean replit_replay_channel_dispatch(gpointer user_data) {
+	ReplitReplayChannel* channel = user_data;
+	ReplitReplay* self = channel->replay;
+	GPtrArray* frames = channel->connection->frames;
+	guint id = channel->id;
+	gint64 now = g_get_monotonic_time();
+
+	g_clear_pointer(&channel->source, g_source_unref);
+
+	for (guint i = 0; i < FRAME_BURST && channel->next < frames->len; i++) {
+		ReplitReplayFrame* frame = g_ptr_array_index(frames, channel->next);
+
+		if (self->speed > 0 && channel->start_time + frame->offset / self->speed > now) break;
+
+		channel->next++;
+		channel->func(REPLIT_TRANSPORT (self), id, frame->data, channel->user_data);
+
+		/* The channel was closed by the callback. */
+		if (g_hash_table_lookup(self->channels, GUINT_TO_POINTER(id)) != channel) {
+			return G_SOURCE_REMOVE;
+		}
+	}
+
+	replit_replay_channel_schedule(channel);
+
+	return G_SOURCE_REMOVE;
+}
+
+static guint replit_replay_open_channel(
+	ReplitTransport* transport,
+	ReplitTransportFrameFunc func,
+	gpointer user_data
+) {
+	ReplitReplay* self = REPLIT_REPLAY (transport);
+	ReplitReplayChannel* channel = g_new0(ReplitReplayChannel, 1);
+
+	channel->replay = self;
+	channel->id = ++self->n_opened;
+	channel->start_time = g_get_monotonic_time();
+	channel->func = func;
+	channel->user_data = user_data;
+
+	if (channel->id <= self->connections->len) {
+		channel->connection = g_ptr_array_index(self->connections, channel->id - 1);
+	}
+
+	g_hash_table_insert(self->channels, GUINT_TO_POINTER(channel->id), channel);
+	replit_replay_channel_schedule(channel);
+
+	return channel->id;
+}
+
+static void replit_replay_close_channel(ReplitTransport* transport, guint channel) {
+	ReplitReplay* self = REPLIT_REPLAY (transport);
+
+	g_hash_table_remove(self->channels, GUINT_TO_POINTER(channel));
+}
+
+static void replit_replay_transport_init(ReplitTransportInterface* iface) {
+	iface->send_async = replit_replay_send_async;
+	iface->send_finish = replit_replay_send_finish;
+	iface->open_channel = replit_replay_open_channel;
+	iface->close_channel = replit_replay_close_channel;
+}
+
+/**
+ * replit_replay_set_speed:
+ * @replay: The replay.
+ * @speed: How many times faster than recorded to play back, or 0 for as fast
+ *   as possible.
+ * 
+ * Sets how many times faster than recorded responses and frames are delivered.
+ * 
+ * This applies to requests sent and frames scheduled after it is called.
+ */
+void replit_replay_set_speed(ReplitReplay* self, gdouble speed) {
+	g_return_if_fail(speed >= 0);
+
+	if (self->speed == speed) return;
+
+	self->speed = speed;
+
+	g_object_notify_by_pspec(G_OBJECT (self), properties[PROP_SPEED]);
+}
+
+/**
+ * replit_replay_get_speed:
+ * @replay: The replay.
+ * 
+ * Gets how many times faster than recorded responses and frames are delivered.
+ * 
+ * Returns: The speed, or 0 for as fast as possible.
+ */
+gdouble replit_replay_get_speed(ReplitReplay* self) {
+	return self->speed;
+}
+
+/**
+ * replit_replay_get_n_exchanges:
+ * @replay: The replay.
+ * 
+ * Gets the number of request and response pairs in the recording.
+ * 
+ * Returns: The number of exchanges.
+ */
+guint replit_replay_get_n_exchanges(ReplitReplay* self) {
+	return self->n_exchanges;
+}
+
+/**
+ * replit_replay_get_n_channels:
+ * @replay: The replay.
+ * 
+ * Gets the number of subscription connections in the recording.
+ * 
+ * Returns: The number of connections.
+ */
+guint replit_replay_get_n_channels(ReplitReplay* self) {
+	return self->connections->len;
+}
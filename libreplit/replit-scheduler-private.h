@@ -0,0 +1,73 @@
+/* replit-scheduler-private.h
+ *
+ * Copyright 2022 Patrick Winters
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE X CONSORTIUM BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written
+ * authorization.
+ */
+
+#pragma once
+
+#include "replit-client.h"
+
+G_BEGIN_DECLS
+
+typedef struct _ReplitScheduler ReplitScheduler;
+
+/* Called when a queued request may be sent. Returns %FALSE if it was not sent
+ * after all, such as when it has been cancelled, so that its token can be
+ * given back. */
+typedef gboolean (* ReplitSchedulerFunc)(gpointer user_data);
+
+ReplitScheduler* replit_scheduler_new(void);
+
+void replit_scheduler_free(ReplitScheduler* scheduler);
+
+void replit_scheduler_set_rate(ReplitScheduler* scheduler, gdouble rate, guint burst);
+
+void replit_scheduler_enqueue(
+	ReplitScheduler* scheduler,
+	ReplitRequestPriority priority,
+	gboolean front,
+	ReplitSchedulerFunc func,
+	gpointer user_data
+);
+
+gboolean replit_scheduler_remove(ReplitScheduler* scheduler, gpointer user_data);
+
+gboolean replit_scheduler_acquire(
+	ReplitScheduler* scheduler,
+	ReplitRequestPriority priority,
+	gboolean front,
+	gint64 deadline,
+	gint64* waited
+);
+
+gboolean replit_scheduler_try_acquire(ReplitScheduler* scheduler);
+
+void replit_scheduler_pause(ReplitScheduler* scheduler, gint64 until);
+
+guint replit_scheduler_get_queued(ReplitScheduler* scheduler);
+
+G_END_DECLS
@@ -0,0 +1,449 @@
+/* replit-scheduler.c
+ *
+ * Copyright 2022 Patrick Winters
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE X CONSORTIUM BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written
+ * authorization.
+ */
+
+#include "replit-scheduler-private.h"
+
+/* The scheduler sits in front of a client's connection and decides when each
+ * request may be sent. Requests take a token from a bucket which refills at
+ * `rate` tokens per second up to `burst`, and are sent strictly in order of
+ * priority, first come first served within each priority. A rate of zero
+ * disables the bucket, so that requests only wait while the scheduler is
+ * paused, which happens when the server asks for requests to be slowed down.
+ * 
+ * Asynchronous requests wait in a queue, which is drained from a timeout on the
+ * thread-default main context when the next token is due. Synchronous requests
+ * may come from any thread, so all state is guarded by a recursive lock, which
+ * is held while queued requests are sent in case sending one queues another.
+ * 
+ * A synchronous request which cannot go straight away joins the same queues,
+ * so that it does not overtake asynchronous requests of the same or a higher
+ * priority, and sleeps until it is granted a token. The timeout grants it one
+ * when it reaches the front, as it would send an asynchronous request, but the
+ * waiting thread also takes its own token once it is at the front, as nothing
+ * may be running the main context that holds the timeout. */
+
+#define N_PRIORITIES (REPLIT_REQUEST_PRIORITY_BACKGROUND + 1)
+
+/* How long a synchronous request waiting behind others sleeps before checking
+ * the queues again, in case it was not woken. */
+#define WAITER_POLL_INTERVAL (100 * G_TIME_SPAN_MILLISECOND)
+
+struct _ReplitScheduler {
+	GRecMutex mutex;
+
+	/* Guards nothing itself, but is held to wake sleeping synchronous requests
+	 * without losing a wakeup, as a #GCond cannot use a recursive lock. */
+	GMutex waiter_mutex;
+	GCond waiter_cond;
+
+	gdouble rate;
+	guint burst;
+	gdouble tokens;
+	gint64 refilled_at;
+	gint64 paused_until;
+	GQueue queues[N_PRIORITIES];
+	GSource* timer;
+};
+
+typedef struct {
+	ReplitSchedulerFunc func;
+	gpointer user_data;
+} ReplitSchedulerEntry;
+
+/* A synchronous request waiting in the queues. */
+typedef struct {
+	ReplitScheduler* scheduler;
+	gboolean granted;
+} ReplitSchedulerWaiter;
+
+static void replit_scheduler_run(ReplitScheduler* self);
+
+ReplitScheduler* replit_scheduler_new(void) {
+	ReplitScheduler* self = g_new0(ReplitScheduler, 1);
+	g_rec_mutex_init(&self->mutex);
+	g_mutex_init(&self->waiter_mutex);
+	g_cond_init(&self->waiter_cond);
+	self->burst = 1;
+	self->tokens = 1;
+	self->refilled_at = g_get_monotonic_time();
+
+	for (guint i = 0; i < N_PRIORITIES; i++) g_queue_init(&self->queues[i]);
+
+	return self;
+}
+
+void replit_scheduler_free(ReplitScheduler* self) {
+	if (self->timer != NULL) {
+		g_source_destroy(self->timer);
+		g_source_unref(self->timer);
+	}
+
+	for (guint i = 0; i < N_PRIORITIES; i++) g_queue_clear_full(&self->queues[i], g_free);
+
+	g_rec_mutex_clear(&self->mutex);
+	g_mutex_clear(&self->waiter_mutex);
+	g_cond_clear(&self->waiter_cond);
+	g_free(self);
+}
+
+static void replit_scheduler_refill(ReplitScheduler* self, gint64 now) {
+	if (self->rate > 0) {
+		gdouble tokens = self->tokens + (now - self->refilled_at) * self->rate / G_USEC_PER_SEC;
+		self->tokens = MIN(tokens, self->burst);
+	}
+
+	self->refilled_at = now;
+}
+
+/* Returns how long the next request has to wait, in microseconds. */
+static gint64 replit_scheduler_delay(ReplitScheduler* self, gint64 now) {
+	gint64 delay = MAX(self->paused_until - now, 0);
+
+	if (self->rate > 0 && self->tokens < 1) {
+		gint64 refill = (gint64) ((1 - self->tokens) * G_USEC_PER_SEC / self->rate) + 1;
+		delay = MAX(delay, refill);
+	}
+
+	return delay;
+}
+
+static gboolean replit_scheduler_timeout(gpointer user_data) {
+	ReplitScheduler* self = user_data;
+
+	g_rec_mutex_lock(&self->mutex);
+
+	g_clear_pointer(&self->timer, g_source_unref);
+	replit_scheduler_run(self);
+
+	g_rec_mutex_unlock(&self->mutex);
+
+	return G_SOURCE_REMOVE;
+}
+
+static void replit_scheduler_arm(ReplitScheduler* self, gint64 delay) {
+	if (self->timer != NULL) return;
+
+	self->timer = g_timeout_source_new((guint) ((delay + 999) / 1000));
+	g_source_set_callback(self->timer, replit_scheduler_timeout, self, NULL);
+	g_source_attach(self->timer, g_main_context_get_thread_default());
+}
+
+/* Wakes every sleeping synchronous request to check whether it has been
+ * granted a token or has reached the front of the queues. */
+static void replit_scheduler_wake(ReplitScheduler* self) {
+	g_mutex_lock(&self->waiter_mutex);
+	g_cond_broadcast(&self->waiter_cond);
+	g_mutex_unlock(&self->waiter_mutex);
+}
+
+/* Grants a token to a synchronous request, as the function of its entry. */
+static gboolean replit_scheduler_grant(gpointer user_data) {
+	ReplitSchedulerWaiter* waiter = user_data;
+
+	g_mutex_lock(&waiter->scheduler->waiter_mutex);
+	waiter->granted = TRUE;
+	g_mutex_unlock(&waiter->scheduler->waiter_mutex);
+
+	return TRUE;
+}
+
+/* Returns the entry that will be sent next, or %NULL if none is queued. */
+static ReplitSchedulerEntry* replit_scheduler_peek(ReplitScheduler* self) {
+	for (guint i = 0; i < N_PRIORITIES; i++) {
+		if (!g_queue_is_empty(&self->queues[i])) return g_queue_peek_head(&self->queues[i]);
+	}
+
+	return NULL;
+}
+
+/* Sends as many queued requests as the bucket allows, and arms the timer for
+ * the rest. */
+static void replit_scheduler_run(ReplitScheduler* self) {
+	while (TRUE) {
+		GQueue* queue = NULL;
+
+		for (guint i = 0; i < N_PRIORITIES && queue == NULL; i++) {
+			if (!g_queue_is_empty(&self->queues[i])) queue = &self->queues[i];
+		}
+
+		if (queue == NULL) return;
+
+		gint64 now = g_get_monotonic_time();
+		replit_scheduler_refill(self, now);
+
+		gint64 delay = replit_scheduler_delay(self, now);
+
+		if (delay > 0) {
+			replit_scheduler_arm(self, delay);
+			return;
+		}
+
+		ReplitSchedulerEntry* entry = g_queue_pop_head(queue);
+
+		if (self->rate > 0) self->tokens -= 1;
+
+		if (!entry->func(entry->user_data) && self->rate > 0) self->tokens += 1;
+
+		g_free(entry);
+
+		replit_scheduler_wake(self);
+	}
+}
+
+void replit_scheduler_set_rate(ReplitScheduler* self, gdouble rate, guint burst) {
+	burst = MAX(burst, 1);
+
+	g_rec_mutex_lock(&self->mutex);
+
+	replit_scheduler_refill(self, g_get_monotonic_time());
+
+	if (self->rate <= 0) self->tokens = burst;
+
+	self->rate = rate;
+	self->burst = burst;
+	self->tokens = MIN(self->tokens, burst);
+
+	if (self->timer != NULL) {
+		g_source_destroy(self->timer);
+		g_clear_pointer(&self->timer, g_source_unref);
+	}
+
+	replit_scheduler_run(self);
+
+	g_rec_mutex_unlock(&self->mutex);
+}
+
+/* Queues a request, to be sent by calling @func. It is sent immediately if
+ * nothing is waiting ahead of it and a token is available. Requests being
+ * retried are put at the @front of their queue. */
+void replit_scheduler_enqueue(
+	ReplitScheduler* self,
+	ReplitRequestPriority priority,
+	gboolean front,
+	ReplitSchedulerFunc func,
+	gpointer user_data
+) {
+	ReplitSchedulerEntry* entry = g_new(ReplitSchedulerEntry, 1);
+	entry->func = func;
+	entry->user_data = user_data;
+
+	GQueue* queue = &self->queues[CLAMP (priority, 0, N_PRIORITIES - 1)];
+
+	g_rec_mutex_lock(&self->mutex);
+
+	if (front) {
+		g_queue_push_head(queue, entry);
+	} else {
+		g_queue_push_tail(queue, entry);
+	}
+
+	replit_scheduler_run(self);
+
+	g_rec_mutex_unlock(&self->mutex);
+}
+
+/* Removes a queued request without sending it. Returns %FALSE if it was not
+ * queued. */
+gboolean replit_scheduler_remove(ReplitScheduler* self, gpointer user_data) {
+	gboolean removed = FALSE;
+
+	g_rec_mutex_lock(&self->mutex);
+
+	for (guint i = 0; i < N_PRIORITIES && !removed; i++) {
+		for (GList* link = self->queues[i].head; link != NULL; link = link->next) {
+			ReplitSchedulerEntry* entry = link->data;
+
+			if (entry->user_data != user_data) continue;
+
+			g_queue_delete_link(&self->queues[i], link);
+			g_free(entry);
+
+			removed = TRUE;
+			break;
+		}
+	}
+
+	g_rec_mutex_unlock(&self->mutex);
+
+	if (removed) replit_scheduler_wake(self);
+
+	return removed;
+}
+
+/* Checks whether anything of @priority or higher is waiting to be sent. */
+static gboolean replit_scheduler_has_queued(ReplitScheduler* self, ReplitRequestPriority priority) {
+	for (guint i = 0; i <= priority; i++) {
+		if (!g_queue_is_empty(&self->queues[i])) return TRUE;
+	}
+
+	return FALSE;
+}
+
+/* Blocks until a synchronous request of @priority may be sent and takes its
+ * token, adding the time spent waiting to @waited. The request waits behind
+ * any queued request of the same or a higher priority, or in front of those
+ * of its own priority if it is a retry at the @front. Fails if the request
+ * could not be sent before the monotonic time @deadline, unless it is zero,
+ * without waiting if that is already known. */
+gboolean replit_scheduler_acquire(
+	ReplitScheduler* self,
+	ReplitRequestPriority priority,
+	gboolean front,
+	gint64 deadline,
+	gint64* waited
+) {
+	gint64 start = g_get_monotonic_time();
+	gint64 now = start;
+
+	priority = CLAMP (priority, 0, N_PRIORITIES - 1);
+
+	g_rec_mutex_lock(&self->mutex);
+
+	replit_scheduler_refill(self, now);
+
+	gint64 delay = replit_scheduler_delay(self, now);
+	gboolean ahead = front
+		? priority > 0 && replit_scheduler_has_queued(self, priority - 1)
+		: replit_scheduler_has_queued(self, priority);
+
+	if (delay == 0 && !ahead) {
+		if (self->rate > 0) self->tokens -= 1;
+
+		g_rec_mutex_unlock(&self->mutex);
+
+		return TRUE;
+	}
+
+	if (!ahead && deadline != 0 && now + delay > deadline) {
+		g_rec_mutex_unlock(&self->mutex);
+
+		return FALSE;
+	}
+
+	ReplitSchedulerWaiter waiter = { self, FALSE };
+	ReplitSchedulerEntry* entry = g_new(ReplitSchedulerEntry, 1);
+	entry->func = replit_scheduler_grant;
+	entry->user_data = &waiter;
+
+	if (front) {
+		g_queue_push_head(&self->queues[priority], entry);
+	} else {
+		g_queue_push_tail(&self->queues[priority], entry);
+	}
+
+	while (TRUE) {
+		if (waiter.granted) break;
+
+		now = g_get_monotonic_time();
+		replit_scheduler_refill(self, now);
+		delay = replit_scheduler_delay(self, now);
+
+		gboolean first = replit_scheduler_peek(self) == entry;
+
+		if (first && delay == 0) {
+			g_queue_pop_head(&self->queues[priority]);
+			g_free(entry);
+
+			if (self->rate > 0) self->tokens -= 1;
+
+			waiter.granted = TRUE;
+
+			break;
+		}
+
+		if (deadline != 0 && (now >= deadline || (first && now + delay > deadline))) {
+			replit_scheduler_remove(self, &waiter);
+			g_rec_mutex_unlock(&self->mutex);
+
+			return FALSE;
+		}
+
+		gint64 wake_at = now + (first ? delay : WAITER_POLL_INTERVAL);
+		if (deadline != 0) wake_at = MIN(wake_at, deadline);
+
+		/* The waiter mutex is taken before the recursive lock is released, so
+		 * that a grant or wakeup cannot slip in between. */
+		g_mutex_lock(&self->waiter_mutex);
+		g_rec_mutex_unlock(&self->mutex);
+
+		if (!waiter.granted) g_cond_wait_until(&self->waiter_cond, &self->waiter_mutex, wake_at);
+
+		g_mutex_unlock(&self->waiter_mutex);
+		g_rec_mutex_lock(&self->mutex);
+	}
+
+	g_rec_mutex_unlock(&self->mutex);
+
+	/* Whatever was queued behind this request may now be due. */
+	replit_scheduler_wake(self);
+
+	*waited += g_get_monotonic_time() - start;
+
+	return TRUE;
+}
+
+/* Takes a token for an extra request if one is available right away, with
+ * nothing queued ahead of it. */
+gboolean replit_scheduler_try_acquire(ReplitScheduler* self) {
+	gint64 now = g_get_monotonic_time();
+	gboolean acquired = FALSE;
+
+	g_rec_mutex_lock(&self->mutex);
+
+	replit_scheduler_refill(self, now);
+
+	if (replit_scheduler_get_queued(self) == 0 && replit_scheduler_delay(self, now) == 0) {
+		if (self->rate > 0) self->tokens -= 1;
+
+		acquired = TRUE;
+	}
+
+	g_rec_mutex_unlock(&self->mutex);
+
+	return acquired;
+}
+
+/* Holds back every request until the monotonic time @until. */
+void replit_scheduler_pause(ReplitScheduler* self, gint64 until) {
+	g_rec_mutex_lock(&self->mutex);
+	self->paused_until = MAX(self->paused_until, until);
+	g_rec_mutex_unlock(&self->mutex);
+}
+
+guint replit_scheduler_get_queued(ReplitScheduler* self) {
+	guint queued = 0;
+
+	g_rec_mutex_lock(&self->mutex);
+
+	for (guint i = 0; i < N_PRIORITIES; i++) queued += g_queue_get_length(&self->queues[i]);
+
+	g_rec_mutex_unlock(&self->mutex);
+
+	return queued;
+}
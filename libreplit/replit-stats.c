@@ -0,0 +1,183 @@
+/* replit-stats.c
+ *
+ * Copyright 2022 Patrick Winters
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE X CONSORTIUM BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written
+ * authorization.
+ */
+
+#include "replit-stats.h"
+#include "replit-stats-private.h"
+
+/* Latencies are bucketed as in HdrHistogram: values below 2^SUB_BUCKET_BITS
+ * get a bucket each, and every power of two above that is split into
+ * SUB_BUCKET_COUNT linear buckets, giving a relative error of at most
+ * 1 / SUB_BUCKET_COUNT across the whole range. */
+#define SUB_BUCKET_BITS 5
+#define SUB_BUCKET_COUNT (1 << SUB_BUCKET_BITS)
+#define MAX_VALUE_BITS 38
+#define MAX_VALUE ((G_GUINT64_CONSTANT (1) << MAX_VALUE_BITS) - 1)
+#define BUCKET_COUNT ((MAX_VALUE_BITS - SUB_BUCKET_BITS + 1) * SUB_BUCKET_COUNT)
+
+struct _ReplitHistogram {
+	guint64 count;
+	gint64 max;
+	guint64 buckets[BUCKET_COUNT];
+};
+
+G_DEFINE_BOXED_TYPE (
+	ReplitRequestRecord,
+	replit_request_record,
+	replit_request_record_copy,
+	replit_request_record_free
+)
+
+G_DEFINE_BOXED_TYPE (
+	ReplitOperationLatency,
+	replit_operation_latency,
+	replit_operation_latency_copy,
+	replit_operation_latency_free
+)
+
+/**
+ * replit_request_record_copy:
+ * @record: The record.
+ * 
+ * Copies a #ReplitRequestRecord.
+ * 
+ * Returns: (transfer full): The copy.
+ */
+ReplitRequestRecord* replit_request_record_copy(const ReplitRequestRecord* record) {
+	ReplitRequestRecord* copy = g_memdup2(record, sizeof(ReplitRequestRecord));
+	copy->operation_name = g_strdup(record->operation_name);
+
+	return copy;
+}
+
+/**
+ * replit_request_record_free:
+ * @record: The record.
+ * 
+ * Frees a #ReplitRequestRecord.
+ */
+void replit_request_record_free(ReplitRequestRecord* record) {
+	g_free(record->operation_name);
+	g_free(record);
+}
+
+/**
+ * replit_operation_latency_copy:
+ * @latency: The latency summary.
+ * 
+ * Copies a #ReplitOperationLatency.
+ * 
+ * Returns: (transfer full): The copy.
+ */
+ReplitOperationLatency* replit_operation_latency_copy(const ReplitOperationLatency* latency) {
+	ReplitOperationLatency* copy = g_memdup2(latency, sizeof(ReplitOperationLatency));
+	copy->operation_name = g_strdup(latency->operation_name);
+
+	return copy;
+}
+
+/**
+ * replit_operation_latency_free:
+ * @latency: The latency summary.
+ * 
+ * Frees a #ReplitOperationLatency.
+ */
+void replit_operation_latency_free(ReplitOperationLatency* latency) {
+	g_free(latency->operation_name);
+	g_free(latency);
+}
+
+static guint replit_histogram_index(guint64 value) {
+	if (value < SUB_BUCKET_COUNT) return value;
+	if (value > MAX_VALUE) value = MAX_VALUE;
+
+	guint shift = 63 - __builtin_clzll(value) - SUB_BUCKET_BITS;
+
+	return (shift + 1) * SUB_BUCKET_COUNT + (value >> shift) - SUB_BUCKET_COUNT;
+}
+
+/* Returns the highest value which falls into a bucket. */
+static gint64 replit_histogram_value(guint index) {
+	if (index < SUB_BUCKET_COUNT) return index;
+
+	guint shift = index / SUB_BUCKET_COUNT - 1;
+	guint64 top = SUB_BUCKET_COUNT + index % SUB_BUCKET_COUNT;
+
+	return ((top + 1) << shift) - 1;
+}
+
+ReplitHistogram* replit_histogram_new(void) {
+	return g_new0(ReplitHistogram, 1);
+}
+
+void replit_histogram_free(ReplitHistogram* histogram) {
+	g_free(histogram);
+}
+
+void replit_histogram_record(ReplitHistogram* histogram, gint64 value) {
+	if (value < 0) value = 0;
+
+	histogram->buckets[replit_histogram_index(value)]++;
+	histogram->count++;
+
+	if (value > histogram->max) histogram->max = value;
+}
+
+guint64 replit_histogram_get_count(ReplitHistogram* histogram) {
+	return histogram->count;
+}
+
+gint64 replit_histogram_percentile(ReplitHistogram* histogram, gdouble percentile) {
+	gdouble exact = histogram->count * percentile / 100;
+	guint64 target = (guint64) exact;
+	guint64 seen = 0;
+
+	if (target < exact) target++;
+
+	if (target == 0) return 0;
+
+	for (guint i = 0; i < BUCKET_COUNT; i++) {
+		seen += histogram->buckets[i];
+
+		if (seen >= target) return MIN (replit_histogram_value(i), histogram->max);
+	}
+
+	return histogram->max;
+}
+
+/* Summarises a histogram, leaving the operation name for the caller to set. */
+ReplitOperationLatency* replit_histogram_summarize(ReplitHistogram* histogram) {
+	ReplitOperationLatency* latency = g_new0(ReplitOperationLatency, 1);
+	latency->count = histogram->count;
+	latency->p50 = replit_histogram_percentile(histogram, 50);
+	latency->p90 = replit_histogram_percentile(histogram, 90);
+	latency->p99 = replit_histogram_percentile(histogram, 99);
+	latency->max = histogram->max;
+
+	return latency;
+}
@@ -0,0 +1,211 @@
+/* replit-stats.h
+ *
+ * Copyright 2022 Patrick Winters
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE X CONSORTIUM BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written
+ * authorization.
+ */
+
+#pragma once
+
+#if !defined(REPLIT_INSIDE) && !defined(REPLIT_COMPILATION)
+#error "Only <replit.h> can be included directly."
+#endif
+
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+/**
+ * REPLIT_CLIENT_N_ERRORS:
+ * 
+ * The number of #ReplitClientError codes, and so the number of entries of the
+ * `errors` array in #ReplitClientStats which are in use. This grows as error
+ * codes are added, up to %REPLIT_CLIENT_MAX_ERRORS.
+ */
+#define REPLIT_CLIENT_N_ERRORS 5
+
+/**
+ * REPLIT_CLIENT_MAX_ERRORS:
+ * 
+ * The length of the `errors` array in #ReplitClientStats, which is fixed so
+ * that adding error codes does not change the size of the structure.
+ */
+#define REPLIT_CLIENT_MAX_ERRORS 8
+
+/**
+ * ReplitRequestRecord:
+ * @start_time: The monotonic time at which the request began, in microseconds.
+ * @total_time: The time taken by the whole request, from serialising the body
+ *   to parsing the response.
+ * @serialize_time: The time taken to serialise the request body.
+ * @dns_time: The time taken to resolve the host name, or zero if no lookup was
+ *   made.
+ * @connect_time: The time taken to establish a TCP connection, or zero if an
+ *   existing connection was reused.
+ * @tls_time: The time taken by the TLS handshake, or zero if an existing
+ *   connection was reused.
+ * @wait_time: The time from starting to send the request to receiving the
+ *   first byte of the response, which is mostly spent by Replit's servers.
+ * @download_time: The time from receiving the first byte of the response to
+ *   receiving the last.
+ * @parse_time: The time taken to parse the response body.
+ * @queue_time: The time spent waiting for the client's rate limit, including
+ *   any time waiting to retry after being throttled.
+ * @retries: The number of times the request was sent again after the server
+ *   responded that too many requests were being made.
+ * @bytes_out: The number of bytes sent, including headers.
+ * @bytes_in: The number of bytes received, including headers.
+ * @reused_connection: Whether an existing connection was reused.
+ * @status: The HTTP status code of the response, or zero if none was received.
+ * @error_domain: The domain of the error the request failed with, or zero if
+ *   it succeeded.
+ * @error_code: The code of the error the request failed with.
+ * @operation_name: (nullable): The name of the GraphQL operation requested, or
+ *   %NULL if it was anonymous.
+ * @cache_hit: Whether the request was answered from
+ *   [property@Client:disk-cache] without being sent, in which case only
+ *   @start_time, @total_time and @operation_name are set.
+ * 
+ * The timings and outcome of a single request, as passed to the
+ * [signal@Client::request-finished] signal.
+ * 
+ * All times are in microseconds. Network phases are taken from libsoup's
+ * message metrics, and are zero when they did not happen. When a response is
+ * parsed as it is downloaded, @download_time and @parse_time overlap.
+ */
+typedef struct {
+	gint64 start_time;
+	gint64 total_time;
+	gint64 serialize_time;
+	gint64 dns_time;
+	gint64 connect_time;
+	gint64 tls_time;
+	gint64 wait_time;
+	gint64 download_time;
+	gint64 parse_time;
+	gint64 queue_time;
+	guint retries;
+	guint64 bytes_out;
+	guint64 bytes_in;
+	gboolean reused_connection;
+	guint status;
+	GQuark error_domain;
+	gint error_code;
+	gchar* operation_name;
+	gboolean cache_hit;
+} ReplitRequestRecord;
+
+#define REPLIT_TYPE_REQUEST_RECORD replit_request_record_get_type()
+GType replit_request_record_get_type(void);
+
+ReplitRequestRecord* replit_request_record_copy(const ReplitRequestRecord* record);
+
+void replit_request_record_free(ReplitRequestRecord* record);
+
+/**
+ * ReplitClientStats:
+ * @requests: The number of requests made, including those answered from
+ *   [property@Client:disk-cache].
+ * @errors: The number of requests which failed, indexed by #ReplitClientError
+ *   code. Entries from %REPLIT_CLIENT_N_ERRORS onwards are zero.
+ * @other_errors: The number of requests which failed with errors from other
+ *   domains, such as network or parsing errors.
+ * @bytes_out: The number of bytes sent, including headers.
+ * @bytes_in: The number of bytes received, including headers.
+ * @new_connections: The number of requests which opened a new connection.
+ * @reused_connections: The number of requests which reused a connection.
+ * @throttled: The number of responses telling the client to slow down, with
+ *   a 429 status or a 503 status and a `Retry-After` header.
+ * @retries: The number of times requests were sent again after being
+ *   throttled.
+ * @queued: The number of requests currently waiting for the rate limit.
+ * @queue_time: The total time requests have spent waiting for the rate limit,
+ *   in microseconds.
+ * @max_queue_time: The longest time a single request has spent waiting for the
+ *   rate limit, in microseconds.
+ * @hedged: The number of queries sent a second time for being slow; see
+ *   [property@Client:hedge-percentile].
+ * @hedge_wins: The number of hedged queries answered first by their second
+ *   copy.
+ * @cache_hits: The number of queries answered from
+ *   [property@Client:disk-cache] without a request.
+ * 
+ * Cumulative counters for the requests made by a #ReplitClient, as returned by
+ * [method@Client.get_stats].
+ * 
+ * The structure is padded to a fixed size, which new counters are taken from,
+ * so that code allocating it keeps working with later versions.
+ */
+typedef struct {
+	guint64 requests;
+	guint64 errors[REPLIT_CLIENT_MAX_ERRORS];
+	guint64 other_errors;
+	guint64 bytes_out;
+	guint64 bytes_in;
+	guint64 new_connections;
+	guint64 reused_connections;
+	guint64 throttled;
+	guint64 retries;
+	guint64 queued;
+	gint64 queue_time;
+	gint64 max_queue_time;
+	guint64 hedged;
+	guint64 hedge_wins;
+	guint64 cache_hits;
+
+	/*< private >*/
+	guint64 reserved[18];
+} ReplitClientStats;
+
+/**
+ * ReplitOperationLatency:
+ * @operation_name: (nullable): The name of the GraphQL operation, or %NULL for
+ *   anonymous operations.
+ * @count: The number of requests recorded.
+ * @p50: The median latency, in microseconds.
+ * @p90: The 90th percentile latency, in microseconds.
+ * @p99: The 99th percentile latency, in microseconds.
+ * @max: The highest latency, in microseconds.
+ * 
+ * A summary of the latency histogram for one operation, as returned by
+ * [method@Client.get_latencies].
+ */
+typedef struct {
+	gchar* operation_name;
+	guint64 count;
+	gint64 p50;
+	gint64 p90;
+	gint64 p99;
+	gint64 max;
+} ReplitOperationLatency;
+
+#define REPLIT_TYPE_OPERATION_LATENCY replit_operation_latency_get_type()
+GType replit_operation_latency_get_type(void);
+
+ReplitOperationLatency* replit_operation_latency_copy(const ReplitOperationLatency* latency);
+
+void replit_operation_latency_free(ReplitOperationLatency* latency);
+
+G_END_DECLS
@@ -27,8 +27,17 @@
  * authorization.
  */
 
+#include <string.h>
+
 #include "replit-client.h"
+#include "replit-config.h"
+#include "replit-graphql.h"
+#include "replit-json.h"
+#include "replit-json-tape-private.h"
+#include "replit-recording-private.h"
 #include "replit-subscriber.h"
+#include "replit-subscriber-private.h"
+#include "replit-trace-private.h"
 
 #define TOKEN_COOKIE "connect.sid"
 
@@ -65,6 +74,17 @@ struct _ReplitSubscriber {
 	GPtrArray* subscriptions;
 	GPtrArray* user_data;
 	SoupWebsocketConnection* ws;
+	GCancellable* connecting;
+	gchar* base_uri;
+	GUri* subscriptions_uri;
+	ReplitTransport* transport;
+	guint channel;
+	ReplitRecorder* recorder;
+	guint32 record_channel;
+	gboolean minify_queries;
+#ifdef HAVE_JSON_TAPE
+	ReplitJsonTape* tape;
+#endif
 };
 
 G_DEFINE_TYPE (ReplitSubscriber, replit_subscriber, G_TYPE_OBJECT)
@@ -72,6 +92,7 @@ G_DEFINE_TYPE (ReplitSubscriber, replit_subscriber, G_TYPE_OBJECT)
 static void replit_subscriber_dispose(GObject* gobject);
 static void replit_subscriber_finalize(GObject* gobject);
 static void replit_subscriber_connect(ReplitSubscriber* subscriber);
+static void replit_subscriber_disconnect(ReplitSubscriber* subscriber);
 static void replit_subscriber_connect_finish(
 	GObject* source_object,
 	GAsyncResult* res,
@@ -87,6 +108,7 @@ static void replit_subscriber_on_close(
 	SoupWebsocketConnection* ws,
 	gpointer user_data
 );
+static void replit_subscriber_handle_frame(ReplitSubscriber* subscriber, GBytes* message);
 
 static void replit_subscriber_class_init(ReplitSubscriberClass* klass) {
 	GObjectClass* object_class = G_OBJECT_CLASS (klass);
@@ -99,15 +121,26 @@ static void replit_subscriber_init(ReplitSubscriber* self) {
 	self->callbacks = g_ptr_array_new();
 	self->subscriptions = g_ptr_array_new_with_free_func(g_free);
 	self->user_data = g_ptr_array_new();
-
-	replit_subscriber_connect(self);
+	self->base_uri = g_strdup(REPLIT_BASE_URI);
+	self->subscriptions_uri = g_uri_parse(
+		REPLIT_BASE_URI "/graphql_subscriptions",
+		SOUP_HTTP_URI_FLAGS,
+		NULL
+	);
+#ifdef HAVE_JSON_TAPE
+	self->tape = replit_json_tape_new();
+#endif
 }
 
 static void replit_subscriber_dispose(GObject* gobject) {
 	ReplitSubscriber* self = REPLIT_SUBSCRIBER (gobject);
 
+	replit_subscriber_disconnect(self);
+
 	g_clear_object(&self->session);
 	g_clear_object(&self->jar);
+	g_clear_object(&self->transport);
+	g_clear_object(&self->recorder);
 
 	G_OBJECT_CLASS (replit_subscriber_parent_class)->dispose(gobject);
 }
@@ -118,25 +151,102 @@ static void replit_subscriber_finalize(GObject* gobject) {
 	g_ptr_array_remove_range(self->subscriptions, 0, self->subscriptions->len);
 
 	g_free(self->token);
+	g_free(self->base_uri);
+	g_uri_unref(self->subscriptions_uri);
 	g_ptr_array_free(self->callbacks, TRUE);
 	g_ptr_array_free(self->subscriptions, TRUE);
 	g_ptr_array_free(self->user_data, TRUE);
+#ifdef HAVE_JSON_TAPE
+	replit_json_tape_free(self->tape);
+#endif
 
 	G_OBJECT_CLASS (replit_subscriber_parent_class)->finalize(gobject);
 }
 
-static void replit_subscriber_connect(ReplitSubscriber* self) {
-	GUri* uri = g_uri_build(
-		0,
-		"https",
-		NULL,
-		REPLIT_DOMAIN,
-		-1,
-		"/graphql_subscriptions",
-		NULL,
+/* Starts recording the frames of a new connection. */
+static void replit_subscriber_record_open(ReplitSubscriber* self) {
+	self->record_channel = replit_recorder_next_id(self->recorder);
+
+	replit_recorder_add(
+		self->recorder,
+		REPLIT_RECORD_CHANNEL_OPEN,
+		self->record_channel,
+		g_get_real_time(),
 		NULL
 	);
-	SoupMessage* msg = soup_message_new_from_uri(SOUP_METHOD_GET, uri);
+}
+
+/* Sends a frame on the current connection, if there is one. */
+static void replit_subscriber_send_text(ReplitSubscriber* self, const gchar* text) {
+	if (self->ws == NULL && self->channel == 0) return;
+
+	GBytes* frame = self->record_channel != 0 || self->ws == NULL
+		? g_bytes_new(text, strlen(text))
+		: NULL;
+
+	if (self->record_channel != 0) {
+		replit_recorder_add(
+			self->recorder,
+			REPLIT_RECORD_FRAME_OUT,
+			self->record_channel,
+			g_get_real_time(),
+			frame
+		);
+	}
+
+	if (self->ws != NULL) {
+		soup_websocket_connection_send_text(self->ws, text);
+	} else {
+		replit_transport_send_frame(self->transport, self->channel, frame);
+	}
+
+	if (frame != NULL) g_bytes_unref(frame);
+}
+
+/* Starts the protocol on a new connection, and sends every subscription that
+ * is still active. */
+static void replit_subscriber_opened(ReplitSubscriber* self) {
+	if (self->recorder != NULL) replit_subscriber_record_open(self);
+
+	replit_subscriber_send_text(self, MESSAGE_INIT);
+
+	for (guint i = 0; i < self->subscriptions->len; i++) {
+		if (g_ptr_array_index(self->subscriptions, i) == NULL) continue;
+
+		gchar* message = g_ptr_array_index(self->subscriptions, i);
+		replit_subscriber_send_text(self, message);
+	}
+}
+
+static void replit_subscriber_on_frame(
+	ReplitTransport* transport __attribute__((unused)),
+	guint channel __attribute__((unused)),
+	GBytes* frame,
+	gpointer user_data
+) {
+	replit_subscriber_handle_frame(REPLIT_SUBSCRIBER (user_data), frame);
+}
+
+static void replit_subscriber_connect(ReplitSubscriber* self) {
+	if (self->transport != NULL) {
+		self->channel = replit_transport_open_channel(
+			self->transport,
+			replit_subscriber_on_frame,
+			self
+		);
+
+		if (self->channel != 0) replit_subscriber_opened(self);
+
+		return;
+	}
+
+	SoupMessage* msg = soup_message_new_from_uri(SOUP_METHOD_GET, self->subscriptions_uri);
+
+	if (self->jar == NULL && self->token != NULL) {
+		replit_subscriber_attach_token(msg, self->token);
+	}
+
+	self->connecting = g_cancellable_new();
 
 	soup_session_websocket_connect_async(
 		self->session,
@@ -144,20 +254,37 @@ static void replit_subscriber_connect(ReplitSubscriber* self) {
 		NULL,
 		NULL,
 		G_PRIORITY_DEFAULT,
-		NULL,
+		self->connecting,
 		replit_subscriber_connect_finish,
 		self
 	);
+
+	g_object_unref(msg);
 }
 
 static void replit_subscriber_connect_finish(
-	GObject* source_object __attribute__((unused)),
+	GObject* source_object,
 	GAsyncResult* res,
 	gpointer user_data
 ) {
+	GError* error = NULL;
+	SoupSession* session = SOUP_SESSION (source_object);
+	SoupWebsocketConnection* ws = soup_session_websocket_connect_finish(session, res, &error);
+
+	/* The subscriber may already have been disposed, or be connecting
+	 * elsewhere after a change of base URI. */
+	if (g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+		g_error_free(error);
+
+		return;
+	}
+
 	ReplitSubscriber* self = REPLIT_SUBSCRIBER (user_data);
 
-	self->ws = soup_session_websocket_connect_finish(self->session, res, NULL);
+	g_clear_object(&self->connecting);
+	g_clear_error(&error);
+
+	self->ws = ws;
 
 	if (self->ws == NULL) {
 		replit_subscriber_connect(self);
@@ -167,14 +294,27 @@ static void replit_subscriber_connect_finish(
 	g_signal_connect(self->ws, "message", (GCallback) replit_subscriber_on_message, self);
 	g_signal_connect(self->ws, "closed", (GCallback) replit_subscriber_on_close, self);
 
-	soup_websocket_connection_send_text(self->ws, MESSAGE_INIT);
+	replit_subscriber_opened(self);
+}
+
+/* Drops the current connection, or the attempt to make one, without
+ * reconnecting. */
+static void replit_subscriber_disconnect(ReplitSubscriber* self) {
+	if (self->connecting != NULL) g_cancellable_cancel(self->connecting);
+	g_clear_object(&self->connecting);
 
-	for (guint i = 0; i < self->subscriptions->len; i++) {
-		if (g_ptr_array_index(self->subscriptions, i) == NULL) continue;
+	if (self->ws != NULL) {
+		g_signal_handlers_disconnect_by_data(self->ws, self);
+		soup_websocket_connection_close(self->ws, SOUP_WEBSOCKET_CLOSE_NORMAL, NULL);
+		g_clear_object(&self->ws);
+	}
 
-		gchar* message = g_ptr_array_index(self->subscriptions, i);
-		soup_websocket_connection_send_text(self->ws, message);
+	if (self->channel != 0) {
+		replit_transport_close_channel(self->transport, self->channel);
+		self->channel = 0;
 	}
+
+	self->record_channel = 0;
 }
 
 static void replit_subscriber_on_message(
@@ -183,40 +323,120 @@ static void replit_subscriber_on_message(
   GBytes* message,
   gpointer user_data
 ) {
-	ReplitSubscriber* self = REPLIT_SUBSCRIBER (user_data);
-
 	if (type != SOUP_WEBSOCKET_DATA_TEXT) return;
 
-	const gchar* data = g_bytes_get_data(message, NULL);
-	JsonParser* parser = json_parser_new();
-	
-	if (!json_parser_load_from_data(parser, data, -1, NULL)) return;
+	replit_subscriber_handle_frame(REPLIT_SUBSCRIBER (user_data), message);
+}
 
-	JsonNode* root = json_parser_get_root(parser);
-	JsonObject* root_object = json_node_get_object(root);
+/* Decodes a received frame, copying its type into @msg_type for tracing. If it
+ * is a `data` message, returns the `data` member of its payload and sets @id to
+ * the subscription it belongs to. Nothing else in the frame is converted to
+ * #JsonNode when the tape decoder is used, and the subscriber's tape is reused
+ * for every frame. */
+static JsonNode* replit_subscriber_decode_frame(
+	ReplitSubscriber* self __attribute__((unused)),
+	const gchar* data,
+	gsize length,
+	guint* id,
+	gchar* msg_type,
+	gsize msg_type_size
+) {
+	JsonNode* node = NULL;
 
-	const gchar* msg_type = json_object_get_string_member(root_object, "type");
+#ifdef HAVE_JSON_TAPE
+	ReplitJsonTape* tape = self->tape;
 
-	if (!g_str_equal(msg_type, "data")) return;
+	if (replit_json_tape_parse(tape, data, length, NULL)) {
+		const gchar* type = replit_json_tape_get_string(
+			tape,
+			replit_json_tape_get_member(tape, REPLIT_JSON_TAPE_ROOT, "type")
+		);
 
-	guint id = (guint) json_object_get_int_member(root_object, "id");
-	JsonObject* payload = json_object_get_object_member(root_object, "payload");
+		g_strlcpy(msg_type, type != NULL ? type : "", msg_type_size);
 
-	if (payload == NULL || id >= self->callbacks->len) return;
+		if (g_str_equal(msg_type, "data")) {
+			gint64 id_value;
+			gsize payload = replit_json_tape_get_member(tape, REPLIT_JSON_TAPE_ROOT, "payload");
+
+			gboolean has_id = replit_json_tape_get_int(
+				tape,
+				replit_json_tape_get_member(tape, REPLIT_JSON_TAPE_ROOT, "id"),
+				&id_value
+			);
+
+			*id = has_id ? (guint) id_value : G_MAXUINT;
+			node = replit_json_tape_to_node(tape, replit_json_tape_get_member(tape, payload, "data"));
+		}
+	}
+#else
+	JsonParser* parser = json_parser_new();
+
+	if (json_parser_load_from_data(parser, data, length, NULL)) {
+		JsonNode* root = json_parser_get_root(parser);
+		JsonObject* root_object = root != NULL && JSON_NODE_HOLDS_OBJECT (root)
+			? json_node_get_object(root)
+			: NULL;
+
+		g_strlcpy(
+			msg_type,
+			root_object != NULL
+				? json_object_get_string_member_with_default(root_object, "type", "")
+				: "",
+			msg_type_size
+		);
+
+		if (g_str_equal(msg_type, "data")) {
+			JsonObject* payload = json_object_get_object_member(root_object, "payload");
+
+			*id = (guint) json_object_get_int_member_with_default(root_object, "id", G_MAXUINT);
+			node = payload != NULL ? json_object_dup_member(payload, "data") : NULL;
+		}
+	}
 
-	JsonNode* node = json_node_copy(json_object_get_member(payload, "data"));
-	gpointer callback_ptr = g_ptr_array_index(self->callbacks, id);
-	
 	g_object_unref(parser);
+#endif
+
+	return node;
+}
+
+/* Parses a received frame and passes its data to the subscription's
+ * callback. */
+static void replit_subscriber_handle_frame(ReplitSubscriber* self, GBytes* message) {
+	if (self->record_channel != 0) {
+		replit_recorder_add(
+			self->recorder,
+			REPLIT_RECORD_FRAME_IN,
+			self->record_channel,
+			g_get_real_time(),
+			message
+		);
+	}
+
+	REPLIT_TRACE_BEGIN(subscription_parse);
 
-	if (callback_ptr == NULL) {
-		g_object_unref(node);
+	gsize length;
+	const gchar* data = g_bytes_get_data(message, &length);
+	gchar msg_type[32] = "";
+	guint id = 0;
+
+	JsonNode* node = replit_subscriber_decode_frame(self, data, length, &id, msg_type, sizeof(msg_type));
+
+	REPLIT_TRACE_END(subscription_parse, msg_type);
+
+	gpointer callback_ptr = id < self->callbacks->len ? g_ptr_array_index(self->callbacks, id) : NULL;
+
+	if (node == NULL || callback_ptr == NULL) {
+		if (node != NULL) json_node_unref(node);
 
 		return;
 	}
 
+	REPLIT_TRACE_BEGIN(subscription_dispatch);
+
 	ReplitSubscriptionCallback callback = (ReplitSubscriptionCallback) callback_ptr;
 	callback(self, id, node, g_ptr_array_index(self->user_data, id));
+
+	REPLIT_TRACE_END(subscription_dispatch, "");
 }
 
 static void replit_subscriber_on_close(
@@ -226,6 +446,7 @@ static void replit_subscriber_on_close(
 	ReplitSubscriber* self = REPLIT_SUBSCRIBER (user_data);
 
 	g_clear_object(&self->ws);
+	self->record_channel = 0;
 
 	replit_subscriber_connect(self);
 }
@@ -252,13 +473,14 @@ ReplitSubscriber* replit_subscriber_new(const gchar* token) {
 
 	soup_session_add_feature(session, SOUP_SESSION_FEATURE (jar));
 
-	return g_object_new(
-		REPLIT_TYPE_SUBSCRIBER,
-		"token", g_strdup(token),
-		"session", session,
-		"jar", jar,
-		NULL
-	);
+	ReplitSubscriber* self = g_object_new(REPLIT_TYPE_SUBSCRIBER, NULL);
+	self->token = g_strdup(token);
+	self->session = session;
+	self->jar = jar;
+
+	replit_subscriber_connect(self);
+
+	return self;
 }
 
 /**
@@ -274,11 +496,49 @@ ReplitSubscriber* replit_subscriber_new(const gchar* token) {
  * Returns: (transfer full): The new #ReplitSubscriber.
  */
 ReplitSubscriber* replit_subscriber_new_with_session(SoupSession* session) {
-	return g_object_new(
-		REPLIT_TYPE_SUBSCRIBER,
-		"session", session,
-		NULL
-	);
+	ReplitSubscriber* self = g_object_new(REPLIT_TYPE_SUBSCRIBER, NULL);
+	self->session = session;
+
+	replit_subscriber_connect(self);
+
+	return self;
+}
+
+/* Creates a subscriber which connects through a session which may be shared
+ * with other users, taking ownership of the session. A @token is sent with each
+ * connection rather than kept in the session's cookie jar; without one, the
+ * session's own cookies are used. The server, transport and recorder are set
+ * before the first connection is made, so that it goes to the right place and
+ * is recorded. */
+ReplitSubscriber* replit_subscriber_new_shared(
+	SoupSession* session,
+	const gchar* token,
+	const gchar* base_uri,
+	ReplitTransport* transport,
+	ReplitRecorder* recorder
+) {
+	ReplitSubscriber* self = g_object_new(REPLIT_TYPE_SUBSCRIBER, NULL);
+	self->token = g_strdup(token);
+	self->session = session;
+
+	replit_subscriber_set_base_uri(self, base_uri);
+	g_set_object(&self->transport, transport);
+	g_set_object(&self->recorder, recorder);
+
+	replit_subscriber_connect(self);
+
+	return self;
+}
+
+/* Authenticates a single message with a token, in place of any cookies from
+ * the session's jar, which may belong to another user. */
+void replit_subscriber_attach_token(SoupMessage* msg, const gchar* token) {
+	gchar* header = g_strdup_printf("%s=%s", TOKEN_COOKIE, token);
+
+	soup_message_disable_feature(msg, SOUP_TYPE_COOKIE_JAR);
+	soup_message_headers_replace(soup_message_get_request_headers(msg), "Cookie", header);
+
+	g_free(header);
 }
 
 /**
@@ -302,9 +562,16 @@ guint replit_subscriber_subscribe(
 ) {
 	guint id = self->id_counter++;
 
-	if (variables == NULL) variables = json_node_new(JSON_NODE_OBJECT);
+	if (variables == NULL) {
+		variables = json_node_new(JSON_NODE_OBJECT);
+		json_node_take_object(variables, json_object_new());
+	}
+
+	gchar* minified = self->minify_queries ? replit_graphql_minify(query, NULL) : NULL;
+	if (minified != NULL) query = minified;
 
 	JsonNode* extensions = json_node_new(JSON_NODE_OBJECT);
+	json_node_take_object(extensions, json_object_new());
 
 	JsonBuilder* builder = json_builder_new();
 	json_builder_begin_object(builder);
@@ -325,16 +592,16 @@ guint replit_subscriber_subscribe(
 	gsize payload_length;
 	gchar* payload = json_generator_to_data(generator, &payload_length);
 
-	g_object_unref(extensions);
+	g_free(minified);
 	g_object_unref(builder);
 	g_object_unref(generator);
-	g_object_unref(builder_root);
+	json_node_unref(builder_root);
 
 	gchar* message = g_strdup_printf(MESSAGE_SUB, id, payload);
 
 	g_free(payload);
 
-	if (self->ws != NULL) soup_websocket_connection_send_text(self->ws, message);
+	replit_subscriber_send_text(self, message);
 
 	g_ptr_array_add(self->callbacks, callback);
 	g_ptr_array_add(self->subscriptions, message);
@@ -358,7 +625,9 @@ static void replit_subscriber_object_callback(
 	ReplitSubscriberObjectUserData* user_data2 = user_data;
 
 	GType gtype = user_data2->gtype;
-	GObject* object = json_gobject_deserialize(gtype, data);
+	GObject* object = replit_json_deserialize(gtype, data);
+
+	json_node_unref(data);
 
 	user_data2->callback(subscriber, id, object, user_data2->user_data);
 }
@@ -375,7 +644,8 @@ static void replit_subscriber_object_callback(
  * Adds a subscription to the #ReplitSubscriber, and converts any response data.
  * 
  * Internally, this method calls [method@Subscriber.subscribe] with its
- * arguments, and then uses GObject to turn the #JsonNode into the object.
+ * arguments, and then uses [func@json_deserialize] to turn the #JsonNode into
+ * the object.
  * 
  * Returns: The subscription ID of the new subscription.
  */
@@ -423,11 +693,165 @@ void replit_subscriber_unsubscribe(ReplitSubscriber* self, guint id) {
 		self->subscriptions->pdata[id] = NULL;
 	}
 
-	if (self->ws != NULL) {
-		gchar* message = g_strdup_printf(MESSAGE_UNSUB, id);
+	gchar* message = g_strdup_printf(MESSAGE_UNSUB, id);
+
+	replit_subscriber_send_text(self, message);
+
+	g_free(message);
+}
+
+/**
+ * replit_subscriber_set_minify_queries:
+ * @subscriber: The subscriber.
+ * @minify: Whether to minify queries.
+ * 
+ * Sets whether subscription documents are minified before being sent.
+ * 
+ * This only affects subscriptions added after it is called. See
+ * [func@graphql_minify] for the transformation applied.
+ */
+void replit_subscriber_set_minify_queries(ReplitSubscriber* self, gboolean minify) {
+	self->minify_queries = !!minify;
+}
+
+/**
+ * replit_subscriber_get_minify_queries:
+ * @subscriber: The subscriber.
+ * 
+ * Gets whether subscription documents are minified before being sent.
+ * 
+ * Returns: %TRUE if subscription documents are minified.
+ */
+gboolean replit_subscriber_get_minify_queries(ReplitSubscriber* self) {
+	return self->minify_queries;
+}
+
+/**
+ * replit_subscriber_set_base_uri:
+ * @subscriber: The subscriber.
+ * @base_uri: (transfer none): The scheme, host and port to connect to.
+ * 
+ * Sets the server that the subscriber connects to, such as
+ * `http://127.0.0.1:8080`. Defaults to %REPLIT_BASE_URI.
+ * 
+ * Any existing connection is closed, and active subscriptions are sent again
+ * once the connection to the new server is established. Subscribers obtained
+ * from [method@Client.get_subscriber] follow [property@Client:base-uri].
+ */
+void replit_subscriber_set_base_uri(ReplitSubscriber* self, const gchar* base_uri) {
+	g_return_if_fail(base_uri != NULL);
+
+	if (g_strcmp0(self->base_uri, base_uri) == 0) return;
+
+	GUri* uri = g_uri_parse(base_uri, SOUP_HTTP_URI_FLAGS, NULL);
+	g_return_if_fail(uri != NULL);
+
+	g_uri_unref(self->subscriptions_uri);
+	self->subscriptions_uri = g_uri_parse_relative(
+		uri,
+		"/graphql_subscriptions",
+		SOUP_HTTP_URI_FLAGS,
+		NULL
+	);
+
+	g_free(self->base_uri);
+	self->base_uri = g_strdup(base_uri);
 
-		soup_websocket_connection_send_text(self->ws, message);
+	if (self->jar != NULL && self->token != NULL) {
+		const gchar* host = g_uri_get_host(uri);
+		SoupCookie* cookie = soup_cookie_new(TOKEN_COOKIE, self->token, host, "/", -1);
+		soup_cookie_jar_add_cookie(self->jar, cookie);
+	}
+
+	g_uri_unref(uri);
+
+	if (self->transport != NULL) return;
 
-		g_free(message);
+	if (self->connecting != NULL) {
+		g_cancellable_cancel(self->connecting);
+		g_clear_object(&self->connecting);
+
+		replit_subscriber_connect(self);
+	} else if (self->ws != NULL) {
+		/* Reconnects to the new server once closed. */
+		soup_websocket_connection_close(self->ws, SOUP_WEBSOCKET_CLOSE_GOING_AWAY, NULL);
 	}
 }
+
+/**
+ * replit_subscriber_get_base_uri:
+ * @subscriber: The subscriber.
+ * 
+ * Gets the server that the subscriber connects to.
+ * 
+ * Returns: (transfer none): The base URI.
+ */
+const gchar* replit_subscriber_get_base_uri(ReplitSubscriber* self) {
+	return self->base_uri;
+}
+
+/**
+ * replit_subscriber_set_transport:
+ * @subscriber: The subscriber.
+ * @transport: (transfer none) (nullable): The transport to use, or %NULL to
+ *   connect to the base URI with a WebSocket.
+ * 
+ * Sets the transport that subscriptions are carried over.
+ * 
+ * The current connection is dropped, and active subscriptions are sent again
+ * over a channel opened on @transport. Subscribers obtained from
+ * [method@Client.get_subscriber] follow [property@Client:transport].
+ */
+void replit_subscriber_set_transport(ReplitSubscriber* self, ReplitTransport* transport) {
+	if (self->transport == transport) return;
+
+	replit_subscriber_disconnect(self);
+	g_set_object(&self->transport, transport);
+	replit_subscriber_connect(self);
+}
+
+/**
+ * replit_subscriber_get_transport:
+ * @subscriber: The subscriber.
+ * 
+ * Gets the transport that subscriptions are carried over.
+ * 
+ * Returns: (transfer none) (nullable): The transport, or %NULL if WebSockets
+ *   are used.
+ */
+ReplitTransport* replit_subscriber_get_transport(ReplitSubscriber* self) {
+	return self->transport;
+}
+
+/**
+ * replit_subscriber_set_recorder:
+ * @subscriber: The subscriber.
+ * @recorder: (transfer none) (nullable): The recorder to write to, or %NULL to
+ *   stop recording.
+ * 
+ * Sets a recorder to write the frames sent and received by the subscriber to.
+ * 
+ * Subscribers obtained from [method@Client.get_subscriber] follow
+ * [property@Client:recorder].
+ */
+void replit_subscriber_set_recorder(ReplitSubscriber* self, ReplitRecorder* recorder) {
+	if (!g_set_object(&self->recorder, recorder)) return;
+
+	self->record_channel = 0;
+
+	if (recorder != NULL && (self->ws != NULL || self->channel != 0)) {
+		replit_subscriber_record_open(self);
+	}
+}
+
+/**
+ * replit_subscriber_get_recorder:
+ * @subscriber: The subscriber.
+ * 
+ * Gets the recorder that the subscriber's frames are written to.
+ * 
+ * Returns: (transfer none) (nullable): The recorder, or %NULL if not recording.
+ */
+ReplitRecorder* replit_subscriber_get_recorder(ReplitSubscriber* self) {
+	return self->recorder;
+}
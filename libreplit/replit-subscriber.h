@@ -37,6 +37,9 @@
 #include <json-glib/json-glib.h>
 #include <libsoup/soup.h>
 
+#include "replit-recorder.h"
+#include "replit-transport.h"
+
 G_BEGIN_DECLS
 
 #define REPLIT_TYPE_SUBSCRIBER replit_subscriber_get_type()
@@ -100,4 +103,20 @@ guint replit_subscriber_subscribe_to_object(
 
 void replit_subscriber_unsubscribe(ReplitSubscriber* subscriber, guint id);
 
+void replit_subscriber_set_minify_queries(ReplitSubscriber* subscriber, gboolean minify);
+
+gboolean replit_subscriber_get_minify_queries(ReplitSubscriber* subscriber);
+
+void replit_subscriber_set_base_uri(ReplitSubscriber* subscriber, const gchar* base_uri);
+
+const gchar* replit_subscriber_get_base_uri(ReplitSubscriber* subscriber);
+
+void replit_subscriber_set_transport(ReplitSubscriber* subscriber, ReplitTransport* transport);
+
+ReplitTransport* replit_subscriber_get_transport(ReplitSubscriber* subscriber);
+
+void replit_subscriber_set_recorder(ReplitSubscriber* subscriber, ReplitRecorder* recorder);
+
+ReplitRecorder* replit_subscriber_get_recorder(ReplitSubscriber* subscriber);
+
 G_END_DECLS
@@ -0,0 +1,86 @@
+/* replit-trace-private.h
+ *
+ * Copyright 2022 Patrick Winters
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE X CONSORTIUM BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written
+ * authorization.
+ */
+
+#pragma once
+
+#include <glib.h>
+
+#include "replit-config.h"
+
+/* Trace points around the stages of each request and subscription message.
+ * Depending on the `tracing` build option, these are either USDT probes in the
+ * `libreplit` provider, which are a single no-op instruction until a tracer
+ * attaches, or marks written to a Sysprof capture, which cost a branch when no
+ * capture is running. Otherwise they compile away entirely.
+ * 
+ * REPLIT_TRACE_BEGIN() and REPLIT_TRACE_END() bracket a span within one scope.
+ * REPLIT_TRACE_MARK() records a span which began at a known monotonic time, in
+ * microseconds, such as the start of a request. Messages must not be %NULL. */
+
+#if defined(HAVE_SYSPROF)
+
+#include <sysprof-capture.h>
+
+#define REPLIT_TRACE_BEGIN(name) \
+	gint64 replit_trace_##name = g_get_monotonic_time()
+
+#define REPLIT_TRACE_END(name, message) \
+	REPLIT_TRACE_MARK(name, replit_trace_##name, message)
+
+#define REPLIT_TRACE_MARK(name, begin, message) \
+	sysprof_collector_mark( \
+		(begin) * 1000, \
+		(g_get_monotonic_time() - (begin)) * 1000, \
+		"libreplit", \
+		#name, \
+		(message) \
+	)
+
+#elif defined(HAVE_USDT)
+
+#include <sys/sdt.h>
+
+#define REPLIT_TRACE_BEGIN(name) DTRACE_PROBE(libreplit, name##__begin)
+
+#define REPLIT_TRACE_END(name, message) DTRACE_PROBE1(libreplit, name##__end, message)
+
+#define REPLIT_TRACE_MARK(name, begin, message) \
+	DTRACE_PROBE2(libreplit, name, begin, message)
+
+#else
+
+#define REPLIT_TRACE_BEGIN(name) G_STMT_START { } G_STMT_END
+
+#define REPLIT_TRACE_END(name, message) G_STMT_START { } G_STMT_END
+
+#define REPLIT_TRACE_MARK(name, begin, message) G_STMT_START { } G_STMT_END
+
+#endif
+
+#define REPLIT_TRACE_NAME(name) ((name) != NULL ? (name) : "")
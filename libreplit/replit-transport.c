@@ -0,0 +1,211 @@
+/* replit-transport.c
+ *
+ * Copyright 2022 Patrick Winters
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE X CONSORTIUM BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written
+ * authorization.
+ */
+
+#include "replit-transport.h"
+
+/**
+ * ReplitTransport:
+ * 
+ * An interface for carrying a client's requests and subscription frames in
+ * place of HTTP and WebSockets.
+ * 
+ * By default, #ReplitClient and #ReplitSubscriber talk to Replit directly with
+ * libsoup. Setting a transport with [method@Client.set_transport] routes
+ * requests and subscriptions through it instead, which allows them to be
+ * served from elsewhere, such as a recording with #ReplitReplay.
+ * 
+ * A transport is used from the thread that the client is used from, and
+ * should complete asynchronous operations in the thread-default main context
+ * they were started in.
+ */
+
+G_DEFINE_INTERFACE (ReplitTransport, replit_transport, G_TYPE_OBJECT)
+
+static void replit_transport_default_init(
+	ReplitTransportInterface* iface __attribute__((unused))
+) {}
+
+static void replit_transport_send_ready(
+	GObject* source __attribute__((unused)),
+	GAsyncResult* result,
+	gpointer user_data
+) {
+	GAsyncResult** result_out = user_data;
+	*result_out = g_object_ref(result);
+}
+
+/**
+ * replit_transport_send:
+ * @transport: The transport.
+ * @request: (transfer none): The body of the GraphQL request.
+ * @cancellable: (nullable): A #GCancellable.
+ * 
+ * Sends a GraphQL request through the transport, blocking until the response
+ * is available.
+ * 
+ * Returns: (transfer full) (nullable): A stream of the response body, or %NULL
+ *   on error.
+ */
+GInputStream* replit_transport_send(
+	ReplitTransport* self,
+	GBytes* request,
+	GCancellable* cancellable,
+	GError** error
+) {
+	ReplitTransportInterface* iface = REPLIT_TRANSPORT_GET_IFACE (self);
+
+	if (iface->send != NULL) return iface->send(self, request, cancellable, error);
+
+	/* Other sources in the caller's context are not dispatched while it
+	 * blocks, as with the synchronous libsoup API. */
+	GMainContext* context = g_main_context_new();
+	GAsyncResult* result = NULL;
+
+	g_main_context_push_thread_default(context);
+
+	replit_transport_send_async(
+		self,
+		request,
+		cancellable,
+		replit_transport_send_ready,
+		&result
+	);
+
+	while (result == NULL) g_main_context_iteration(context, TRUE);
+
+	g_main_context_pop_thread_default(context);
+	g_main_context_unref(context);
+
+	GBytes* response = replit_transport_send_finish(self, result, error);
+
+	g_object_unref(result);
+
+	if (response == NULL) return NULL;
+
+	GInputStream* stream = g_memory_input_stream_new_from_bytes(response);
+
+	g_bytes_unref(response);
+
+	return stream;
+}
+
+/**
+ * replit_transport_send_async:
+ * @transport: The transport.
+ * @request: (transfer none): The body of the GraphQL request.
+ * @cancellable: (nullable): A #GCancellable.
+ * @callback: (scope async): The function to call when the response is ready.
+ * @user_data: (closure): Data to pass to @callback.
+ * 
+ * Sends a GraphQL request through the transport.
+ */
+void replit_transport_send_async(
+	ReplitTransport* self,
+	GBytes* request,
+	GCancellable* cancellable,
+	GAsyncReadyCallback callback,
+	gpointer user_data
+) {
+	ReplitTransportInterface* iface = REPLIT_TRANSPORT_GET_IFACE (self);
+	g_return_if_fail(iface->send_async != NULL);
+
+	iface->send_async(self, request, cancellable, callback, user_data);
+}
+
+/**
+ * replit_transport_send_finish:
+ * @transport: The transport.
+ * @result: The result passed to the callback.
+ * 
+ * Finishes a request started with [method@Transport.send_async].
+ * 
+ * Returns: (transfer full) (nullable): The response body, or %NULL on error.
+ */
+GBytes* replit_transport_send_finish(
+	ReplitTransport* self,
+	GAsyncResult* result,
+	GError** error
+) {
+	ReplitTransportInterface* iface = REPLIT_TRANSPORT_GET_IFACE (self);
+	g_return_val_if_fail(iface->send_finish != NULL, NULL);
+
+	return iface->send_finish(self, result, error);
+}
+
+/**
+ * replit_transport_open_channel:
+ * @transport: The transport.
+ * @func: (scope forever): The function to call with each received frame.
+ * @user_data: (closure): Data to pass to @func.
+ * 
+ * Opens a channel for subscription frames, taking the place of a WebSocket
+ * connection. @func is called from the thread-default main context until the
+ * channel is closed with [method@Transport.close_channel].
+ * 
+ * Returns: The ID of the channel, or 0 if the transport does not carry
+ *   subscriptions.
+ */
+guint replit_transport_open_channel(
+	ReplitTransport* self,
+	ReplitTransportFrameFunc func,
+	gpointer user_data
+) {
+	ReplitTransportInterface* iface = REPLIT_TRANSPORT_GET_IFACE (self);
+
+	if (iface->open_channel == NULL) return 0;
+
+	return iface->open_channel(self, func, user_data);
+}
+
+/**
+ * replit_transport_send_frame:
+ * @transport: The transport.
+ * @channel: The ID of an open channel.
+ * @frame: (transfer none): The text of the frame.
+ * 
+ * Sends a subscription frame on a channel.
+ */
+void replit_transport_send_frame(ReplitTransport* self, guint channel, GBytes* frame) {
+	ReplitTransportInterface* iface = REPLIT_TRANSPORT_GET_IFACE (self);
+
+	if (iface->send_frame != NULL) iface->send_frame(self, channel, frame);
+}
+
+/**
+ * replit_transport_close_channel:
+ * @transport: The transport.
+ * @channel: The ID of an open channel.
+ * 
+ * Closes a channel opened with [method@Transport.open_channel].
+ */
+void replit_transport_close_channel(ReplitTransport* self, guint channel) {
+	ReplitTransportInterface* iface = REPLIT_TRANSPORT_GET_IFACE (self);
+
+	if (iface->close_channel != NULL) iface->close_channel(self, channel);
+}
@@ -0,0 +1,140 @@
+/* replit-transport.h
+ *
+ * Copyright 2022 Patrick Winters
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE X CONSORTIUM BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written
+ * authorization.
+ */
+
+#pragma once
+
+#if !defined(REPLIT_INSIDE) && !defined(REPLIT_COMPILATION)
+#error "Only <replit.h> can be included directly."
+#endif
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+#define REPLIT_TYPE_TRANSPORT replit_transport_get_type()
+G_DECLARE_INTERFACE (ReplitTransport, replit_transport, REPLIT, TRANSPORT, GObject)
+
+/**
+ * ReplitTransportFrameFunc:
+ * @transport: The transport.
+ * @channel: The channel the frame was received on.
+ * @frame: (transfer none): The text of the frame.
+ * @user_data: (closure): The data passed when opening the channel.
+ * 
+ * The function called by a #ReplitTransport with each frame received on a
+ * channel opened with [method@Transport.open_channel].
+ */
+typedef void (* ReplitTransportFrameFunc)(
+	ReplitTransport* transport,
+	guint channel,
+	GBytes* frame,
+	gpointer user_data
+);
+
+/**
+ * ReplitTransportInterface:
+ * @send: Sends a request and returns a stream of the response body. Optional;
+ *   by default, @send_async is run to completion on a private main context.
+ * @send_async: Starts sending a request.
+ * @send_finish: Finishes sending a request, returning the response body.
+ * @open_channel: Opens a channel for subscription frames, returning its ID.
+ * @send_frame: Sends a frame on an open channel.
+ * @close_channel: Closes a channel, after which its function is not called.
+ * 
+ * The virtual methods of a #ReplitTransport. Requests and responses are the
+ * bodies of GraphQL requests, and frames are the text messages of the
+ * `graphql-ws` protocol.
+ */
+struct _ReplitTransportInterface {
+	GTypeInterface parent_iface;
+
+	GInputStream* (* send)(
+		ReplitTransport* transport,
+		GBytes* request,
+		GCancellable* cancellable,
+		GError** error
+	);
+
+	void (* send_async)(
+		ReplitTransport* transport,
+		GBytes* request,
+		GCancellable* cancellable,
+		GAsyncReadyCallback callback,
+		gpointer user_data
+	);
+
+	GBytes* (* send_finish)(
+		ReplitTransport* transport,
+		GAsyncResult* result,
+		GError** error
+	);
+
+	guint (* open_channel)(
+		ReplitTransport* transport,
+		ReplitTransportFrameFunc func,
+		gpointer user_data
+	);
+
+	void (* send_frame)(ReplitTransport* transport, guint channel, GBytes* frame);
+
+	void (* close_channel)(ReplitTransport* transport, guint channel);
+};
+
+GInputStream* replit_transport_send(
+	ReplitTransport* transport,
+	GBytes* request,
+	GCancellable* cancellable,
+	GError** error
+);
+
+void replit_transport_send_async(
+	ReplitTransport* transport,
+	GBytes* request,
+	GCancellable* cancellable,
+	GAsyncReadyCallback callback,
+	gpointer user_data
+);
+
+GBytes* replit_transport_send_finish(
+	ReplitTransport* transport,
+	GAsyncResult* result,
+	GError** error
+);
+
+guint replit_transport_open_channel(
+	ReplitTransport* transport,
+	ReplitTransportFrameFunc func,
+	gpointer user_data
+);
+
+void replit_transport_send_frame(ReplitTransport* transport, guint channel, GBytes* frame);
+
+void replit_transport_close_channel(ReplitTransport* transport, guint channel);
+
+G_END_DECLS
@@ -35,7 +35,16 @@ G_BEGIN_DECLS
 
 #define REPLIT_INSIDE
 #include "replit-client.h"
+#include "replit-client-pool.h"
+#include "replit-disk-cache.h"
+#include "replit-graphql.h"
+#include "replit-json.h"
+#include "replit-pager.h"
+#include "replit-recorder.h"
+#include "replit-replay.h"
+#include "replit-stats.h"
 #include "replit-subscriber.h"
+#include "replit-transport.h"
 #include "replit-version.h"
 #undef REPLIT_INSIDE
 
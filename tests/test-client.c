@@ -0,0 +1,128 @@
+/* test-client.c
+ *
+ * Copyright 2022 Patrick Winters
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE X CONSORTIUM BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written
+ * authorization.
+ */
+
+#include <glib.h>
+#include <json-glib/json-glib.h>
+#include <replit.h>
+
+#include "mock-server.h"
+
+#define QUERY "query Items { items { id title description } }"
+#define MUTATION "mutation Items { items { id title description } }"
+
+/* Enough answers for an operation to be hedged; see HEDGE_MIN_SAMPLES. */
+#define WARM_UP_QUERIES 64
+
+typedef struct {
+	GMainLoop* loop;
+	GError* error;
+} TestQuery;
+
+static void test_graphql_operation_is_query(void) {
+	const gchar* document = "query First { a } mutation Second { b } query Third { c }";
+
+	g_assert_true(replit_graphql_operation_is_query(document, NULL));
+	g_assert_true(replit_graphql_operation_is_query(document, "First"));
+	g_assert_false(replit_graphql_operation_is_query(document, "Second"));
+	g_assert_true(replit_graphql_operation_is_query(document, "Third"));
+	g_assert_false(replit_graphql_operation_is_query(document, "Fourth"));
+
+	g_assert_false(replit_graphql_operation_is_query("mutation First { a } query Second { b }", NULL));
+	g_assert_true(replit_graphql_operation_is_query("mutation First { a } query Second { b }", "Second"));
+	g_assert_true(replit_graphql_operation_is_query("fragment F on T { x } query Q { ...F }", "Q"));
+	g_assert_true(replit_graphql_operation_is_query("fragment F on T { x } { ...F }", NULL));
+	g_assert_false(replit_graphql_operation_is_query("fragment F on T { x } mutation { ...F }", NULL));
+	g_assert_false(replit_graphql_operation_is_query("{ a }", "Q"));
+}
+
+static void test_query_ready(GObject* source, GAsyncResult* res, gpointer user_data) {
+	TestQuery* query = user_data;
+	JsonNode* data = replit_client_query_finish(REPLIT_CLIENT (source), res, &query->error);
+
+	if (data != NULL) json_node_unref(data);
+
+	g_main_loop_quit(query->loop);
+}
+
+/* Warms up the latencies of the Items operation, then sends @document once
+ * while the server is slow, returning how many times it was hedged. */
+static guint64 test_hedge_document(const gchar* document) {
+	MockServerOptions options = { 0 };
+	GError* error = NULL;
+	MockServer* server = mock_server_new(&options, 0, &error);
+
+	g_assert_no_error(error);
+
+	ReplitClient* client = replit_client_new("test");
+	replit_client_set_base_uri(client, mock_server_get_uri(server));
+	replit_client_set_hedge_percentile(client, 50);
+
+	for (guint i = 0; i < WARM_UP_QUERIES; i++) {
+		JsonNode* data = replit_client_query(client, QUERY, NULL, &error);
+
+		g_assert_no_error(error);
+		json_node_unref(data);
+	}
+
+	mock_server_set_latency(server, 200);
+
+	TestQuery query = { g_main_loop_new(NULL, FALSE), NULL };
+
+	replit_client_query_async(client, document, NULL, NULL, test_query_ready, &query);
+	g_main_loop_run(query.loop);
+
+	g_assert_no_error(query.error);
+
+	ReplitClientStats stats;
+	replit_client_get_stats(client, &stats);
+
+	g_main_loop_unref(query.loop);
+	g_object_unref(client);
+	mock_server_free(server);
+
+	return stats.hedged;
+}
+
+static void test_hedge_named_query(void) {
+	g_assert_cmpuint(test_hedge_document(QUERY), ==, 1);
+}
+
+static void test_hedge_named_mutation(void) {
+	g_assert_cmpuint(test_hedge_document(MUTATION), ==, 0);
+}
+
+gint main(gint argc, gchar** argv) {
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_func("/graphql/operation-is-query", test_graphql_operation_is_query);
+	g_test_add_func("/client/hedge/named-query", test_hedge_named_query);
+	g_test_add_func("/client/hedge/named-mutation", test_hedge_named_mutation);
+
+	return g_test_run();
+}
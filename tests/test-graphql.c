@@ -0,0 +1,154 @@
+/* test-graphql.c
+ *
+ * Copyright 2022 Patrick Winters
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE X CONSORTIUM BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written
+ * authorization.
+ */
+
+#include <glib.h>
+#include <replit.h>
+#include <string.h>
+
+typedef struct {
+	const gchar* name;
+	const gchar* document;
+	const gchar* minified;
+} TestMinify;
+
+typedef struct {
+	const gchar* name;
+	const gchar* document;
+	ReplitGraphqlError code;
+} TestInvalid;
+
+static const TestMinify minify_documents[] = {
+	{ "whitespace", "  query  Q  {\n\ta\r\n\tb\n}\n", "query Q{a b}" },
+	{ "commas", "{ a, b,, c(x: 1, y: 2) }", "{a b c(x:1 y:2)}" },
+	{ "comments", "# leading\n{ a # trailing, with a \"quote\"\n b }# last", "{a b}" },
+	{ "byte-order-mark", "\xef\xbb\xbf{ a }", "{a}" },
+	{ "names", "query Q { a b }", "query Q{a b}" },
+	{ "numbers", "{ a(x: 1 y: -2.5e3 z: [0 1]) }", "{a(x:1 y:-2.5e3 z:[0 1])}" },
+	{ "variables", "query Q($x: Int = 1, $y: [String!]!) { a(x: $x) }", "query Q($x:Int=1$y:[String!]!){a(x:$x)}" },
+	{ "spreads", "{ a ...F ... on T { b } ... @skip(if: true) { c } }", "{a ...F ...on T{b}...@skip(if:true){c}}" },
+	{ "strings", "{ a(x: \"  b ,  # c \" y: \"\\\"\\\\\\u00e9\\n\") }", "{a(x:\"  b ,  # c \" y:\"\\\"\\\\\\u00e9\\n\")}" },
+	{ "string-after-name", "{ a(x: \"b\" y: \"c\") }", "{a(x:\"b\" y:\"c\")}" },
+	{ "block-strings", "{ a(x: \"\"\"\n  b,  # c\n  \\\"\"\" \"\n\"\"\") }", "{a(x:\"\"\"\n  b,  # c\n  \\\"\"\" \"\n\"\"\")}" },
+	{ "empty", " \n# nothing\n", "" },
+};
+
+static const TestInvalid invalid_documents[] = {
+	{ "unclosed-brace", "{ a { b }", REPLIT_GRAPHQL_ERROR_UNBALANCED },
+	{ "unopened-brace", "{ a } }", REPLIT_GRAPHQL_ERROR_UNBALANCED },
+	{ "mismatched-bracket", "{ a(x: [1) }", REPLIT_GRAPHQL_ERROR_UNBALANCED },
+	{ "unterminated-string", "{ a(x: \"b) }", REPLIT_GRAPHQL_ERROR_SYNTAX },
+	{ "string-newline", "{ a(x: \"b\nc\") }", REPLIT_GRAPHQL_ERROR_SYNTAX },
+	{ "unterminated-block-string", "{ a(x: \"\"\"b) }", REPLIT_GRAPHQL_ERROR_SYNTAX },
+	{ "illegal-character", "{ a ? b }", REPLIT_GRAPHQL_ERROR_SYNTAX },
+	{ "two-dots", "{ a .. b }", REPLIT_GRAPHQL_ERROR_SYNTAX },
+	{ "bad-number", "{ a(x: 1.) }", REPLIT_GRAPHQL_ERROR_SYNTAX },
+	{ "number-then-name", "{ a(x: 1b) }", REPLIT_GRAPHQL_ERROR_SYNTAX },
+};
+
+static void test_graphql_minify(void) {
+	for (guint i = 0; i < G_N_ELEMENTS (minify_documents); i++) {
+		GError* error = NULL;
+		gchar* minified = replit_graphql_minify(minify_documents[i].document, &error);
+
+		g_test_message("%s", minify_documents[i].name);
+		g_assert_no_error(error);
+		g_assert_cmpstr(minified, ==, minify_documents[i].minified);
+
+		/* Minifying is idempotent. */
+		gchar* again = replit_graphql_minify(minified, &error);
+
+		g_assert_no_error(error);
+		g_assert_cmpstr(again, ==, minified);
+
+		g_free(again);
+		g_free(minified);
+	}
+}
+
+static void test_graphql_invalid(void) {
+	for (guint i = 0; i < G_N_ELEMENTS (invalid_documents); i++) {
+		GError* error = NULL;
+
+		g_test_message("%s", invalid_documents[i].name);
+
+		g_assert_null(replit_graphql_minify(invalid_documents[i].document, &error));
+		g_assert_error(error, REPLIT_GRAPHQL_ERROR, invalid_documents[i].code);
+		g_clear_error(&error);
+
+		g_assert_null(replit_graphql_hash(invalid_documents[i].document, &error));
+		g_assert_error(error, REPLIT_GRAPHQL_ERROR, invalid_documents[i].code);
+		g_clear_error(&error);
+	}
+}
+
+static void test_graphql_hash(void) {
+	GError* error = NULL;
+	gchar* compact = replit_graphql_hash("query Q($x:Int){a(x:$x){b ...F}}", &error);
+
+	g_assert_no_error(error);
+	g_assert_cmpuint(strlen(compact), ==, 64);
+
+	gchar* formatted = replit_graphql_hash(
+		"# Fetches a.\n"
+		"query Q(\n"
+		"\t$x: Int,\n"
+		") {\n"
+		"\ta(x: $x) {\n"
+		"\t\tb, # The b.\n"
+		"\t\t...F\n"
+		"\t}\n"
+		"}\n",
+		&error
+	);
+
+	g_assert_no_error(error);
+	g_assert_cmpstr(formatted, ==, compact);
+
+	/* Whitespace inside a string is part of the document. */
+	gchar* spaced = replit_graphql_hash("query Q($x:Int){a(x:$x, y: \" \"){b ...F}}", &error);
+	gchar* unspaced = replit_graphql_hash("query Q($x:Int){a(x:$x, y: \"\"){b ...F}}", &error);
+
+	g_assert_no_error(error);
+	g_assert_cmpstr(spaced, !=, unspaced);
+
+	g_free(unspaced);
+	g_free(spaced);
+	g_free(formatted);
+	g_free(compact);
+}
+
+gint main(gint argc, gchar** argv) {
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_func("/graphql/minify", test_graphql_minify);
+	g_test_add_func("/graphql/invalid", test_graphql_invalid);
+	g_test_add_func("/graphql/hash", test_graphql_hash);
+
+	return g_test_run();
+}
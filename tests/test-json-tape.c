@@ -0,0 +1,172 @@
+/* test-json-tape.c
+ *
+ * Copyright 2022 Patrick Winters
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE X CONSORTIUM BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written
+ * authorization.
+ */
+
+#include <glib.h>
+#include <json-glib/json-glib.h>
+#include <string.h>
+
+#include "replit-json-tape-private.h"
+
+typedef enum {
+	/* Both decoders accept the document and build equal trees. */
+	EXPECT_VALID,
+
+	/* Both decoders reject the document. */
+	EXPECT_INVALID,
+
+	/* The tape decoder rejects the document, whatever json-glib makes of it. */
+	EXPECT_TAPE_INVALID,
+} Expectation;
+
+typedef struct {
+	const gchar* name;
+	const gchar* text;
+	Expectation expect;
+} TestDocument;
+
+static const TestDocument documents[] = {
+	{ "object", "{\"a\": 1, \"b\": [true, false, null], \"c\": {\"d\": \"e\"}}", EXPECT_VALID },
+	{ "empty", " { \"a\" : [ ] , \"b\" : { } } ", EXPECT_VALID },
+	{ "numbers", "[0, -1, 1.5, 1e3, -2.5E-3, 9223372036854775807, -9223372036854775808]", EXPECT_VALID },
+	{ "duplicate-keys", "{\"a\": 1, \"a\": 2}", EXPECT_VALID },
+	{ "escapes", "[\"\\\"\\\\\\/\\b\\f\\n\\r\\t\"]", EXPECT_VALID },
+	{ "unicode-escapes", "{\"\\u00e9\": \"\\u2028\\u0041\\u00FF\"}", EXPECT_VALID },
+	{ "surrogate-pair", "\"\\ud83d\\ude00\"", EXPECT_VALID },
+	{ "utf-8", "{\"caf\xc3\xa9\": \"\xf0\x9f\x98\x80\"}", EXPECT_VALID },
+	{ "delete", "\"\x7f\"", EXPECT_VALID },
+	{ "truncated-object", "{\"a\": ", EXPECT_INVALID },
+	{ "truncated-array", "[1, 2", EXPECT_INVALID },
+	{ "truncated-string", "[\"abc", EXPECT_INVALID },
+	{ "truncated-escape", "[\"abc\\", EXPECT_INVALID },
+	{ "truncated-unicode-escape", "[\"\\u00\"]", EXPECT_INVALID },
+	{ "missing-colon", "{\"a\" 1}", EXPECT_INVALID },
+	{ "trailing-comma", "[1, 2,]", EXPECT_INVALID },
+	{ "empty-member", "{,}", EXPECT_INVALID },
+	{ "bad-escape", "[\"\\x41\"]", EXPECT_INVALID },
+	{ "bad-literal", "[tru]", EXPECT_INVALID },
+	{ "trailing-data", "{} {}", EXPECT_INVALID },
+	{ "bad-utf-8", "[\"\xc3\x28\"]", EXPECT_INVALID },
+	{ "nul-escape", "[\"a\\u0000b\"]", EXPECT_TAPE_INVALID },
+	{ "nul-escape-key", "{\"a\\u0000b\": 1}", EXPECT_TAPE_INVALID },
+	{ "lone-high-surrogate", "[\"\\ud83d\"]", EXPECT_TAPE_INVALID },
+	{ "lone-low-surrogate", "[\"\\ude00\"]", EXPECT_TAPE_INVALID },
+	{ "control-character", "[\"a\x01" "b\"]", EXPECT_TAPE_INVALID },
+	{ "newline", "{\"a\": \"b\nc\"}", EXPECT_TAPE_INVALID },
+	{ "tab-key", "{\"a\tb\": 1}", EXPECT_TAPE_INVALID },
+};
+
+static JsonNode* parse_json_glib(const gchar* text, gsize length) {
+	JsonParser* parser = json_parser_new_immutable();
+	JsonNode* root = NULL;
+
+	if (json_parser_load_from_data(parser, text, length, NULL)) {
+		root = json_parser_steal_root(parser);
+	}
+
+	g_object_unref(parser);
+
+	return root;
+}
+
+static JsonNode* parse_tape(ReplitJsonTape* tape, const gchar* text, gsize length) {
+	if (!replit_json_tape_parse(tape, text, length, NULL)) return NULL;
+
+	return replit_json_tape_to_node(tape, REPLIT_JSON_TAPE_ROOT);
+}
+
+static void check_document(ReplitJsonTape* tape, const gchar* name, const gchar* text, Expectation expect) {
+	gsize length = strlen(text);
+	JsonNode* actual = parse_tape(tape, text, length);
+	JsonNode* expected = expect != EXPECT_TAPE_INVALID ? parse_json_glib(text, length) : NULL;
+
+	g_test_message("%s", name);
+
+	if (expect == EXPECT_VALID) {
+		g_assert_nonnull(expected);
+		g_assert_nonnull(actual);
+		g_assert_true(json_node_equal(expected, actual));
+	} else {
+		g_assert_null(expected);
+		g_assert_null(actual);
+	}
+
+	g_clear_pointer(&expected, json_node_unref);
+	g_clear_pointer(&actual, json_node_unref);
+}
+
+/* Every document is parsed into the same tape, so that each also checks that
+ * nothing is left over from the one before. */
+static void test_json_tape_corpus(void) {
+	ReplitJsonTape* tape = replit_json_tape_new();
+
+	for (guint i = 0; i < G_N_ELEMENTS (documents); i++) {
+		check_document(tape, documents[i].name, documents[i].text, documents[i].expect);
+	}
+
+	replit_json_tape_free(tape);
+}
+
+/* Places escapes, quotes and control characters on either side of the 64 byte
+ * blocks which the first stage classifies at once. */
+static void test_json_tape_block_boundaries(void) {
+	static const gchar* const inserts[] = { "\\\"", "\\\\", "\\ud83d\\ude00", "\\u0000", "\x01" };
+
+	ReplitJsonTape* tape = replit_json_tape_new();
+
+	for (guint i = 0; i < G_N_ELEMENTS (inserts); i++) {
+		for (guint offset = 56; offset < 72; offset++) {
+			GString* text = g_string_new("[\"");
+
+			for (guint j = 2; j < offset; j++) g_string_append_c(text, 'x');
+
+			g_string_append(text, inserts[i]);
+			g_string_append(text, "y\", 1]");
+
+			check_document(
+				tape,
+				inserts[i],
+				text->str,
+				i < 3 ? EXPECT_VALID : EXPECT_TAPE_INVALID
+			);
+
+			g_string_free(text, TRUE);
+		}
+	}
+
+	replit_json_tape_free(tape);
+}
+
+gint main(gint argc, gchar** argv) {
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_func("/json-tape/corpus", test_json_tape_corpus);
+	g_test_add_func("/json-tape/block-boundaries", test_json_tape_block_boundaries);
+
+	return g_test_run();
+}